@@ -0,0 +1,1337 @@
+//=============================================================
+/** Host-side benchmark suite.
+ *
+ * Times the library's hot paths on a desktop machine so that performance
+ * changes can be measured: WAV save, load, lazy view and probe across file lengths and
+ * channel counts, streaming through WavReader with each read-ahead source,
+ * mixing several streams, gapless and crossfaded playlists, a cache of
+ * short clips, PCM conversion at each bit depth, the FFTs, FLAC
+ * decoding against the same audio as WAV (and libFLAC, when built with it), MP3
+ * decoding, recording from a simulated interrupt, samples kept as ADPCM, and
+ * drawing a waveform overview from samples and from a peak pyramid. Every result
+ * reports throughput along with the peak heap use and number of allocations
+ * made during the operation, counted by the operator new/delete overrides below.
+ *
+ *      benchmark [--max-seconds <s>] [--repeat <n>] [--dir <path>] [--no-threads] [--flac <file>] [--mp3 <file>]
+ *
+ * Configure with -DAUDIOFILE_PROFILING=ON to also print a per-stage breakdown
+ * of each file's load and save.
+ */
+//=============================================================
+
+#include <Arduino.h>
+#include <SD.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "../main/AudioFile.h"
+#include "../main/ClipCache.h"
+#include "../main/Mixer.h"
+#include "../main/PeakPyramid.h"
+#include "../main/Playlist.h"
+#include "../main/Spectrum.h"
+#include "../main/WavReader.h"
+#include "../main/WavRecorder.h"
+#include <TimerOne.h>
+
+#ifdef AUDIOFILE_WITH_LIBFLAC
+ #include <FLAC/stream_decoder.h>
+#endif
+
+//=============================================================
+/** Heap accounting. Each block carries its size in a header so that frees can be
+ * counted too; the header is 16 bytes to keep the caller's alignment.
+ */
+namespace HeapStats
+{
+    static std::atomic<uint64_t> numAllocations (0);
+    static std::atomic<uint64_t> currentBytes (0);
+    static std::atomic<uint64_t> peakBytes (0);
+
+    static const size_t headerSize = 16;
+
+    static void* allocate (size_t size)
+    {
+        void* block = malloc (size + headerSize);
+
+        if (block == nullptr)
+            throw std::bad_alloc();
+
+        *(size_t*)block = size;
+        numAllocations++;
+        uint64_t now = currentBytes += size;
+        uint64_t peak = peakBytes.load();
+
+        while (now > peak && ! peakBytes.compare_exchange_weak (peak, now)) {}
+
+        return (uint8_t*)block + headerSize;
+    }
+
+    static void release (void* pointer)
+    {
+        if (pointer == nullptr)
+            return;
+
+        void* block = (uint8_t*)pointer - headerSize;
+        currentBytes -= *(size_t*)block;
+        free (block);
+    }
+}
+
+void* operator new (size_t size) { return HeapStats::allocate (size); }
+void* operator new[] (size_t size) { return HeapStats::allocate (size); }
+void operator delete (void* pointer) noexcept { HeapStats::release (pointer); }
+void operator delete[] (void* pointer) noexcept { HeapStats::release (pointer); }
+void operator delete (void* pointer, size_t) noexcept { HeapStats::release (pointer); }
+void operator delete[] (void* pointer, size_t) noexcept { HeapStats::release (pointer); }
+
+//=============================================================
+struct BenchmarkSettings
+{
+    double maxSeconds = 3600.;
+    int numRepeats = 3;
+    std::string directory = "/tmp";
+    bool useThreads = true;
+    std::string flacPath;
+    std::string mp3Path;
+};
+
+//=============================================================
+/** The best of several runs of one operation, with the heap use of that run */
+struct Measurement
+{
+    double seconds = 1.e30;
+    uint64_t peakHeapBytes = 0;
+    uint64_t numAllocations = 0;
+};
+
+//=============================================================
+/** Runs an operation numRepeats times and keeps the fastest. The peak is measured
+ * above the heap in use when the operation starts, so it is what the operation
+ * itself costs.
+ */
+template <class Function>
+static Measurement measure (int numRepeats, Function function)
+{
+    Measurement best;
+
+    for (int i = 0; i < numRepeats; i++)
+    {
+        uint64_t baseBytes = HeapStats::currentBytes.load();
+        uint64_t baseAllocations = HeapStats::numAllocations.load();
+        HeapStats::peakBytes = baseBytes;
+
+        auto start = std::chrono::steady_clock::now();
+        function();
+        double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+        if (seconds < best.seconds)
+        {
+            best.seconds = seconds;
+            best.peakHeapBytes = HeapStats::peakBytes.load() - baseBytes;
+            best.numAllocations = HeapStats::numAllocations.load() - baseAllocations;
+        }
+    }
+
+    return best;
+}
+
+//=============================================================
+static void printHeader (const char* title)
+{
+    printf ("\n%s\n", title);
+    printf ("%-28s %10s %10s %12s %12s %10s\n", "case", "ms", "MB/s", "Msamples/s", "peak heap", "allocs");
+}
+
+//=============================================================
+static void printResult (const std::string& name, const Measurement& m, double numBytes, double numSamples)
+{
+    printf ("%-28s %10.3f %10.1f %12.2f %10.2fMB %10llu\n", name.c_str(), m.seconds * 1000.,
+            numBytes / 1.e6 / m.seconds, numSamples / 1.e6 / m.seconds,
+            (double)m.peakHeapBytes / 1.e6, (unsigned long long)m.numAllocations);
+}
+
+//=============================================================
+static void fillWithTestSignal (AudioFile<float>& audioFile, int numChannels, int numSamples)
+{
+    audioFile.setAudioBufferSize (numChannels, numSamples);
+
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        float* data = audioFile.samples[channel].getData();
+        double increment = 2. * M_PI * (220. * (channel + 1)) / audioFile.getSampleRate();
+
+        for (int i = 0; i < numSamples; i++)
+            data[i] = (float)(0.5 * sin (increment * i));
+    }
+}
+
+//=============================================================
+/** Save, load and probe of 16-bit WAV files of each length and channel count */
+static void benchmarkFiles (const BenchmarkSettings& settings)
+{
+    const double lengths[] = { 1., 10., 60., 600., 3600. };
+    const uint32_t sampleRate = 44100;
+    std::string path = settings.directory + "/audiofile_benchmark.wav";
+
+    printHeader ("WAV files (16 bit, 44.1 kHz)");
+
+    for (double length : lengths)
+    {
+        if (length > settings.maxSeconds)
+            continue;
+
+        for (int numChannels = 1; numChannels <= 2; numChannels++)
+        {
+            int numSamples = (int)(length * sampleRate);
+            double numFileBytes = (double)numSamples * numChannels * 2 + 44;
+            double numTotalSamples = (double)numSamples * numChannels;
+            char label[64];
+            bool ok = true;
+
+            {
+                AudioFile<float> audioFile;
+                audioFile.setUseThreads (settings.useThreads);
+                audioFile.setSampleRate (sampleRate);
+                audioFile.setBitDepth (16);
+                fillWithTestSignal (audioFile, numChannels, numSamples);
+
+                Measurement m = measure (settings.numRepeats, [&] { ok = audioFile.save (path.c_str()) && ok; });
+                snprintf (label, sizeof (label), "save %gs %dch", length, numChannels);
+                printResult (label, m, numFileBytes, numTotalSamples);
+
+                // a copy duplicates every sample, where a copy of shared samples only counts a reference
+                m = measure (settings.numRepeats, [&]
+                {
+                    AudioFile<float> copy = audioFile;
+                    ok = copy.getNumSamplesPerChannel() == numSamples && ok;
+                });
+
+                snprintf (label, sizeof (label), "copy %gs %dch", length, numChannels);
+                printResult (label, m, 0., numTotalSamples);
+
+                AudioFile<float, SharedAllocation> shared;
+                ok = shared.load (path.c_str()) && ok;
+
+                m = measure (settings.numRepeats, [&]
+                {
+                    AudioFile<float, SharedAllocation> copy = shared;
+                    ok = copy.getNumSamplesPerChannel() == numSamples && ok;
+                });
+
+                snprintf (label, sizeof (label), "shared copy %gs %dch", length, numChannels);
+                printResult (label, m, 0., numTotalSamples);
+            }
+
+            {
+                // a new AudioFile each time, so that the heap figures include the sample buffers
+                Measurement m = measure (settings.numRepeats, [&]
+                {
+                    AudioFile<float> audioFile;
+                    audioFile.setUseThreads (settings.useThreads);
+                    ok = audioFile.load (path.c_str()) && ok;
+                    ok = ok && audioFile.getNumSamplesPerChannel() == numSamples && audioFile.getNumChannels() == numChannels;
+                });
+
+                snprintf (label, sizeof (label), "load %gs %dch", length, numChannels);
+                printResult (label, m, numFileBytes, numTotalSamples);
+            }
+
+#ifdef AUDIOFILE_PROFILING
+            {
+                // one more load and save, broken down by stage
+                AudioFile<float> audioFile;
+                audioFile.setUseThreads (settings.useThreads);
+                audioFile.load (path.c_str());
+                audioFile.save (path.c_str());
+                audioFile.getProfileStats().print();
+            }
+#endif
+
+            {
+                // a lazy view reads the header, then decodes only the blocks that are read
+                Measurement m = measure (settings.numRepeats, [&]
+                {
+                    AudioFile<float, LazyAllocation<>> view;
+                    ok = view.load (path.c_str()) && view.getNumSamplesPerChannel() == numSamples && ok;
+
+                    float sum = 0.f;
+
+                    for (int i = 0; i < 1000; i++)
+                        sum += view.samples[0][numSamples / 2 + i];
+
+                    ok = ok && sum == sum;
+                });
+
+                snprintf (label, sizeof (label), "view 1000 of %gs %dch", length, numChannels);
+                printResult (label, m, 0., 1000.);
+            }
+
+            // probing is quick, so time enough calls to get above the clock resolution
+            const int numProbes = 1000;
+
+            Measurement m = measure (settings.numRepeats, [&]
+            {
+                for (int i = 0; i < numProbes; i++)
+                    ok = AudioFile<float>::probe (path.c_str()).getNumSamplesPerChannel() == numSamples && ok;
+            });
+
+            m.seconds /= numProbes;
+            m.numAllocations /= numProbes;
+            snprintf (label, sizeof (label), "probe %gs %dch", length, numChannels);
+            printResult (label, m, 0., 0.);
+
+            if (! ok)
+                printf ("  FAILED: the file didn't round trip\n");
+
+            SD.remove (path.c_str());
+        }
+    }
+}
+
+//=============================================================
+template <class Source>
+static void benchmarkStreamingSource (const BenchmarkSettings& settings, const char* name, const std::string& path,
+                                      uint32_t numFrames, double numFileBytes)
+{
+    const int blockFrames = 1024;
+    std::vector<float> block (blockFrames * 2);
+    PrefetchStats stats = PrefetchStats();
+    bool ok = true;
+
+    Measurement m = measure (settings.numRepeats, [&]
+    {
+        WavReader<float, 4096, Source>* reader = new WavReader<float, 4096, Source>();
+        uint32_t numRead = 0;
+
+        if (reader->open (path.c_str()))
+        {
+            int n;
+
+            while ((n = reader->read (block.data(), blockFrames)) > 0)
+                numRead += n;
+        }
+
+        ok = numRead == numFrames && ok;
+        stats = reader->getPrefetchStats();
+        delete reader;
+    });
+
+    printResult (name, m, numFileBytes, (double)numFrames * 2);
+    printf ("  hits %u, misses %u, stalled %.3f ms, %u file reads\n", stats.numHits, stats.numMisses,
+            stats.stallMicros / 1000., stats.numFileReads);
+
+    if (! ok)
+        printf ("  FAILED: not every frame was read\n");
+}
+
+//=============================================================
+/** Sequential reads of a 16-bit stereo file through WavReader in 1024 frame blocks,
+ * with the file read a sector at a time, with synchronous read-ahead, and with
+ * read-ahead on a background thread
+ */
+static void benchmarkStreaming (const BenchmarkSettings& settings)
+{
+    double length = settings.maxSeconds < 60. ? settings.maxSeconds : 60.;
+    uint32_t numFrames = (uint32_t)(length * 44100);
+    double numFileBytes = (double)numFrames * 4 + 44;
+    std::string path = settings.directory + "/audiofile_streaming.wav";
+
+    {
+        AudioFile<float> audioFile;
+        audioFile.setBitDepth (16);
+        fillWithTestSignal (audioFile, 2, (int)numFrames);
+
+        if (! audioFile.save (path.c_str()))
+            return;
+    }
+
+    char title[64];
+    snprintf (title, sizeof (title), "WavReader streaming (%gs, 16 bit stereo)", length);
+    printHeader (title);
+
+    benchmarkStreamingSource<PrefetchReader<512, 1>> (settings, "sector reads", path, numFrames, numFileBytes);
+    benchmarkStreamingSource<PrefetchReader<>> (settings, "read-ahead", path, numFrames, numFileBytes);
+    benchmarkStreamingSource<AsyncPrefetchReader<>> (settings, "async read-ahead", path, numFrames, numFileBytes);
+
+    SD.remove (path.c_str());
+}
+
+//=============================================================
+template <class T>
+static void benchmarkMixerType (const BenchmarkSettings& settings, const char* name, const std::string& path,
+                                uint32_t numFrames, MixMode mode)
+{
+    const int numVoices = 4;
+    const int blockFrames = 256;
+    std::vector<T> block (blockFrames * 2);
+
+    Measurement m = measure (settings.numRepeats, [&]
+    {
+        Mixer<T, numVoices>* mixer = new Mixer<T, numVoices>();
+        mixer->setMixMode (mode);
+
+        for (int i = 0; i < numVoices; i++)
+            mixer->play (path.c_str(), 0.5f, -1.f + 2.f * i / (numVoices - 1));
+
+        while (mixer->getNumVoicesPlaying() > 0)
+            mixer->process (block.data(), blockFrames);
+
+        delete mixer;
+    });
+
+    printResult (name, m, (double)numFrames * numVoices * 4, (double)numFrames * numVoices * 2);
+}
+
+//=============================================================
+/** Four stereo voices of the same file mixed to stereo in 256 frame blocks */
+static void benchmarkMixer (const BenchmarkSettings& settings)
+{
+    double length = settings.maxSeconds < 10. ? settings.maxSeconds : 10.;
+    uint32_t numFrames = (uint32_t)(length * 44100);
+    std::string path = settings.directory + "/audiofile_mixer.wav";
+
+    {
+        AudioFile<float> audioFile;
+        audioFile.setBitDepth (16);
+        fillWithTestSignal (audioFile, 2, (int)numFrames);
+
+        if (! audioFile.save (path.c_str()))
+            return;
+    }
+
+    char title[64];
+    snprintf (title, sizeof (title), "Mixer (4 voices of %gs, 16 bit stereo)", length);
+    printHeader (title);
+
+    benchmarkMixerType<float> (settings, "float saturate", path, numFrames, MixMode::Saturate);
+    benchmarkMixerType<float> (settings, "float headroom", path, numFrames, MixMode::Headroom);
+    benchmarkMixerType<int16_t> (settings, "Q15 saturate", path, numFrames, MixMode::Saturate);
+    benchmarkMixerType<int16_t> (settings, "Q15 headroom", path, numFrames, MixMode::Headroom);
+
+    SD.remove (path.c_str());
+}
+
+//=============================================================
+/** Plays a list of tracks through a Playlist in 256 frame blocks and checks the result
+ * against the tracks loaded with AudioFile: with no crossfade every frame must match,
+ * and with one the output must be shorter by the overlaps and match up to the first fade
+ */
+template <class T>
+static void benchmarkPlaylistType (const BenchmarkSettings& settings, const char* name,
+                                   const std::vector<std::string>& paths, uint32_t crossfadeFrames)
+{
+    const int blockFrames = 256;
+
+    // the tracks as AudioFile decodes them, one after another
+    std::vector<T> expected;
+    std::vector<size_t> trackFrames;
+
+    for (const auto& path : paths)
+    {
+        AudioFile<T> track;
+
+        if (! track.load (path.c_str()))
+            return;
+
+        int numChannels = track.getNumChannels();
+
+        for (int i = 0; i < track.getNumSamplesPerChannel(); i++)
+        {
+            expected.push_back (track.samples[0][i]);
+            expected.push_back (track.samples[numChannels > 1 ? 1 : 0][i]);
+        }
+
+        trackFrames.push_back ((size_t) track.getNumSamplesPerChannel());
+    }
+
+    size_t numExpectedFrames = expected.size() / 2 - (paths.size() - 1) * crossfadeFrames;
+    std::vector<T> output ((numExpectedFrames / blockFrames + 2) * blockFrames * 2);
+    size_t numPlayed = 0;
+    uint32_t numLateStarts = 0;
+
+    Measurement m = measure (settings.numRepeats, [&]
+    {
+        Playlist<T>* playlist = new Playlist<T>();
+
+        for (const auto& path : paths)
+            playlist->addTrack (path.c_str());
+
+        playlist->setCrossfade (crossfadeFrames);
+        playlist->start();
+        numPlayed = 0;
+
+        for (size_t position = 0; playlist->isPlaying() && position + blockFrames * 2 <= output.size(); position += blockFrames * 2)
+            numPlayed += (size_t) playlist->process (output.data() + position, blockFrames);
+
+        numLateStarts = playlist->getNumLateStarts();
+        delete playlist;
+    });
+
+    printResult (name, m, (double) numPlayed * 4, (double) numPlayed * 2);
+
+    size_t numToCompare = crossfadeFrames == 0 ? numPlayed : trackFrames[0] - crossfadeFrames;
+    bool ok = numPlayed == numExpectedFrames && numLateStarts == 0
+        && std::equal (output.begin(), output.begin() + (ptrdiff_t) (numToCompare * 2), expected.begin());
+
+    if (! ok)
+        printf ("  FAILED: %llu frames played (%llu expected), %u late starts, or the samples differ\n",
+                (unsigned long long) numPlayed, (unsigned long long) numExpectedFrames, (unsigned) numLateStarts);
+}
+
+//=============================================================
+/** Three tracks (stereo, mono and stereo) played back to back, and overlapped */
+static void benchmarkPlaylist (const BenchmarkSettings& settings)
+{
+    double length = settings.maxSeconds < 10. ? settings.maxSeconds : 10.;
+    int numFrames = (int)(length * 44100 / 3);
+    std::vector<std::string> paths;
+
+    for (int i = 0; i < 3; i++)
+    {
+        AudioFile<float> track;
+        track.setBitDepth (16);
+
+        // lengths that don't fall on block boundaries, so joins land mid-block
+        fillWithTestSignal (track, i == 1 ? 1 : 2, numFrames + 77 * i);
+        paths.push_back (settings.directory + "/audiofile_playlist" + std::to_string (i) + ".wav");
+
+        if (! track.save (paths.back().c_str()))
+            return;
+    }
+
+    char title[64];
+    snprintf (title, sizeof (title), "Playlist (3 tracks of %gs, 16 bit)", length / 3);
+    printHeader (title);
+
+    benchmarkPlaylistType<float> (settings, "float gapless", paths, 0);
+    benchmarkPlaylistType<float> (settings, "float crossfade 0.1s", paths, 4410);
+    benchmarkPlaylistType<int16_t> (settings, "Q15 gapless", paths, 0);
+
+    for (const auto& path : paths)
+        SD.remove (path.c_str());
+}
+
+//=============================================================
+/** Triggering short clips through a ClipCache with room for half of them: hits, misses,
+ * and a workload where a few clips are played far more often than the rest. A scripted
+ * sequence checks the hit, miss and eviction counts, and that pinned clips and a clip
+ * too big to fit beside them leave the cache as it was.
+ */
+static void benchmarkClipCache (const BenchmarkSettings& settings)
+{
+    const int numClips = 6;
+    const int numFrames = 11025;
+    const uint32_t clipBytes = numFrames * 2 * sizeof (float);
+    const int numGets = 1000;
+    std::vector<std::string> paths;
+
+    // the last one is three clips long
+    for (int i = 0; i <= numClips; i++)
+    {
+        AudioFile<float> clip;
+        clip.setBitDepth (16);
+        fillWithTestSignal (clip, 2, i < numClips ? numFrames : 3 * numFrames);
+        paths.push_back (settings.directory + "/audiofile_clip" + std::to_string (i) + ".wav");
+
+        if (! clip.save (paths.back().c_str()))
+            return;
+    }
+
+    printHeader ("Clip cache (0.25s stereo clips, room for 3)");
+
+    ClipCache<float, 8>* cache = new ClipCache<float, 8>();
+    cache->setBudget (3 * clipBytes);
+    bool ok = true;
+
+    // a b c a d b a: d evicts b, then b evicts c
+    const int script[] = { 0, 1, 2, 0, 3, 1, 0 };
+
+    for (int clip : script)
+        ok = cache->get (paths[(size_t) clip].c_str()) != nullptr && ok;
+
+    const ClipCacheStats& stats = cache->getStats();
+    ok = ok && stats.numHits == 2 && stats.numMisses == 5 && stats.numEvictions == 2
+        && cache->contains (paths[0].c_str()) && cache->contains (paths[1].c_str()) && cache->contains (paths[3].c_str());
+
+    // with a pinned, the long clip can't fit, and nothing may be evicted trying
+    cache->clear();
+    AudioFile<float>* pinned = cache->get (paths[0].c_str(), true);
+    cache->get (paths[1].c_str());
+    cache->get (paths[2].c_str());
+    ok = ok && cache->get (paths[numClips].c_str()) == nullptr && cache->getNumClips() == 3;
+    cache->unpin (pinned);
+    ok = ok && cache->get (paths[numClips].c_str()) != nullptr && cache->getNumClips() == 1;
+
+    cache->clear();
+    cache->resetStats();
+    cache->get (paths[0].c_str());
+
+    Measurement m = measure (settings.numRepeats, [&]
+    {
+        for (int i = 0; i < numGets; i++)
+            ok = cache->get (paths[0].c_str()) != nullptr && ok;
+    });
+
+    printResult ("1000 hits", m, (double) clipBytes * numGets, (double) numFrames * 2 * numGets);
+
+    m = measure (settings.numRepeats, [&]
+    {
+        cache->remove (paths[0].c_str());
+        ok = cache->get (paths[0].c_str()) != nullptr && ok;
+    });
+
+    printResult ("miss (load)", m, (double) clipBytes, (double) numFrames * 2);
+
+    // clip i is asked for about twice as often as clip i + 1
+    cache->clear();
+    cache->resetStats();
+
+    m = measure (settings.numRepeats, [&]
+    {
+        uint32_t random = 12345;
+
+        for (int i = 0; i < numGets; i++)
+        {
+            random = random * 1664525u + 1013904223u;
+            int clip = 0;
+
+            while (clip < numClips - 1 && ((random >> (8 + clip)) & 1) != 0)
+                clip++;
+
+            ok = cache->get (paths[(size_t) clip].c_str()) != nullptr && ok;
+        }
+    });
+
+    printResult ("1000 skewed gets", m, (double) clipBytes * numGets, (double) numFrames * 2 * numGets);
+    printf ("  %.1f%% hit rate, %u evictions over %d repeats\n", 100. * stats.getHitRate(), (unsigned) stats.numEvictions, settings.numRepeats);
+
+    if (! ok)
+        printf ("  FAILED: the cache's hits, misses, evictions or pins weren't as expected\n");
+
+    delete cache;
+
+    for (const auto& path : paths)
+        SD.remove (path.c_str());
+}
+
+//=============================================================
+/** Decoding and encoding of interleaved stereo PCM held in memory */
+static void benchmarkConversion (const BenchmarkSettings& settings)
+{
+    const int numFrames = 1 << 20;
+    const int numChannels = 2;
+    const int bitDepths[] = { 8, 16, 24 };
+
+    std::vector<float> samples ((size_t)(numFrames * numChannels));
+
+    for (size_t i = 0; i < samples.size(); i++)
+        samples[i] = (float)(0.9 * sin (0.001 * (double)i));
+
+    printHeader ("PCM conversion (1M stereo frames in memory)");
+
+    for (int bitDepth : bitDepths)
+    {
+        int numBytesPerSample = bitDepth / 8;
+        int numSamples = numFrames * numChannels;
+        std::vector<uint8_t> bytes ((size_t)numSamples * numBytesPerSample);
+        std::vector<float> decoded (samples.size());
+        char label[64];
+
+        Measurement m = measure (settings.numRepeats, [&] { encodePcmSamples (samples.data(), numSamples, bitDepth, bytes.data()); });
+        snprintf (label, sizeof (label), "encode %d bit", bitDepth);
+        printResult (label, m, (double)bytes.size(), numSamples);
+
+        m = measure (settings.numRepeats, [&] { decodePcmSamples (bytes.data(), bitDepth, decoded.data(), numSamples); });
+        snprintf (label, sizeof (label), "decode %d bit", bitDepth);
+        printResult (label, m, (double)bytes.size(), numSamples);
+
+        // one channel out of interleaved data, as AudioFile does it
+        m = measure (settings.numRepeats, [&] { decodePcmSamples (bytes.data(), bitDepth, decoded.data(), numFrames, numBytesPerSample * numChannels); });
+        snprintf (label, sizeof (label), "decode %d bit strided", bitDepth);
+        printResult (label, m, (double)bytes.size() / numChannels, numFrames);
+    }
+}
+
+//=============================================================
+template <int N>
+static void benchmarkFFTSize (const BenchmarkSettings& settings)
+{
+    // enough transforms to cover about 4M samples
+    const int numTransforms = (1 << 22) / N;
+
+    RealFFT<float, N>* fft = new RealFFT<float, N>();
+    RealFFTQ15<N>* fftQ15 = new RealFFTQ15<N>();
+    std::vector<float> input (N), buffer (N);
+    std::vector<int16_t> inputQ15 (N), bufferQ15 (N);
+
+    for (int i = 0; i < N; i++)
+    {
+        input[(size_t)i] = (float)(0.5 * sin (0.37 * i));
+        inputQ15[(size_t)i] = (int16_t)(input[(size_t)i] * 32767.f);
+    }
+
+    char label[64];
+
+    Measurement m = measure (settings.numRepeats, [&]
+    {
+        for (int i = 0; i < numTransforms; i++)
+        {
+            buffer = input;
+            fft->forward (buffer.data());
+        }
+    });
+
+    snprintf (label, sizeof (label), "fft float %d", N);
+    printResult (label, m, (double)numTransforms * N * sizeof (float), (double)numTransforms * N);
+
+    m = measure (settings.numRepeats, [&]
+    {
+        for (int i = 0; i < numTransforms; i++)
+        {
+            bufferQ15 = inputQ15;
+            fftQ15->forward (bufferQ15.data());
+        }
+    });
+
+    snprintf (label, sizeof (label), "fft q15 %d", N);
+    printResult (label, m, (double)numTransforms * N * sizeof (int16_t), (double)numTransforms * N);
+
+    delete fft;
+    delete fftQ15;
+}
+
+//=============================================================
+static void benchmarkFFT (const BenchmarkSettings& settings)
+{
+    printHeader ("Real FFT (about 4M samples per case)");
+
+    benchmarkFFTSize<64> (settings);
+    benchmarkFFTSize<256> (settings);
+    benchmarkFFTSize<1024> (settings);
+    benchmarkFFTSize<4096> (settings);
+}
+
+//=============================================================
+#ifdef AUDIOFILE_WITH_LIBFLAC
+namespace LibFlac
+{
+    static FLAC__StreamDecoderWriteStatus write (const FLAC__StreamDecoder*, const FLAC__Frame* frame,
+                                                 const FLAC__int32* const*, void* numFrames)
+    {
+        *(uint32_t*)numFrames += frame->header.blocksize;
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
+
+    static void error (const FLAC__StreamDecoder*, FLAC__StreamDecoderErrorStatus, void*) {}
+
+    /** Decodes a whole file with libFLAC, @Returns the number of frames decoded */
+    static uint32_t decode (const char* path)
+    {
+        uint32_t numFrames = 0;
+        FLAC__StreamDecoder* decoder = FLAC__stream_decoder_new();
+
+        if (FLAC__stream_decoder_init_file (decoder, path, write, nullptr, error, &numFrames) == FLAC__STREAM_DECODER_INIT_STATUS_OK)
+            FLAC__stream_decoder_process_until_end_of_stream (decoder);
+
+        FLAC__stream_decoder_delete (decoder);
+        return numFrames;
+    }
+}
+#endif
+
+//=============================================================
+/** Decoding of a FLAC file given with --flac: loaded into an AudioFile, streamed
+ * through FlacDecoder, and, as references, the same audio loaded from a 16-bit WAV
+ * and decoded by libFLAC when the build found it
+ */
+static void benchmarkFlac (const BenchmarkSettings& settings)
+{
+    if (settings.flacPath.empty())
+    {
+        printf ("\nFLAC decoding: skipped, pass --flac <file> to measure it\n");
+        return;
+    }
+
+    FlacDecoder<float>* probe = new FlacDecoder<float>();
+
+    if (! probe->open (settings.flacPath.c_str()) || probe->getNumFrames() == 0)
+    {
+        printf ("\nFLAC decoding: can't read %s, or its length is unknown\n", settings.flacPath.c_str());
+        delete probe;
+        return;
+    }
+
+    uint32_t numFrames = probe->getNumFrames();
+    int numChannels = probe->getNumChannels();
+    double length = probe->getLengthInSeconds();
+    delete probe;
+
+    double numFileBytes = (double)SD.open (settings.flacPath.c_str()).size();
+    double numTotalSamples = (double)numFrames * numChannels;
+    std::string wavPath = settings.directory + "/audiofile_flac_reference.wav";
+    bool ok = true;
+
+    char title[96];
+    snprintf (title, sizeof (title), "FLAC decoding (%.1fs, %d ch, %.1f MB)", length, numChannels, numFileBytes / 1.e6);
+    printHeader (title);
+
+    {
+        AudioFile<float> audioFile;
+        Measurement m = measure (settings.numRepeats, [&]
+        {
+            ok = audioFile.load (settings.flacPath.c_str()) && ok;
+        });
+
+        printResult ("AudioFile load", m, numFileBytes, numTotalSamples);
+
+        audioFile.setBitDepth (16);
+        ok = audioFile.save (wavPath.c_str()) && ok;
+    }
+
+    const int blockFrames = 1024;
+    std::vector<float> block (blockFrames * numChannels);
+
+    Measurement m = measure (settings.numRepeats, [&]
+    {
+        FlacDecoder<float>* decoder = new FlacDecoder<float>();
+        uint32_t numRead = 0;
+
+        if (decoder->open (settings.flacPath.c_str()))
+        {
+            int n;
+
+            while ((n = decoder->read (block.data(), blockFrames)) > 0)
+                numRead += n;
+        }
+
+        ok = numRead == numFrames && ok;
+        delete decoder;
+    });
+
+    printResult ("FlacDecoder read", m, numFileBytes, numTotalSamples);
+
+    {
+        AudioFile<float> audioFile;
+        m = measure (settings.numRepeats, [&] { ok = audioFile.load (wavPath.c_str()) && ok; });
+        printResult ("same audio as WAV", m, numTotalSamples * 2 + 44, numTotalSamples);
+    }
+
+#ifdef AUDIOFILE_WITH_LIBFLAC
+    m = measure (settings.numRepeats, [&] { ok = LibFlac::decode (settings.flacPath.c_str()) == numFrames && ok; });
+    printResult ("libFLAC", m, numFileBytes, numTotalSamples);
+#endif
+
+    if (! ok)
+        printf ("  FAILED: a file couldn't be decoded in full\n");
+
+    SD.remove (wavPath.c_str());
+}
+
+//=============================================================
+/** Decoding of an MP3 file given with --mp3: loaded into an AudioFile, and streamed
+ * through Mp3Decoder to float and to 16 bit samples
+ */
+static void benchmarkMp3 (const BenchmarkSettings& settings)
+{
+    if (settings.mp3Path.empty())
+    {
+        printf ("\nMP3 decoding: skipped, pass --mp3 <file> to measure it\n");
+        return;
+    }
+
+    Mp3Decoder<float>* probe = new Mp3Decoder<float>();
+
+    if (! probe->open (settings.mp3Path.c_str()) || probe->getNumFrames() == 0)
+    {
+        printf ("\nMP3 decoding: can't read %s, or its length is unknown\n", settings.mp3Path.c_str());
+        delete probe;
+        return;
+    }
+
+    uint32_t numFrames = probe->getNumFrames();
+    int numChannels = probe->getNumChannels();
+    double length = probe->getLengthInSeconds();
+    delete probe;
+
+    double numFileBytes = (double)SD.open (settings.mp3Path.c_str()).size();
+    double numTotalSamples = (double)numFrames * numChannels;
+    bool ok = true;
+
+    char title[96];
+    snprintf (title, sizeof (title), "MP3 decoding (%.1fs, %d ch, %.1f MB)", length, numChannels, numFileBytes / 1.e6);
+    printHeader (title);
+
+    {
+        AudioFile<float> audioFile;
+        Measurement m = measure (settings.numRepeats, [&] { ok = audioFile.load (settings.mp3Path.c_str()) && ok; });
+        printResult ("AudioFile load", m, numFileBytes, numTotalSamples);
+    }
+
+    const int blockFrames = 1024;
+    std::vector<float> block (blockFrames * numChannels);
+    std::vector<int16_t> fixedBlock (blockFrames * numChannels);
+
+    Measurement m = measure (settings.numRepeats, [&]
+    {
+        Mp3Decoder<float>* decoder = new Mp3Decoder<float>();
+        uint32_t numRead = 0;
+
+        if (decoder->open (settings.mp3Path.c_str()))
+        {
+            int n;
+
+            while ((n = decoder->read (block.data(), blockFrames)) > 0)
+                numRead += n;
+        }
+
+        ok = numRead == numFrames && ok;
+        delete decoder;
+    });
+
+    printResult ("Mp3Decoder read, float", m, numFileBytes, numTotalSamples);
+
+    m = measure (settings.numRepeats, [&]
+    {
+        Mp3Decoder<int16_t>* decoder = new Mp3Decoder<int16_t>();
+        uint32_t numRead = 0;
+
+        if (decoder->open (settings.mp3Path.c_str()))
+        {
+            int n;
+
+            while ((n = decoder->read (fixedBlock.data(), blockFrames)) > 0)
+                numRead += n;
+        }
+
+        ok = numRead == numFrames && ok;
+        delete decoder;
+    });
+
+    printResult ("Mp3Decoder read, int16", m, numFileBytes, numTotalSamples);
+
+    if (! ok)
+        printf ("  FAILED: a file couldn't be decoded in full\n");
+}
+
+//=============================================================
+/** The simulated DMA interrupt of benchmarkCapture(): each call deposits a block of a 1 kHz tone */
+template <class Recorder>
+struct SimulatedCapture
+{
+    static Recorder* recorder;
+    static uint32_t sampleRate;
+    static int numChannels;
+    static int framesPerInterrupt;
+    static uint32_t numFramesDeposited;
+
+    static void interrupt()
+    {
+        int16_t block[64 * 8];
+
+        for (int frame = 0; frame < framesPerInterrupt; frame++, numFramesDeposited++)
+        {
+            int16_t sample = (int16_t)(16000. * sin (2. * M_PI * 1000. * numFramesDeposited / sampleRate));
+
+            for (int channel = 0; channel < numChannels; channel++)
+                block[frame * numChannels + channel] = sample;
+        }
+
+        recorder->depositSamples (block, framesPerInterrupt * numChannels);
+    }
+};
+
+template <class Recorder> Recorder* SimulatedCapture<Recorder>::recorder = nullptr;
+template <class Recorder> uint32_t SimulatedCapture<Recorder>::sampleRate = 0;
+template <class Recorder> int SimulatedCapture<Recorder>::numChannels = 0;
+template <class Recorder> int SimulatedCapture<Recorder>::framesPerInterrupt = 64;
+template <class Recorder> uint32_t SimulatedCapture<Recorder>::numFramesDeposited = 0;
+
+//=============================================================
+/** Records in real time from the simulated interrupt while the main loop writes the
+ * buffers out, now and then busy for stallMillis as a sketch doing other work would be
+ */
+template <class Recorder>
+static void runCapture (const BenchmarkSettings& settings, const char* name, uint32_t sampleRate, int numChannels, int stallMillis)
+{
+    typedef SimulatedCapture<Recorder> Capture;
+
+    std::string path = settings.directory + "/audiofile_capture.wav";
+    double seconds = settings.maxSeconds < 2. ? settings.maxSeconds : 2.;
+    Recorder* recorder = new Recorder();
+
+    if (! recorder->start (path.c_str(), sampleRate, numChannels, (uint32_t)(seconds * sampleRate) + sampleRate))
+    {
+        delete recorder;
+        return;
+    }
+
+    Capture::recorder = recorder;
+    Capture::sampleRate = sampleRate;
+    Capture::numChannels = numChannels;
+    Capture::numFramesDeposited = 0;
+    Timer1.attachInterrupt (Capture::interrupt, (unsigned long)(1.e6 * Capture::framesPerInterrupt / sampleRate));
+
+    auto start = std::chrono::steady_clock::now();
+    auto nextStall = start + std::chrono::milliseconds (250);
+
+    while (std::chrono::steady_clock::now() - start < std::chrono::duration<double> (seconds))
+    {
+        recorder->process();
+
+        if (stallMillis > 0 && std::chrono::steady_clock::now() >= nextStall)
+        {
+            delay ((unsigned long) stallMillis);
+            nextStall += std::chrono::milliseconds (250);
+        }
+        else
+        {
+            delayMicroseconds (100);
+        }
+    }
+
+    Timer1.detachInterrupt();
+    bool ok = recorder->stop();
+
+    // every frame deposited is in the file, apart from the ones counted as dropped
+    WaveFormat format;
+    File file = SD.open (path.c_str());
+    ok = readWaveFormat (file, format) && ok;
+    file.close();
+    ok = format.getNumFrames() == Capture::numFramesDeposited - recorder->getNumDroppedFrames() && ok;
+
+    printf ("%-28s %10u %10u %10u %10.2f %10.2f %10d%s\n", name, (unsigned)format.getNumFrames(),
+            (unsigned)recorder->getNumOverruns(), (unsigned)recorder->getNumDroppedFrames(),
+            recorder->getLongestWriteMicros() / 1000., recorder->getBufferMicros() / 1000.,
+            recorder->getMostBuffersWaiting(), ok ? "" : "  FAILED");
+
+    SD.remove (path.c_str());
+    delete recorder;
+}
+
+//=============================================================
+/** Checks that a recording cut off before stop(), as by a reset, loads up to the last
+ * buffer written through every reader, although its header was never completed
+ */
+static void runCutOffCapture (const BenchmarkSettings& settings)
+{
+    typedef WavRecorder<int16_t, 8192, 2> Recorder;
+
+    std::string path = settings.directory + "/audiofile_cutoff.wav";
+    Recorder* recorder = new Recorder();
+
+    if (! recorder->start (path.c_str(), 16000, 1))
+    {
+        delete recorder;
+        return;
+    }
+
+    // three and a half buffers: the last half is still in memory when the reset comes
+    int16_t block[64];
+
+    for (int i = 0; i < 64; i++)
+        block[i] = (int16_t)(16000. * sin (2. * M_PI * i / 64.));
+
+    for (int i = 0; i < 7 * 4096 / 2 / 64; i++)
+    {
+        recorder->depositSamples (block, 64);
+        recorder->process();
+    }
+
+    recorder->flush();
+    int numFrames = (int) recorder->getNumFramesWritten();
+
+    AudioFile<float> dynamicFile;
+    AudioFile<float, StaticAllocation<1, 16384>> staticFile;
+    AudioFile<float, LazyAllocation<>> lazyFile;
+    AudioFile<float, AdpcmAllocation<>> adpcmFile;
+    WavReader<float> reader;
+
+    bool ok = numFrames == 3 * 4096
+        && probeAudioFile (path.c_str()).getNumSamplesPerChannel() == numFrames
+        && dynamicFile.load (path.c_str()) && dynamicFile.getNumSamplesPerChannel() == numFrames
+        && staticFile.load (path.c_str()) && staticFile.getNumSamplesPerChannel() == numFrames
+        && lazyFile.load (path.c_str()) && lazyFile.getNumSamplesPerChannel() == numFrames
+        && adpcmFile.load (path.c_str()) && adpcmFile.getNumSamplesPerChannel() == numFrames
+        && reader.open (path.c_str()) && reader.getNumFrames() == (uint32_t) numFrames;
+
+    reader.close();
+    ok = recorder->stop() && ok;
+
+    printf ("%-28s %10d%s\n", "cut off before stop()", numFrames, ok ? "" : "  FAILED");
+
+    SD.remove (path.c_str());
+    delete recorder;
+}
+
+//=============================================================
+/** Recording through WavRecorder from a timer thread standing in for a DMA interrupt,
+ * with and without a main loop that is sometimes too busy to keep up
+ */
+static void benchmarkCapture (const BenchmarkSettings& settings)
+{
+    printf ("\nCapture from a simulated interrupt (64 frames per interrupt, stalls of 60 ms every 250 ms)\n");
+    printf ("%-28s %10s %10s %10s %10s %10s %10s\n", "case", "frames", "overruns", "dropped", "write ms", "buffer ms", "waiting");
+
+    runCapture<WavRecorder<int16_t, 8192, 2>> (settings, "44.1 kHz stereo, 2 buffers", 44100, 2, 0);
+    runCapture<WavRecorder<int16_t, 8192, 2>> (settings, "96 kHz stereo, 2 buffers", 96000, 2, 0);
+    runCapture<WavRecorder<int16_t, 8192, 2>> (settings, "44.1 kHz, 2 buffers, stalls", 44100, 2, 60);
+    runCapture<WavRecorder<int16_t, 8192, 8>> (settings, "44.1 kHz, 8 buffers, stalls", 44100, 2, 60);
+    runCutOffCapture (settings);
+}
+
+//=============================================================
+/** Loading into float samples and into ADPCM, then playing through them and jumping around them */
+static void benchmarkAdpcm (const BenchmarkSettings& settings)
+{
+    double length = settings.maxSeconds < 60. ? settings.maxSeconds : 60.;
+    int numFrames = (int)(length * 44100);
+    double numFileBytes = (double)numFrames * 4 + 44;
+    double numTotalSamples = (double)numFrames * 2;
+    std::string path = settings.directory + "/audiofile_adpcm.wav";
+
+    AudioFile<float> audioFile;
+    audioFile.setBitDepth (16);
+    fillWithTestSignal (audioFile, 2, numFrames);
+
+    if (! audioFile.save (path.c_str()))
+        return;
+
+    char title[64];
+    snprintf (title, sizeof (title), "ADPCM sample storage (%gs, 16 bit stereo)", length);
+    printHeader (title);
+
+    AudioFile<float, AdpcmAllocation<>> compressed;
+    bool ok = true;
+
+    Measurement m = measure (settings.numRepeats, [&] { ok = audioFile.load (path.c_str()) && ok; });
+    printResult ("load, float", m, numFileBytes, numTotalSamples);
+
+    m = measure (settings.numRepeats, [&] { ok = compressed.load (path.c_str()) && ok; });
+    printResult ("load, ADPCM", m, numFileBytes, numTotalSamples);
+
+    // sums keep the reads from being optimised away
+    volatile float sink = 0.f;
+    const AudioFile<float>& floatFile = audioFile;
+
+    m = measure (settings.numRepeats, [&]
+    {
+        float sum = 0.f;
+
+        for (int channel = 0; channel < 2; channel++)
+            for (int i = 0; i < numFrames; i++)
+                sum += floatFile.samples[channel][i];
+
+        sink = sum;
+    });
+
+    printResult ("read in order, float", m, numFileBytes, numTotalSamples);
+
+    m = measure (settings.numRepeats, [&]
+    {
+        float sum = 0.f;
+
+        for (int i = 0; i < numFrames; i++)
+            sum += compressed.samples[0][i] + compressed.samples[1][i];
+
+        sink = sum;
+    });
+
+    printResult ("read in order, ADPCM", m, numFileBytes, numTotalSamples);
+
+    // one 256 frame block from each of a thousand places, as when jumping to cue points
+    const int numJumps = 1000;
+
+    m = measure (settings.numRepeats, [&]
+    {
+        float sum = 0.f;
+        uint32_t position = 12345;
+
+        for (int jump = 0; jump < numJumps; jump++)
+        {
+            position = position * 1664525u + 1013904223u;
+            int blockIndex = (int)(position % (uint32_t)(numFrames / 256));
+
+            for (int channel = 0; channel < 2; channel++)
+                sum += compressed.samples.getBlock (channel, blockIndex)[255];
+        }
+
+        sink = sum;
+    });
+
+    printResult ("1000 jumps, ADPCM", m, numJumps * 256. * 4, numJumps * 256. * 2);
+
+    double noise = 0., signal = 0.;
+
+    for (int channel = 0; channel < 2; channel++)
+    {
+        for (int i = 0; i < numFrames; i++)
+        {
+            double difference = (double)floatFile.samples[channel][i] - compressed.samples[channel][i];
+            signal += (double)floatFile.samples[channel][i] * floatFile.samples[channel][i];
+            noise += difference * difference;
+        }
+    }
+
+    printf ("  %.2f MB as float, %.2f MB as ADPCM, %.1f dB signal to noise\n", numTotalSamples * 4. / 1.e6,
+            compressed.samples.getNumEncodedBytes() / 1.e6, 10. * log10 (signal / noise));
+
+    if (! ok)
+        printf ("  FAILED: the file couldn't be loaded\n");
+
+    (void) sink;
+    SD.remove (path.c_str());
+}
+
+//=============================================================
+/** Drawing an overview of a long file from its samples, and from a PeakPyramid built while it loads */
+static void benchmarkPeaks (const BenchmarkSettings& settings)
+{
+    double length = settings.maxSeconds < 600. ? settings.maxSeconds : 600.;
+    int numFrames = (int)(length * 44100);
+    double numFileBytes = (double)numFrames * 4 + 44;
+    double numTotalSamples = (double)numFrames * 2;
+    std::string path = settings.directory + "/audiofile_peaks.wav";
+    const int numPixels = 1000;
+
+    AudioFile<float> audioFile;
+    audioFile.setBitDepth (16);
+    fillWithTestSignal (audioFile, 2, numFrames);
+
+    if (! audioFile.save (path.c_str()))
+        return;
+
+    char title[64];
+    snprintf (title, sizeof (title), "Waveform overview (%gs, 16 bit stereo, %d pixels)", length, numPixels);
+    printHeader (title);
+
+    PeakPyramid<float> peaks;
+    bool ok = true;
+
+    Measurement m = measure (settings.numRepeats, [&] { ok = audioFile.load (path.c_str()) && ok; });
+    printResult ("load", m, numFileBytes, numTotalSamples);
+
+    audioFile.setAnalysisSink (&peaks);
+    m = measure (settings.numRepeats, [&] { ok = audioFile.load (path.c_str()) && ok; });
+    printResult ("load + peak pyramid", m, numFileBytes, numTotalSamples);
+    audioFile.setAnalysisSink (nullptr);
+
+    m = measure (settings.numRepeats, [&] { ok = peaks.save (path.c_str()) && ok; });
+    double numPeakBytes = (double)SD.open (PeakPyramid<float>::getSidecarPath (path.c_str()).c_str()).size();
+    printResult ("save sidecar", m, numPeakBytes, numTotalSamples);
+
+    PeakPyramid<float> reloaded;
+    m = measure (settings.numRepeats, [&] { ok = reloaded.load (path.c_str()) && ok; });
+    printResult ("load sidecar", m, numPeakBytes, numTotalSamples);
+
+    std::vector<PeakSummary<float>> pixels (numPixels);
+
+    m = measure (settings.numRepeats, [&]
+    {
+        for (int channel = 0; channel < 2; channel++)
+        {
+            const float* data = audioFile.samples[channel].getData();
+
+            for (int i = 0; i < numPixels; i++)
+            {
+                int start = (int)((int64_t)numFrames * i / numPixels);
+                int end = (int)((int64_t)numFrames * (i + 1) / numPixels);
+                float minimum = data[start], maximum = data[start];
+                double sumOfSquares = 0.;
+
+                for (int j = start; j < end; j++)
+                {
+                    minimum = data[j] < minimum ? data[j] : minimum;
+                    maximum = data[j] > maximum ? data[j] : maximum;
+                    sumOfSquares += (double)data[j] * data[j];
+                }
+
+                pixels[(size_t)i].minimum = minimum;
+                pixels[(size_t)i].maximum = maximum;
+                pixels[(size_t)i].rms = (float)sqrt (sumOfSquares / (end - start));
+            }
+        }
+    });
+
+    printResult ("overview from samples", m, numFileBytes, numTotalSamples);
+
+    m = measure (settings.numRepeats, [&]
+    {
+        for (int channel = 0; channel < 2; channel++)
+            reloaded.render (channel, 0, reloaded.getNumFrames(), pixels.data(), numPixels);
+    });
+
+    printResult ("overview from pyramid", m, numFileBytes, numTotalSamples);
+
+    if (! ok)
+        printf ("  FAILED: a file or its peaks couldn't be saved or loaded\n");
+
+    SD.remove (PeakPyramid<float>::getSidecarPath (path.c_str()).c_str());
+    SD.remove (path.c_str());
+}
+
+//=============================================================
+static void printUsage()
+{
+    fprintf (stderr, "usage: benchmark [--max-seconds <s>] [--repeat <n>] [--dir <path>] [--no-threads] [--flac <file>] [--mp3 <file>]\n");
+}
+
+//=============================================================
+static bool parseArguments (int argc, char** argv, BenchmarkSettings& settings)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--max-seconds" && hasValue)
+            settings.maxSeconds = atof (argv[++i]);
+        else if (argument == "--repeat" && hasValue)
+            settings.numRepeats = atoi (argv[++i]);
+        else if (argument == "--dir" && hasValue)
+            settings.directory = argv[++i];
+        else if (argument == "--no-threads")
+            settings.useThreads = false;
+        else if (argument == "--flac" && hasValue)
+            settings.flacPath = argv[++i];
+        else if (argument == "--mp3" && hasValue)
+            settings.mp3Path = argv[++i];
+        else
+            return false;
+    }
+
+    return settings.numRepeats > 0;
+}
+
+//=============================================================
+int main (int argc, char** argv)
+{
+    BenchmarkSettings settings;
+
+    if (! parseArguments (argc, argv, settings))
+    {
+        printUsage();
+        return 1;
+    }
+
+    benchmarkConversion (settings);
+    benchmarkFFT (settings);
+    benchmarkFiles (settings);
+    benchmarkStreaming (settings);
+    benchmarkMixer (settings);
+    benchmarkPlaylist (settings);
+    benchmarkClipCache (settings);
+    benchmarkFlac (settings);
+    benchmarkMp3 (settings);
+    benchmarkCapture (settings);
+    benchmarkAdpcm (settings);
+    benchmarkPeaks (settings);
+
+    return 0;
+}
@@ -0,0 +1,354 @@
+//=============================================================
+/** Host-side batch transcoder.
+ *
+ * Preprocesses WAV, FLAC and MP3 files before they are copied to SD cards:
+ * each file is loaded with AudioFile, optionally resampled and loudness
+ * normalised, and saved as a WAV file at the requested bit depth (with the
+ * input's name and a .wav extension), with a peak file next to it for drawing
+ * its waveform if asked for. Files are spread over a work-stealing
+ * thread pool and every worker keeps its own AudioFile and scratch buffers,
+ * so workers never share memory and throughput scales with the number of cores.
+ *
+ *      transcode [--rate <hz>] [--bits <8|16|24>] [--loudness <lufs>] [--threads <n>] [--peaks] --out <dir> <file.wav|file.flac|file.mp3>...
+ */
+//=============================================================
+
+#include <Arduino.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "../main/AudioFile.h"
+#include "../main/PeakPyramid.h"
+#include "../main/ThreadPool.h"
+
+//=============================================================
+struct TranscodeSettings
+{
+    uint32_t sampleRate = 0;     // 0 keeps the input sample rate
+    int bitDepth = 0;            // 0 keeps the input bit depth
+    bool normalise = false;
+    double targetLoudness = -23.;
+    int numThreads = 0;
+    bool writePeaks = false;     // also write a PeakPyramid sidecar next to each output file
+    std::string outputDirectory;
+    std::vector<std::string> inputFiles;
+};
+
+//=============================================================
+struct FileResult
+{
+    bool ok = false;
+    double seconds = 0.;         // wall time spent on this file
+    double audioSeconds = 0.;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+};
+
+//=============================================================
+/** Windowed sinc interpolation with a precomputed kernel. The cutoff follows the
+ * lower of the two sample rates so that downsampling doesn't alias.
+ */
+class Resampler
+{
+public:
+
+    void prepare (uint32_t inputRate, uint32_t outputRate)
+    {
+        ratio = (double)inputRate / (double)outputRate;
+        cutoff = ratio > 1. ? 1. / ratio : 1.;
+
+        // the kernel spans numZeroCrossings input periods (stretched when downsampling) either side
+        halfWidth = (int)ceil (numZeroCrossings / cutoff);
+        kernel.resize (numZeroCrossings * tableResolution + 2);
+
+        for (size_t i = 0; i < kernel.size(); i++)
+        {
+            double x = (double)i / tableResolution;
+            double sinc = x == 0. ? 1. : sin (M_PI * x) / (M_PI * x);
+            double window = x < numZeroCrossings ? 0.42 + 0.5 * cos (M_PI * x / numZeroCrossings) + 0.08 * cos (2. * M_PI * x / numZeroCrossings) : 0.;
+            kernel[i] = (float)(sinc * window);
+        }
+    }
+
+    void process (const std::vector<float>& input, std::vector<float>& output, size_t numOutputSamples)
+    {
+        output.resize (numOutputSamples);
+        long numInput = (long)input.size();
+
+        for (size_t i = 0; i < numOutputSamples; i++)
+        {
+            double centre = (double)i * ratio;
+            long first = (long)floor (centre) - halfWidth + 1;
+            long last = (long)floor (centre) + halfWidth;
+            double sum = 0.;
+
+            for (long j = first; j <= last; j++)
+            {
+                if (j < 0 || j >= numInput)
+                    continue;
+
+                double position = fabs (centre - (double)j) * cutoff * tableResolution;
+                size_t index = (size_t)position;
+
+                if (index + 1 >= kernel.size())
+                    continue;
+
+                double fraction = position - (double)index;
+                double k = kernel[index] + (kernel[index + 1] - kernel[index]) * fraction;
+                sum += input[(size_t)j] * k;
+            }
+
+            output[i] = (float)(sum * cutoff);
+        }
+    }
+
+private:
+
+    static const int numZeroCrossings = 16;
+    static const int tableResolution = 512;
+    std::vector<float> kernel;
+    double ratio = 1.;
+    double cutoff = 1.;
+    int halfWidth = numZeroCrossings;
+};
+
+//=============================================================
+/** Everything one worker needs. Only ever touched by its own worker thread */
+struct WorkerState
+{
+    AudioFile<float> audioFile;
+    LevelAnalyser<float, 2> analyser;
+    PeakPyramid<float> peaks;
+    Resampler resampler;
+    std::vector<float> input;
+    std::vector<float> output;
+};
+
+//=============================================================
+static double secondsSince (std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+}
+
+//=============================================================
+static uint64_t getFileSize (const std::string& path)
+{
+    struct stat info;
+    return stat (path.c_str(), &info) == 0 ? (uint64_t)info.st_size : 0;
+}
+
+//=============================================================
+static std::string getOutputPath (const TranscodeSettings& settings, const std::string& inputPath)
+{
+    size_t slash = inputPath.find_last_of ('/');
+    std::string fileName = slash == std::string::npos ? inputPath : inputPath.substr (slash + 1);
+
+    // every file is saved as WAV, whatever it was read from
+    size_t dot = fileName.find_last_of ('.');
+    return settings.outputDirectory + "/" + fileName.substr (0, dot) + ".wav";
+}
+
+//=============================================================
+static FileResult transcodeFile (const TranscodeSettings& settings, const std::string& inputPath, WorkerState& state)
+{
+    FileResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    // files are already spread over the pool, one per worker, so converting each
+    // one's frames on the pool as well would only oversubscribe it
+    AudioFile<float>& audioFile = state.audioFile;
+    audioFile.setUseThreads (false);
+    audioFile.setAnalysisSink (settings.normalise ? &state.analyser : nullptr);
+
+    // decode
+    if (! audioFile.load (inputPath.c_str()))
+        return result;
+
+    result.bytesIn = getFileSize (inputPath);
+    result.audioSeconds = audioFile.getLengthInSeconds();
+
+    int numChannels = audioFile.getNumChannels();
+    int numSamples = audioFile.getNumSamplesPerChannel();
+    uint32_t inputRate = audioFile.getSampleRate();
+    uint32_t outputRate = settings.sampleRate != 0 ? settings.sampleRate : inputRate;
+    float gain = settings.normalise ? state.analyser.getGainForLoudness (settings.targetLoudness) : 1.f;
+
+    // process
+    if (outputRate != inputRate)
+    {
+        size_t numOutputSamples = (size_t)((uint64_t)numSamples * outputRate / inputRate);
+        state.resampler.prepare (inputRate, outputRate);
+
+        AudioFile<float>::AudioBuffer resampled;
+        resampled.resize (numChannels);
+
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            state.input.resize ((size_t)numSamples);
+
+            for (int i = 0; i < numSamples; i++)
+                state.input[(size_t)i] = audioFile.samples[channel][i];
+
+            state.resampler.process (state.input, state.output, numOutputSamples);
+            resampled[channel].resize ((int)numOutputSamples);
+
+            for (size_t i = 0; i < numOutputSamples; i++)
+                resampled[channel][(int)i] = state.output[i] * gain;
+        }
+
+        audioFile.setAudioBuffer (resampled);
+        audioFile.setSampleRate (outputRate);
+    }
+    else if (gain != 1.f)
+    {
+        for (int channel = 0; channel < numChannels; channel++)
+            for (int i = 0; i < numSamples; i++)
+                audioFile.samples[channel][i] *= gain;
+    }
+
+    if (settings.bitDepth != 0)
+        audioFile.setBitDepth (settings.bitDepth);
+
+    // encode
+    std::string outputPath = getOutputPath (settings, inputPath);
+
+    if (! audioFile.save (outputPath.c_str()))
+        return result;
+
+    // the peaks describe the output, so they are built from the processed samples rather than while decoding
+    if (settings.writePeaks)
+    {
+        numChannels = audioFile.getNumChannels();
+        numSamples = audioFile.getNumSamplesPerChannel();
+        float frame[2];
+
+        state.peaks.begin (audioFile.getSampleRate(), numChannels);
+
+        for (int i = 0; i < numSamples; i++)
+        {
+            for (int channel = 0; channel < numChannels; channel++)
+                frame[channel] = audioFile.samples[channel][i];
+
+            state.peaks.processFrame (frame);
+        }
+
+        state.peaks.end();
+
+        if (! state.peaks.save (outputPath.c_str()))
+            return result;
+    }
+
+    result.bytesOut = getFileSize (outputPath);
+    result.seconds = secondsSince (start);
+    result.ok = true;
+    return result;
+}
+
+//=============================================================
+static void printUsage()
+{
+    fprintf (stderr, "usage: transcode [--rate <hz>] [--bits <8|16|24>] [--loudness <lufs>] [--threads <n>] [--peaks] --out <dir> <file.wav|file.flac|file.mp3>...\n");
+}
+
+//=============================================================
+static bool parseArguments (int argc, char** argv, TranscodeSettings& settings)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--rate" && hasValue)
+            settings.sampleRate = (uint32_t)atol (argv[++i]);
+        else if (argument == "--bits" && hasValue)
+            settings.bitDepth = atoi (argv[++i]);
+        else if (argument == "--loudness" && hasValue)
+        {
+            settings.normalise = true;
+            settings.targetLoudness = atof (argv[++i]);
+        }
+        else if (argument == "--threads" && hasValue)
+            settings.numThreads = atoi (argv[++i]);
+        else if (argument == "--peaks")
+            settings.writePeaks = true;
+        else if (argument == "--out" && hasValue)
+            settings.outputDirectory = argv[++i];
+        else if (argument.size() > 1 && argument[0] == '-')
+            return false;
+        else
+            settings.inputFiles.push_back (argument);
+    }
+
+    if (settings.bitDepth != 0 && settings.bitDepth != 8 && settings.bitDepth != 16 && settings.bitDepth != 24)
+        return false;
+
+    return ! settings.outputDirectory.empty() && ! settings.inputFiles.empty();
+}
+
+//=============================================================
+int main (int argc, char** argv)
+{
+    TranscodeSettings settings;
+
+    if (! parseArguments (argc, argv, settings))
+    {
+        printUsage();
+        return 1;
+    }
+
+    mkdir (settings.outputDirectory.c_str(), 0755);
+
+    ThreadPool pool (settings.numThreads);
+    std::vector<WorkerState> workerStates ((size_t)pool.getNumThreads());
+    std::vector<FileResult> results (settings.inputFiles.size());
+    std::mutex printLock;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < settings.inputFiles.size(); i++)
+    {
+        pool.addJob ([&, i] (int workerIndex)
+        {
+            const std::string& path = settings.inputFiles[i];
+            results[i] = transcodeFile (settings, path, workerStates[(size_t)workerIndex]);
+
+            std::lock_guard<std::mutex> guard (printLock);
+            const FileResult& result = results[i];
+
+            if (result.ok)
+                printf ("%-40s %8.2f s audio %8.1f ms %8.2f MB/s %8.1fx realtime\n", path.c_str(), result.audioSeconds,
+                        result.seconds * 1000., (double)result.bytesIn / 1.e6 / result.seconds, result.audioSeconds / result.seconds);
+            else
+                printf ("%-40s FAILED\n", path.c_str());
+        });
+    }
+
+    pool.waitForAll();
+    double wallTime = secondsSince (start);
+
+    int numOk = 0;
+    uint64_t totalBytes = 0;
+    double totalAudio = 0.;
+    double totalBusy = 0.;
+
+    for (const auto& result : results)
+    {
+        if (! result.ok)
+            continue;
+
+        numOk++;
+        totalBytes += result.bytesIn;
+        totalAudio += result.audioSeconds;
+        totalBusy += result.seconds;
+    }
+
+    printf ("\n%d of %d files, %d threads, %.2f s wall\n", numOk, (int)results.size(), pool.getNumThreads(), wallTime);
+    printf ("%.2f MB/s, %.1fx realtime, %.2f parallel speedup\n", (double)totalBytes / 1.e6 / wallTime, totalAudio / wallTime, totalBusy / wallTime);
+
+    return numOk == (int)results.size() ? 0 : 1;
+}
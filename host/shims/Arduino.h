@@ -0,0 +1,136 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+/** Host build stand-ins for the parts of the Arduino core this library uses:
+ * String, Serial, micros(), millis() and PROGMEM. They behave like the real ones as far
+ * as the library can tell, so code compiled against them runs unchanged on a
+ * desktop machine for benchmarking and tooling.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+//=============================================================
+/** Arduino's String, backed by std::string. Like the real one it can hold
+ * binary data (including zero bytes) when built up with concat().
+ */
+class String
+{
+public:
+    String() {}
+    String (const char* s) : text (s != nullptr ? s : "") {}
+    String (const std::string& s) : text (s) {}
+    explicit String (char c) : text (1, c) {}
+    String (int value) : text (std::to_string (value)) {}
+    String (unsigned int value) : text (std::to_string (value)) {}
+    String (long value) : text (std::to_string (value)) {}
+    String (unsigned long value) : text (std::to_string (value)) {}
+    String (long long value) : text (std::to_string (value)) {}
+    String (unsigned long long value) : text (std::to_string (value)) {}
+    String (double value, unsigned int decimalPlaces = 2) : text (formatDouble (value, decimalPlaces)) {}
+
+    unsigned int length() const { return (unsigned int)text.size(); }
+    const char* c_str() const { return text.c_str(); }
+    char charAt (unsigned int index) const { return index < text.size() ? text[index] : 0; }
+    char operator [] (unsigned int index) const { return charAt (index); }
+    char& operator [] (unsigned int index) { return text[index]; }
+
+    bool concat (const String& s) { text += s.text; return true; }
+    bool concat (const char* s, unsigned int length) { text.append (s, length); return true; }
+    bool concat (char c) { text += c; return true; }
+    String& operator += (const String& s) { text += s.text; return *this; }
+    String& operator += (const char* s) { text += s; return *this; }
+    String& operator += (char c) { text += c; return *this; }
+
+    bool equals (const String& s) const { return text == s.text; }
+    bool operator == (const String& s) const { return text == s.text; }
+    bool operator == (const char* s) const { return text == s; }
+    bool operator != (const String& s) const { return text != s.text; }
+    bool operator != (const char* s) const { return text != s; }
+    bool operator < (const String& s) const { return text < s.text; }
+
+    bool startsWith (const String& s) const { return text.compare (0, s.text.size(), s.text) == 0; }
+    bool endsWith (const String& s) const { return text.size() >= s.text.size() && text.compare (text.size() - s.text.size(), s.text.size(), s.text) == 0; }
+    int indexOf (char c, unsigned int from = 0) const { size_t i = text.find (c, from); return i == std::string::npos ? -1 : (int)i; }
+    int indexOf (const String& s, unsigned int from = 0) const { size_t i = text.find (s.text, from); return i == std::string::npos ? -1 : (int)i; }
+    int lastIndexOf (char c) const { size_t i = text.rfind (c); return i == std::string::npos ? -1 : (int)i; }
+    String substring (unsigned int from) const { return from < text.size() ? String (text.substr (from)) : String(); }
+    String substring (unsigned int from, unsigned int to) const { return from < to && from < text.size() ? String (text.substr (from, to - from)) : String(); }
+    long toInt() const { return atol (text.c_str()); }
+    float toFloat() const { return (float)atof (text.c_str()); }
+
+    friend String operator + (const String& a, const String& b) { return String (a.text + b.text); }
+    friend String operator + (const String& a, const char* b) { return String (a.text + b); }
+    friend String operator + (const char* a, const String& b) { return String (a + b.text); }
+
+private:
+    static std::string formatDouble (double value, unsigned int decimalPlaces)
+    {
+        char buffer[64];
+        snprintf (buffer, sizeof (buffer), "%.*f", (int)decimalPlaces, value);
+        return buffer;
+    }
+
+    std::string text;
+};
+
+//=============================================================
+/** Serial, printing to stdout */
+class HardwareSerial
+{
+public:
+    void begin (unsigned long) {}
+    explicit operator bool() const { return true; }
+
+    size_t print (const String& s) { return fwrite (s.c_str(), 1, s.length(), stdout); }
+    size_t print (const char* s) { return print (String (s)); }
+    size_t print (char c) { return print (String (c)); }
+    size_t print (int value) { return print (String (value)); }
+    size_t print (unsigned int value) { return print (String (value)); }
+    size_t print (long value) { return print (String (value)); }
+    size_t print (unsigned long value) { return print (String (value)); }
+    size_t print (double value, int decimalPlaces = 2) { return print (String (value, (unsigned int)decimalPlaces)); }
+
+    size_t println() { return print ("\n"); }
+    template <class Value>
+    size_t println (const Value& value) { return print (value) + println(); }
+    size_t println (double value, int decimalPlaces) { return print (value, decimalPlaces) + println(); }
+};
+
+static HardwareSerial Serial;
+
+//=============================================================
+inline unsigned long micros()
+{
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+inline void delay (unsigned long milliseconds)
+{
+    std::this_thread::sleep_for (std::chrono::milliseconds (milliseconds));
+}
+
+inline void delayMicroseconds (unsigned int microseconds)
+{
+    std::this_thread::sleep_for (std::chrono::microseconds (microseconds));
+}
+
+//=============================================================
+/** Flash is ordinary memory on a desktop, as it is on ARM and ESP32 boards */
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef SD_h
+#define SD_h
+
+/** Host build stand-in for the Arduino SD library. Paths are ordinary paths
+ * on the host file system and File wraps a stdio FILE. As on the device, a
+ * File is a cheap handle that can be copied, and FILE_WRITE opens for
+ * appending (creating the file if needed), so callers that want to replace a
+ * file remove it first.
+ */
+
+#include "Arduino.h"
+#include <memory>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+ #include <fcntl.h>
+#endif
+
+#define FILE_READ  0
+#define FILE_WRITE 1
+
+//=============================================================
+class File
+{
+public:
+    File() {}
+
+    File (FILE* file, const char* path)
+        : handle (file, [] (FILE* f) { if (f != nullptr) fclose (f); }), filePath (path) {}
+
+    explicit operator bool() const { return handle != nullptr; }
+
+    int read (void* buffer, size_t numBytes)
+    {
+        return handle ? (int)fread (buffer, 1, numBytes, handle.get()) : -1;
+    }
+
+    int read()
+    {
+        uint8_t byte;
+        return read (&byte, 1) == 1 ? (int)byte : -1;
+    }
+
+    int peek()
+    {
+        int byte = read();
+
+        if (byte >= 0)
+            fseek (handle.get(), -1, SEEK_CUR);
+
+        return byte;
+    }
+
+    size_t write (const uint8_t* buffer, size_t numBytes)
+    {
+        return handle ? fwrite (buffer, 1, numBytes, handle.get()) : 0;
+    }
+
+    size_t write (uint8_t byte)
+    {
+        return write (&byte, 1);
+    }
+
+    bool seek (uint32_t position)
+    {
+        return handle && fseek (handle.get(), (long)position, SEEK_SET) == 0;
+    }
+
+    uint32_t position() const
+    {
+        return handle ? (uint32_t)ftell (handle.get()) : 0;
+    }
+
+    uint32_t size() const
+    {
+        struct stat info;
+
+        if (! handle)
+            return 0;
+
+        fflush (handle.get());
+        return fstat (fileno (handle.get()), &info) == 0 ? (uint32_t)info.st_size : 0;
+    }
+
+    int available() const
+    {
+        return (int)(size() - position());
+    }
+
+    /** Like SdFat's preAllocate(): reserves space for the file on disk without changing its size */
+    bool preAllocate (uint32_t numBytes)
+    {
+#ifdef __linux__
+        return handle && fallocate (fileno (handle.get()), FALLOC_FL_KEEP_SIZE, 0, (off_t)numBytes) == 0;
+#else
+        return false;
+#endif
+    }
+
+    /** Like the ESP32 FS library's getLastWrite(): the modification time in seconds since 1970 */
+    time_t getLastWrite() const
+    {
+        struct stat info;
+        return handle && fstat (fileno (handle.get()), &info) == 0 ? info.st_mtime : 0;
+    }
+
+    void flush()
+    {
+        if (handle)
+            fflush (handle.get());
+    }
+
+    void close()
+    {
+        handle.reset();
+    }
+
+    const char* name() const
+    {
+        return filePath.c_str();
+    }
+
+private:
+    std::shared_ptr<FILE> handle;
+    std::string filePath;
+};
+
+//=============================================================
+class SDClass
+{
+public:
+    bool begin (uint8_t = 0) { return true; }
+
+    File open (const char* path, uint8_t mode = FILE_READ)
+    {
+        if (mode == FILE_READ)
+            return File (fopen (path, "rb"), path);
+
+        FILE* file = fopen (path, "r+b");
+
+        if (file == nullptr)
+            file = fopen (path, "w+b");
+
+        if (file != nullptr)
+            fseek (file, 0, SEEK_END);
+
+        return File (file, path);
+    }
+
+    File open (const String& path, uint8_t mode = FILE_READ)
+    {
+        return open (path.c_str(), mode);
+    }
+
+    bool exists (const char* path)
+    {
+        struct stat info;
+        return stat (path, &info) == 0;
+    }
+
+    bool remove (const char* path)
+    {
+        return ::remove (path) == 0;
+    }
+
+    bool mkdir (const char* path)
+    {
+        return ::mkdir (path, 0755) == 0;
+    }
+};
+
+static SDClass SD;
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef TimerOne_h
+#define TimerOne_h
+
+/** Host build stand-in for the TimerOne library: attachInterrupt() calls a function
+ * every period, as the timer's interrupt would, from a thread of its own. It is
+ * how code that records from an interrupt (see WavRecorder) is exercised on a
+ * desktop machine. The thread sleeps until each tick is due; ticks it wakes too
+ * late for are delivered back to back rather than dropped, as a DMA engine would
+ * keep filling its buffers while the CPU was busy.
+ */
+
+#include "Arduino.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+//=============================================================
+class TimerOne
+{
+public:
+    ~TimerOne() { stop(); }
+
+    /** Sets the period, in microseconds */
+    void initialize (unsigned long microseconds = 1000000) { setPeriod (microseconds); }
+
+    void setPeriod (unsigned long microseconds) { periodMicros = microseconds > 0 ? microseconds : 1; }
+
+    /** Starts calling isr every period */
+    void attachInterrupt (void (*isr)())
+    {
+        stop();
+        interrupt = isr;
+        start();
+    }
+
+    void attachInterrupt (void (*isr)(), unsigned long microseconds)
+    {
+        setPeriod (microseconds);
+        attachInterrupt (isr);
+    }
+
+    /** Stops calling the interrupt. Once this returns it isn't running any more */
+    void detachInterrupt()
+    {
+        stop();
+        interrupt = nullptr;
+    }
+
+    void start()
+    {
+        if (interrupt == nullptr || thread.joinable())
+            return;
+
+        running = true;
+        thread = std::thread ([this]
+        {
+            auto period = std::chrono::microseconds (periodMicros);
+            auto nextTick = std::chrono::steady_clock::now() + period;
+
+            while (running)
+            {
+                std::this_thread::sleep_until (nextTick);
+
+                while (running && std::chrono::steady_clock::now() >= nextTick)
+                {
+                    interrupt();
+                    nextTick += period;
+                }
+            }
+        });
+    }
+
+    void stop()
+    {
+        running = false;
+
+        if (thread.joinable())
+            thread.join();
+    }
+
+private:
+    void (*interrupt)() = nullptr;
+    unsigned long periodMicros = 1000000;
+    std::atomic<bool> running { false };
+    std::thread thread;
+};
+
+static TimerOne Timer1;
+
+#endif
@@ -0,0 +1,433 @@
+#ifndef AdpcmBuffer_h
+#define AdpcmBuffer_h
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "BlockCache.h"
+#include "DynamicArray.h"
+
+/** A sample buffer that keeps audio in RAM as 4 bit IMA ADPCM.
+ *
+ * Each channel is stored in blocks of BlockFrames samples. A block starts with
+ * the predictor and step index the encoder had reached (4 bytes) followed by one
+ * 4 bit code per sample, so any block can be decoded on its own. A sample takes
+ * half a byte plus a little for the block headers: about a seventh of a float and
+ * a quarter of an int16_t, at the cost of some noise (IMA ADPCM is roughly as good
+ * as 12 bit PCM on music).
+ *
+ * Samples are indexed as they are in an AudioFile:
+ *
+ *      buffer[channel][sampleIndex]
+ *
+ * and read like those of a LazySampleBuffer: the first access to a sample decodes
+ * the block around it, for every channel, into one of NumCachedBlocks cache slots,
+ * and later reads of that block come straight from the cache until its slot is
+ * needed for another block. Playing through the buffer therefore decodes each
+ * block once, and a jump to any position costs one block.
+ *
+ * The buffer is filled by appending samples to the end of each channel with
+ * appendSamples(); samples that have been stored can't be changed.
+ *
+ * AudioFile uses it as its sample buffer with AdpcmAllocation (see Allocation.h).
+ */
+
+namespace AdpcmHelpers
+{
+    static const int16_t stepSizes[89] PROGMEM = {
+            7,     8,     9,    10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,
+           31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+          130,   143,   157,   173,   190,   209,   230,   253,   279,   307,   337,   371,   408,   449,   494,
+          544,   598,   658,   724,   796,   876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+         2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,
+         9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+
+    static const int8_t stepIndexChanges[16] PROGMEM = {
+        -1, -1, -1, -1, 2, 4, 6, 8,
+        -1, -1, -1, -1, 2, 4, 6, 8
+    };
+
+    /** What the encoder and decoder track from one sample to the next */
+    struct State
+    {
+        int32_t predictor;
+        int stepIndex;
+    };
+
+    /** Applies a 4 bit code to the state, as the decoder does. @Returns the new sample */
+    inline int16_t decodeSample (State& state, int code)
+    {
+        int32_t step = (int16_t) pgm_read_word (stepSizes + state.stepIndex);
+        int32_t difference = step >> 3;
+
+        if (code & 4)
+            difference += step;
+
+        if (code & 2)
+            difference += step >> 1;
+
+        if (code & 1)
+            difference += step >> 2;
+
+        state.predictor += (code & 8) ? -difference : difference;
+        state.predictor = state.predictor > 32767 ? 32767 : (state.predictor < -32768 ? -32768 : state.predictor);
+
+        state.stepIndex += (int8_t) pgm_read_byte (stepIndexChanges + code);
+        state.stepIndex = state.stepIndex > 88 ? 88 : (state.stepIndex < 0 ? 0 : state.stepIndex);
+
+        return (int16_t) state.predictor;
+    }
+
+    /** @Returns the 4 bit code that brings the decoder closest to a sample, updating the state
+     * as decodeSample() will, so the encoder and decoder never drift apart
+     */
+    inline int encodeSample (State& state, int16_t sample)
+    {
+        int32_t step = (int16_t) pgm_read_word (stepSizes + state.stepIndex);
+        int32_t difference = (int32_t) sample - state.predictor;
+        int code = 0;
+
+        if (difference < 0)
+        {
+            code = 8;
+            difference = -difference;
+        }
+
+        for (int bit = 4; bit > 0; bit >>= 1)
+        {
+            if (difference >= step)
+            {
+                code |= bit;
+                difference -= step;
+            }
+
+            step >>= 1;
+        }
+
+        decodeSample (state, code);
+        return code;
+    }
+
+    /** Samples are coded as 16 bit: Q15 for floating point samples, as is for int16_t ones */
+    template <class T>
+    inline int16_t toInt16 (T sample)
+    {
+        double scaled = (double) sample * 32768.;
+        return (int16_t)(scaled >= 32767. ? 32767 : (scaled <= -32768. ? -32768 : lround (scaled)));
+    }
+
+    template <>
+    inline int16_t toInt16<int16_t> (int16_t sample)
+    {
+        return sample;
+    }
+
+    template <class T>
+    inline T fromInt16 (int16_t sample)
+    {
+        return static_cast<T> (sample) / static_cast<T> (32768.);
+    }
+
+    template <>
+    inline int16_t fromInt16<int16_t> (int16_t sample)
+    {
+        return sample;
+    }
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+class AdpcmSampleBuffer
+{
+public:
+
+    static_assert (BlockFrames > 0 && BlockFrames % 2 == 0, "AdpcmSampleBuffer blocks must hold an even number of frames");
+    static_assert (NumCachedBlocks > 0 && MaxChannels > 0, "AdpcmSampleBuffer sizes must be positive");
+
+    /** The bytes that one block of one channel takes: the encoder state, then a 4 bit code per sample */
+    static const int bytesPerBlock = 4 + BlockFrames / 2;
+
+    /** One channel of the buffer, read with [] */
+    class Channel
+    {
+    public:
+        Channel (const AdpcmSampleBuffer& buffer_, int channel_) : buffer (buffer_), channel (channel_) {}
+
+        /** @Returns a sample, decoding its block first if it isn't cached */
+        T operator [] (int index) const { return buffer.getSample (channel, index); }
+
+        /** @Returns the number of samples in the channel */
+        int size() const { return buffer.channelLengths[channel]; }
+
+    private:
+        const AdpcmSampleBuffer& buffer;
+        int channel;
+    };
+
+    /** Constructor. The buffer starts empty */
+    AdpcmSampleBuffer();
+
+    /** @Returns the number of channels */
+    int size() const;
+
+    /** @Returns one channel */
+    Channel operator [] (int channel) const;
+
+    /** Empties the buffer and leaves it with a number of channels and no samples */
+    void resize (int numChannels);
+
+    /** Empties the buffer and leaves it with no channels */
+    void clear();
+
+    /** Makes room for this many samples on every channel, so appending them doesn't reallocate */
+    void reserve (int numSamples);
+
+    /** Encodes samples onto the end of a channel.
+     * @Returns false if memory ran out, in which case the samples that fitted are kept
+     */
+    bool appendSamples (int channel, const T* source, int numSamples);
+
+    /** @Returns the samples of one block of a channel, decoding the block if it isn't cached,
+     * or nullptr if the block is past the end. Block i holds samples i * BlockFrames onwards.
+     */
+    const T* getBlock (int channel, int blockIndex) const;
+
+    //=============================================================
+    /** @Returns the bytes of encoded audio held for all channels */
+    uint32_t getNumEncodedBytes() const;
+
+    /** @Returns the number of blocks decoded since the buffer was last emptied */
+    uint32_t getNumBlocksDecoded() const;
+
+    /** @Returns the number of sample and block reads that found their block cached */
+    uint32_t getNumCacheHits() const;
+
+private:
+
+    //=============================================================
+    T getSample (int channel, int index) const;
+    const T* getSlot (int blockIndex) const;
+
+    //=============================================================
+    DynamicArray<uint8_t> channelData[MaxChannels];
+    AdpcmHelpers::State encoders[MaxChannels];
+    int channelLengths[MaxChannels];
+    int numChannels;
+    mutable BlockCache<T, MaxChannels * BlockFrames, NumCachedBlocks> cache;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::AdpcmSampleBuffer()
+{
+    resize (0);
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+int AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::size() const
+{
+    return numChannels;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+typename AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::Channel
+AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::operator [] (int channel) const
+{
+    return Channel (*this, channel);
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+void AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::resize (int newNumChannels)
+{
+    numChannels = newNumChannels < 0 ? 0 : (newNumChannels > MaxChannels ? MaxChannels : newNumChannels);
+
+    for (int c = 0; c < MaxChannels; c++)
+    {
+        channelData[c].clear();
+        encoders[c].predictor = 0;
+        encoders[c].stepIndex = 0;
+        channelLengths[c] = 0;
+    }
+
+    cache.clear();
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+void AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::clear()
+{
+    resize (0);
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+void AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::reserve (int numSamples)
+{
+    if (numSamples <= 0)
+        return;
+
+    // rounded up without adding to numSamples, which may be close to the largest int
+    int numBlocks = numSamples / BlockFrames + (numSamples % BlockFrames != 0 ? 1 : 0);
+
+    for (int c = 0; c < numChannels; c++)
+        channelData[c].reserve (numBlocks * bytesPerBlock);
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+bool AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::appendSamples (int channel, const T* source, int numSamples)
+{
+    if (channel < 0 || channel >= numChannels || numSamples <= 0)
+        return true;
+
+    DynamicArray<uint8_t>& data = channelData[channel];
+    AdpcmHelpers::State& encoder = encoders[channel];
+    int position = channelLengths[channel];
+
+    // cached copies of the blocks being added to would be missing the new samples
+    cache.forgetFrom (position / BlockFrames);
+
+    for (int i = 0; i < numSamples; i++, position++)
+    {
+        int blockIndex = position / BlockFrames;
+        int blockPosition = position - blockIndex * BlockFrames;
+        uint8_t* block;
+
+        if (blockPosition == 0)
+        {
+            // whole blocks are added at once, their codes zeroed, so each code is ORed into place;
+            // without a reserve() first, the storage grows geometrically
+            int numBytes = (blockIndex + 1) * bytesPerBlock;
+
+            if (data.getCapacity() < numBytes)
+                data.reserve (2 * numBytes);
+
+            data.resize (numBytes);
+
+            if (data.size() != numBytes)
+            {
+                channelLengths[channel] = position;
+                return false;
+            }
+
+            block = data.getData() + blockIndex * bytesPerBlock;
+
+            block[0] = (uint8_t)(encoder.predictor & 0xFF);
+            block[1] = (uint8_t)((encoder.predictor >> 8) & 0xFF);
+            block[2] = (uint8_t) encoder.stepIndex;
+            block[3] = 0;
+        }
+        else
+        {
+            block = data.getData() + blockIndex * bytesPerBlock;
+        }
+
+        int code = AdpcmHelpers::encodeSample (encoder, AdpcmHelpers::toInt16<T> (source[i]));
+        block[4 + blockPosition / 2] |= (uint8_t)(code << (4 * (blockPosition & 1)));
+    }
+
+    channelLengths[channel] = position;
+    return true;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+const T* AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getBlock (int channel, int blockIndex) const
+{
+    if (channel < 0 || channel >= numChannels || blockIndex < 0 || blockIndex * BlockFrames >= channelLengths[channel])
+        return nullptr;
+
+    return getSlot (blockIndex) + channel * BlockFrames;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+uint32_t AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getNumEncodedBytes() const
+{
+    uint32_t numBytes = 0;
+
+    for (int c = 0; c < numChannels; c++)
+        numBytes += (uint32_t) channelData[c].size();
+
+    return numBytes;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+uint32_t AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getNumBlocksDecoded() const
+{
+    return cache.getNumClaims();
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+uint32_t AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getNumCacheHits() const
+{
+    return cache.getNumHits();
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+T AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getSample (int channel, int index) const
+{
+    if (index < 0 || index >= channelLengths[channel])
+        return T();
+
+    int blockIndex = index / BlockFrames;
+    return getSlot (blockIndex)[channel * BlockFrames + index - blockIndex * BlockFrames];
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+const T* AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getSlot (int blockIndex) const
+{
+    T* slot = cache.find (blockIndex);
+
+    if (slot != nullptr)
+        return slot;
+
+    // decode the block of every channel into the least recently used slot
+    slot = cache.claim (blockIndex);
+
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        T* destination = slot + channel * BlockFrames;
+        int numBlockSamples = channelLengths[channel] - blockIndex * BlockFrames;
+
+        if (numBlockSamples > BlockFrames)
+            numBlockSamples = BlockFrames;
+
+        if (numBlockSamples <= 0)
+        {
+            for (int i = 0; i < BlockFrames; i++)
+                destination[i] = T();
+
+            continue;
+        }
+
+        const uint8_t* block = channelData[channel].getData() + blockIndex * bytesPerBlock;
+
+        AdpcmHelpers::State decoder;
+        decoder.predictor = (int16_t)(block[0] | (block[1] << 8));
+        decoder.stepIndex = block[2] > 88 ? 88 : block[2];
+
+        for (int i = 0; i < numBlockSamples; i++)
+        {
+            int code = (block[4 + i / 2] >> (4 * (i & 1))) & 0x0F;
+            destination[i] = AdpcmHelpers::fromInt16<T> (AdpcmHelpers::decodeSample (decoder, code));
+        }
+    }
+
+    return slot;
+}
+
+#endif /* AdpcmBuffer_h */
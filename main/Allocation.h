@@ -0,0 +1,178 @@
+#ifndef Allocation_h
+#define Allocation_h
+
+#include <stdint.h>
+#include "AdpcmBuffer.h"
+#include "DynamicArray.h"
+#include "FixedArray.h"
+#include "LazyBuffer.h"
+#include "SharedBuffer.h"
+
+/** Allocation policies for AudioFile, chosen with its second template argument.
+ *
+ * DynamicAllocation (the default) keeps samples in heap arrays that grow to fit
+ * whatever file is loaded, and load() reads the whole file into memory first.
+ *
+ * StaticAllocation sizes everything at compile time and never touches the heap.
+ * Samples live inside the AudioFile object, and load() and save() stream the
+ * file through a block of BlockFrames frames on the stack:
+ *
+ *      // up to 2 seconds of 22.05 kHz mono, streamed in 64 frame blocks
+ *      static AudioFile<float, StaticAllocation<1, 44100, 64>> clip;
+ *
+ * Files with more channels or frames than the policy allows fail to load, and so do
+ * FLAC and MP3 files, whose decoders live on the heap: stream those with FlacDecoder
+ * or Mp3Decoder.
+ *
+ * LazyAllocation doesn't decode anything in load(): it reads the header and
+ * leaves samples as a read-only view of the file (a LazySampleBuffer), which
+ * decodes blocks of BlockFrames frames as they are first read and keeps the
+ * last NumCachedBlocks of them:
+ *
+ *      // opens in the time it takes to read the header, whatever the length
+ *      AudioFile<float, LazyAllocation<>> preview;
+ *
+ * Its samples can be read (samples[channel][index]) and saved to another file,
+ * but not changed, and an analysis sink is not fed because nothing is decoded
+ * up front. The file stays open while it is viewed, so it can't be saved over.
+ *
+ * SharedAllocation is DynamicAllocation with copy-on-write samples (a SharedBuffer):
+ * copying an AudioFile shares its samples until one of the copies changes them.
+ *
+ *      AudioFile<float, SharedAllocation> voices[4];
+ *      for (int i = 1; i < 4; i++) voices[i] = voices[0];   // one set of samples in RAM
+ *
+ * AdpcmAllocation keeps samples in RAM as 4 bit IMA ADPCM (an AdpcmSampleBuffer),
+ * about a seventh of the space of floats. load() decodes the file a block at a time
+ * and encodes each block as it arrives; reads decode blocks of BlockFrames frames
+ * into a cache of NumCachedBlocks of them, as with LazyAllocation:
+ *
+ *      // 30 seconds of 44.1 kHz stereo in about 1.4 MB instead of 10.6 MB
+ *      AudioFile<float, AdpcmAllocation<>> music;
+ *
+ * As with LazyAllocation the samples can be read and saved but not changed.
+ */
+
+//=============================================================
+/** Tags saying whether an allocation policy decodes every sample in load(), on access,
+ * or in load() into a compressed form that is decoded again on access
+ */
+struct DecodeOnLoad {};
+struct DecodeOnAccess {};
+struct CompressOnLoad {};
+
+//=============================================================
+/** The RAM the static buffers of an AudioFile may use, in bytes. Defaults to all of
+ * the RAM on AVR boards and to no limit elsewhere; define it to set your own.
+ */
+#ifndef AUDIOFILE_RAM_BUDGET
+ #if defined (RAMEND) && defined (RAMSTART)
+  #define AUDIOFILE_RAM_BUDGET (RAMEND - RAMSTART + 1)
+ #else
+  #define AUDIOFILE_RAM_BUDGET 0xFFFFFFFFUL
+ #endif
+#endif
+
+//=============================================================
+struct DynamicAllocation
+{
+    static const bool isStatic = false;
+    typedef DecodeOnLoad Decoding;
+    static const int maxChannels = 0x7FFFFFFF;
+    static const int maxFrames = 0x7FFFFFFF;
+    static const int blockFrames = 1024;
+    static const int blockBytes = 4096;
+
+    template <class T>
+    struct Buffer
+    {
+        typedef DynamicArray<DynamicArray<T>> Type;
+    };
+};
+
+//=============================================================
+struct SharedAllocation
+{
+    static const bool isStatic = false;
+    typedef DecodeOnLoad Decoding;
+    static const int maxChannels = 0x7FFFFFFF;
+    static const int maxFrames = 0x7FFFFFFF;
+    static const int blockFrames = 1024;
+    static const int blockBytes = 4096;
+
+    template <class T>
+    struct Buffer
+    {
+        typedef SharedBuffer<T> Type;
+    };
+};
+
+//=============================================================
+template <int MaxChannels, int MaxFrames, int BlockFrames = 64>
+struct StaticAllocation
+{
+    static_assert (MaxChannels > 0 && MaxFrames > 0 && BlockFrames > 0, "StaticAllocation sizes must be positive");
+
+    static const bool isStatic = true;
+    typedef DecodeOnLoad Decoding;
+    static const int maxChannels = MaxChannels;
+    static const int maxFrames = MaxFrames;
+    static const int blockFrames = BlockFrames;
+    static const int blockBytes = BlockFrames * MaxChannels * 3;    // room for 24 bit samples
+
+    template <class T>
+    struct Buffer
+    {
+        typedef FixedArray<FixedArray<T, MaxFrames>, MaxChannels> Type;
+    };
+};
+
+//=============================================================
+template <int BlockFrames = 256, int NumCachedBlocks = 8, int MaxChannels = 2>
+struct LazyAllocation
+{
+    static const bool isStatic = false;
+    typedef DecodeOnAccess Decoding;
+    static const int maxChannels = MaxChannels;
+    static const int blockFrames = BlockFrames;
+    static const int blockBytes = BlockFrames * MaxChannels * 3;
+
+    template <class T>
+    struct Buffer
+    {
+        typedef LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels> Type;
+    };
+};
+
+//=============================================================
+template <int BlockFrames = 256, int NumCachedBlocks = 2, int MaxChannels = 2>
+struct AdpcmAllocation
+{
+    static const bool isStatic = false;
+    typedef CompressOnLoad Decoding;
+    static const int maxChannels = MaxChannels;
+    static const int maxFrames = 0x7FFFFFFF;
+    static const int blockFrames = BlockFrames;
+    static const int blockBytes = BlockFrames * MaxChannels * 3;
+
+    template <class T>
+    struct Buffer
+    {
+        typedef AdpcmSampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels> Type;
+    };
+};
+
+//=============================================================
+/** Fails to compile when an AudioFile's static buffers don't fit the RAM budget.
+ * The compiler's error names this template, so its arguments show the footprint
+ * and the budget in bytes, e.g. CheckRamBudget<90184, 2048>.
+ */
+template <unsigned long Footprint, unsigned long Budget>
+struct CheckRamBudget
+{
+    static_assert (Footprint <= Budget, "AudioFile's static buffers exceed AUDIOFILE_RAM_BUDGET "
+                                        "(the footprint and budget in bytes are the arguments of CheckRamBudget)");
+    static const unsigned long footprint = Footprint;
+};
+
+#endif /* Allocation_h */
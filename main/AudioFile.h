@@ -1,5 +1,42 @@
+#ifndef AudioFile_h
+#define AudioFile_h
+
+#include <Arduino.h>
+
+/** The FLAC and MP3 decoders (and the MP3 tables) add tens of KB of flash to a sketch
+ * that only reads WAV files, so on Arduino they are left out unless one of these is
+ * defined as 1 before AudioFile.h is included. Without them load() fails on that format.
+ */
+#ifndef AUDIOFILE_WITH_FLAC
+ #ifdef ARDUINO
+  #define AUDIOFILE_WITH_FLAC 0
+ #else
+  #define AUDIOFILE_WITH_FLAC 1
+ #endif
+#endif
+
+#ifndef AUDIOFILE_WITH_MP3
+ #ifdef ARDUINO
+  #define AUDIOFILE_WITH_MP3 0
+ #else
+  #define AUDIOFILE_WITH_MP3 1
+ #endif
+#endif
+
 #include "LinkedList.h"
-#include "Util.h"
+#include "DynamicArray.h"
+#include "Allocation.h"
+#include "LevelAnalysis.h"
+#include "WaveFormat.h"
+#if AUDIOFILE_WITH_FLAC
+#include "FlacDecoder.h"
+#endif
+#if AUDIOFILE_WITH_MP3
+#include "Mp3Decoder.h"
+#endif
+#include "BufferedWriter.h"
+#include "ThreadPool.h"
+#include "Profiling.h"
 
 /** The different types of audio file, plus some other types to 
  * indicate a failure to load a file, or that one hasn't been
@@ -10,35 +47,122 @@ enum class AudioFileFormat
     Error,
     NotLoaded,
     Wave,
-    Aiff
+    Aiff,
+    Flac,
+    Mp3
+};
+
+//=============================================================
+/** An immutable description of an audio file's format, as returned by
+ * AudioFile::probe(). It is filled from the file's headers alone, without
+ * decoding (or even reading) any samples.
+ */
+class AudioFileInfo
+{
+public:
+    
+    /** Constructs an invalid descriptor, for files that couldn't be probed */
+    AudioFileInfo();
+    
+    /** Constructs a descriptor for a WAV file from its fmt and data chunk fields */
+    explicit AudioFileInfo (const WaveFormat& waveFormat);
+    
+#if AUDIOFILE_WITH_FLAC
+    /** Constructs a descriptor for a FLAC file from its STREAMINFO */
+    explicit AudioFileInfo (const FlacStreamInfo& streamInfo);
+#endif
+    
+#if AUDIOFILE_WITH_MP3
+    /** Constructs a descriptor for an MP3 file from its first frames */
+    explicit AudioFileInfo (const Mp3StreamInfo& streamInfo);
+#endif
+    
+    /** @Returns true if the file was found and has a format this library can decode */
+    bool isValid() const;
+    
+    /** @Returns the type of the file, or AudioFileFormat::Error if it couldn't be probed */
+    AudioFileFormat getFileFormat() const;
+    
+    /** @Returns the sample rate */
+    uint32_t getSampleRate() const;
+    
+    /** @Returns the number of audio channels */
+    int getNumChannels() const;
+    
+    /** @Returns the bit depth of each sample */
+    int getBitDepth() const;
+    
+    /** @Returns the number of samples per channel */
+    int getNumSamplesPerChannel() const;
+    
+    /** @Returns the length in seconds of the audio file based on the number of samples and sample rate */
+    double getLengthInSeconds() const;
+    
+    /** @Returns the fmt and data chunk fields of a WAV file. For a FLAC or MP3 file these
+     * describe the PCM it decodes to, and dataOffset is the offset of its first block.
+     */
+    const WaveFormat& getWaveFormat() const;
+    
+private:
+    
+    //=============================================================
+    AudioFileFormat fileFormat;
+    WaveFormat waveFormat;
 };
 
+//=============================================================
+/** Reads the headers of an audio file (at most 512 bytes) and describes its format */
+AudioFileInfo probeAudioFile (const String& filePath);
+
+/** As above, for a file that is already open. The file is left open */
+AudioFileInfo probeAudioFile (File& file);
 
-template <class T>
+
+template <class T, class Storage = DynamicAllocation>
 class AudioFile
 {
 public:
     
     // typedef std::vector<std::vector<T> > AudioBuffer;
-    typedef LinkedList<LinkedList<T>> AudioBuffer;
+    typedef typename Storage::template Buffer<T>::Type AudioBuffer;
     
 
     /** Constructor */
     AudioFile();
+    
+    /** Copies share the samples with SharedAllocation and copy them otherwise. Moves take
+     * over the other AudioFile's samples without copying any, leaving it empty.
+     * (An AudioFile with LazyAllocation can be moved but not copied.)
+     */
+    AudioFile (const AudioFile&) = default;
+    AudioFile (AudioFile&&) = default;
+    AudioFile& operator = (const AudioFile&) = default;
+    AudioFile& operator = (AudioFile&&) = default;
         
 
-    /** Loads an audio file from a given file path.
+    /** Loads an audio file from a given file path. With storage that holds the samples in
+     * memory, a WAV file is first read whole, so it must be smaller than 2 GB; stream
+     * longer ones with WavReader or LazyAllocation. StaticAllocation loads WAV files only,
+     * since the FLAC and MP3 decoders live on the heap.
      * @Returns true if the file was successfully loaded
      */
     // bool load (std::string filePath);
-    bool load (String filePath);
+    bool load (const String& filePath);
 
     
-    /** Saves an audio file to a given file path.
+    /** Saves an audio file to a given file path. The samples must come to less than 2 GB
+     * once encoded.
      * @Returns true if the file was successfully saved
      */
     // bool save (std::string filePath, AudioFileFormat format = AudioFileFormat::Wave);
-    bool save (String filePath, AudioFileFormat format = AudioFileFormat::Wave);
+    bool save (const String& filePath, AudioFileFormat format = AudioFileFormat::Wave);
+
+    /** Reads only the headers of an audio file to find its format, without loading or decoding
+     * any samples. Use this instead of load() when only the sample rate, channels, bit depth
+     * or length are needed.
+     * @Returns a descriptor whose isValid() is false if the file can't be decoded
+     */
+    static AudioFileInfo probe (const String& filePath);
 
         
     //=============================================================
@@ -73,6 +197,13 @@ public:
      */
     bool setAudioBuffer (AudioBuffer& newBuffer);
     
+    /** Set the audio buffer for this AudioFile by taking over another buffer's samples, which
+     * doesn't copy any of them, e.g. setAudioBuffer (std::move (buffer)). The other buffer is left empty.
+     * @Returns true if the buffer was taken, or false (leaving both unchanged) if it has no channels
+     * or its channels differ in length.
+     */
+    bool setAudioBuffer (AudioBuffer&& newBuffer);
+    
     /** Sets the audio buffer to a given number of channels and number of samples per channel. This will try to preserve
      * the existing audio, adding zeros to any new channels or new samples in a given channel.
      */
@@ -92,11 +223,39 @@ public:
     /** Sets the sample rate for the audio file. If you use the save() function, this sample rate will be used */
     void setSampleRate (uint32_t newSampleRate);
     
+    /** @Returns the RAM used by an AudioFile with this allocation policy, not counting heap
+     * memory: the object itself plus the block that StaticAllocation streams files through
+     * and the buffer of the writer that save() uses
+     */
+    static constexpr unsigned long getRamFootprint() { return (unsigned long)(sizeof (AudioFile) + (Storage::isStatic ? Storage::blockBytes + AUDIOFILE_WRITE_BUFFER_SIZE : 0)); }
+    
+    /** Attaches an analysis sink (e.g. a LevelAnalyser) that is fed every frame while a file is decoded.
+     * Pass nullptr to detach it. The sink is not owned by the AudioFile.
+     */
+    void setAnalysisSink (AudioAnalysisSink<T>* sink);
+    
+#ifndef ARDUINO
+    /** Host builds only: sets whether large files are decoded and saved in parallel on the
+     * shared thread pool, each thread converting its own range of frames (on by default)
+     */
+    void setUseThreads (bool shouldUseThreads);
+#endif
+    
+#ifdef AUDIOFILE_PROFILING
+    /** Only with AUDIOFILE_PROFILING defined: @Returns the time, bytes and allocations of
+     * each stage of every load() and save() so far. Call reset() on it to start again.
+     */
+    ProfileStats& getProfileStats();
+#endif
+    
     //=============================================================
-    /** A vector of vectors holding the audio samples for the AudioFile. You can 
+    /** An array of arrays holding the audio samples for the AudioFile. You can 
      * access the samples by channel and then by sample index, i.e:
      *
      *      samples[channel][sampleIndex]
+     *
+     * Each channel is contiguous, so samples[channel].getData() can be handed to
+     * code that works on plain arrays.
      */
     AudioBuffer samples;
     
@@ -110,16 +269,53 @@ private:
     };
     
     //=============================================================
-    AudioFileFormat determineAudioFileFormat (String fileData);
+    // AudioFileFormat determineAudioFileFormat (DynamicArray<uint8_t>& fileData);
+    AudioFileFormat determineAudioFileFormat (const uint8_t* header, int numBytes);
     // bool decodeWaveFile (std::vector<uint8_t>& fileData);
-    bool decodeWaveFile (String fileData);
+    bool decodeWaveFile (DynamicArray<uint8_t>& fileData);
 
     // bool decodeAiffFile (std::vector<uint8_t>& fileData);
     // bool decodeAiffFile (LinkedList<uint8_t>& fileData);
     
+    bool decodeWaveFileInBlocks (File& file);
+    bool compressWaveFile (File& file);
+    bool decodeFlacFile (File& file);
+    bool decodeMp3File (File& file);
+    
+    template <class Decoder>
+    static int getNumFramesToReserve (const Decoder& decoder);
+    template <class Decoder>
+    bool decodeBlocks (Decoder& decoder, DecodeOnLoad);
+    template <class Decoder>
+    bool decodeBlocks (Decoder& decoder, CompressOnLoad);
+#if AUDIOFILE_WITH_FLAC
+    void decodeBlockChannel (const FlacDecoder<T>& decoder, int channel, int startFrame, T* destination, int numFrames);
+#endif
+#if AUDIOFILE_WITH_MP3
+    void decodeBlockChannel (const Mp3Decoder<T>& decoder, int channel, int startFrame, T* destination, int numFrames);
+#endif
+    bool compressFrames (const T* source, int numFrames);
+    
+    // the policy's Decoding tag picks one of these, so only the one that suits its buffer is compiled
+    bool loadFromFile (File& file, const String& filePath, DecodeOnLoad);
+    bool loadFromFile (File& file, const String& filePath, DecodeOnAccess);
+    bool loadFromFile (File& file, const String& filePath, CompressOnLoad);
+    
+    //=============================================================
+    void decodeFrames (const uint8_t* source, int startFrame, int numFrames, int numBytesPerBlock);
+    void encodeFrames (uint8_t* destination, int startFrame, int numFrames, int numBytesPerBlock);
+    void feedAnalysisSink (int startFrame, int endFrame);
+
+    template <class Function>
+    void forEachFrameRange (int numFrames, Function function);
+    
     //=============================================================
     // bool saveToWaveFile (std::string filePath);
-    bool saveToWaveFile (String filePath);
+    bool saveToWaveFile (const String& filePath);
+    bool saveToWaveFile (const String& filePath, int32_t dataChunkSize, DecodeOnLoad);
+    bool saveToWaveFile (const String& filePath, int32_t dataChunkSize, DecodeOnAccess);
+    bool saveToWaveFile (const String& filePath, int32_t dataChunkSize, CompressOnLoad);
+    bool saveToWaveFileInBlocks (const String& filePath, int32_t dataChunkSize);
 
     // bool saveToAiffFile (std::string filePath);
     // bool saveToAiffFile (String filePath);
@@ -130,13 +326,16 @@ private:
     
     //=============================================================
     // int32_t fourBytesToInt (std::vector<uint8_t>& source, int startIndex, Endianness endianness = Endianness::LittleEndian);
-    int32_t fourBytesToInt (String source, int startIndex, Endianness endianness = Endianness::LittleEndian);
+    int32_t fourBytesToInt (DynamicArray<uint8_t>& source, int startIndex, Endianness endianness = Endianness::LittleEndian);
 
     // int16_t twoBytesToInt (std::vector<uint8_t>& source, int startIndex, Endianness endianness = Endianness::LittleEndian);
-    int16_t twoBytesToInt (String source, int startIndex, Endianness endianness = Endianness::LittleEndian);
+    int16_t twoBytesToInt (DynamicArray<uint8_t>& source, int startIndex, Endianness endianness = Endianness::LittleEndian);
 
     // int getIndexOfString (std::vector<uint8_t>& source, std::string s);
-    int getIndexOfString (String source, String s);
+    int getIndexOfString (DynamicArray<uint8_t>& source, const char* s);
+
+    // bool fourCharsMatch (std::vector<uint8_t>& source, int startIndex, std::string s);
+    bool fourCharsMatch (DynamicArray<uint8_t>& source, int startIndex, const char* s);
 
     
     //=============================================================
@@ -153,25 +352,41 @@ private:
     T clamp (T v1, T minValue, T maxValue);
     
     //=============================================================
+    // the file data can be a DynamicArray or, for the header alone, a FixedArray
+    template <class Container>
+    void addWaveHeaderToFileData (Container& fileData, int32_t dataChunkSize);
+
     // void addStringToFileData (std::vector<uint8_t>& fileData, std::string s);
-    void addStringToFileData (LinkedList<uint8_t> fileData, String s);
+    template <class Container>
+    void addStringToFileData (Container& fileData, const char* s);
 
     // void addInt32ToFileData (std::vector<uint8_t>& fileData, int32_t i, Endianness endianness = Endianness::LittleEndian);
-    void addInt32ToFileData (LinkedList<uint8_t>& fileData, int32_t i, Endianness endianness = Endianness::LittleEndian);
+    template <class Container>
+    void addInt32ToFileData (Container& fileData, int32_t i, Endianness endianness = Endianness::LittleEndian);
 
     // void addInt16ToFileData (std::vector<uint8_t>& fileData, int16_t i, Endianness endianness = Endianness::LittleEndian);
-    void addInt16ToFileData (LinkedList<uint8_t>& fileData, int16_t i, Endianness endianness = Endianness::LittleEndian);
+    template <class Container>
+    void addInt16ToFileData (Container& fileData, int16_t i, Endianness endianness = Endianness::LittleEndian);
 
     
     //=============================================================
     // bool writeDataToFile (std::vector<uint8_t>& fileData, std::string filePath);
-    bool writeDataToFile (LinkedList<uint8_t>& fileData, String filePath);
+    bool writeDataToFile (DynamicArray<uint8_t>& fileData, const String& filePath);
 
     
     //=============================================================
     AudioFileFormat audioFileFormat;
     uint32_t sampleRate;
     int bitDepth;
+    AudioAnalysisSink<T>* analysisSink;
+    
+#ifndef ARDUINO
+    bool useThreads;
+#endif
+    
+#ifdef AUDIOFILE_PROFILING
+    ProfileStats profileStats;
+#endif
 };
 
 //=============================================================
@@ -179,54 +394,209 @@ private:
 //=============================================================
 
 //=============================================================
-template <class T>
-AudioFile<T>::AudioFile()
+inline AudioFileInfo::AudioFileInfo()
+{
+    fileFormat = AudioFileFormat::Error;
+    memset (&waveFormat, 0, sizeof (waveFormat));
+}
+
+//=============================================================
+inline AudioFileInfo::AudioFileInfo (const WaveFormat& waveFormat_)
+{
+    fileFormat = AudioFileFormat::Wave;
+    waveFormat = waveFormat_;
+}
+
+#if AUDIOFILE_WITH_FLAC
+//=============================================================
+inline AudioFileInfo::AudioFileInfo (const FlacStreamInfo& streamInfo)
+{
+    fileFormat = AudioFileFormat::Flac;
+    
+    // the format of the PCM the file decodes to
+    waveFormat.audioFormat = 1;
+    waveFormat.numChannels = streamInfo.numChannels;
+    waveFormat.sampleRate = streamInfo.sampleRate;
+    waveFormat.numBytesPerBlock = (uint16_t)(streamInfo.numChannels * ((streamInfo.bitDepth + 7) / 8));
+    waveFormat.numBytesPerSecond = streamInfo.sampleRate * waveFormat.numBytesPerBlock;
+    waveFormat.bitDepth = streamInfo.bitDepth;
+    waveFormat.dataOffset = streamInfo.firstBlockOffset;
+    waveFormat.dataSize = streamInfo.numFrames * waveFormat.numBytesPerBlock;
+}
+#endif
+
+#if AUDIOFILE_WITH_MP3
+//=============================================================
+inline AudioFileInfo::AudioFileInfo (const Mp3StreamInfo& streamInfo)
+{
+    fileFormat = AudioFileFormat::Mp3;
+    
+    // MP3 has no bit depth, so this describes the 16 bit PCM it is usually played as
+    waveFormat.audioFormat = 1;
+    waveFormat.numChannels = streamInfo.numChannels;
+    waveFormat.sampleRate = streamInfo.sampleRate;
+    waveFormat.numBytesPerBlock = (uint16_t)(streamInfo.numChannels * 2);
+    waveFormat.numBytesPerSecond = streamInfo.sampleRate * waveFormat.numBytesPerBlock;
+    waveFormat.bitDepth = 16;
+    waveFormat.dataOffset = streamInfo.firstBlockOffset;
+    waveFormat.dataSize = streamInfo.numFrames * waveFormat.numBytesPerBlock;
+}
+#endif
+
+//=============================================================
+inline bool AudioFileInfo::isValid() const
+{
+    return fileFormat != AudioFileFormat::Error;
+}
+
+//=============================================================
+inline AudioFileFormat AudioFileInfo::getFileFormat() const
+{
+    return fileFormat;
+}
+
+//=============================================================
+inline uint32_t AudioFileInfo::getSampleRate() const
+{
+    return waveFormat.sampleRate;
+}
+
+//=============================================================
+inline int AudioFileInfo::getNumChannels() const
+{
+    return (int)waveFormat.numChannels;
+}
+
+//=============================================================
+inline int AudioFileInfo::getBitDepth() const
+{
+    return (int)waveFormat.bitDepth;
+}
+
+//=============================================================
+inline int AudioFileInfo::getNumSamplesPerChannel() const
+{
+    return (int)waveFormat.getNumFrames();
+}
+
+//=============================================================
+inline double AudioFileInfo::getLengthInSeconds() const
+{
+    return waveFormat.getLengthInSeconds();
+}
+
+//=============================================================
+inline const WaveFormat& AudioFileInfo::getWaveFormat() const
+{
+    return waveFormat;
+}
+
+//=============================================================
+inline AudioFileInfo probeAudioFile (const String& filePath)
+{
+    File file = SD.open (filePath.c_str());
+    
+    if (! file)
+        return AudioFileInfo();
+    
+    AudioFileInfo info = probeAudioFile (file);
+    file.close();
+    return info;
+}
+
+//=============================================================
+inline AudioFileInfo probeAudioFile (File& file)
+{
+    // enough for RIFF, fmt and data headers with a few metadata chunks in front of them
+    const uint32_t maxProbeBytes = 512;
+    
+    WaveFormat waveFormat;
+    
+    if (readWaveFormat (file, waveFormat, maxProbeBytes))
+        return AudioFileInfo (waveFormat);
+    
+#if AUDIOFILE_WITH_FLAC
+    FlacStreamInfo streamInfo = {};
+    
+    // same restrictions on bit depth as for WAV files
+    if (readFlacStreamInfo (file, streamInfo, maxProbeBytes)
+        && (streamInfo.bitDepth == 8 || streamInfo.bitDepth == 16 || streamInfo.bitDepth == 24))
+        return AudioFileInfo (streamInfo);
+#endif
+    
+#if AUDIOFILE_WITH_MP3
+    Mp3StreamInfo mp3StreamInfo = {};
+    
+    if (readMp3StreamInfo (file, mp3StreamInfo, maxProbeBytes))
+        return AudioFileInfo (mp3StreamInfo);
+#endif
+    
+    return AudioFileInfo();
+}
+
+//=============================================================
+template <class T, class Storage>
+AudioFileInfo AudioFile<T, Storage>::probe (const String& filePath)
+{
+    return probeAudioFile (filePath);
+}
+
+//=============================================================
+template <class T, class Storage>
+AudioFile<T, Storage>::AudioFile()
 {
+    // fails to compile, showing the numbers, if the static buffers don't fit in RAM
+    (void) CheckRamBudget<getRamFootprint(), AUDIOFILE_RAM_BUDGET>::footprint;
+    
     bitDepth = 16;
     sampleRate = 44100;
-    samples.resize(1);
-    samples[0].resize(0);
+    samples.resize (1);
     audioFileFormat = AudioFileFormat::NotLoaded;
+    analysisSink = nullptr;
+    
+#ifndef ARDUINO
+    useThreads = true;
+#endif
 }
 
 //=============================================================
-template <class T>
-uint32_t AudioFile<T>::getSampleRate() const
+template <class T, class Storage>
+uint32_t AudioFile<T, Storage>::getSampleRate() const
 {
     return sampleRate;
 }
 
 //=============================================================
-template <class T>
-int AudioFile<T>::getNumChannels() const
+template <class T, class Storage>
+int AudioFile<T, Storage>::getNumChannels() const
 {
     return (int)samples.size();
 }
 
 //=============================================================
-template <class T>
-bool AudioFile<T>::isMono() const
+template <class T, class Storage>
+bool AudioFile<T, Storage>::isMono() const
 {
     return getNumChannels() == 1;
 }
 
 //=============================================================
-template <class T>
-bool AudioFile<T>::isStereo() const
+template <class T, class Storage>
+bool AudioFile<T, Storage>::isStereo() const
 {
     return getNumChannels() == 2;
 }
 
 //=============================================================
-template <class T>
-int AudioFile<T>::getBitDepth() const
+template <class T, class Storage>
+int AudioFile<T, Storage>::getBitDepth() const
 {
     return bitDepth;
 }
 
 //=============================================================
-template <class T>
-int AudioFile<T>::getNumSamplesPerChannel() const
+template <class T, class Storage>
+int AudioFile<T, Storage>::getNumSamplesPerChannel() const
 {
     if (samples.size() > 0)
         return (int) samples[0].size();
@@ -235,15 +605,15 @@ int AudioFile<T>::getNumSamplesPerChannel() const
 }
 
 //=============================================================
-template <class T>
-double AudioFile<T>::getLengthInSeconds() const
+template <class T, class Storage>
+double AudioFile<T, Storage>::getLengthInSeconds() const
 {
     return (double)getNumSamplesPerChannel() / (double)sampleRate;
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::printSummary() const
+template <class T, class Storage>
+void AudioFile<T, Storage>::printSummary() const
 {
     // std::cout << "|======================================|" << std::endl;
     Serial.println("|======================================|");
@@ -269,8 +639,8 @@ void AudioFile<T>::printSummary() const
 }
 
 //=============================================================
-template <class T>
-bool AudioFile<T>::setAudioBuffer (AudioBuffer& newBuffer)
+template <class T, class Storage>
+bool AudioFile<T, Storage>::setAudioBuffer (AudioBuffer& newBuffer)
 {
     int numChannels = (int)newBuffer.size();
     
@@ -280,22 +650,34 @@ bool AudioFile<T>::setAudioBuffer (AudioBuffer& newBuffer)
         return false;
     }
     
-    int numSamples = (int)newBuffer[0].size();
+    // only read newBuffer here, so a shared buffer isn't copied just to be copied from
+    const AudioBuffer& source = newBuffer;
+    int numSamples = (int)source[0].size();
+    
+    for (int k = 0; k < numChannels; k++)
+    {
+        // assert (newBuffer[k].size() == numSamples);
+        if (source[k].size() != numSamples)
+            return false;
+    }
     
     // set the number of channels
-    samples.resize (newBuffer.size());
+    samples.resize (numChannels);
     
     for (int k = 0; k < getNumChannels(); k++)
     {
-        // assert (newBuffer[k].size() == numSamples);
-        if (newBuffer[k].size() != numSamples)
-            return false; // not sure whether this is handled completely
-        
         samples[k].resize (numSamples);
         
+        if (samples[k].size() != numSamples)
+        {
+            Serial.println ("ERROR: there isn't enough memory to copy these samples");
+            clearAudioBuffer();
+            return false;
+        }
+        
         for (int i = 0; i < numSamples; i++)
         {
-            samples[k][i] = newBuffer[k][i];
+            samples[k][i] = source[k][i];
         }
     }
     
@@ -303,34 +685,47 @@ bool AudioFile<T>::setAudioBuffer (AudioBuffer& newBuffer)
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::setAudioBufferSize (int numChannels, int numSamples)
+template <class T, class Storage>
+bool AudioFile<T, Storage>::setAudioBuffer (AudioBuffer&& newBuffer)
+{
+    const AudioBuffer& source = newBuffer;
+    int numChannels = (int)source.size();
+    
+    if (numChannels <= 0)
+        return false;
+    
+    for (int k = 1; k < numChannels; k++)
+    {
+        if (source[k].size() != source[0].size())
+            return false;
+    }
+    
+    samples = static_cast<AudioBuffer&&> (newBuffer);
+    return true;
+}
+
+//=============================================================
+template <class T, class Storage>
+void AudioFile<T, Storage>::setAudioBufferSize (int numChannels, int numSamples)
 {
     samples.resize (numChannels);
     setNumSamplesPerChannel (numSamples);
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::setNumSamplesPerChannel (int numSamples)
+template <class T, class Storage>
+void AudioFile<T, Storage>::setNumSamplesPerChannel (int numSamples)
 {
-    int originalSize = getNumSamplesPerChannel();
-    
     for (int i = 0; i < getNumChannels();i++)
     {
+        // any new samples are set to zero by resize()
         samples[i].resize (numSamples);
-        
-        // set any new samples to zero
-        if (numSamples > originalSize)
-            // std::fill (samples[i].begin() + originalSize, samples[i].end(), (T)0.);
-            samples.fill(i + originalSize, samples.size()-1, (T) 0.); //not sure to whether use size-1 or size.
-
     }
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::setNumChannels (int numChannels)
+template <class T, class Storage>
+void AudioFile<T, Storage>::setNumChannels (int numChannels)
 {
     int originalNumChannels = getNumChannels();
     int originalNumSamplesPerChannel = getNumSamplesPerChannel();
@@ -343,48 +738,128 @@ void AudioFile<T>::setNumChannels (int numChannels)
     {
         for (int i = originalNumChannels; i < numChannels; i++)
         {
+            // resize() fills the new channel with zeros
             samples[i].resize (originalNumSamplesPerChannel);
-            // std::fill (samples[i].begin(), samples[i].end(), (T)0.);
-            samples.fill(i, samples.size()-1, (T) 0.); //not sure to whether use size-1 or size.
-
         }
     }
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::setBitDepth (int numBitsPerSample)
+template <class T, class Storage>
+void AudioFile<T, Storage>::setBitDepth (int numBitsPerSample)
 {
     bitDepth = numBitsPerSample;
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::setSampleRate (uint32_t newSampleRate)
+template <class T, class Storage>
+void AudioFile<T, Storage>::setSampleRate (uint32_t newSampleRate)
 {
     sampleRate = newSampleRate;
 }
 
 //=============================================================
-template <class T>
-bool AudioFile<T>::load (String fileData)
+template <class T, class Storage>
+void AudioFile<T, Storage>::setAnalysisSink (AudioAnalysisSink<T>* sink)
+{
+    analysisSink = sink;
+}
+
+#ifndef ARDUINO
+//=============================================================
+template <class T, class Storage>
+void AudioFile<T, Storage>::setUseThreads (bool shouldUseThreads)
+{
+    useThreads = shouldUseThreads;
+}
+#endif
+
+#ifdef AUDIOFILE_PROFILING
+//=============================================================
+template <class T, class Storage>
+ProfileStats& AudioFile<T, Storage>::getProfileStats()
+{
+    return profileStats;
+}
+#endif
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::load (const String& filePath)
 {
     //std::ifstream file (filePath, std::ios::binary);
+    File file = SD.open (filePath.c_str());
     
     // check the file exists
-    // if (! file.good())
-    // {
+    if (! file)
+    {
         // std::cout << "ERROR: File doesn't exist or otherwise can't load file" << std::endl;
-        // std::cout << filePath << std::endl;
-        // return false;
-    // }
+        Serial.println ("ERROR: File doesn't exist or otherwise can't load file");
+        Serial.println (filePath);
+        return false;
+    }
+    
+    return loadFromFile (file, filePath, typename Storage::Decoding());
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::loadFromFile (File& file, const String& filePath, DecodeOnLoad)
+{
+    uint8_t header[4];
+    int numHeaderBytes = file.read (header, 4);
+    file.seek (0);
+    
+    // FLAC and MP3 are decoded as they stream in, so the compressed file is never held in memory
+    AudioFileFormat format = determineAudioFileFormat (header, numHeaderBytes);
+    
+    if (format == AudioFileFormat::Flac || format == AudioFileFormat::Mp3)
+    {
+        bool ok = format == AudioFileFormat::Flac ? decodeFlacFile (file) : decodeMp3File (file);
+        file.close();
+        return ok;
+    }
+    
+    // with static allocation there is no room for the whole file, so it is decoded a block at a time
+    if (Storage::isStatic)
+    {
+        bool ok = decodeWaveFileInBlocks (file);
+        file.close();
+        return ok;
+    }
+    
+    // read the whole file in one go into a contiguous buffer
+    AUDIOFILE_PROFILE_START (readTimer);
+    // DynamicArray counts in ints
+    if (file.size() > 0x7FFFFFFF)
+    {
+        Serial.println ("ERROR: files of 2 GB or more can't be loaded whole: " + filePath);
+        file.close();
+        return false;
+    }
+    
+    DynamicArray<uint8_t> fileData;
+    fileData.resize ((int)file.size());
+    
+    if (fileData.size() != (int)file.size())
+    {
+        Serial.println ("ERROR: there isn't enough memory to load " + filePath);
+        file.close();
+        return false;
+    }
     
-    // file.unsetf (std::ios::skipws);
-    // std::istream_iterator<uint8_t> begin (file), end; 
-    // std::vector<uint8_t> fileData (begin, end);
+    int numBytesRead = fileData.size() > 0 ? file.read (fileData.getData(), fileData.size()) : 0;
+    file.close();
+    AUDIOFILE_PROFILE_STOP (readTimer, profileStats, ProfileStage::FileRead, numBytesRead);
+    
+    if (numBytesRead != fileData.size())
+    {
+        Serial.println ("ERROR: couldn't read the whole of " + filePath);
+        return false;
+    }
     
     // get audio file format
-    audioFileFormat = determineAudioFileFormat (fileData);
+    audioFileFormat = determineAudioFileFormat (fileData.getData(), fileData.size());
     
     if (audioFileFormat == AudioFileFormat::Wave)
     {
@@ -403,17 +878,19 @@ bool AudioFile<T>::load (String fileData)
 }
 
 //=============================================================
-template <class T>
-bool AudioFile<T>::decodeWaveFile (String fileData)
+template <class T, class Storage>
+bool AudioFile<T, Storage>::decodeWaveFile (DynamicArray<uint8_t>& fileData)
 {
+    AUDIOFILE_PROFILE_START (headerTimer);
+    
     // -----------------------------------------------------------
     // HEADER CHUNK
     // std::string headerChunkID (fileData.begin(), fileData.begin() + 4);
-    String header = splitString(fileData, 0, 4);
+    bool isRiff = fourCharsMatch (fileData, 0, "RIFF");
 
     //int32_t fileSizeInBytes = fourBytesToInt (fileData, 4) + 8;
     // std::string format (fileData.begin() + 8, fileData.begin() + 12);
-    String format = splitString(fileData, 8, 12);
+    bool isWave = fourCharsMatch (fileData, 8, "WAVE");
 
     
     // -----------------------------------------------------------
@@ -423,7 +900,7 @@ bool AudioFile<T>::decodeWaveFile (String fileData)
     
     // if we can't find the data or format chunks, or the IDs/formats don't seem to be as expected
     // then it is unlikely we'll able to read this file, so abort
-    if (indexOfDataChunk == -1 || indexOfFormatChunk == -1 || headerChunkID != "RIFF" || format != "WAVE")
+    if (indexOfDataChunk == -1 || indexOfFormatChunk == -1 || ! isRiff || ! isWave)
     {
         // std::cout << "ERROR: this doesn't seem to be a valid .WAV file" << std::endl;
         Serial.println("ERROR: this doesn't seem to be a valid .WAV file");
@@ -434,14 +911,13 @@ bool AudioFile<T>::decodeWaveFile (String fileData)
     // -----------------------------------------------------------
     // FORMAT CHUNK
     int f = indexOfFormatChunk;
-    // String formatChunkID (fileData.begin() + f, fileData.begin() + f + 4);
-    String formatChunkID = splitString(fileData, f, f + 4);
+    // std::string formatChunkID (fileData.begin() + f, fileData.begin() + f + 4);
 
     //int32_t formatChunkSize = fourBytesToInt (fileData, f + 4);
     int16_t audioFormat = twoBytesToInt (fileData, f + 8);
     int16_t numChannels = twoBytesToInt (fileData, f + 10);
     sampleRate = (uint32_t) fourBytesToInt (fileData, f + 12);
-    int32_t numBytesPerSecond = fourBytesToInt (fileData, f + 16);
+    uint32_t numBytesPerSecond = (uint32_t) fourBytesToInt (fileData, f + 16);
     int16_t numBytesPerBlock = twoBytesToInt (fileData, f + 20);
     bitDepth = (int) twoBytesToInt (fileData, f + 22);
     
@@ -486,201 +962,988 @@ bool AudioFile<T>::decodeWaveFile (String fileData)
     // -----------------------------------------------------------
     // DATA CHUNK
     int d = indexOfDataChunk;
-    String dataChunkID = splitString(fileData.begin() + d, fileData.begin() + d + 4);
-    int32_t dataChunkSize = fourBytesToInt (fileData, d + 4);
-    
-    int numSamples = dataChunkSize / (numChannels * bitDepth / 8);
+    // std::string dataChunkID (fileData.begin() + d, fileData.begin() + d + 4);
+    uint32_t dataChunkSize = (uint32_t) fourBytesToInt (fileData, d + 4);
     int samplesStartIndex = indexOfDataChunk + 8;
     
+    // don't read past the end of a truncated file (e.g. a recording whose size was never filled in)
+    uint32_t numBytesAvailable = fileData.size() > samplesStartIndex ? (uint32_t) (fileData.size() - samplesStartIndex) : 0;
+    
+    if (dataChunkSize > numBytesAvailable)
+        dataChunkSize = numBytesAvailable;
+    
+    int numSamples = (int) (dataChunkSize / (uint32_t) numBytesPerBlock);
+    
+    const uint8_t* sampleData = fileData.getData() + samplesStartIndex;
+    
+    AUDIOFILE_PROFILE_STOP (headerTimer, profileStats, ProfileStage::HeaderParse, samplesStartIndex);
+    AUDIOFILE_PROFILE_STAGE (profileStats, ProfileStage::Decode, numSamples * numBytesPerBlock);
+    
     clearAudioBuffer();
     samples.resize (numChannels);
     
-    for (int i = 0; i < numSamples; i++)
+    // every frame has a fixed place in the output, so each channel is sized up
+    // front and ranges of frames can then be converted independently
+    for (int channel = 0; channel < numChannels; channel++)
     {
-        for (int channel = 0; channel < numChannels; channel++)
+        samples[channel].resize (numSamples);
+        
+        if (samples[channel].size() != numSamples)
         {
-            int sampleIndex = samplesStartIndex + (numBytesPerBlock * i) + channel * numBytesPerSample;
-            
-            if (bitDepth == 8)
-            {
-                T sample = singleByteToSample (fileData[sampleIndex]);
-                samples[channel].Append(sample);
-            }
-            else if (bitDepth == 16)
-            {
-                int16_t sampleAsInt = twoBytesToInt (fileData, sampleIndex);
-                T sample = sixteenBitIntToSample (sampleAsInt);
-                samples[channel].Append(sample);
-            }
-            else if (bitDepth == 24)
-            {
-                int32_t sampleAsInt = 0;
-                sampleAsInt = (fileData[sampleIndex + 2] << 16) | (fileData[sampleIndex + 1] << 8) | fileData[sampleIndex];
-                
-                if (sampleAsInt & 0x800000) //  if the 24th bit is set, this is a negative number in 24-bit world
-                    sampleAsInt = sampleAsInt | ~0xFFFFFF; // so make sure sign is extended to the 32 bit float
-
-                T sample = (T)sampleAsInt / (T)8388608.;
-                samples[channel].Append(sample);
-            }
-            else
-            {
-                return false;
-            }
+            Serial.println ("ERROR: there isn't enough memory to load this file");
+            clearAudioBuffer();
+            return false;
         }
     }
-
-    return true;
-}
-
-//=============================================================
-/*template <class T>
-bool AudioFile<T>::tenByteMatch (std::vector<uint8_t>& v1, int startIndex1, std::vector<uint8_t>& v2, int startIndex2)
-{
-    for (int i = 0; i < 10; i++)
+    
+    if (analysisSink == nullptr)
     {
-        if (v1[startIndex1 + i] != v2[startIndex2 + i])
-            return false;
+        forEachFrameRange (numSamples, [&] (int startFrame, int endFrame)
+        {
+            decodeFrames (sampleData + startFrame * numBytesPerBlock, startFrame, endFrame - startFrame, numBytesPerBlock);
+        });
+        
+        return true;
     }
     
-    return true;
-}*/
-
-//=============================================================
-template <class T>
-bool AudioFile<T>::save (String filePath, AudioFileFormat format)
-{
-    if (format == AudioFileFormat::Wave)
+    // with an analysis sink attached, frames are converted in order in small blocks and
+    // handed to the sink while they are still in the cache
+    analysisSink->begin (sampleRate, numChannels);
+    
+    const int framesPerBlock = Storage::blockFrames;
+    
+    for (int startFrame = 0; startFrame < numSamples; startFrame += framesPerBlock)
     {
-        return saveToWaveFile (filePath);
+        int endFrame = startFrame + framesPerBlock < numSamples ? startFrame + framesPerBlock : numSamples;
+        decodeFrames (sampleData + startFrame * numBytesPerBlock, startFrame, endFrame - startFrame, numBytesPerBlock);
+        feedAnalysisSink (startFrame, endFrame);
     }
     
-    return false;
+    analysisSink->end();
+
+    return true;
 }
 
 //=============================================================
-template <class T>
-bool AudioFile<T>::saveToWaveFile (String filePath)
+template <class T, class Storage>
+bool AudioFile<T, Storage>::decodeWaveFileInBlocks (File& file)
 {
-    LinkedList<uint8_t> fileData;
+    AUDIOFILE_PROFILE_START (headerTimer);
     
-    int32_t dataChunkSize = getNumSamplesPerChannel() * (getNumChannels() * bitDepth / 8);
+    // leaves the file at the first sample
+    WaveFormat format;
     
-    // -----------------------------------------------------------
-    // HEADER CHUNK
-    addStringToFileData (fileData, "RIFF");
+    if (! readWaveFormat (file, format))
+    {
+        Serial.println ("ERROR: this doesn't seem to be a valid .WAV file");
+        return false;
+    }
     
-    // The file size in bytes is the header chunk size (4, not counting RIFF and WAVE) + the format
-    // chunk size (24) + the metadata part of the data chunk plus the actual data chunk size
-    int32_t fileSizeInBytes = 4 + 24 + 8 + dataChunkSize;
-    addInt32ToFileData (fileData, fileSizeInBytes);
+    int numChannels = (int) format.numChannels;
+    int numSamples = (int) format.getNumFrames();
+    int numBytesPerBlock = (int) format.numBytesPerBlock;
     
-    addStringToFileData (fileData, "WAVE");
+    if (numChannels > 2)
+    {
+        Serial.println ("ERROR: this WAV file seems to be neither mono nor stereo (perhaps multi-track, or corrupted?)");
+        return false;
+    }
     
-    // -----------------------------------------------------------
-    // FORMAT CHUNK
-    addStringToFileData (fileData, "fmt ");
-    addInt32ToFileData (fileData, 16); // format chunk size (16 for PCM)
-    addInt16ToFileData (fileData, 1); // audio format = 1
-    addInt16ToFileData (fileData, (uint16_t)getNumChannels()); // num channels
-    addInt32ToFileData (fileData, (uint32_t)sampleRate); // sample rate
+    if (numChannels > Storage::maxChannels || numSamples > Storage::maxFrames || numBytesPerBlock > Storage::blockBytes)
+    {
+        Serial.println ("ERROR: this WAV file doesn't fit in the AudioFile's static buffers");
+        return false;
+    }
     
-    int32_t numBytesPerSecond = (uint32_t) ((getNumChannels() * sampleRate * bitDepth) / 8);
-    addInt32ToFileData (fileData, numBytesPerSecond);
+    audioFileFormat = AudioFileFormat::Wave;
+    sampleRate = format.sampleRate;
+    bitDepth = (int) format.bitDepth;
     
-    int16_t numBytesPerBlock = getNumChannels() * (bitDepth / 8);
-    addInt16ToFileData (fileData, numBytesPerBlock);
+    AUDIOFILE_PROFILE_STOP (headerTimer, profileStats, ProfileStage::HeaderParse, format.dataOffset);
     
-    addInt16ToFileData (fileData, (uint16_t)bitDepth);
+    samples.resize (numChannels);
     
-    // -----------------------------------------------------------
-    // DATA CHUNK
-    addStringToFileData (fileData, "data");
-    addInt32ToFileData (fileData, dataChunkSize);
+    for (int channel = 0; channel < numChannels; channel++)
+        samples[channel].resize (numSamples);
+    
+    if (analysisSink != nullptr)
+        analysisSink->begin (sampleRate, numChannels);
+    
+    uint8_t block[Storage::blockBytes];
+    int framesPerBlock = Storage::blockBytes / numBytesPerBlock;
     
-    for (int i = 0; i < getNumSamplesPerChannel(); i++)
+    for (int startFrame = 0; startFrame < numSamples; startFrame += framesPerBlock)
     {
-        for (int channel = 0; channel < getNumChannels(); channel++)
+        int numFrames = numSamples - startFrame < framesPerBlock ? numSamples - startFrame : framesPerBlock;
+        
+        AUDIOFILE_PROFILE_START (readTimer);
+        int numBytesRead = file.read (block, numFrames * numBytesPerBlock);
+        AUDIOFILE_PROFILE_STOP (readTimer, profileStats, ProfileStage::FileRead, numBytesRead > 0 ? numBytesRead : 0);
+        
+        int numFramesRead = numBytesRead > 0 ? numBytesRead / numBytesPerBlock : 0;
+        
+        AUDIOFILE_PROFILE_START (decodeTimer);
+        decodeFrames (block, startFrame, numFramesRead, numBytesPerBlock);
+        AUDIOFILE_PROFILE_STOP (decodeTimer, profileStats, ProfileStage::Decode, numFramesRead * numBytesPerBlock);
+        
+        if (analysisSink != nullptr)
+            feedAnalysisSink (startFrame, startFrame + numFramesRead);
+        
+        // a truncated file keeps the frames that were there
+        if (numFramesRead < numFrames)
         {
-            if (bitDepth == 8)
-            {
-                uint8_t byte = sampleToSingleByte (samples[channel][i]);
-                fileData.push_back (byte);
-            }
-            else if (bitDepth == 16)
-            {
-                int16_t sampleAsInt = sampleToSixteenBitInt (samples[channel][i]);
-                addInt16ToFileData (fileData, sampleAsInt);
-            }
-            else if (bitDepth == 24)
+            setNumSamplesPerChannel (startFrame + numFramesRead);
+            break;
+        }
+    }
+    
+    if (analysisSink != nullptr)
+        analysisSink->end();
+    
+    return true;
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::decodeFlacFile (File& file)
+{
+#if ! AUDIOFILE_WITH_FLAC
+    Serial.println ("ERROR: FLAC files can't be loaded unless AUDIOFILE_WITH_FLAC is defined as 1");
+    (void) file;
+    return false;
+#else
+    AUDIOFILE_PROFILE_START (headerTimer);
+    
+    // the decoder's block buffers are too big for the stack of most boards, so it
+    // lives on the heap while the file is decoded, which StaticAllocation never uses
+    if (Storage::isStatic)
+    {
+        Serial.println ("ERROR: FLAC files can't be loaded with StaticAllocation (stream them with FlacDecoder instead)");
+        return false;
+    }
+    
+    FlacDecoder<T>* decoder = DynamicArrayHelpers::create<FlacDecoder<T>>();
+    
+    if (decoder == nullptr)
+    {
+        Serial.println ("ERROR: there isn't enough memory to decode this FLAC file");
+        return false;
+    }
+    
+    if (! decoder->open (file))
+    {
+        delete decoder;
+        return false;
+    }
+    
+    int numChannels = decoder->getNumChannels();
+    int fileBitDepth = decoder->getBitDepth();
+    bool ok = false;
+    
+    if (numChannels > 2)
+    {
+        Serial.println ("ERROR: this FLAC file seems to be neither mono nor stereo (perhaps multi-track, or corrupted?)");
+    }
+    else if (fileBitDepth != 8 && fileBitDepth != 16 && fileBitDepth != 24)
+    {
+        Serial.println ("ERROR: this file has a bit depth that is not 8, 16 or 24 bits");
+    }
+    else if (numChannels > Storage::maxChannels || decoder->getNumFrames() > (uint32_t) Storage::maxFrames)
+    {
+        Serial.println ("ERROR: this FLAC file doesn't fit in the AudioFile's static buffers");
+    }
+    else
+    {
+        ok = true;
+    }
+    
+    if (! ok)
+    {
+        delete decoder;
+        return false;
+    }
+    
+    audioFileFormat = AudioFileFormat::Flac;
+    sampleRate = decoder->getSampleRate();
+    bitDepth = fileBitDepth;
+    
+    AUDIOFILE_PROFILE_STOP (headerTimer, profileStats, ProfileStage::HeaderParse, decoder->getStreamInfo().firstBlockOffset);
+    
+    ok = decodeBlocks (*decoder, typename Storage::Decoding());
+    
+    if (decoder->getNumCorruptBlocks() > 0)
+        Serial.println ("WARNING: some blocks of this FLAC file were corrupt and have been replaced with silence");
+    
+    // the decoder closes the file, so it mustn't be closed again
+    decoder->close();
+    file = File();
+    delete decoder;
+    return ok;
+#endif
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::decodeMp3File (File& file)
+{
+#if ! AUDIOFILE_WITH_MP3
+    Serial.println ("ERROR: MP3 files can't be loaded unless AUDIOFILE_WITH_MP3 is defined as 1");
+    (void) file;
+    return false;
+#else
+    AUDIOFILE_PROFILE_START (headerTimer);
+    
+    // as with FLAC, the decoder's buffers are too big for the stack
+    if (Storage::isStatic)
+    {
+        Serial.println ("ERROR: MP3 files can't be loaded with StaticAllocation (stream them with Mp3Decoder instead)");
+        return false;
+    }
+    
+    Mp3Decoder<T>* decoder = DynamicArrayHelpers::create<Mp3Decoder<T>>();
+    
+    if (decoder == nullptr)
+    {
+        Serial.println ("ERROR: there isn't enough memory to decode this MP3 file");
+        return false;
+    }
+    
+    if (! decoder->open (file))
+    {
+        delete decoder;
+        return false;
+    }
+    
+    bool ok = true;
+    
+    if (decoder->getNumChannels() > Storage::maxChannels || decoder->getNumFrames() > (uint32_t) Storage::maxFrames)
+    {
+        Serial.println ("ERROR: this MP3 file doesn't fit in the AudioFile's static buffers");
+        ok = false;
+    }
+    
+    if (ok)
+    {
+        audioFileFormat = AudioFileFormat::Mp3;
+        sampleRate = decoder->getSampleRate();
+        bitDepth = 16;
+        
+        AUDIOFILE_PROFILE_STOP (headerTimer, profileStats, ProfileStage::HeaderParse, decoder->getStreamInfo().firstBlockOffset);
+        
+        ok = decodeBlocks (*decoder, typename Storage::Decoding());
+        
+        if (decoder->getNumCorruptBlocks() > 0)
+            Serial.println ("WARNING: some frames of this MP3 file couldn't be decoded and have been replaced with silence");
+    }
+    
+    // the decoder closes the file, so it mustn't be closed again
+    decoder->close();
+    file = File();
+    delete decoder;
+    return ok;
+#endif
+}
+
+//=============================================================
+template <class T, class Storage>
+template <class Decoder>
+int AudioFile<T, Storage>::getNumFramesToReserve (const Decoder& decoder)
+{
+    int numSamples = (int) decoder.getNumFrames();
+    
+    if (numSamples <= 0)
+        return 0;
+    
+    // the header's length is only trusted as far as the file's blocks could decode to: music
+    // rarely compresses by more than 16:1 against 16 bit PCM, and a file that does (or
+    // whose length is unknown) grows its samples as it is decoded
+    uint32_t firstBlockOffset = decoder.getStreamInfo().firstBlockOffset;
+    uint32_t endOffset = decoder.getStreamInfo().endOffset;
+    uint64_t maxFrames = endOffset > firstBlockOffset ? (uint64_t) (endOffset - firstBlockOffset) * 8 / (uint64_t) decoder.getNumChannels() : 0;
+    
+    return (uint64_t) numSamples < maxFrames ? numSamples : (int) maxFrames;
+}
+
+//=============================================================
+template <class T, class Storage>
+template <class Decoder>
+bool AudioFile<T, Storage>::decodeBlocks (Decoder& decoder, DecodeOnLoad)
+{
+    int numChannels = decoder.getNumChannels();
+    int numSamples = (int) decoder.getNumFrames();
+    bool lengthIsKnown = numSamples > 0;
+    int numReserved = getNumFramesToReserve (decoder);
+    bool ok = true;
+    
+    clearAudioBuffer();
+    samples.resize (numChannels);
+    
+    for (int channel = 0; channel < numChannels; channel++)
+        samples[channel].reserve (numReserved);
+    
+    if (analysisSink != nullptr)
+        analysisSink->begin (sampleRate, numChannels);
+    
+    // the samples grow as blocks decode, so a truncated file keeps the frames that were there
+    int numDecoded = 0;
+    
+    while (ok && (! lengthIsKnown || numDecoded < numSamples))
+    {
+        AUDIOFILE_PROFILE_START (decodeTimer);
+        int numFrames = decoder.decodeBlock();
+        
+        if (numFrames <= 0)
+            break;
+        
+        // the last block may run past a length the header got wrong
+        if (lengthIsKnown && numFrames > numSamples - numDecoded)
+            numFrames = numSamples - numDecoded;
+        
+        if (numFrames > Storage::maxFrames - numDecoded)
+        {
+            Serial.println ("ERROR: this file doesn't fit in the AudioFile's static buffers");
+            ok = false;
+            break;
+        }
+        
+        int newSize = numDecoded + numFrames;
+        
+        for (int channel = 0; channel < numChannels && ok; channel++)
+        {
+            // grow geometrically, so the samples aren't copied for every block
+            if (samples[channel].getCapacity() < newSize)
             {
-                int32_t sampleAsIntAgain = (int32_t) (samples[channel][i] * (T)8388608.);
-                
-                uint8_t bytes[3];
-                bytes[2] = (uint8_t) (sampleAsIntAgain >> 16) & 0xFF;
-                bytes[1] = (uint8_t) (sampleAsIntAgain >>  8) & 0xFF;
-                bytes[0] = (uint8_t) sampleAsIntAgain & 0xFF;
-                
-                fileData.Append(bytes[0]);
-                fileData.Append(bytes[1]);
-                fileData.Append(bytes[2]);
+                int newCapacity = newSize < Storage::maxFrames / 2 ? 2 * newSize : Storage::maxFrames;
+                samples[channel].reserve (lengthIsKnown && newCapacity > numSamples ? numSamples : newCapacity);
             }
-            else
+            
+            samples[channel].resize (newSize);
+            
+            if (samples[channel].size() != newSize)
             {
-                // assert (false && "Trying to write a file with unsupported bit depth");
-                Serial.println("Trying to write a file with unsupported bit depth");
-                return false;
+                Serial.println ("ERROR: there isn't enough memory to load this file");
+                ok = false;
             }
         }
+        
+        if (! ok)
+            break;
+        
+        for (int channel = 0; channel < numChannels; channel++)
+            decodeBlockChannel (decoder, channel, 0, samples[channel].getData() + numDecoded, numFrames);
+        
+        AUDIOFILE_PROFILE_STOP (decodeTimer, profileStats, ProfileStage::Decode, numFrames * numChannels * (bitDepth / 8));
+        
+        if (analysisSink != nullptr)
+            feedAnalysisSink (numDecoded, numDecoded + numFrames);
+        
+        numDecoded += numFrames;
     }
     
+    if (analysisSink != nullptr)
+        analysisSink->end();
+    
+    if (! ok)
+        clearAudioBuffer();
+    
+    return ok;
+}
+
+#if AUDIOFILE_WITH_FLAC
+//=============================================================
+template <class T, class Storage>
+void AudioFile<T, Storage>::decodeBlockChannel (const FlacDecoder<T>& decoder, int channel, int startFrame, T* destination, int numFrames)
+{
+    decodeFlacSamples (decoder.getBlockChannel (channel) + startFrame, bitDepth, destination, numFrames);
+}
+#endif
+
+#if AUDIOFILE_WITH_MP3
+//=============================================================
+template <class T, class Storage>
+void AudioFile<T, Storage>::decodeBlockChannel (const Mp3Decoder<T>& decoder, int channel, int startFrame, T* destination, int numFrames)
+{
+    decodeMp3Samples (decoder.getBlockChannel (channel) + startFrame, destination, numFrames);
+}
+#endif
+
+//=============================================================
+template <class T, class Storage>
+template <class Decoder>
+bool AudioFile<T, Storage>::decodeBlocks (Decoder& decoder, CompressOnLoad)
+{
+    int numChannels = decoder.getNumChannels();
+    int numSamples = (int) decoder.getNumFrames();
+    bool lengthIsKnown = numSamples > 0;
+    
+    samples.resize (numChannels);
+    samples.reserve (getNumFramesToReserve (decoder));
+    
+    if (analysisSink != nullptr)
+        analysisSink->begin (sampleRate, numChannels);
+    
+    // each decoded block is converted and encoded in pieces the size of the buffer's blocks
+    T decoded[Storage::maxChannels * Storage::blockFrames];
+    int numDecoded = 0;
+    bool ok = true;
+    
+    while (ok && (! lengthIsKnown || numDecoded < numSamples))
+    {
+        AUDIOFILE_PROFILE_START (decodeTimer);
+        int numFrames = decoder.decodeBlock();
+        
+        if (numFrames <= 0)
+            break;
+        
+        // the last block may run past a length the header got wrong
+        if (lengthIsKnown && numFrames > numSamples - numDecoded)
+            numFrames = numSamples - numDecoded;
+        
+        for (int startFrame = 0; startFrame < numFrames && ok; startFrame += Storage::blockFrames)
+        {
+            int numPieceFrames = numFrames - startFrame < Storage::blockFrames ? numFrames - startFrame : Storage::blockFrames;
+            
+            for (int channel = 0; channel < numChannels; channel++)
+                decodeBlockChannel (decoder, channel, startFrame, decoded + channel * Storage::blockFrames, numPieceFrames);
+            
+            ok = compressFrames (decoded, numPieceFrames);
+        }
+        
+        AUDIOFILE_PROFILE_STOP (decodeTimer, profileStats, ProfileStage::Decode, numFrames * numChannels * (bitDepth / 8));
+        numDecoded += numFrames;
+    }
+    
+    if (analysisSink != nullptr)
+        analysisSink->end();
+    
+    if (! ok)
+        clearAudioBuffer();
+    
+    return ok;
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::compressFrames (const T* source, int numFrames)
+{
+    // source holds each channel's frames Storage::blockFrames apart, and is fed to
+    // the sink from there rather than decoded again from the buffer
+    if (analysisSink != nullptr)
+    {
+        T frame[2];
+        
+        for (int i = 0; i < numFrames; i++)
+        {
+            for (int channel = 0; channel < getNumChannels(); channel++)
+                frame[channel] = source[channel * Storage::blockFrames + i];
+            
+            analysisSink->processFrame (frame);
+        }
+    }
+    
+    for (int channel = 0; channel < getNumChannels(); channel++)
+    {
+        if (! samples.appendSamples (channel, source + channel * Storage::blockFrames, numFrames))
+        {
+            Serial.println ("ERROR: there isn't enough memory to load this file");
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::loadFromFile (File& file, const String& filePath, DecodeOnAccess)
+{
+    AUDIOFILE_PROFILE_START (headerTimer);
+    WaveFormat format;
+    
+    if (! readWaveFormat (file, format))
+    {
+        Serial.println ("ERROR: this doesn't seem to be a valid .WAV file");
+        file.close();
+        return false;
+    }
+    
+    // the file stays open for the buffer to read blocks from as they are needed
+    if (! samples.attach (file, format))
+    {
+        Serial.println ("ERROR: this WAV file has more channels than the AudioFile's view can hold");
+        file.close();
+        return false;
+    }
+    
+    audioFileFormat = AudioFileFormat::Wave;
+    sampleRate = format.sampleRate;
+    bitDepth = (int) format.bitDepth;
+    
+    AUDIOFILE_PROFILE_STOP (headerTimer, profileStats, ProfileStage::HeaderParse, format.dataOffset);
+    (void) filePath;
+    return true;
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::loadFromFile (File& file, const String& filePath, CompressOnLoad)
+{
+    uint8_t header[4];
+    int numHeaderBytes = file.read (header, 4);
+    file.seek (0);
+    
+    // every format is decoded a block at a time and each block encoded as it arrives,
+    // so neither the file nor its decoded samples are ever all in memory
+    AudioFileFormat format = determineAudioFileFormat (header, numHeaderBytes);
+    bool ok;
+    
+    if (format == AudioFileFormat::Flac)
+        ok = decodeFlacFile (file);
+    else if (format == AudioFileFormat::Mp3)
+        ok = decodeMp3File (file);
+    else
+        ok = compressWaveFile (file);
+    
+    file.close();
+    (void) filePath;
+    return ok;
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::compressWaveFile (File& file)
+{
+    AUDIOFILE_PROFILE_START (headerTimer);
+    
+    // leaves the file at the first sample
+    WaveFormat format;
+    
+    if (! readWaveFormat (file, format))
+    {
+        Serial.println ("ERROR: this doesn't seem to be a valid .WAV file");
+        return false;
+    }
+    
+    int numChannels = (int) format.numChannels;
+    int numSamples = (int) format.getNumFrames();
+    int numBytesPerBlock = (int) format.numBytesPerBlock;
+    int numBytesPerSample = (int) format.bitDepth / 8;
+    
+    if (numChannels > 2)
+    {
+        Serial.println ("ERROR: this WAV file seems to be neither mono nor stereo (perhaps multi-track, or corrupted?)");
+        return false;
+    }
+    
+    if (numChannels > Storage::maxChannels || numBytesPerBlock * Storage::blockFrames > Storage::blockBytes)
+    {
+        Serial.println ("ERROR: this WAV file has more channels than the AudioFile's buffer can hold");
+        return false;
+    }
+    
+    audioFileFormat = AudioFileFormat::Wave;
+    sampleRate = format.sampleRate;
+    bitDepth = (int) format.bitDepth;
+    
+    AUDIOFILE_PROFILE_STOP (headerTimer, profileStats, ProfileStage::HeaderParse, format.dataOffset);
+    
+    // readWaveFormat() has already cut the data size down to the bytes in the file, so a
+    // header that claims more (e.g. a recording that was never stopped) reserves no more
+    samples.resize (numChannels);
+    samples.reserve (numSamples);
+    
+    if (analysisSink != nullptr)
+        analysisSink->begin (sampleRate, numChannels);
+    
+    uint8_t block[Storage::blockBytes];
+    T decoded[Storage::maxChannels * Storage::blockFrames];
+    
+    for (int startFrame = 0; startFrame < numSamples; startFrame += Storage::blockFrames)
+    {
+        int numFrames = numSamples - startFrame < Storage::blockFrames ? numSamples - startFrame : Storage::blockFrames;
+        
+        AUDIOFILE_PROFILE_START (readTimer);
+        int numBytesRead = file.read (block, numFrames * numBytesPerBlock);
+        AUDIOFILE_PROFILE_STOP (readTimer, profileStats, ProfileStage::FileRead, numBytesRead > 0 ? numBytesRead : 0);
+        
+        int numFramesRead = numBytesRead > 0 ? numBytesRead / numBytesPerBlock : 0;
+        
+        AUDIOFILE_PROFILE_START (decodeTimer);
+        
+        for (int channel = 0; channel < numChannels; channel++)
+            decodePcmSamples (block + channel * numBytesPerSample, bitDepth, decoded + channel * Storage::blockFrames,
+                              numFramesRead, numBytesPerBlock);
+        
+        bool ok = compressFrames (decoded, numFramesRead);
+        AUDIOFILE_PROFILE_STOP (decodeTimer, profileStats, ProfileStage::Decode, numFramesRead * numBytesPerBlock);
+        
+        if (! ok)
+        {
+            if (analysisSink != nullptr)
+                analysisSink->end();
+            
+            clearAudioBuffer();
+            return false;
+        }
+        
+        // a truncated file keeps the frames that were there
+        if (numFramesRead < numFrames)
+            break;
+    }
+    
+    if (analysisSink != nullptr)
+        analysisSink->end();
+    
+    return true;
+}
+
+//=============================================================
+template <class T, class Storage>
+void AudioFile<T, Storage>::feedAnalysisSink (int startFrame, int endFrame)
+{
+    // decoding only accepts mono and stereo files
+    T frame[2];
+    const AudioBuffer& source = samples;
+    
+    for (int i = startFrame; i < endFrame; i++)
+    {
+        for (int channel = 0; channel < getNumChannels(); channel++)
+            frame[channel] = source[channel][i];
+        
+        analysisSink->processFrame (frame);
+    }
+}
+
+//=============================================================
+template <class T, class Storage>
+void AudioFile<T, Storage>::decodeFrames (const uint8_t* source, int startFrame, int numFrames, int numBytesPerBlock)
+{
+    // source points at the first of the frames, which go to startFrame onwards
+    int numBytesPerSample = bitDepth / 8;
+    
+    for (int channel = 0; channel < getNumChannels(); channel++)
+    {
+        const uint8_t* channelSource = source + channel * numBytesPerSample;
+        decodePcmSamples (channelSource, bitDepth, samples[channel].getData() + startFrame, numFrames, numBytesPerBlock);
+    }
+}
+
+//=============================================================
+template <class T, class Storage>
+void AudioFile<T, Storage>::encodeFrames (uint8_t* destination, int startFrame, int numFrames, int numBytesPerBlock)
+{
+    // frames from startFrame onwards go to the start of destination
+    int numBytesPerSample = bitDepth / 8;
+    
+    // read through a const reference, so saving a shared buffer doesn't unshare it
+    const AudioBuffer& source = samples;
+    
+    for (int channel = 0; channel < getNumChannels(); channel++)
+    {
+        uint8_t* channelDestination = destination + channel * numBytesPerSample;
+        encodePcmSamples (source[channel].getData() + startFrame, numFrames, bitDepth, channelDestination, numBytesPerBlock);
+    }
+}
+
+//=============================================================
+template <class T, class Storage>
+template <class Function>
+void AudioFile<T, Storage>::forEachFrameRange (int numFrames, Function function)
+{
+#ifndef ARDUINO
+    // below this many frames per thread the hand-off costs more than it saves
+    const int minFramesPerRange = 1 << 16;
+    
+    if (useThreads && numFrames >= 2 * minFramesPerRange)
+    {
+        ThreadPool& pool = getSharedThreadPool();
+        
+        // a few ranges per thread so that a slow thread doesn't hold everything up
+        int framesPerRange = numFrames / (pool.getNumThreads() * 4);
+        
+        if (framesPerRange < minFramesPerRange)
+            framesPerRange = minFramesPerRange;
+        
+        pool.parallelFor (0, (size_t)numFrames, (size_t)framesPerRange, [&] (size_t startFrame, size_t endFrame, int)
+        {
+            function ((int)startFrame, (int)endFrame);
+        });
+        
+        return;
+    }
+#endif
+    
+    function (0, numFrames);
+}
+
+//=============================================================
+/*template <class T, class Storage>
+bool AudioFile<T, Storage>::tenByteMatch (std::vector<uint8_t>& v1, int startIndex1, std::vector<uint8_t>& v2, int startIndex2)
+{
+    for (int i = 0; i < 10; i++)
+    {
+        if (v1[startIndex1 + i] != v2[startIndex2 + i])
+            return false;
+    }
+    
+    return true;
+}*/
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::save (const String& filePath, AudioFileFormat format)
+{
+    if (format == AudioFileFormat::Wave)
+    {
+        return saveToWaveFile (filePath);
+    }
+    
+    return false;
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::saveToWaveFile (const String& filePath)
+{
+    if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24)
+    {
+        // assert (false && "Trying to write a file with unsupported bit depth");
+        Serial.println("Trying to write a file with unsupported bit depth");
+        return false;
+    }
+    
+    // the sizes in the header, and the buffer the file is built in, are limited to 2 GB
+    uint64_t numDataBytes = (uint64_t) getNumSamplesPerChannel() * (uint64_t) (getNumChannels() * bitDepth / 8);
+    
+    if (numDataBytes > 0x7FFFFFFF - 512)
+    {
+        Serial.println ("ERROR: files of 2 GB or more can't be saved: " + filePath);
+        return false;
+    }
+    
+    int32_t dataChunkSize = (int32_t) numDataBytes;
+    return saveToWaveFile (filePath, dataChunkSize, typename Storage::Decoding());
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::saveToWaveFile (const String& filePath, int32_t dataChunkSize, DecodeOnLoad)
+{
+    int16_t numBytesPerBlock = getNumChannels() * (bitDepth / 8);
+    
+    // with static allocation there is no room for the whole file, so it is encoded a block at a time
+    if (Storage::isStatic)
+        return saveToWaveFileInBlocks (filePath, dataChunkSize);
+    
+    AUDIOFILE_PROFILE_START (encodeTimer);
+    
+    DynamicArray<uint8_t> fileData;
+    addWaveHeaderToFileData (fileData, dataChunkSize);
+    
+    // the whole file is allocated at once and each frame is encoded straight into its place
+    int numHeaderBytes = fileData.size();
+    fileData.resize (numHeaderBytes + dataChunkSize);
+    
+    if (fileData.size() != numHeaderBytes + dataChunkSize)
+    {
+        Serial.println ("ERROR: there isn't enough memory to save this file");
+        return false;
+    }
+    
+    uint8_t* sampleData = fileData.getData() + numHeaderBytes;
+    
+    forEachFrameRange (getNumSamplesPerChannel(), [&] (int startFrame, int endFrame)
+    {
+        encodeFrames (sampleData + startFrame * numBytesPerBlock, startFrame, endFrame - startFrame, numBytesPerBlock);
+    });
+    
     // check that the various sizes we put in the metadata are correct
-    if (fileSizeInBytes != (fileData.size() - 8) || dataChunkSize != (getNumSamplesPerChannel() * getNumChannels() * (bitDepth / 8)))
+    if (fourBytesToInt (fileData, 4) != (fileData.size() - 8) || dataChunkSize != (getNumSamplesPerChannel() * getNumChannels() * (bitDepth / 8)))
     {
         // std::cout << "ERROR: couldn't save file to " << filePath << std::endl;
-        Serial.println("ERROR: couldn't save file to ", filePath);
+        Serial.println ("ERROR: couldn't save file to " + filePath);
 
         return false;
     }
     
+    AUDIOFILE_PROFILE_STOP (encodeTimer, profileStats, ProfileStage::Encode, fileData.size());
+    
     // try to write the file
     return writeDataToFile (fileData, filePath);
 }
 
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::saveToWaveFileInBlocks (const String& filePath, int32_t dataChunkSize)
+{
+    FixedArray<uint8_t, 44> header;
+    addWaveHeaderToFileData (header, dataChunkSize);
+    
+    BufferedWriter<> writer;
+    
+    if (! writer.open (filePath, (uint32_t) (header.size() + dataChunkSize)))
+    {
+        Serial.println ("ERROR: couldn't save file to " + filePath);
+        return false;
+    }
+    
+    bool ok = writer.write (header.getData(), header.size());
+    
+    int numBytesPerBlock = getNumChannels() * (bitDepth / 8);
+    int numSamples = getNumSamplesPerChannel();
+    int framesPerBlock = Storage::blockBytes / numBytesPerBlock;
+    uint8_t block[Storage::blockBytes];
+    
+    for (int startFrame = 0; ok && startFrame < numSamples; startFrame += framesPerBlock)
+    {
+        int numFrames = numSamples - startFrame < framesPerBlock ? numSamples - startFrame : framesPerBlock;
+        int numBytes = numFrames * numBytesPerBlock;
+        
+        AUDIOFILE_PROFILE_START (encodeTimer);
+        encodeFrames (block, startFrame, numFrames, numBytesPerBlock);
+        AUDIOFILE_PROFILE_STOP (encodeTimer, profileStats, ProfileStage::Encode, numBytes);
+        
+        AUDIOFILE_PROFILE_START (writeTimer);
+        ok = writer.write (block, numBytes);
+        AUDIOFILE_PROFILE_STOP (writeTimer, profileStats, ProfileStage::FileWrite, numBytes);
+    }
+    
+    ok = writer.close() && ok;
+    
+    if (! ok)
+        Serial.println ("ERROR: couldn't save file to " + filePath);
+    
+    return ok;
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::saveToWaveFile (const String& filePath, int32_t dataChunkSize, CompressOnLoad)
+{
+    // compressed samples are read back a block at a time, just like a view's
+    return saveToWaveFile (filePath, dataChunkSize, DecodeOnAccess());
+}
 
 //=============================================================
-template <class T>
-bool AudioFile<T>::writeDataToFile (LinkedList<uint8_t>& fileData, String filePath)
+template <class T, class Storage>
+bool AudioFile<T, Storage>::saveToWaveFile (const String& filePath, int32_t dataChunkSize, DecodeOnAccess)
 {
-    std::ofstream outputFile (filePath, std::ios::binary);
+    FixedArray<uint8_t, 44> header;
+    addWaveHeaderToFileData (header, dataChunkSize);
+    
+    // the samples are read from the file being viewed, so that file can't be the one written
+    BufferedWriter<> writer;
     
-    if (outputFile.is_open())
+    if (! writer.open (filePath, (uint32_t) (header.size() + dataChunkSize)))
     {
-        for (int i = 0; i < fileData.size(); i++)
-        {
-            char value = (char) fileData[i];
-            outputFile.write (&value, sizeof (char));
-        }
+        Serial.println ("ERROR: couldn't save file to " + filePath);
+        return false;
+    }
+    
+    bool ok = writer.write (header.getData(), header.size());
+    
+    // the view decodes a block of every channel at a time, so encode in the same blocks
+    int numChannels = getNumChannels();
+    int numSamples = getNumSamplesPerChannel();
+    int numBytesPerSample = bitDepth / 8;
+    int numBytesPerBlock = numChannels * numBytesPerSample;
+    uint8_t block[Storage::blockBytes];
+    
+    for (int startFrame = 0; ok && startFrame < numSamples; startFrame += Storage::blockFrames)
+    {
+        int numFrames = numSamples - startFrame < Storage::blockFrames ? numSamples - startFrame : Storage::blockFrames;
+        int numBytes = numFrames * numBytesPerBlock;
         
-        outputFile.close();
+        AUDIOFILE_PROFILE_START (encodeTimer);
         
-        return true;
+        for (int channel = 0; channel < numChannels; channel++)
+            encodePcmSamples (samples.getBlock (channel, startFrame / Storage::blockFrames), numFrames, bitDepth,
+                              block + channel * numBytesPerSample, numBytesPerBlock);
+        
+        AUDIOFILE_PROFILE_STOP (encodeTimer, profileStats, ProfileStage::Encode, numBytes);
+        
+        AUDIOFILE_PROFILE_START (writeTimer);
+        ok = writer.write (block, numBytes);
+        AUDIOFILE_PROFILE_STOP (writeTimer, profileStats, ProfileStage::FileWrite, numBytes);
     }
     
-    return false;
+    ok = writer.close() && ok;
+    
+    if (! ok)
+        Serial.println ("ERROR: couldn't save file to " + filePath);
+    
+    return ok;
+}
+
+//=============================================================
+template <class T, class Storage>
+template <class Container>
+void AudioFile<T, Storage>::addWaveHeaderToFileData (Container& fileData, int32_t dataChunkSize)
+{
+    // -----------------------------------------------------------
+    // HEADER CHUNK
+    addStringToFileData (fileData, "RIFF");
+    
+    // The file size in bytes is the header chunk size (4, not counting RIFF and WAVE) + the format
+    // chunk size (24) + the metadata part of the data chunk plus the actual data chunk size
+    int32_t fileSizeInBytes = 4 + 24 + 8 + dataChunkSize;
+    addInt32ToFileData (fileData, fileSizeInBytes);
+    
+    addStringToFileData (fileData, "WAVE");
+    
+    // -----------------------------------------------------------
+    // FORMAT CHUNK
+    addStringToFileData (fileData, "fmt ");
+    addInt32ToFileData (fileData, 16); // format chunk size (16 for PCM)
+    addInt16ToFileData (fileData, 1); // audio format = 1
+    addInt16ToFileData (fileData, (uint16_t)getNumChannels()); // num channels
+    addInt32ToFileData (fileData, (uint32_t)sampleRate); // sample rate
+    
+    int32_t numBytesPerSecond = (uint32_t) ((getNumChannels() * sampleRate * bitDepth) / 8);
+    addInt32ToFileData (fileData, numBytesPerSecond);
+    
+    int16_t numBytesPerBlock = getNumChannels() * (bitDepth / 8);
+    addInt16ToFileData (fileData, numBytesPerBlock);
+    
+    addInt16ToFileData (fileData, (uint16_t)bitDepth);
+    
+    // -----------------------------------------------------------
+    // DATA CHUNK
+    addStringToFileData (fileData, "data");
+    addInt32ToFileData (fileData, dataChunkSize);
+}
+
+//=============================================================
+template <class T, class Storage>
+bool AudioFile<T, Storage>::writeDataToFile (DynamicArray<uint8_t>& fileData, const String& filePath)
+{
+    AUDIOFILE_PROFILE_STAGE (profileStats, ProfileStage::FileWrite, fileData.size());
+    
+    // std::ofstream outputFile (filePath, std::ios::binary);
+    
+    // the file goes out in whole sectors, with its clusters reserved up front
+    BufferedWriter<> writer;
+    
+    if (! writer.open (filePath, (uint32_t) fileData.size()))
+        return false;
+    
+    writer.write (fileData.getData(), (uint32_t) fileData.size());
+    return writer.close();
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::addStringToFileData (LinkedList<uint8_t>& fileData, String s)
+template <class T, class Storage>
+template <class Container>
+void AudioFile<T, Storage>::addStringToFileData (Container& fileData, const char* s)
 {
-    for (int i = 0; i < s.length();i++)
+    for (int i = 0; s[i] != 0;i++)
         fileData.Append((uint8_t) s[i]);
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::addInt32ToFileData (LinkedList<uint8_t>& fileData, uint32_t i, Endianness endianness)
+template <class T, class Storage>
+template <class Container>
+void AudioFile<T, Storage>::addInt32ToFileData (Container& fileData, int32_t i, Endianness endianness)
 {
     uint8_t bytes[4];
     
@@ -704,8 +1967,9 @@ void AudioFile<T>::addInt32ToFileData (LinkedList<uint8_t>& fileData, uint32_t i
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::addInt16ToFileData (LinkedList<uint8_t>& fileData, uint16_t i, Endianness endianness)
+template <class T, class Storage>
+template <class Container>
+void AudioFile<T, Storage>::addInt16ToFileData (Container& fileData, int16_t i, Endianness endianness)
 {
     uint8_t bytes[2];
     
@@ -725,49 +1989,52 @@ void AudioFile<T>::addInt16ToFileData (LinkedList<uint8_t>& fileData, uint16_t i
 }
 
 //=============================================================
-template <class T>
-void AudioFile<T>::clearAudioBuffer()
+template <class T, class Storage>
+void AudioFile<T, Storage>::clearAudioBuffer()
 {
-    for (int i = 0; i < samples.size();i++)
-    {
-        samples[i].clear();
-    }
-    
+    // emptying the outer array frees (or resets) every channel, and doesn't copy channels
+    // that are shared with another AudioFile just to empty them
     samples.clear();
 }
 
 //=============================================================
-template <class T>
-AudioFileFormat AudioFile<T>::determineAudioFileFormat (String fileData)
+template <class T, class Storage>
+AudioFileFormat AudioFile<T, Storage>::determineAudioFileFormat (const uint8_t* header, int numBytes)
 {
+    if (numBytes < 4)
+        return AudioFileFormat::Error;
+    
     // std::string header (fileData.begin(), fileData.begin() + 4);
-    String header = splitString(fileData, 0, 4);
-
-    if (header == "RIFF")
+    if (memcmp (header, "RIFF", 4) == 0)
         return AudioFileFormat::Wave;
     // else if (header == "FORM")
         // return AudioFileFormat::Aiff;
+    else if (memcmp (header, "fLaC", 4) == 0)
+        return AudioFileFormat::Flac;
+    // an ID3v2 tag, or the sync word of an MPEG audio frame
+    else if (memcmp (header, "ID3", 3) == 0 || (header[0] == 0xFF && (header[1] & 0xE0) == 0xE0))
+        return AudioFileFormat::Mp3;
     else
         return AudioFileFormat::Error;
 }
 
 //=============================================================
-template <class T>
-int32_t AudioFile<T>::fourBytesToInt (String source, int startIndex, Endianness endianness)
+template <class T, class Storage>
+int32_t AudioFile<T, Storage>::fourBytesToInt (DynamicArray<uint8_t>& source, int startIndex, Endianness endianness)
 {
     int32_t result;
     
     if (endianness == Endianness::LittleEndian)
-        result = (source[startIndex + 3] << 24) | (source[startIndex + 2] << 16) | (source[startIndex + 1] << 8) | source[startIndex];
+        result = ((uint32_t)source[startIndex + 3] << 24) | ((uint32_t)source[startIndex + 2] << 16) | ((uint32_t)source[startIndex + 1] << 8) | source[startIndex];
     else
-        result = (source[startIndex] << 24) | (source[startIndex + 1] << 16) | (source[startIndex + 2] << 8) | source[startIndex + 3];
+        result = ((uint32_t)source[startIndex] << 24) | ((uint32_t)source[startIndex + 1] << 16) | ((uint32_t)source[startIndex + 2] << 8) | source[startIndex + 3];
     
     return result;
 }
 
 //=============================================================
-template <class T>
-int16_t AudioFile<T>::twoBytesToInt (String source, int startIndex, Endianness endianness)
+template <class T, class Storage>
+int16_t AudioFile<T, Storage>::twoBytesToInt (DynamicArray<uint8_t>& source, int startIndex, Endianness endianness)
 {
     int16_t result;
     
@@ -780,18 +2047,16 @@ int16_t AudioFile<T>::twoBytesToInt (String source, int startIndex, Endianness e
 }
 
 //=============================================================
-template <class T>
-int AudioFile<T>::getIndexOfString (String source, String stringToSearchFor)
+template <class T, class Storage>
+int AudioFile<T, Storage>::getIndexOfString (DynamicArray<uint8_t>& source, const char* stringToSearchFor)
 {
     int index = -1;
-    int stringLength = (int) stringToSearchFor.length();
+    int stringLength = (int) strlen (stringToSearchFor);
     
-    for (int i = 0; i < source.length() - stringLength;i++)
+    for (int i = 0; i <= source.size() - stringLength;i++)
     {
         // std::string section (source.begin() + i, source.begin() + i + stringLength);
-        String section = splitString(source, i, i + stringLength);
-        
-        if (section == stringToSearchFor)
+        if (memcmp (source.getData() + i, stringToSearchFor, stringLength) == 0)
         {
             index = i;
             break;
@@ -802,23 +2067,33 @@ int AudioFile<T>::getIndexOfString (String source, String stringToSearchFor)
 }
 
 //=============================================================
-template <class T>
-T AudioFile<T>::sixteenBitIntToSample (int16_t sample)
+template <class T, class Storage>
+bool AudioFile<T, Storage>::fourCharsMatch (DynamicArray<uint8_t>& source, int startIndex, const char* s)
+{
+    if (startIndex + 4 > source.size())
+        return false;
+    
+    return memcmp (source.getData() + startIndex, s, 4) == 0;
+}
+
+//=============================================================
+template <class T, class Storage>
+T AudioFile<T, Storage>::sixteenBitIntToSample (int16_t sample)
 {
     return static_cast<T> (sample) / static_cast<T> (32768.);
 }
 
 //=============================================================
-template <class T>
-int16_t AudioFile<T>::sampleToSixteenBitInt (T sample)
+template <class T, class Storage>
+int16_t AudioFile<T, Storage>::sampleToSixteenBitInt (T sample)
 {
     sample = clamp (sample, -1., 1.);
     return static_cast<int16_t> (sample * 32767.);
 }
 
 //=============================================================
-template <class T>
-uint8_t AudioFile<T>::sampleToSingleByte (T sample)
+template <class T, class Storage>
+uint8_t AudioFile<T, Storage>::sampleToSingleByte (T sample)
 {
     sample = clamp (sample, -1., 1.);
     sample = (sample + 1.) / 2.;
@@ -826,21 +2101,21 @@ uint8_t AudioFile<T>::sampleToSingleByte (T sample)
 }
 
 //=============================================================
-template <class T>
-T AudioFile<T>::singleByteToSample (uint8_t sample)
+template <class T, class Storage>
+T AudioFile<T, Storage>::singleByteToSample (uint8_t sample)
 {
     return static_cast<T> (sample - 128) / static_cast<T> (128.);
 }
 
 //=============================================================
-template <class T>
-T AudioFile<T>::clamp (T value, T minValue, T maxValue)
+template <class T, class Storage>
+T AudioFile<T, Storage>::clamp (T value, T minValue, T maxValue)
 {
     // value = std::min (value, maxValue);
-    value = ((value < minValue) ? value : minValue);
+    value = ((value < maxValue) ? value : maxValue);
 
     // value = std::max (value, minValue);
-    value = ((value > maxValue) ? value : maxValue);
+    value = ((value > minValue) ? value : minValue);
 
     return value;
 }
@@ -0,0 +1,154 @@
+#ifndef BlockCache_h
+#define BlockCache_h
+
+#include <stdint.h>
+
+/** The cache of decoded blocks behind LazySampleBuffer and AdpcmSampleBuffer.
+ *
+ * It holds NumSlots slots of SlotSize samples. find() returns the slot holding a
+ * block if there is one; otherwise the owner takes the least recently used slot with
+ * claim() and decodes the block into it. The slot used last is checked before any
+ * search, since reads mostly walk through one block.
+ *
+ * The buffers fill their caches from reads, which are const like reads of any other
+ * buffer, so they keep them mutable.
+ */
+template <class T, int SlotSize, int NumSlots>
+class BlockCache
+{
+public:
+
+    static_assert (SlotSize > 0 && NumSlots > 0, "BlockCache sizes must be positive");
+
+    /** Constructor. The cache starts empty */
+    BlockCache();
+
+    /** Forgets every block and resets the counts */
+    void clear();
+
+    /** Forgets the blocks from blockIndex onwards, whose samples have changed */
+    void forgetFrom (int blockIndex);
+
+    /** @Returns the slot holding a block, or nullptr if it isn't cached */
+    T* find (int blockIndex);
+
+    /** Gives the least recently used slot to a block that isn't cached.
+     * @Returns the slot, which the caller must decode the block into
+     */
+    T* claim (int blockIndex);
+
+    //=============================================================
+    /** @Returns the number of reads that find() answered from the cache */
+    uint32_t getNumHits() const;
+
+    /** @Returns the number of blocks claim() has given a slot to */
+    uint32_t getNumClaims() const;
+
+private:
+
+    //=============================================================
+    T slots[NumSlots][SlotSize];
+    int slotBlocks[NumSlots];
+    uint32_t slotLastUsed[NumSlots];
+    int lastSlot;
+    uint32_t useCounter;
+    uint32_t numHits;
+    uint32_t numClaims;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int SlotSize, int NumSlots>
+BlockCache<T, SlotSize, NumSlots>::BlockCache()
+{
+    clear();
+}
+
+//=============================================================
+template <class T, int SlotSize, int NumSlots>
+void BlockCache<T, SlotSize, NumSlots>::clear()
+{
+    for (int i = 0; i < NumSlots; i++)
+    {
+        slotBlocks[i] = -1;
+        slotLastUsed[i] = 0;
+    }
+
+    lastSlot = 0;
+    useCounter = 0;
+    numHits = 0;
+    numClaims = 0;
+}
+
+//=============================================================
+template <class T, int SlotSize, int NumSlots>
+void BlockCache<T, SlotSize, NumSlots>::forgetFrom (int blockIndex)
+{
+    for (int i = 0; i < NumSlots; i++)
+    {
+        if (slotBlocks[i] >= blockIndex)
+            slotBlocks[i] = -1;
+    }
+}
+
+//=============================================================
+template <class T, int SlotSize, int NumSlots>
+T* BlockCache<T, SlotSize, NumSlots>::find (int blockIndex)
+{
+    if (slotBlocks[lastSlot] == blockIndex)
+    {
+        numHits++;
+        return slots[lastSlot];
+    }
+
+    for (int i = 0; i < NumSlots; i++)
+    {
+        if (slotBlocks[i] == blockIndex)
+        {
+            slotLastUsed[i] = ++useCounter;
+            lastSlot = i;
+            numHits++;
+            return slots[i];
+        }
+    }
+
+    return nullptr;
+}
+
+//=============================================================
+template <class T, int SlotSize, int NumSlots>
+T* BlockCache<T, SlotSize, NumSlots>::claim (int blockIndex)
+{
+    int oldest = 0;
+
+    for (int i = 1; i < NumSlots; i++)
+    {
+        if (useCounter - slotLastUsed[i] > useCounter - slotLastUsed[oldest])
+            oldest = i;
+    }
+
+    slotBlocks[oldest] = blockIndex;
+    slotLastUsed[oldest] = ++useCounter;
+    numClaims++;
+    lastSlot = oldest;
+    return slots[oldest];
+}
+
+//=============================================================
+template <class T, int SlotSize, int NumSlots>
+uint32_t BlockCache<T, SlotSize, NumSlots>::getNumHits() const
+{
+    return numHits;
+}
+
+//=============================================================
+template <class T, int SlotSize, int NumSlots>
+uint32_t BlockCache<T, SlotSize, NumSlots>::getNumClaims() const
+{
+    return numClaims;
+}
+
+#endif /* BlockCache_h */
@@ -0,0 +1,280 @@
+#ifndef BufferedWriter_h
+#define BufferedWriter_h
+
+#include <stdint.h>
+#include <string.h>
+#include <SD.h>
+
+/** Write-behind output to a File in whole sectors.
+ *
+ * Writes are gathered into a buffer of BufferSize bytes and handed to the file
+ * only when the buffer is full, so every write the card sees starts on a sector
+ * boundary and covers whole sectors. Large writes skip the buffer and go straight
+ * to the file in whole buffers. Only the last, partial buffer is written short,
+ * by close().
+ *
+ * When the final size is known, open() asks the file system to reserve the file's
+ * clusters up front (SdFat's preAllocate(), or fallocate on Linux hosts), so the
+ * card doesn't have to search for free clusters in the middle of a save.
+ *
+ *      BufferedWriter<> writer;
+ *
+ *      if (writer.open ("/out.wav", numBytes))
+ *      {
+ *          writer.write (header, 44);
+ *          writer.write (samples, numSampleBytes);
+ *          writer.close();
+ *      }
+ */
+
+//=============================================================
+/** The buffer size used by AudioFile when it saves: one SD sector on Arduino, and
+ * many sectors on hosts where each write is a system call. Must be a multiple of 512.
+ */
+#ifndef AUDIOFILE_WRITE_BUFFER_SIZE
+ #ifdef ARDUINO
+  #define AUDIOFILE_WRITE_BUFFER_SIZE 512
+ #else
+  #define AUDIOFILE_WRITE_BUFFER_SIZE 65536
+ #endif
+#endif
+
+namespace BufferedWriterHelpers
+{
+    // File types with preAllocate() (SdFat, and the host shim) reserve their clusters;
+    // for any others this does nothing
+    template <class FileType>
+    auto preAllocate (FileType& file, uint32_t numBytes, int) -> decltype (file.preAllocate (numBytes))
+    {
+        return file.preAllocate (numBytes);
+    }
+
+    template <class FileType>
+    bool preAllocate (FileType&, uint32_t, long)
+    {
+        return false;
+    }
+
+    // File types with getLastWrite() (the ESP32 FS library, and the host shim) report the
+    // modification time, which tells a cache or sidecar when its file has changed; for any others it is 0
+    template <class FileType>
+    auto getModificationTime (FileType& file, int) -> decltype ((uint32_t) file.getLastWrite())
+    {
+        return (uint32_t) file.getLastWrite();
+    }
+
+    template <class FileType>
+    uint32_t getModificationTime (FileType&, long)
+    {
+        return 0;
+    }
+
+    /** Stores the low numBytes bytes of a value, least significant first, as WAV and peak file headers are */
+    inline void writeLittleEndian (uint8_t* destination, uint32_t value, int numBytes)
+    {
+        for (int i = 0; i < numBytes; i++)
+            destination[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+template <int BufferSize = AUDIOFILE_WRITE_BUFFER_SIZE>
+class BufferedWriter
+{
+public:
+
+    static_assert (BufferSize > 0 && BufferSize % 512 == 0, "BufferedWriter's buffer must be a whole number of 512 byte sectors");
+
+    /** Constructor */
+    BufferedWriter();
+
+    /** Destructor. Closes the file, writing anything still buffered */
+    ~BufferedWriter();
+
+    /** Creates a file, replacing any file already at the path.
+     * @param expectedSize the final size of the file if it is known, to reserve its clusters, or 0
+     * @Returns true if the file was created
+     */
+    bool open (const String& filePath, uint32_t expectedSize = 0);
+
+    /** Adds bytes to the end of the file.
+     * @Returns false if this or an earlier write failed
+     */
+    bool write (const uint8_t* data, uint32_t numBytes);
+
+    /** Writes anything still buffered and closes the file.
+     * @Returns true if every write succeeded
+     */
+    bool close();
+
+    /** @Returns true if a file is open */
+    bool isOpen() const;
+
+    /** @Returns the number of bytes passed to write() since the file was opened */
+    uint32_t getNumBytesWritten() const;
+
+    /** @Returns the number of writes made to the file since it was opened */
+    uint32_t getNumFileWrites() const;
+
+    /** @Returns true if open() managed to reserve the file's clusters */
+    bool isPreAllocated() const;
+
+private:
+
+    //=============================================================
+    bool writeToFile (const uint8_t* data, uint32_t numBytes);
+
+    //=============================================================
+    File file;
+    uint8_t buffer[BufferSize];
+    uint32_t numBufferedBytes;
+    uint32_t numBytesWritten;
+    uint32_t numFileWrites;
+    bool fileIsOpen;
+    bool preAllocated;
+    bool ok;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <int BufferSize>
+BufferedWriter<BufferSize>::BufferedWriter()
+{
+    numBufferedBytes = 0;
+    numBytesWritten = 0;
+    numFileWrites = 0;
+    fileIsOpen = false;
+    preAllocated = false;
+    ok = false;
+}
+
+//=============================================================
+template <int BufferSize>
+BufferedWriter<BufferSize>::~BufferedWriter()
+{
+    close();
+}
+
+//=============================================================
+template <int BufferSize>
+bool BufferedWriter<BufferSize>::open (const String& filePath, uint32_t expectedSize)
+{
+    close();
+
+    // FILE_WRITE appends to an existing file, so replace it instead
+    if (SD.exists (filePath.c_str()))
+        SD.remove (filePath.c_str());
+
+    file = SD.open (filePath.c_str(), FILE_WRITE);
+
+    if (! file)
+        return false;
+
+    preAllocated = expectedSize > 0 && BufferedWriterHelpers::preAllocate (file, expectedSize, 0);
+    numBufferedBytes = 0;
+    numBytesWritten = 0;
+    numFileWrites = 0;
+    fileIsOpen = true;
+    ok = true;
+    return true;
+}
+
+//=============================================================
+template <int BufferSize>
+bool BufferedWriter<BufferSize>::write (const uint8_t* data, uint32_t numBytes)
+{
+    if (! fileIsOpen)
+        return false;
+
+    numBytesWritten += numBytes;
+
+    // top up a partly filled buffer first, so the file only ever grows by whole buffers
+    if (numBufferedBytes > 0)
+    {
+        uint32_t numToCopy = BufferSize - numBufferedBytes < numBytes ? BufferSize - numBufferedBytes : numBytes;
+        memcpy (buffer + numBufferedBytes, data, numToCopy);
+        numBufferedBytes += numToCopy;
+        data += numToCopy;
+        numBytes -= numToCopy;
+
+        if (numBufferedBytes < (uint32_t) BufferSize)
+            return ok;
+
+        writeToFile (buffer, BufferSize);
+        numBufferedBytes = 0;
+    }
+
+    // whole buffers go straight from the caller's memory
+    uint32_t numDirectBytes = numBytes - numBytes % BufferSize;
+
+    if (numDirectBytes > 0)
+    {
+        writeToFile (data, numDirectBytes);
+        data += numDirectBytes;
+        numBytes -= numDirectBytes;
+    }
+
+    memcpy (buffer, data, numBytes);
+    numBufferedBytes = numBytes;
+    return ok;
+}
+
+//=============================================================
+template <int BufferSize>
+bool BufferedWriter<BufferSize>::close()
+{
+    if (! fileIsOpen)
+        return ok;
+
+    if (numBufferedBytes > 0)
+        writeToFile (buffer, numBufferedBytes);
+
+    numBufferedBytes = 0;
+    file.close();
+    fileIsOpen = false;
+    return ok;
+}
+
+//=============================================================
+template <int BufferSize>
+bool BufferedWriter<BufferSize>::isOpen() const
+{
+    return fileIsOpen;
+}
+
+//=============================================================
+template <int BufferSize>
+uint32_t BufferedWriter<BufferSize>::getNumBytesWritten() const
+{
+    return numBytesWritten;
+}
+
+//=============================================================
+template <int BufferSize>
+uint32_t BufferedWriter<BufferSize>::getNumFileWrites() const
+{
+    return numFileWrites;
+}
+
+//=============================================================
+template <int BufferSize>
+bool BufferedWriter<BufferSize>::isPreAllocated() const
+{
+    return preAllocated;
+}
+
+//=============================================================
+template <int BufferSize>
+bool BufferedWriter<BufferSize>::writeToFile (const uint8_t* data, uint32_t numBytes)
+{
+    numFileWrites++;
+
+    if (file.write (data, numBytes) != numBytes)
+        ok = false;
+
+    return ok;
+}
+
+#endif /* BufferedWriter_h */
@@ -0,0 +1,473 @@
+#ifndef ClipCache_h
+#define ClipCache_h
+
+#include <stdint.h>
+#include "AudioFile.h"
+
+/** A cache of decoded clips for sounds that are played again and again.
+ *
+ * get() loads a WAV, FLAC or MP3 file through AudioFile the first time it is
+ * asked for and keeps the decoded samples, so later requests for the same path
+ * start with no SD access at all. The samples of all cached clips are kept under a byte
+ * budget; to make room, the least recently used clips are evicted first.
+ *
+ * A clip that is playing can be pinned so that it is never evicted while its
+ * samples are being read:
+ *
+ *      static ClipCache<float, 8> cache;
+ *
+ *      AudioFile<float>* beep = cache.get ("/beep.wav", true);
+ *      ...play it...
+ *      cache.unpin (beep);
+ *
+ * Each clip remembers the size and modification time its file had when it was
+ * loaded. With setCheckForChanges (true), every hit opens the file (but reads
+ * no samples) to compare them, and a file that has changed is loaded again.
+ * Modification times come from File::getLastWrite() where the SD library has
+ * it (ESP32, and the host shim); elsewhere only the size is compared.
+ */
+
+//=============================================================
+/** The default budget for the samples of all cached clips, in bytes */
+#ifndef AUDIOFILE_CLIP_CACHE_BUDGET
+ #ifdef ARDUINO
+  #define AUDIOFILE_CLIP_CACHE_BUDGET 16384UL
+ #else
+  #define AUDIOFILE_CLIP_CACHE_BUDGET 67108864UL
+ #endif
+#endif
+
+//=============================================================
+struct ClipCacheStats
+{
+    uint32_t numHits;           // get() calls answered from the cache
+    uint32_t numMisses;         // get() calls that loaded the file
+    uint32_t numEvictions;      // clips dropped to make room
+    uint32_t numReloads;        // misses because a cached clip's file had changed
+
+    /** @Returns the fraction of get() calls that were hits, from 0 to 1 */
+    float getHitRate() const
+    {
+        uint32_t numRequests = numHits + numMisses;
+        return numRequests > 0 ? (float) numHits / (float) numRequests : 0.f;
+    }
+};
+
+//=============================================================
+template <class T, int MaxClips = 8>
+class ClipCache
+{
+public:
+
+    static_assert (MaxClips > 0, "a ClipCache needs room for at least one clip");
+
+    /** Constructor */
+    ClipCache();
+
+    /** Sets the most bytes of samples the cache may hold, evicting clips if it is now over */
+    void setBudget (uint32_t numBytes);
+
+    /** Sets whether hits check that the file's size and modification time haven't changed (off by default) */
+    void setCheckForChanges (bool shouldCheck);
+
+    //=============================================================
+    /** @Returns the decoded clip for a WAV, FLAC or MP3 file, loading it if it isn't cached, or nullptr
+     * if it can't be loaded or can't fit in the budget
+     * @param pin pins the clip, as pin() does
+     */
+    AudioFile<T>* get (const String& filePath, bool pin = false);
+
+    /** @Returns true if a clip is cached, without loading it or counting a hit or miss */
+    bool contains (const String& filePath) const;
+
+    /** Stops a clip being evicted until it is unpinned. Pins are counted */
+    void pin (const AudioFile<T>* clip);
+
+    /** Undoes one pin() */
+    void unpin (const AudioFile<T>* clip);
+
+    /** Drops a clip from the cache. @Returns false if it isn't cached or is pinned */
+    bool remove (const String& filePath);
+
+    /** Drops every clip that isn't pinned */
+    void clear();
+
+    //=============================================================
+    /** @Returns the number of clips cached */
+    int getNumClips() const;
+
+    /** @Returns the bytes of samples held by the cached clips */
+    uint32_t getNumBytesUsed() const;
+
+    /** @Returns the hit, miss and eviction counters */
+    const ClipCacheStats& getStats() const;
+
+    /** Clears the counters */
+    void resetStats();
+
+private:
+
+    //=============================================================
+    struct Entry
+    {
+        AudioFile<T> clip;
+        String path;
+        uint32_t fileSize;
+        uint32_t modificationTime;
+        uint32_t numBytes;
+        uint32_t lastUsed;
+        int numPins;
+        bool used;
+    };
+
+    int findEntry (const String& filePath) const;
+    int findEntry (const AudioFile<T>* clip) const;
+    bool readFileKey (const String& filePath, uint32_t& fileSize, uint32_t& modificationTime, AudioFileInfo& info);
+    bool makeRoom (uint32_t numBytes);
+    int findLeastRecentlyUsed() const;
+    void evict (int index);
+
+    //=============================================================
+    Entry entries[MaxClips];
+    uint32_t budget;
+    uint32_t numBytesUsed;
+    uint32_t useCounter;
+    bool checkForChanges;
+    ClipCacheStats stats;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int MaxClips>
+ClipCache<T, MaxClips>::ClipCache()
+{
+    for (int i = 0; i < MaxClips; i++)
+    {
+        entries[i].used = false;
+        entries[i].numPins = 0;
+        entries[i].numBytes = 0;
+    }
+
+    budget = AUDIOFILE_CLIP_CACHE_BUDGET;
+    numBytesUsed = 0;
+    useCounter = 0;
+    checkForChanges = false;
+    resetStats();
+}
+
+//=============================================================
+template <class T, int MaxClips>
+void ClipCache<T, MaxClips>::setBudget (uint32_t numBytes)
+{
+    budget = numBytes;
+
+    while (numBytesUsed > budget)
+    {
+        int index = findLeastRecentlyUsed();
+
+        if (index < 0)
+            break;
+
+        evict (index);
+        stats.numEvictions++;
+    }
+}
+
+//=============================================================
+template <class T, int MaxClips>
+void ClipCache<T, MaxClips>::setCheckForChanges (bool shouldCheck)
+{
+    checkForChanges = shouldCheck;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+AudioFile<T>* ClipCache<T, MaxClips>::get (const String& filePath, bool pin)
+{
+    int index = findEntry (filePath);
+    uint32_t fileSize = 0;
+    uint32_t modificationTime = 0;
+    AudioFileInfo info;
+    bool haveKey = false;
+
+    if (index >= 0 && checkForChanges)
+    {
+        haveKey = readFileKey (filePath, fileSize, modificationTime, info);
+
+        if (! haveKey || fileSize != entries[index].fileSize || modificationTime != entries[index].modificationTime)
+        {
+            // a changed clip that is pinned is still being played, so it is kept as it is
+            if (entries[index].numPins == 0)
+            {
+                evict (index);
+                stats.numReloads++;
+                index = -1;
+            }
+        }
+    }
+
+    if (index >= 0)
+    {
+        Entry& entry = entries[index];
+        stats.numHits++;
+        entry.lastUsed = ++useCounter;
+
+        if (pin)
+            entry.numPins++;
+
+        return &entry.clip;
+    }
+
+    stats.numMisses++;
+
+    // the header says how much room the samples need before any of them are decoded
+    if (! haveKey && ! readFileKey (filePath, fileSize, modificationTime, info))
+        return nullptr;
+
+    uint32_t numBytes = (uint32_t) info.getNumChannels() * (uint32_t) info.getNumSamplesPerChannel() * sizeof (T);
+
+    if (! makeRoom (numBytes))
+    {
+        Serial.println ("ERROR: this clip doesn't fit in the cache's budget");
+        return nullptr;
+    }
+
+    index = findEntry ((const AudioFile<T>*) nullptr);
+
+    Entry& entry = entries[index];
+
+    if (! entry.clip.load (filePath))
+    {
+        entry.clip.samples.clear();
+        return nullptr;
+    }
+
+    // FLAC and MP3 headers may not give the length, or only roughly, so the
+    // decoded samples are what is counted against the budget
+    uint32_t numBytesLoaded = (uint32_t) entry.clip.getNumChannels() * (uint32_t) entry.clip.getNumSamplesPerChannel() * sizeof (T);
+
+    if (numBytesLoaded > numBytes && ! makeRoom (numBytesLoaded))
+    {
+        Serial.println ("ERROR: this clip doesn't fit in the cache's budget");
+        entry.clip.samples.clear();
+        return nullptr;
+    }
+
+    numBytes = numBytesLoaded;
+
+    entry.path = filePath;
+    entry.fileSize = fileSize;
+    entry.modificationTime = modificationTime;
+    entry.numBytes = numBytes;
+    entry.lastUsed = ++useCounter;
+    entry.numPins = pin ? 1 : 0;
+    entry.used = true;
+    numBytesUsed += numBytes;
+    return &entry.clip;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+bool ClipCache<T, MaxClips>::contains (const String& filePath) const
+{
+    return findEntry (filePath) >= 0;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+void ClipCache<T, MaxClips>::pin (const AudioFile<T>* clip)
+{
+    int index = findEntry (clip);
+
+    if (index >= 0 && clip != nullptr)
+        entries[index].numPins++;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+void ClipCache<T, MaxClips>::unpin (const AudioFile<T>* clip)
+{
+    int index = findEntry (clip);
+
+    if (index >= 0 && clip != nullptr && entries[index].numPins > 0)
+        entries[index].numPins--;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+bool ClipCache<T, MaxClips>::remove (const String& filePath)
+{
+    int index = findEntry (filePath);
+
+    if (index < 0 || entries[index].numPins > 0)
+        return false;
+
+    evict (index);
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+void ClipCache<T, MaxClips>::clear()
+{
+    for (int i = 0; i < MaxClips; i++)
+        if (entries[i].used && entries[i].numPins == 0)
+            evict (i);
+}
+
+//=============================================================
+template <class T, int MaxClips>
+int ClipCache<T, MaxClips>::getNumClips() const
+{
+    int numClips = 0;
+
+    for (int i = 0; i < MaxClips; i++)
+        if (entries[i].used)
+            numClips++;
+
+    return numClips;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+uint32_t ClipCache<T, MaxClips>::getNumBytesUsed() const
+{
+    return numBytesUsed;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+const ClipCacheStats& ClipCache<T, MaxClips>::getStats() const
+{
+    return stats;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+void ClipCache<T, MaxClips>::resetStats()
+{
+    memset (&stats, 0, sizeof (stats));
+}
+
+//=============================================================
+template <class T, int MaxClips>
+int ClipCache<T, MaxClips>::findEntry (const String& filePath) const
+{
+    for (int i = 0; i < MaxClips; i++)
+        if (entries[i].used && entries[i].path == filePath)
+            return i;
+
+    return -1;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+int ClipCache<T, MaxClips>::findEntry (const AudioFile<T>* clip) const
+{
+    // nullptr finds a free entry
+    for (int i = 0; i < MaxClips; i++)
+        if (clip == nullptr ? ! entries[i].used : (entries[i].used && &entries[i].clip == clip))
+            return i;
+
+    return -1;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+bool ClipCache<T, MaxClips>::readFileKey (const String& filePath, uint32_t& fileSize, uint32_t& modificationTime, AudioFileInfo& info)
+{
+    File file = SD.open (filePath.c_str());
+
+    if (! file)
+    {
+        Serial.println ("ERROR: File doesn't exist or otherwise can't load file");
+        return false;
+    }
+
+    fileSize = file.size();
+    modificationTime = BufferedWriterHelpers::getModificationTime (file, 0);
+
+    info = probeAudioFile (file);
+    file.close();
+
+    if (! info.isValid())
+    {
+        Serial.println ("ERROR: this doesn't seem to be a valid WAV, FLAC or MP3 file");
+        return false;
+    }
+
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+bool ClipCache<T, MaxClips>::makeRoom (uint32_t numBytes)
+{
+    // pinned clips stay, so find out whether they leave enough room before evicting anything
+    uint32_t numPinnedBytes = 0;
+    int numPinned = 0;
+
+    for (int i = 0; i < MaxClips; i++)
+    {
+        if (entries[i].used && entries[i].numPins > 0)
+        {
+            numPinnedBytes += entries[i].numBytes;
+            numPinned++;
+        }
+    }
+
+    if (numPinnedBytes > budget || numBytes > budget - numPinnedBytes || numPinned == MaxClips)
+        return false;
+
+    while (numBytesUsed + numBytes > budget || findEntry ((const AudioFile<T>*) nullptr) < 0)
+    {
+        int index = findLeastRecentlyUsed();
+
+        if (index < 0)
+            return false;
+
+        evict (index);
+        stats.numEvictions++;
+    }
+
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+int ClipCache<T, MaxClips>::findLeastRecentlyUsed() const
+{
+    int oldest = -1;
+
+    for (int i = 0; i < MaxClips; i++)
+    {
+        const Entry& entry = entries[i];
+
+        // the counter can wrap, so compare ages rather than raw values
+        if (entry.used && entry.numPins == 0
+            && (oldest < 0 || useCounter - entry.lastUsed > useCounter - entries[oldest].lastUsed))
+            oldest = i;
+    }
+
+    return oldest;
+}
+
+//=============================================================
+template <class T, int MaxClips>
+void ClipCache<T, MaxClips>::evict (int index)
+{
+    Entry& entry = entries[index];
+
+    // frees the samples; the entry keeps its AudioFile for the next clip
+    entry.clip.samples.clear();
+    entry.path = String();
+    numBytesUsed -= entry.numBytes;
+    entry.numBytes = 0;
+    entry.numPins = 0;
+    entry.used = false;
+}
+
+#endif /* ClipCache_h */
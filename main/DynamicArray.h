@@ -0,0 +1,291 @@
+#ifndef DynamicArray_h
+#define DynamicArray_h
+
+#include "Profiling.h"
+
+#ifndef ARDUINO
+ #include <new>
+#endif
+
+/** A growable array with contiguous storage, standing in for std::vector on
+ * boards without the STL. It keeps the method names of LinkedList so either can
+ * be used for the same job, but element access is constant time and the whole
+ * array can be handed to code that works on raw pointers (decoders, FFTs, DMA).
+ * When memory runs out it stops growing, as FixedArray does when it is full,
+ * so callers check size() after resize() rather than catching anything.
+ */
+template <class T>
+class DynamicArray
+{
+public:
+    DynamicArray();
+    DynamicArray (const DynamicArray<T>&);
+    DynamicArray (DynamicArray<T>&&);
+    ~DynamicArray();
+    DynamicArray& operator = (const DynamicArray<T>&);
+    DynamicArray& operator = (DynamicArray<T>&&);
+
+    T& operator [] (int index);
+    const T& operator [] (int index) const;
+    T& First() const;
+    T& Last() const;
+    T* getData();
+    const T* getData() const;
+
+    int size() const;
+    int getCapacity() const;
+
+    /** Appends an element, growing the storage geometrically when it is full.
+     * The element is dropped if there is no memory for it
+     */
+    void Append (T element);
+
+    /** Changes the number of elements. New elements are value-initialised (zero for numbers).
+     * Growing stops at the capacity that could be allocated
+     */
+    void resize (int newSize);
+
+    /** Makes sure the array can hold at least this many elements without reallocating.
+     * If the memory can't be allocated the array is left as it was
+     */
+    void reserve (int newCapacity);
+
+    /** Sets the elements from startIndex to endIndex (inclusive) to a value */
+    void fill (int startIndex, int endIndex, T value);
+
+    /** Removes all elements and frees the storage */
+    void clear();
+
+    /** Exchanges the contents of two arrays without copying any elements */
+    void swap (DynamicArray<T>& other);
+
+private:
+    T* data;
+    int length;
+    int capacity;
+};
+
+namespace DynamicArrayHelpers
+{
+    /** new[] that returns nullptr when memory runs out, as it does on Arduino, instead of throwing */
+    template <class T>
+    T* allocate (int numElements)
+    {
+#ifdef ARDUINO
+        return new T[numElements];
+#else
+        return new (std::nothrow) T[numElements];
+#endif
+    }
+
+    /** new that returns nullptr when memory runs out, in the same way as allocate() */
+    template <class T>
+    T* create()
+    {
+#ifdef ARDUINO
+        return new T();
+#else
+        return new (std::nothrow) T();
+#endif
+    }
+}
+
+template <class T>
+DynamicArray<T>::DynamicArray()
+{
+    data = nullptr;
+    length = 0;
+    capacity = 0;
+}
+
+template <class T>
+DynamicArray<T>::DynamicArray (const DynamicArray<T>& other)
+{
+    data = nullptr;
+    length = 0;
+    capacity = 0;
+
+    *this = other;
+}
+
+// takes over the other array's storage, leaving it empty
+template <class T>
+DynamicArray<T>::DynamicArray (DynamicArray<T>&& other)
+{
+    data = other.data;
+    length = other.length;
+    capacity = other.capacity;
+
+    other.data = nullptr;
+    other.length = 0;
+    other.capacity = 0;
+}
+
+template <class T>
+DynamicArray<T>& DynamicArray<T>::operator = (const DynamicArray<T>& other)
+{
+    if (this == &other)
+        return *this;
+
+    if (capacity < other.length)
+    {
+        clear();
+        reserve (other.length);
+    }
+
+    int numToCopy = other.length < capacity ? other.length : capacity;
+
+    for (int i = 0; i < numToCopy; i++)
+        data[i] = other.data[i];
+
+    length = numToCopy;
+    return *this;
+}
+
+template <class T>
+DynamicArray<T>& DynamicArray<T>::operator = (DynamicArray<T>&& other)
+{
+    if (this == &other)
+        return *this;
+
+    clear();
+    swap (other);
+    return *this;
+}
+
+template <class T>
+DynamicArray<T>::~DynamicArray()
+{
+    clear();
+}
+
+template <class T>
+T& DynamicArray<T>::operator [] (int index)
+{
+    return data[index];
+}
+
+template <class T>
+const T& DynamicArray<T>::operator [] (int index) const
+{
+    return data[index];
+}
+
+template <class T>
+T& DynamicArray<T>::First() const
+{
+    return data[0];
+}
+
+template <class T>
+T& DynamicArray<T>::Last() const
+{
+    return data[length - 1];
+}
+
+template <class T>
+T* DynamicArray<T>::getData()
+{
+    return data;
+}
+
+template <class T>
+const T* DynamicArray<T>::getData() const
+{
+    return data;
+}
+
+template <class T>
+int DynamicArray<T>::size() const
+{
+    return length;
+}
+
+template <class T>
+int DynamicArray<T>::getCapacity() const
+{
+    return capacity;
+}
+
+template <class T>
+void DynamicArray<T>::Append (T element)
+{
+    if (length == capacity)
+        reserve (capacity < 8 ? 8 : capacity * 2);
+
+    if (length == capacity)
+        return;
+
+    data[length++] = static_cast<T&&> (element);
+}
+
+template <class T>
+void DynamicArray<T>::resize (int newSize)
+{
+    if (newSize < 0)
+        newSize = 0;
+
+    reserve (newSize);
+
+    if (newSize > capacity)
+        newSize = capacity;
+
+    for (int i = length; i < newSize; i++)
+        data[i] = T();
+
+    length = newSize;
+}
+
+template <class T>
+void DynamicArray<T>::reserve (int newCapacity)
+{
+    if (newCapacity <= capacity)
+        return;
+
+    AUDIOFILE_PROFILE_ALLOCATION();
+    T* newData = DynamicArrayHelpers::allocate<T> (newCapacity);
+
+    if (newData == nullptr)
+        return;
+
+    for (int i = 0; i < length; i++)
+        newData[i] = static_cast<T&&> (data[i]);
+
+    delete[] data;
+    data = newData;
+    capacity = newCapacity;
+}
+
+template <class T>
+void DynamicArray<T>::fill (int startIndex, int endIndex, T value)
+{
+    for (int i = startIndex; i <= endIndex && i < length; i++)
+        data[i] = value;
+}
+
+template <class T>
+void DynamicArray<T>::clear()
+{
+    delete[] data;
+    data = nullptr;
+    length = 0;
+    capacity = 0;
+}
+
+template <class T>
+void DynamicArray<T>::swap (DynamicArray<T>& other)
+{
+    T* otherData = other.data;
+    int otherLength = other.length;
+    int otherCapacity = other.capacity;
+
+    other.data = data;
+    other.length = length;
+    other.capacity = capacity;
+
+    data = otherData;
+    length = otherLength;
+    capacity = otherCapacity;
+}
+
+#endif
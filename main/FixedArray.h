@@ -0,0 +1,168 @@
+#ifndef FixedArray_h
+#define FixedArray_h
+
+/** An array with the same methods as DynamicArray, but with its storage inside
+ * the object, sized at compile time. It never touches the heap: growing past
+ * Capacity is refused (resize() clamps and Append() drops the element), so it
+ * can hold buffers in long-running firmware where fragmentation is a risk.
+ */
+template <class T, int Capacity>
+class FixedArray
+{
+public:
+    static_assert (Capacity > 0, "FixedArray needs room for at least one element");
+
+    FixedArray();
+
+    T& operator [] (int index);
+    const T& operator [] (int index) const;
+    T& First();
+    T& Last();
+    T* getData();
+    const T* getData() const;
+
+    int size() const;
+    int getCapacity() const;
+
+    /** Appends an element. @Returns false (and drops it) if the array is full */
+    bool Append (T element);
+
+    /** Changes the number of elements, up to Capacity. New elements are value-initialised
+     * (zero for numbers). @Returns false if newSize was more than Capacity
+     */
+    bool resize (int newSize);
+
+    /** Does nothing except report whether the capacity is enough, to match DynamicArray */
+    bool reserve (int newCapacity);
+
+    /** Sets the elements from startIndex to endIndex (inclusive) to a value */
+    void fill (int startIndex, int endIndex, T value);
+
+    /** Removes all elements */
+    void clear();
+
+private:
+    T data[Capacity];
+    int length;
+};
+
+namespace FixedArrayHelpers
+{
+    /** Resets an element to its value-initialised state in place. Nested FixedArrays are
+     * emptied instead of assigned, so no channel-sized temporary lands on the stack.
+     */
+    template <class T>
+    void reset (T& element)
+    {
+        element = T();
+    }
+
+    template <class T, int Capacity>
+    void reset (FixedArray<T, Capacity>& element)
+    {
+        element.clear();
+    }
+}
+
+template <class T, int Capacity>
+FixedArray<T, Capacity>::FixedArray()
+{
+    length = 0;
+}
+
+template <class T, int Capacity>
+T& FixedArray<T, Capacity>::operator [] (int index)
+{
+    return data[index];
+}
+
+template <class T, int Capacity>
+const T& FixedArray<T, Capacity>::operator [] (int index) const
+{
+    return data[index];
+}
+
+template <class T, int Capacity>
+T& FixedArray<T, Capacity>::First()
+{
+    return data[0];
+}
+
+template <class T, int Capacity>
+T& FixedArray<T, Capacity>::Last()
+{
+    return data[length - 1];
+}
+
+template <class T, int Capacity>
+T* FixedArray<T, Capacity>::getData()
+{
+    return data;
+}
+
+template <class T, int Capacity>
+const T* FixedArray<T, Capacity>::getData() const
+{
+    return data;
+}
+
+template <class T, int Capacity>
+int FixedArray<T, Capacity>::size() const
+{
+    return length;
+}
+
+template <class T, int Capacity>
+int FixedArray<T, Capacity>::getCapacity() const
+{
+    return Capacity;
+}
+
+template <class T, int Capacity>
+bool FixedArray<T, Capacity>::Append (T element)
+{
+    if (length == Capacity)
+        return false;
+
+    data[length++] = element;
+    return true;
+}
+
+template <class T, int Capacity>
+bool FixedArray<T, Capacity>::resize (int newSize)
+{
+    bool fits = newSize <= Capacity;
+
+    if (newSize < 0)
+        newSize = 0;
+
+    if (! fits)
+        newSize = Capacity;
+
+    for (int i = length; i < newSize; i++)
+        FixedArrayHelpers::reset (data[i]);
+
+    length = newSize;
+    return fits;
+}
+
+template <class T, int Capacity>
+bool FixedArray<T, Capacity>::reserve (int newCapacity)
+{
+    return newCapacity <= Capacity;
+}
+
+template <class T, int Capacity>
+void FixedArray<T, Capacity>::fill (int startIndex, int endIndex, T value)
+{
+    for (int i = startIndex; i <= endIndex && i < length; i++)
+        data[i] = value;
+}
+
+template <class T, int Capacity>
+void FixedArray<T, Capacity>::clear()
+{
+    length = 0;
+}
+
+#endif
@@ -0,0 +1,1334 @@
+#ifndef FlacDecoder_h
+#define FlacDecoder_h
+
+#include <stdint.h>
+#include <string.h>
+#include <SD.h>
+#include "PrefetchReader.h"
+
+/** Streaming decoder for FLAC files on SD (or any File).
+ *
+ * FLAC splits audio into blocks of up to a few thousand frames, each coded on
+ * its own, so a file is decoded one block at a time and memory use is fixed by
+ * the largest block the decoder accepts (MaxBlockSize frames of MaxChannels
+ * channels, as 32 bit integers) whatever the length of the file. Blocks are
+ * read through the Source's read-ahead ring (see PrefetchReader.h).
+ *
+ * All of the subframe types are decoded: constant, verbatim, the fixed
+ * predictors and LPC of any order, with Rice coded residuals. Bit depths up to
+ * 24 bits are supported. Every block's CRCs are checked; a block that fails is
+ * returned as silence and counted by getNumCorruptBlocks().
+ *
+ *      FlacDecoder<float> decoder;
+ *
+ *      if (decoder.open ("/loop.flac"))
+ *          int numRead = decoder.read (block, 256);
+ *
+ * FLAC calls its blocks "frames"; here a frame is one sample of every channel,
+ * as in the rest of the library.
+ */
+
+//=============================================================
+/** The largest block a FlacDecoder accepts by default. 4608 is the limit of FLAC's
+ * streamable subset for rates up to 48 kHz, and covers what common encoders write.
+ */
+#ifndef AUDIOFILE_FLAC_MAX_BLOCK_SIZE
+ #define AUDIOFILE_FLAC_MAX_BLOCK_SIZE 4608
+#endif
+
+//=============================================================
+/** The fields of a FLAC file's STREAMINFO block, plus where its first block starts */
+struct FlacStreamInfo
+{
+    uint16_t minBlockSize;
+    uint16_t maxBlockSize;
+    uint32_t minFrameSize;
+    uint32_t maxFrameSize;
+    uint32_t sampleRate;
+    uint16_t numChannels;
+    uint16_t bitDepth;
+
+    /** Frames (samples per channel) in the file, or 0 if the encoder didn't know */
+    uint32_t numFrames;
+
+    /** Byte offsets of the first block in the file and of the end of the file */
+    uint32_t firstBlockOffset;
+    uint32_t endOffset;
+
+    //=============================================================
+    /** @Returns the length of the file in seconds */
+    double getLengthInSeconds() const
+    {
+        return sampleRate > 0 ? (double)numFrames / (double)sampleRate : 0.;
+    }
+};
+
+//=============================================================
+/** Reads the "fLaC" marker and the metadata blocks of an open file. Only the block
+ * headers and the 34 bytes of STREAMINFO are read; other blocks are skipped with seek().
+ * On return the file is positioned at the first block of audio.
+ * @param maxBytesToRead gives up if the metadata can't be read within this many bytes of reads
+ * @Returns true if the file is a FLAC file with a valid STREAMINFO block
+ */
+inline bool readFlacStreamInfo (File& file, FlacStreamInfo& info, uint32_t maxBytesToRead = 0xFFFFFFFF)
+{
+    uint8_t header[34];
+
+    if (! file.seek (0) || file.read (header, 4) != 4 || memcmp (header, "fLaC", 4) != 0)
+        return false;
+
+    uint32_t numBytesRead = 4;
+    uint32_t position = 4;
+    bool foundStreamInfo = false;
+    bool isLastBlock = false;
+
+    while (! isLastBlock)
+    {
+        if (numBytesRead + 4 > maxBytesToRead || ! file.seek (position) || file.read (header, 4) != 4)
+            return false;
+
+        numBytesRead += 4;
+
+        isLastBlock = (header[0] & 0x80) != 0;
+        int blockType = header[0] & 0x7F;
+        uint32_t blockLength = ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | (uint32_t)header[3];
+
+        // STREAMINFO is always the first block
+        if (blockType == 0)
+        {
+            if (blockLength < 34 || numBytesRead + 34 > maxBytesToRead || file.read (header, 34) != 34)
+                return false;
+
+            numBytesRead += 34;
+
+            info.minBlockSize = (uint16_t)((header[0] << 8) | header[1]);
+            info.maxBlockSize = (uint16_t)((header[2] << 8) | header[3]);
+            info.minFrameSize = ((uint32_t)header[4] << 16) | ((uint32_t)header[5] << 8) | (uint32_t)header[6];
+            info.maxFrameSize = ((uint32_t)header[7] << 16) | ((uint32_t)header[8] << 8) | (uint32_t)header[9];
+            info.sampleRate = ((uint32_t)header[10] << 12) | ((uint32_t)header[11] << 4) | ((uint32_t)header[12] >> 4);
+            info.numChannels = (uint16_t)(((header[12] >> 1) & 0x07) + 1);
+            info.bitDepth = (uint16_t)((((header[12] & 0x01) << 4) | (header[13] >> 4)) + 1);
+
+            // the count has 36 bits, but no file with more than 2^32 frames fits anywhere this library runs
+            uint32_t highBits = header[13] & 0x0F;
+            uint32_t numFrames = ((uint32_t)header[14] << 24) | ((uint32_t)header[15] << 16) | ((uint32_t)header[16] << 8) | (uint32_t)header[17];
+            info.numFrames = highBits != 0 ? 0xFFFFFFFF : numFrames;
+            foundStreamInfo = true;
+        }
+        else if (! foundStreamInfo)
+        {
+            return false;
+        }
+
+        position += 4 + blockLength;
+    }
+
+    if (info.sampleRate == 0 || info.maxBlockSize < 16 || info.bitDepth < 4)
+        return false;
+
+    info.firstBlockOffset = position;
+    info.endOffset = file.size();
+    return file.seek (position);
+}
+
+//=============================================================
+/** Converts numSamples decoded FLAC samples of the given bit depth into samples in
+ * the range -1 to 1, using the same scaling as decodePcmSamples() does for WAV.
+ * @param destinationStride the number of samples from one output to the next, e.g.
+ *                          the number of channels to write interleaved frames
+ */
+template <class T>
+void decodeFlacSamples (const int32_t* source, int bitDepth, T* destination, int numSamples, int destinationStride = 1)
+{
+    const T scale = static_cast<T> (1.) / static_cast<T> (1L << (bitDepth - 1));
+
+    for (int i = 0; i < numSamples; i++, destination += destinationStride)
+        *destination = static_cast<T> (source[i]) * scale;
+}
+
+//=============================================================
+/** Fixed point version: converts decoded FLAC samples into Q15 samples, dropping the
+ * low bits of anything deeper than 16 bits like the Q15 version of decodePcmSamples()
+ */
+inline void decodeFlacSamples (const int32_t* source, int bitDepth, int16_t* destination, int numSamples, int destinationStride = 1)
+{
+    int shift = bitDepth - 16;
+
+    for (int i = 0; i < numSamples; i++, destination += destinationStride)
+        *destination = (int16_t)(shift >= 0 ? source[i] >> shift : source[i] * (1 << -shift));
+}
+
+//=============================================================
+namespace FlacHelpers
+{
+    /** @Returns the number of zero bits above the highest set bit of a non-zero value */
+    inline int countLeadingZeros (uint64_t value)
+    {
+    #if defined (__GNUC__)
+        return __builtin_clzll (value);
+    #else
+        int numZeros = 0;
+
+        while ((value & 0x8000000000000000ULL) == 0)
+        {
+            value <<= 1;
+            numZeros++;
+        }
+
+        return numZeros;
+    #endif
+    }
+
+    /** @Returns a CRC-8 (polynomial 0x07) of some bytes, as used in block headers */
+    inline uint8_t getCrc8 (const uint8_t* bytes, int numBytes)
+    {
+        static const uint8_t table[16] = { 0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D };
+        uint8_t crc = 0;
+
+        for (int i = 0; i < numBytes; i++)
+        {
+            crc = (uint8_t)((crc << 4) ^ table[(crc >> 4) ^ (bytes[i] >> 4)]);
+            crc = (uint8_t)((crc << 4) ^ table[(crc >> 4) ^ (bytes[i] & 0x0F)]);
+        }
+
+        return crc;
+    }
+
+    /** CRC-16 tables, built once on first use: values[k][i] is the CRC of byte i followed by
+     * k zero bytes, so four bytes can be looked up at once rather than one after another
+     */
+    struct Crc16Table
+    {
+        Crc16Table()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                uint16_t crc = (uint16_t)(i << 8);
+
+                for (int bit = 0; bit < 8; bit++)
+                    crc = (uint16_t)((crc & 0x8000) != 0 ? (crc << 1) ^ 0x8005 : crc << 1);
+
+                values[0][i] = crc;
+            }
+
+            for (int k = 1; k < 4; k++)
+                for (int i = 0; i < 256; i++)
+                    values[k][i] = (uint16_t)((values[k - 1][i] << 8) ^ values[0][values[k - 1][i] >> 8]);
+        }
+
+        uint16_t values[4][256];
+    };
+
+    /** Continues a CRC-16 (polynomial 0x8005) of a block over some more of its bytes.
+     * Every byte of the file goes through this, so it takes four bytes at a time.
+     */
+    inline uint16_t updateCrc16 (uint16_t crc, const uint8_t* bytes, int numBytes)
+    {
+        static const Crc16Table table;
+        int i = 0;
+
+        for (; i + 4 <= numBytes; i += 4)
+        {
+            uint16_t top = (uint16_t)(crc ^ ((bytes[i] << 8) | bytes[i + 1]));
+            crc = (uint16_t)(table.values[3][top >> 8] ^ table.values[2][top & 0xFF]
+                           ^ table.values[1][bytes[i + 2]] ^ table.values[0][bytes[i + 3]]);
+        }
+
+        for (; i < numBytes; i++)
+            crc = (uint16_t)((crc << 8) ^ table.values[0][(crc >> 8) ^ bytes[i]]);
+
+        return crc;
+    }
+
+    /** The terms of a prediction of order N, written out by recursion so that they are
+     * unrolled at any optimisation level and whatever the compiler
+     */
+    template <int N, class Sum>
+    struct LpcTerms
+    {
+        /** @Returns the sum of coefficients[j] * history[j] for j below N */
+        static Sum predict (const int32_t* coefficients, const int32_t* history)
+        {
+            return LpcTerms<N - 1, Sum>::predict (coefficients, history) + (Sum)coefficients[N - 1] * history[N - 1];
+        }
+
+        /** Moves each of the first N - 1 samples of history one place along */
+        static void age (int32_t* history)
+        {
+            history[N - 1] = history[N - 2];
+            LpcTerms<N - 1, Sum>::age (history);
+        }
+    };
+
+    template <class Sum>
+    struct LpcTerms<1, Sum>
+    {
+        static Sum predict (const int32_t* coefficients, const int32_t* history) { return (Sum)coefficients[0] * history[0]; }
+        static void age (int32_t*) {}
+    };
+
+    /** @Returns a prediction scaled down by the LPC shift. An int64_t sum is shifted as it is;
+     * a uint32_t one holds the bits of an int32_t sum, so it is shifted as one
+     */
+    inline int32_t shiftPrediction (int64_t prediction, int shift)
+    {
+        return (int32_t)(prediction >> shift);
+    }
+
+    inline int32_t shiftPrediction (uint32_t prediction, int shift)
+    {
+        return (int32_t)prediction >> shift;
+    }
+
+    /** Undoes linear prediction with Order known at compile time. With the loops unrolled,
+     * the coefficients and the last Order samples stay in registers rather than each
+     * sample being stored and loaded again for the next one.
+     * coefficients[0] multiplies the sample before the one being restored, and the
+     * products are summed as Sum: int64_t where a valid block's sums need more than
+     * 32 bits, otherwise uint32_t, which wraps where a corrupt block's sums overflow
+     * (as int32_t must not) and gives the same bits as int32_t everywhere else.
+     */
+    template <int Order, class Sum>
+    void restoreLpc (int32_t* samples, int numSamples, const int32_t* coefficients, int shift)
+    {
+        int32_t c[Order];
+        int32_t history[Order];
+
+        for (int j = 0; j < Order; j++)
+        {
+            c[j] = coefficients[j];
+            history[j] = samples[Order - 1 - j];
+        }
+
+        for (int i = Order; i < numSamples; i++)
+        {
+            int32_t sample = (int32_t)((uint32_t)samples[i] + (uint32_t)shiftPrediction (LpcTerms<Order, Sum>::predict (c, history), shift));
+            samples[i] = sample;
+            LpcTerms<Order, Sum>::age (history);
+            history[0] = sample;
+        }
+    }
+
+    /** Undoes linear prediction of any order, for the orders that aren't unrolled */
+    template <class Sum>
+    void restoreLpc (int32_t* samples, int numSamples, const int32_t* coefficients, int order, int shift)
+    {
+        for (int i = order; i < numSamples; i++)
+        {
+            Sum prediction = 0;
+
+            for (int j = 0; j < order; j++)
+                prediction += (Sum)coefficients[j] * samples[i - 1 - j];
+
+            samples[i] = (int32_t)((uint32_t)samples[i] + (uint32_t)shiftPrediction (prediction, shift));
+        }
+    }
+
+    /** Undoes linear prediction, unrolling the orders encoders choose most often */
+    template <class Sum>
+    void restoreLpcOfOrder (int32_t* samples, int numSamples, const int32_t* coefficients, int order, int shift)
+    {
+        switch (order)
+        {
+            case 1:  restoreLpc<1, Sum>  (samples, numSamples, coefficients, shift); break;
+            case 2:  restoreLpc<2, Sum>  (samples, numSamples, coefficients, shift); break;
+            case 3:  restoreLpc<3, Sum>  (samples, numSamples, coefficients, shift); break;
+            case 4:  restoreLpc<4, Sum>  (samples, numSamples, coefficients, shift); break;
+            case 5:  restoreLpc<5, Sum>  (samples, numSamples, coefficients, shift); break;
+            case 6:  restoreLpc<6, Sum>  (samples, numSamples, coefficients, shift); break;
+            case 7:  restoreLpc<7, Sum>  (samples, numSamples, coefficients, shift); break;
+            case 8:  restoreLpc<8, Sum>  (samples, numSamples, coefficients, shift); break;
+            case 10: restoreLpc<10, Sum> (samples, numSamples, coefficients, shift); break;
+            case 12: restoreLpc<12, Sum> (samples, numSamples, coefficients, shift); break;
+            default: restoreLpc<Sum> (samples, numSamples, coefficients, order, shift); break;
+        }
+    }
+}
+
+//=============================================================
+template <class T, int MaxBlockSize = AUDIOFILE_FLAC_MAX_BLOCK_SIZE, int MaxChannels = 2, class Source = PrefetchReader<>>
+class FlacDecoder
+{
+public:
+
+    static_assert (MaxBlockSize >= 16 && MaxBlockSize <= 65535, "FLAC blocks have between 16 and 65535 frames");
+    static_assert (MaxChannels > 0 && MaxChannels <= 8, "FLAC files have between 1 and 8 channels");
+
+    /** Constructor */
+    FlacDecoder();
+
+    /** Destructor. Closes the file if it is still open */
+    ~FlacDecoder();
+
+    /** Opens a FLAC file and reads its metadata.
+     * @Returns true if the file is a FLAC file that fits this decoder
+     */
+    bool open (const String& filePath);
+
+    /** Decodes a file that is already open. The decoder closes it in close() */
+    bool open (File file);
+
+    /** Closes the file */
+    void close();
+
+    /** @Returns true if a file is open */
+    bool isOpen() const;
+
+    //=============================================================
+    /** @Returns the STREAMINFO of the open file */
+    const FlacStreamInfo& getStreamInfo() const;
+
+    /** @Returns the sample rate */
+    uint32_t getSampleRate() const;
+
+    /** @Returns the number of audio channels */
+    int getNumChannels() const;
+
+    /** @Returns the bit depth of each sample */
+    int getBitDepth() const;
+
+    /** @Returns the number of frames (samples per channel) in the file, or 0 if the file doesn't say */
+    uint32_t getNumFrames() const;
+
+    /** @Returns the length of the file in seconds */
+    double getLengthInSeconds() const;
+
+    //=============================================================
+    /** Moves the read position to a frame index. Blocks can only be found by decoding
+     * the ones before them, so moving back starts again from the first block.
+     * @Returns false if the frame is past the end of the file
+     */
+    bool seekToFrame (uint32_t frame);
+
+    /** @Returns the index of the next frame read() will return */
+    uint32_t getPosition() const;
+
+    /** Reads up to numFrames interleaved frames from the current position and advances it.
+     * @Returns the number of frames read, which is less than numFrames at the end of the file
+     */
+    int read (T* interleavedFrames, int numFrames);
+
+    //=============================================================
+    /** Decodes the next block, skipping anything read() hasn't returned from the current one.
+     * @Returns the number of frames in the block, or 0 at the end of the file
+     */
+    int decodeBlock();
+
+    /** @Returns the samples of one channel of the last block decoded, as integers of getBitDepth() bits */
+    const int32_t* getBlockChannel (int channel) const;
+
+    /** @Returns the number of frames in the last block decoded */
+    int getBlockSize() const;
+
+    /** @Returns the number of blocks that failed their CRC or couldn't be parsed, and were returned as silence */
+    uint32_t getNumCorruptBlocks() const;
+
+    //=============================================================
+    /** Lets the Source read ahead. Worth calling from idle time between reads on Arduino */
+    void prefetch();
+
+    /** @Returns the read-ahead hit, miss and stall counters */
+    PrefetchStats getPrefetchStats();
+
+private:
+
+    //=============================================================
+    static const int inputBufferSize = 512;
+
+    // how the channels of a block were coded
+    enum ChannelCoding
+    {
+        Independent,
+        LeftSide,
+        RightSide,
+        MidSide
+    };
+
+    //=============================================================
+    void resetInput();
+    bool fillInput();
+    void refill();
+    uint32_t readBits (int numBits);
+    int32_t readSignedBits (int numBits);
+    uint32_t readUnary();
+    void alignToByte();
+    int getBytePosition() const;
+    bool isPastEnd() const;
+    void addToCrc (int endPosition);
+
+    //=============================================================
+    bool findSync();
+    bool readBlockHeader (int& numChannels, ChannelCoding& coding);
+    bool decodeSubframe (int32_t* samples, int numSamples, int subframeBitDepth);
+    bool decodeResidual (int32_t* samples, int numSamples, int predictorOrder);
+    void decodeRicePartition (int32_t* samples, int numSamples, int parameter);
+    void restoreFixed (int32_t* samples, int numSamples, int order);
+    void restoreLpc (int32_t* samples, int numSamples, const int32_t* coefficients, int order, int shift, int subframeBitDepth);
+    void decorrelate (ChannelCoding coding);
+
+    //=============================================================
+    File file;
+    Source source;
+    FlacStreamInfo info;
+    bool fileIsOpen;
+
+    // bits are read from the top of bitBuffer, which bytes from input are shifted into;
+    // the bits below the numBits that are valid are always zero
+    uint8_t input[inputBufferSize];
+    int inputPosition;
+    int inputLength;
+    uint64_t bitBuffer;
+    int numBits;
+    int numOverreadBytes;
+
+    // the CRC-16 of the current block covers the bytes of input from crcPosition back to its start
+    int crcPosition;
+    uint16_t crc;
+
+    int32_t blockSamples[MaxChannels][MaxBlockSize];
+    int blockSize;
+    int blockPosition;
+    uint32_t blockStartFrame;
+    uint32_t numCorruptBlocks;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::FlacDecoder()
+{
+    memset (&info, 0, sizeof (info));
+    fileIsOpen = false;
+    blockSize = 0;
+    blockPosition = 0;
+    blockStartFrame = 0;
+    numCorruptBlocks = 0;
+    resetInput();
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::~FlacDecoder()
+{
+    close();
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::open (const String& filePath)
+{
+    File newFile = SD.open (filePath.c_str());
+
+    if (! newFile)
+    {
+        Serial.println ("ERROR: File doesn't exist or otherwise can't load file");
+        return false;
+    }
+
+    return open (newFile);
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::open (File newFile)
+{
+    close();
+    file = newFile;
+
+    if (! readFlacStreamInfo (file, info))
+    {
+        Serial.println ("ERROR: this doesn't seem to be a valid .FLAC file");
+        file.close();
+        return false;
+    }
+
+    if (info.numChannels > MaxChannels || info.maxBlockSize > MaxBlockSize || info.bitDepth > 24)
+    {
+        Serial.println ("ERROR: this FLAC file has more channels, longer blocks or deeper samples than the decoder can hold");
+        file.close();
+        return false;
+    }
+
+    source.attach (file, info.firstBlockOffset, info.endOffset);
+    resetInput();
+    blockSize = 0;
+    blockPosition = 0;
+    blockStartFrame = 0;
+    numCorruptBlocks = 0;
+    fileIsOpen = true;
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::close()
+{
+    if (fileIsOpen)
+    {
+        source.detach();
+        file.close();
+    }
+
+    fileIsOpen = false;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::isOpen() const
+{
+    return fileIsOpen;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+const FlacStreamInfo& FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getStreamInfo() const
+{
+    return info;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+uint32_t FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getSampleRate() const
+{
+    return info.sampleRate;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+int FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getNumChannels() const
+{
+    return (int)info.numChannels;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+int FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getBitDepth() const
+{
+    return (int)info.bitDepth;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+uint32_t FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getNumFrames() const
+{
+    return info.numFrames;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+double FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getLengthInSeconds() const
+{
+    return info.getLengthInSeconds();
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::seekToFrame (uint32_t frame)
+{
+    if (! fileIsOpen || (info.numFrames > 0 && frame > info.numFrames))
+        return false;
+
+    if (frame < blockStartFrame)
+    {
+        if (! source.seek (info.firstBlockOffset))
+            return false;
+
+        resetInput();
+        blockSize = 0;
+        blockStartFrame = 0;
+    }
+
+    while (frame >= blockStartFrame + (uint32_t)blockSize)
+    {
+        // the end of the file is a valid position, but nothing past it
+        if (decodeBlock() == 0)
+            return frame == blockStartFrame;
+    }
+
+    blockPosition = (int)(frame - blockStartFrame);
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+uint32_t FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getPosition() const
+{
+    return blockStartFrame + (uint32_t)blockPosition;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+int FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::read (T* interleavedFrames, int numFrames)
+{
+    if (! fileIsOpen)
+        return 0;
+
+    int numChannels = info.numChannels;
+    int numRead = 0;
+
+    while (numRead < numFrames)
+    {
+        if (blockPosition >= blockSize && decodeBlock() == 0)
+            break;
+
+        int framesThisTime = blockSize - blockPosition < numFrames - numRead ? blockSize - blockPosition : numFrames - numRead;
+
+        for (int channel = 0; channel < numChannels; channel++)
+            decodeFlacSamples (blockSamples[channel] + blockPosition, info.bitDepth,
+                               interleavedFrames + numRead * numChannels + channel, framesThisTime, numChannels);
+
+        blockPosition += framesThisTime;
+        numRead += framesThisTime;
+    }
+
+    return numRead;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+int FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::decodeBlock()
+{
+    blockStartFrame += (uint32_t)blockSize;
+    blockSize = 0;
+    blockPosition = 0;
+
+    if (! fileIsOpen)
+        return 0;
+
+    int numChannels = 0;
+    ChannelCoding coding = Independent;
+
+    // a header that fails its CRC was a false sync, so the search carries on after it
+    do
+    {
+        if (! findSync())
+            return 0;
+    }
+    while (! readBlockHeader (numChannels, coding));
+
+    bool ok = true;
+
+    for (int channel = 0; channel < numChannels && ok; channel++)
+    {
+        // the side channel needs one more bit than the others
+        bool isSide = (coding == LeftSide && channel == 1) || (coding == RightSide && channel == 0) || (coding == MidSide && channel == 1);
+        ok = decodeSubframe (blockSamples[channel], blockSize, info.bitDepth + (isSide ? 1 : 0));
+    }
+
+    // a block cut off by the end of the file isn't played
+    if (isPastEnd())
+    {
+        blockSize = 0;
+        return 0;
+    }
+
+    if (ok)
+    {
+        alignToByte();
+        addToCrc (getBytePosition());
+        uint16_t expectedCrc = crc;
+        ok = readBits (16) == expectedCrc;
+    }
+
+    if (! ok)
+    {
+        // the block keeps its length, so the frames after it stay in time
+        for (int channel = 0; channel < numChannels; channel++)
+            memset (blockSamples[channel], 0, sizeof (int32_t) * (size_t)blockSize);
+
+        numCorruptBlocks++;
+        return blockSize;
+    }
+
+    decorrelate (coding);
+    return blockSize;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+const int32_t* FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getBlockChannel (int channel) const
+{
+    return blockSamples[channel];
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+int FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getBlockSize() const
+{
+    return blockSize;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+uint32_t FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getNumCorruptBlocks() const
+{
+    return numCorruptBlocks;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::prefetch()
+{
+    if (fileIsOpen)
+        source.prefetch();
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+PrefetchStats FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getPrefetchStats()
+{
+    return source.getStats();
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::resetInput()
+{
+    inputPosition = 0;
+    inputLength = 0;
+    bitBuffer = 0;
+    numBits = 0;
+    numOverreadBytes = 0;
+    crcPosition = 0;
+    crc = 0;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::fillInput()
+{
+    // bitBuffer holds at most the last 8 bytes, which may belong to the next block, so
+    // they are kept (uncounted by the CRC) along with anything the CRC hasn't reached
+    int keepFrom = inputLength - 8 > crcPosition ? inputLength - 8 : crcPosition;
+
+    if (keepFrom < 0)
+        keepFrom = 0;
+
+    addToCrc (keepFrom);
+
+    int numKept = inputLength - keepFrom;
+    memmove (input, input + keepFrom, (size_t)numKept);
+    crcPosition -= keepFrom;
+    inputPosition -= keepFrom;
+
+    int numBytesRead = source.read (input + numKept, inputBufferSize - numKept);
+    inputLength = numKept + (numBytesRead > 0 ? numBytesRead : 0);
+    return numBytesRead > 0;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::refill()
+{
+    // usually there are 8 bytes to hand, and as many whole bytes as fit go in at once
+    if (numBits <= 56 && inputLength - inputPosition >= 8)
+    {
+        const uint8_t* bytes = input + inputPosition;
+        uint64_t word = ((uint64_t)bytes[0] << 56) | ((uint64_t)bytes[1] << 48) | ((uint64_t)bytes[2] << 40) | ((uint64_t)bytes[3] << 32)
+                      | ((uint64_t)bytes[4] << 24) | ((uint64_t)bytes[5] << 16) | ((uint64_t)bytes[6] << 8) | (uint64_t)bytes[7];
+        int numBytes = (64 - numBits) >> 3;
+        bitBuffer |= (word >> (64 - 8 * numBytes)) << (64 - numBits - 8 * numBytes);
+        inputPosition += numBytes;
+        numBits += 8 * numBytes;
+        return;
+    }
+
+    while (numBits <= 56)
+    {
+        if (inputPosition == inputLength && ! fillInput())
+        {
+            // past the end of the file reads as zeros, which isPastEnd() reports
+            numBits += 8;
+            numOverreadBytes++;
+            continue;
+        }
+
+        bitBuffer |= (uint64_t)input[inputPosition++] << (56 - numBits);
+        numBits += 8;
+    }
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+uint32_t FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::readBits (int n)
+{
+    if (n == 0)
+        return 0;
+
+    if (numBits < n)
+        refill();
+
+    uint32_t value = (uint32_t)(bitBuffer >> (64 - n));
+    bitBuffer <<= n;
+    numBits -= n;
+    return value;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+int32_t FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::readSignedBits (int n)
+{
+    if (n == 0)
+        return 0;
+
+    uint32_t value = readBits (n);
+    uint32_t signBit = 1UL << (n - 1);
+    return (int32_t)((value ^ signBit) - signBit);
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+uint32_t FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::readUnary()
+{
+    uint32_t numZeros = 0;
+
+    while (true)
+    {
+        if (numBits == 0)
+            refill();
+
+        if (bitBuffer == 0)
+        {
+            numZeros += (uint32_t)numBits;
+            numBits = 0;
+
+            // a run of zeros into the end of the file has no end
+            if (numOverreadBytes > 8)
+                return numZeros;
+
+            continue;
+        }
+
+        int z = FlacHelpers::countLeadingZeros (bitBuffer);
+        bitBuffer = bitBuffer << z << 1;
+        numBits -= z + 1;
+        return numZeros + (uint32_t)z;
+    }
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::alignToByte()
+{
+    readBits (numBits & 7);
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+int FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::getBytePosition() const
+{
+    // where in input the next byte to be read came from, once aligned to a byte
+    int numUnreadBits = numBits - 8 * numOverreadBytes;
+    return inputPosition - (numUnreadBits > 0 ? numUnreadBits / 8 : 0);
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::isPastEnd() const
+{
+    return numBits < 8 * numOverreadBytes;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::addToCrc (int endPosition)
+{
+    if (endPosition > crcPosition)
+    {
+        crc = FlacHelpers::updateCrc16 (crc, input + crcPosition, endPosition - crcPosition);
+        crcPosition = endPosition;
+    }
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::findSync()
+{
+    alignToByte();
+
+    while (true)
+    {
+        if (numBits < 16)
+            refill();
+
+        // fewer than two bytes of the file left
+        if (numBits - 8 * numOverreadBytes < 16)
+            return false;
+
+        // 14 sync bits, a zero and the blocking strategy bit
+        if ((bitBuffer >> 49) == (0xFFF8 >> 1))
+            break;
+
+        readBits (8);
+    }
+
+    crcPosition = getBytePosition();
+    crc = 0;
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::readBlockHeader (int& numChannels, ChannelCoding& coding)
+{
+    // the header is kept for its CRC-8, which is checked before anything in it is trusted
+    uint8_t header[16];
+    int numHeaderBytes = 0;
+
+    for (int i = 0; i < 4; i++)
+        header[numHeaderBytes++] = (uint8_t)readBits (8);
+
+    int blockSizeCode = header[2] >> 4;
+    int sampleRateCode = header[2] & 0x0F;
+    int channelCode = header[3] >> 4;
+    int bitDepthCode = (header[3] >> 1) & 0x07;
+
+    if ((header[3] & 0x01) != 0 || blockSizeCode == 0 || sampleRateCode == 15 || channelCode > 10)
+        return false;
+
+    // then the block or sample number, coded like UTF-8 in up to 7 bytes; decoding in
+    // order doesn't need it. The number of leading ones in the first byte is its length.
+    uint8_t firstByte = (uint8_t)readBits (8);
+    header[numHeaderBytes++] = firstByte;
+
+    int numNumberBytes = 0;
+
+    while (numNumberBytes < 8 && (firstByte & (0x80 >> numNumberBytes)) != 0)
+        numNumberBytes++;
+
+    if (numNumberBytes == 1 || numNumberBytes > 7)
+        return false;
+
+    for (int i = 1; i < numNumberBytes; i++)
+    {
+        uint8_t byte = (uint8_t)readBits (8);
+        header[numHeaderBytes++] = byte;
+
+        if ((byte & 0xC0) != 0x80)
+            return false;
+    }
+
+    if (blockSizeCode == 1)
+        blockSize = 192;
+    else if (blockSizeCode <= 5)
+        blockSize = 576 << (blockSizeCode - 2);
+    else if (blockSizeCode == 6)
+        blockSize = (int)(header[numHeaderBytes++] = (uint8_t)readBits (8)) + 1;
+    else if (blockSizeCode == 7)
+    {
+        header[numHeaderBytes++] = (uint8_t)readBits (8);
+        header[numHeaderBytes++] = (uint8_t)readBits (8);
+        blockSize = ((header[numHeaderBytes - 2] << 8) | header[numHeaderBytes - 1]) + 1;
+    }
+    else
+        blockSize = 256 << (blockSizeCode - 8);
+
+    // the sample rate of the stream is already known, so a rate here is only skipped
+    int numRateBytes = sampleRateCode == 12 ? 1 : (sampleRateCode >= 13 ? 2 : 0);
+
+    for (int i = 0; i < numRateBytes; i++)
+        header[numHeaderBytes++] = (uint8_t)readBits (8);
+
+    if ((uint8_t)readBits (8) != FlacHelpers::getCrc8 (header, numHeaderBytes) || isPastEnd())
+    {
+        blockSize = 0;
+        return false;
+    }
+
+    static const int bitDepths[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+    numChannels = channelCode < 8 ? channelCode + 1 : 2;
+    coding = channelCode < 8 ? Independent : (ChannelCoding)(channelCode - 7);
+
+    // a valid header for something this stream can't be is treated as corruption
+    if (blockSize > MaxBlockSize || numChannels != (int)info.numChannels
+        || (bitDepthCode != 0 && bitDepths[bitDepthCode] != (int)info.bitDepth))
+    {
+        blockSize = 0;
+        return false;
+    }
+
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::decodeSubframe (int32_t* samples, int numSamples, int subframeBitDepth)
+{
+    if (readBits (1) != 0)
+        return false;
+
+    int type = (int)readBits (6);
+    int numWastedBits = 0;
+
+    // samples whose low bits are all zero are sent without them
+    if (readBits (1) != 0)
+    {
+        numWastedBits = (int)readUnary() + 1;
+        subframeBitDepth -= numWastedBits;
+
+        if (subframeBitDepth <= 0)
+            return false;
+    }
+
+    if (type == 0)
+    {
+        int32_t value = readSignedBits (subframeBitDepth);
+
+        for (int i = 0; i < numSamples; i++)
+            samples[i] = value;
+    }
+    else if (type == 1)
+    {
+        for (int i = 0; i < numSamples; i++)
+            samples[i] = readSignedBits (subframeBitDepth);
+    }
+    else if (type >= 8 && type <= 12)
+    {
+        int order = type - 8;
+
+        if (order > numSamples)
+            return false;
+
+        for (int i = 0; i < order; i++)
+            samples[i] = readSignedBits (subframeBitDepth);
+
+        if (! decodeResidual (samples, numSamples, order))
+            return false;
+
+        restoreFixed (samples, numSamples, order);
+    }
+    else if (type >= 32)
+    {
+        int order = type - 31;
+
+        if (order > numSamples)
+            return false;
+
+        for (int i = 0; i < order; i++)
+            samples[i] = readSignedBits (subframeBitDepth);
+
+        int precisionCode = (int)readBits (4);
+        int shift = readSignedBits (5);
+
+        if (precisionCode == 15 || shift < 0)
+            return false;
+
+        int32_t coefficients[32];
+
+        for (int i = 0; i < order; i++)
+            coefficients[i] = readSignedBits (precisionCode + 1);
+
+        if (! decodeResidual (samples, numSamples, order))
+            return false;
+
+        restoreLpc (samples, numSamples, coefficients, order, shift, subframeBitDepth + precisionCode + 1);
+    }
+    else
+    {
+        return false;
+    }
+
+    if (numWastedBits > 0)
+    {
+        for (int i = 0; i < numSamples; i++)
+            samples[i] = (int32_t)((uint32_t)samples[i] << numWastedBits);
+    }
+
+    return ! isPastEnd();
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+bool FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::decodeResidual (int32_t* samples, int numSamples, int predictorOrder)
+{
+    int method = (int)readBits (2);
+
+    if (method > 1)
+        return false;
+
+    int numParameterBits = method == 0 ? 4 : 5;
+    int escapeCode = method == 0 ? 15 : 31;
+    int partitionOrder = (int)readBits (4);
+    int partitionSize = numSamples >> partitionOrder;
+
+    if ((partitionSize << partitionOrder) != numSamples || partitionSize < predictorOrder)
+        return false;
+
+    // the residual follows the warm up samples, which the first partition is short by
+    int32_t* residual = samples + predictorOrder;
+
+    for (int partition = 0; partition < (1 << partitionOrder); partition++)
+    {
+        int numPartitionSamples = partition == 0 ? partitionSize - predictorOrder : partitionSize;
+        int parameter = (int)readBits (numParameterBits);
+
+        if (parameter == escapeCode)
+        {
+            int numRawBits = (int)readBits (5);
+
+            for (int i = 0; i < numPartitionSamples; i++)
+                residual[i] = readSignedBits (numRawBits);
+        }
+        else
+        {
+            decodeRicePartition (residual, numPartitionSamples, parameter);
+        }
+
+        residual += numPartitionSamples;
+
+        if (isPastEnd())
+            return false;
+    }
+
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::decodeRicePartition (int32_t* samples, int numSamples, int parameter)
+{
+    for (int i = 0; i < numSamples; i++)
+    {
+        if (numBits < 32)
+            refill();
+
+        uint32_t value;
+        int z = bitBuffer != 0 ? FlacHelpers::countLeadingZeros (bitBuffer) : 64;
+        int numCodeBits = z + 1 + parameter;
+
+        // almost every code is a short run of zeros, a one and the low bits, all in bitBuffer
+        if (numCodeBits <= numBits)
+        {
+            uint64_t afterStop = bitBuffer << z << 1;
+            value = ((uint32_t)z << parameter) | (uint32_t)(afterStop >> (63 - parameter) >> 1);
+            bitBuffer = numCodeBits < 64 ? bitBuffer << numCodeBits : 0;
+            numBits -= numCodeBits;
+        }
+        else
+        {
+            uint32_t quotient = readUnary();
+            value = (quotient << parameter) | readBits (parameter);
+
+            if (isPastEnd())
+                return;
+        }
+
+        // zig-zag coding puts the sign in the lowest bit
+        samples[i] = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::restoreFixed (int32_t* s, int numSamples, int order)
+{
+    // the fixed predictors are polynomials through the last few samples, which are
+    // kept in locals so that each sample isn't loaded again straight after its store.
+    // They are summed as uint32_t, which wraps where a corrupt block's sums would overflow
+    if (order == 0 || numSamples <= order)
+        return;
+
+    uint32_t s1 = (uint32_t)s[order - 1];
+    uint32_t s2 = order >= 2 ? (uint32_t)s[order - 2] : 0;
+    uint32_t s3 = order >= 3 ? (uint32_t)s[order - 3] : 0;
+    uint32_t s4 = order >= 4 ? (uint32_t)s[order - 4] : 0;
+
+    switch (order)
+    {
+        case 1:
+            for (int i = 1; i < numSamples; i++)
+            {
+                s1 += (uint32_t)s[i];
+                s[i] = (int32_t)s1;
+            }
+            break;
+
+        case 2:
+            for (int i = 2; i < numSamples; i++)
+            {
+                uint32_t sample = (uint32_t)s[i] + 2 * s1 - s2;
+                s[i] = (int32_t)sample;
+                s2 = s1;
+                s1 = sample;
+            }
+            break;
+
+        case 3:
+            for (int i = 3; i < numSamples; i++)
+            {
+                uint32_t sample = (uint32_t)s[i] + 3 * (s1 - s2) + s3;
+                s[i] = (int32_t)sample;
+                s3 = s2;
+                s2 = s1;
+                s1 = sample;
+            }
+            break;
+
+        case 4:
+            for (int i = 4; i < numSamples; i++)
+            {
+                uint32_t sample = (uint32_t)s[i] + 4 * (s1 + s3) - 6 * s2 - s4;
+                s[i] = (int32_t)sample;
+                s4 = s3;
+                s3 = s2;
+                s2 = s1;
+                s1 = sample;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::restoreLpc (int32_t* samples, int numSamples, const int32_t* coefficients,
+                                                                    int order, int shift, int numProductBits)
+{
+    int numSumBits = numProductBits;
+
+    while ((1 << (numSumBits - numProductBits)) < order)
+        numSumBits++;
+
+    // deep samples with precise coefficients can overflow a 32 bit sum
+    if (numSumBits > 32)
+        FlacHelpers::restoreLpcOfOrder<int64_t> (samples, numSamples, coefficients, order, shift);
+    else
+        FlacHelpers::restoreLpcOfOrder<uint32_t> (samples, numSamples, coefficients, order, shift);
+}
+
+//=============================================================
+template <class T, int MaxBlockSize, int MaxChannels, class Source>
+void FlacDecoder<T, MaxBlockSize, MaxChannels, Source>::decorrelate (ChannelCoding coding)
+{
+    int32_t* left = blockSamples[0];
+    int32_t* right = blockSamples[MaxChannels > 1 ? 1 : 0];
+
+    if (coding == LeftSide)
+    {
+        for (int i = 0; i < blockSize; i++)
+            right[i] = (int32_t)((uint32_t)left[i] - (uint32_t)right[i]);
+    }
+    else if (coding == RightSide)
+    {
+        for (int i = 0; i < blockSize; i++)
+            left[i] = (int32_t)((uint32_t)left[i] + (uint32_t)right[i]);
+    }
+    else if (coding == MidSide)
+    {
+        for (int i = 0; i < blockSize; i++)
+        {
+            // the bit of the mid channel that was dropped is the low bit of the side channel
+            uint32_t mid = ((uint32_t)left[i] << 1) | ((uint32_t)right[i] & 1);
+            uint32_t side = (uint32_t)right[i];
+            left[i] = (int32_t)(mid + side) >> 1;
+            right[i] = (int32_t)(mid - side) >> 1;
+        }
+    }
+}
+
+#endif /* FlacDecoder_h */
@@ -0,0 +1,342 @@
+#ifndef LazyBuffer_h
+#define LazyBuffer_h
+
+#include <stdint.h>
+#include <string.h>
+#include "BlockCache.h"
+#include "WaveFormat.h"
+
+/** A read-only sample buffer that decodes PCM only when it is read.
+ *
+ * It is a view over the data chunk of a WAV file, either still on the card
+ * (read a block at a time with seek and read) or already in memory (a buffer,
+ * flash, or a file mapped with mmap on a host). Samples are indexed as they are
+ * in an AudioFile:
+ *
+ *      buffer[channel][sampleIndex]
+ *
+ * The first access to a sample decodes the block of BlockFrames frames around
+ * it, for every channel, into one of NumCachedBlocks cache slots. Later reads of
+ * that block come straight from the cache until the least recently used slot is
+ * needed for another block. Opening a file therefore costs only its header, and
+ * RAM use is fixed by the cache size however long the file is.
+ *
+ * AudioFile uses it as its sample buffer with LazyAllocation (see Allocation.h).
+ */
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+class LazySampleBuffer
+{
+public:
+
+    static_assert (BlockFrames > 0 && NumCachedBlocks > 0 && MaxChannels > 0, "LazySampleBuffer sizes must be positive");
+
+    /** One channel of the buffer, read with [] */
+    class Channel
+    {
+    public:
+        Channel (const LazySampleBuffer& buffer_, int channel_) : buffer (buffer_), channel (channel_) {}
+
+        /** @Returns a sample, decoding its block first if it isn't cached */
+        T operator [] (int index) const { return buffer.getSample (channel, index); }
+
+        /** @Returns the number of samples in the channel */
+        int size() const { return buffer.numFrames; }
+
+    private:
+        const LazySampleBuffer& buffer;
+        int channel;
+    };
+
+    /** Constructor. The buffer starts empty */
+    LazySampleBuffer();
+
+    /** Takes over another buffer's file or memory and its cache, leaving it empty */
+    LazySampleBuffer (LazySampleBuffer&& other);
+    LazySampleBuffer& operator = (LazySampleBuffer&& other);
+
+    /** Destructor. Closes the file being viewed */
+    ~LazySampleBuffer();
+
+    /** Views the data chunk of a WAV file on the card. The File is kept open until detach() */
+    bool attach (File file, const WaveFormat& format);
+
+    /** Views PCM data already in memory, laid out as described by a WAV format whose
+     * dataOffset is ignored. The memory must stay valid until detach()
+     */
+    bool attach (const uint8_t* sampleData, const WaveFormat& format);
+
+    /** Stops viewing the file or memory and empties the cache */
+    void detach();
+
+    /** @Returns the number of channels */
+    int size() const;
+
+    /** @Returns one channel */
+    Channel operator [] (int channel) const;
+
+    /** Detaches and leaves the buffer with a number of channels and no samples */
+    void resize (int numChannels);
+
+    /** Detaches and leaves the buffer with no channels */
+    void clear();
+
+    /** @Returns the frames of one block of a channel, decoding the block if it isn't cached,
+     * or nullptr if the block is past the end. Block i holds frames i * BlockFrames onwards.
+     */
+    const T* getBlock (int channel, int blockIndex) const;
+
+    //=============================================================
+    /** @Returns the number of blocks decoded since the buffer was attached */
+    uint32_t getNumBlocksDecoded() const;
+
+    /** @Returns the number of sample and block reads that found their block cached */
+    uint32_t getNumCacheHits() const;
+
+private:
+
+    //=============================================================
+    T getSample (int channel, int index) const;
+    const T* getSlot (int blockIndex) const;
+    void takeFrom (LazySampleBuffer& other);
+
+    // two views of one File would both close it
+    LazySampleBuffer (const LazySampleBuffer&) = delete;
+    LazySampleBuffer& operator = (const LazySampleBuffer&) = delete;
+
+    //=============================================================
+    mutable File file;
+    const uint8_t* memory;
+    WaveFormat format;
+    int numChannels;
+    int numFrames;
+
+    mutable BlockCache<T, MaxChannels * BlockFrames, NumCachedBlocks> cache;
+    mutable uint8_t rawBlock[BlockFrames * MaxChannels * 3];
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::LazySampleBuffer()
+{
+    memory = nullptr;
+    memset (&format, 0, sizeof (format));
+    numChannels = 0;
+    numFrames = 0;
+    detach();
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::LazySampleBuffer (LazySampleBuffer&& other)
+{
+    memory = nullptr;
+    numChannels = 0;
+    numFrames = 0;
+    detach();
+    takeFrom (other);
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>&
+LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::operator = (LazySampleBuffer&& other)
+{
+    if (this != &other)
+    {
+        detach();
+        takeFrom (other);
+    }
+
+    return *this;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::~LazySampleBuffer()
+{
+    detach();
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+bool LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::attach (File file_, const WaveFormat& format_)
+{
+    detach();
+
+    if (format_.numChannels < 1 || format_.numChannels > MaxChannels || format_.bitDepth > 24)
+        return false;
+
+    file = file_;
+    format = format_;
+    numChannels = format.numChannels;
+    numFrames = (int) format.getNumFrames();
+
+    // a file shorter than its header says only has the frames that are there
+    uint32_t fileSize = file.size();
+
+    if (fileSize <= format.dataOffset)
+        numFrames = 0;
+    else if (format.dataSize > fileSize - format.dataOffset)
+        numFrames = (int)((fileSize - format.dataOffset) / format.numBytesPerBlock);
+
+    return true;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+bool LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::attach (const uint8_t* sampleData, const WaveFormat& format_)
+{
+    detach();
+
+    if (sampleData == nullptr || format_.numChannels < 1 || format_.numChannels > MaxChannels || format_.bitDepth > 24)
+        return false;
+
+    memory = sampleData;
+    format = format_;
+    numChannels = format.numChannels;
+    numFrames = (int) format.getNumFrames();
+    return true;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+void LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::detach()
+{
+    if (file)
+        file.close();
+
+    file = File();
+    memory = nullptr;
+    numFrames = 0;
+    cache.clear();
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+int LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::size() const
+{
+    return numChannels;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+typename LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::Channel
+LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::operator [] (int channel) const
+{
+    return Channel (*this, channel);
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+void LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::resize (int newNumChannels)
+{
+    detach();
+    numChannels = newNumChannels;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+void LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::clear()
+{
+    resize (0);
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+const T* LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getBlock (int channel, int blockIndex) const
+{
+    if (blockIndex < 0 || blockIndex * BlockFrames >= numFrames || channel < 0 || channel >= numChannels)
+        return nullptr;
+
+    return getSlot (blockIndex) + channel * BlockFrames;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+uint32_t LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getNumBlocksDecoded() const
+{
+    return cache.getNumClaims();
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+uint32_t LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getNumCacheHits() const
+{
+    return cache.getNumHits();
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+T LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getSample (int channel, int index) const
+{
+    if (index < 0 || index >= numFrames)
+        return T();
+
+    int blockIndex = index / BlockFrames;
+    return getSlot (blockIndex)[channel * BlockFrames + index - blockIndex * BlockFrames];
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+const T* LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::getSlot (int blockIndex) const
+{
+    T* slot = cache.find (blockIndex);
+
+    if (slot != nullptr)
+        return slot;
+
+    // decode the block into the least recently used slot
+    slot = cache.claim (blockIndex);
+    int startFrame = blockIndex * BlockFrames;
+    int numBlockFrames = numFrames - startFrame < BlockFrames ? numFrames - startFrame : BlockFrames;
+    int numBytesPerSample = format.bitDepth / 8;
+    const uint8_t* source = nullptr;
+
+    if (memory != nullptr)
+    {
+        source = memory + (uint32_t) startFrame * format.numBytesPerBlock;
+    }
+    else
+    {
+        int numBytes = numBlockFrames * format.numBytesPerBlock;
+        int numBytesRead = file.seek (format.getFrameOffset ((uint32_t) startFrame)) ? file.read (rawBlock, numBytes) : 0;
+
+        // anything the card couldn't supply reads as silence
+        if (numBytesRead < numBytes)
+            memset (rawBlock + (numBytesRead > 0 ? numBytesRead : 0), 0, numBytes - (numBytesRead > 0 ? numBytesRead : 0));
+
+        source = rawBlock;
+    }
+
+    for (int channel = 0; channel < numChannels; channel++)
+        decodePcmSamples (source + channel * numBytesPerSample, format.bitDepth, slot + channel * BlockFrames,
+                          numBlockFrames, format.numBytesPerBlock);
+
+    return slot;
+}
+
+//=============================================================
+template <class T, int BlockFrames, int NumCachedBlocks, int MaxChannels>
+void LazySampleBuffer<T, BlockFrames, NumCachedBlocks, MaxChannels>::takeFrom (LazySampleBuffer& other)
+{
+    file = other.file;
+    memory = other.memory;
+    format = other.format;
+    numChannels = other.numChannels;
+    numFrames = other.numFrames;
+
+    // the decoded blocks are still valid, so they come across rather than being decoded again
+    cache = other.cache;
+
+    // the File now belongs to this buffer, so the other one must forget it without closing it
+    other.file = File();
+    other.memory = nullptr;
+    other.numChannels = 0;
+    other.detach();
+}
+
+#endif /* LazyBuffer_h */
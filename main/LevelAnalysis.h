@@ -0,0 +1,434 @@
+#ifndef LevelAnalysis_h
+#define LevelAnalysis_h
+
+#include <math.h>
+#include <stdint.h>
+
+//=============================================================
+/** Something that wants to see every decoded frame as it is converted.
+ * Attach one to an AudioFile with setAnalysisSink() and it is fed from
+ * inside the decode loop, so no second pass over the samples is needed.
+ */
+template <class T>
+class AudioAnalysisSink
+{
+public:
+
+    virtual ~AudioAnalysisSink() {}
+
+    /** Called before the first frame of a file is decoded */
+    virtual void begin (uint32_t sampleRate, int numChannels) = 0;
+
+    /** Called once for every decoded frame, with one sample per channel */
+    virtual void processFrame (const T* frame) = 0;
+
+    /** Called after the last frame of a file has been decoded */
+    virtual void end() {}
+};
+
+//=============================================================
+/** Per-channel peak, RMS, clip count and DC offset plus EBU R128 integrated
+ * loudness, accumulated one frame at a time.
+ *
+ * Loudness follows ITU-R BS.1770: K-weighting, 400ms blocks with 75% overlap,
+ * an absolute gate at -70 LUFS and a relative gate 10 LU below the ungated
+ * level. To keep memory bounded the gated blocks are collected into a
+ * histogram of NumLoudnessBins bins spread over -70 to +5 LUFS; each bin keeps
+ * the energy sum of its blocks, so only blocks in the bin containing the
+ * relative gate are approximated.
+ */
+template <class T, int MaxChannels = 2, int NumLoudnessBins = 150>
+class LevelAnalyser : public AudioAnalysisSink<T>
+{
+public:
+
+    /** Constructor */
+    LevelAnalyser();
+
+    /** Resets all statistics and prepares the K-weighting filters for a sample rate */
+    void begin (uint32_t sampleRate, int numChannels) override;
+
+    /** Adds one frame (one sample per channel) to the statistics */
+    void processFrame (const T* frame) override;
+
+    /** Sets the absolute level at or above which a sample is counted as clipped (default 0.999) */
+    void setClipThreshold (T threshold);
+
+    //=============================================================
+    /** @Returns the number of frames analysed so far */
+    uint32_t getNumFrames() const;
+
+    /** @Returns the largest absolute sample value seen on a channel */
+    T getPeak (int channel) const;
+
+    /** @Returns the RMS level of a channel */
+    T getRMS (int channel) const;
+
+    /** @Returns the mean sample value (DC offset) of a channel */
+    T getDCOffset (int channel) const;
+
+    /** @Returns the number of samples on a channel at or above the clip threshold */
+    uint32_t getClipCount (int channel) const;
+
+    /** @Returns the gated integrated loudness in LUFS, or -HUGE_VAL if everything was below the absolute gate */
+    double getIntegratedLoudness() const;
+
+    /** @Returns the linear gain that brings the integrated loudness to targetLoudness (in LUFS) */
+    T getGainForLoudness (double targetLoudness) const;
+
+    /** @Returns the linear gain that brings the largest peak on any channel to targetPeak */
+    T getGainForPeak (T targetPeak = (T)1.) const;
+
+private:
+
+    //=============================================================
+    static const int numSubBlocks = 4;
+
+    struct Biquad
+    {
+        double b0, b1, b2, a1, a2;
+        double z1, z2;
+
+        double process (double x)
+        {
+            double y = b0 * x + z1;
+            z1 = b1 * x - a1 * y + z2;
+            z2 = b2 * x - a2 * y;
+            return y;
+        }
+    };
+
+    struct ChannelState
+    {
+        Biquad shelf;
+        Biquad highPass;
+        double sum;
+        double sumOfSquares;
+        double weightedEnergy[numSubBlocks];
+        double channelWeight;
+        T peak;
+        uint32_t clipCount;
+    };
+
+    //=============================================================
+    void finishSubBlock();
+    static double energyToLoudness (double energy);
+    static int loudnessToBin (double loudness);
+    static double getBinTop (int bin);
+
+    //=============================================================
+    ChannelState channels[MaxChannels];
+    double binEnergy[NumLoudnessBins];
+    uint32_t binCount[NumLoudnessBins];
+    int numChannels;
+    T clipThreshold;
+    uint32_t numFrames;
+    uint32_t subBlockLength;
+    uint32_t framesInSubBlock;
+    int subBlockIndex;
+    int numSubBlocksSeen;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+LevelAnalyser<T, MaxChannels, NumLoudnessBins>::LevelAnalyser()
+{
+    clipThreshold = (T)0.999;
+    begin (44100, 1);
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+void LevelAnalyser<T, MaxChannels, NumLoudnessBins>::begin (uint32_t sampleRate, int numChannels_)
+{
+    numChannels = numChannels_ < 1 ? 1 : (numChannels_ > MaxChannels ? MaxChannels : numChannels_);
+    numFrames = 0;
+    subBlockLength = sampleRate / 10;
+    framesInSubBlock = 0;
+    subBlockIndex = 0;
+    numSubBlocksSeen = 0;
+
+    if (subBlockLength == 0)
+        subBlockLength = 1;
+
+    // K-weighting filter design (pre-filter shelf then RLB high pass) for any sample rate
+    const double pi = 3.14159265358979323846;
+
+    double K = tan (pi * 1681.974450955533 / (double)sampleRate);
+    double Q = 0.7071752369554196;
+    double Vh = pow (10., 3.999843853973347 / 20.);
+    double Vb = pow (Vh, 0.4996667741545416);
+    double a0 = 1. + K / Q + K * K;
+
+    Biquad shelf;
+    shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+    shelf.b1 = 2. * (K * K - Vh) / a0;
+    shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+    shelf.a1 = 2. * (K * K - 1.) / a0;
+    shelf.a2 = (1. - K / Q + K * K) / a0;
+    shelf.z1 = shelf.z2 = 0.;
+
+    K = tan (pi * 38.13547087602444 / (double)sampleRate);
+    Q = 0.5003270373238773;
+    a0 = 1. + K / Q + K * K;
+
+    Biquad highPass;
+    highPass.b0 = 1.;
+    highPass.b1 = -2.;
+    highPass.b2 = 1.;
+    highPass.a1 = 2. * (K * K - 1.) / a0;
+    highPass.a2 = (1. - K / Q + K * K) / a0;
+    highPass.z1 = highPass.z2 = 0.;
+
+    for (int c = 0; c < MaxChannels; c++)
+    {
+        ChannelState& state = channels[c];
+        state.shelf = shelf;
+        state.highPass = highPass;
+        state.sum = 0.;
+        state.sumOfSquares = 0.;
+        state.peak = (T)0.;
+        state.clipCount = 0;
+
+        for (int i = 0; i < numSubBlocks; i++)
+            state.weightedEnergy[i] = 0.;
+
+        // BS.1770 channel weights for a 5.1 layout (L R C LFE Ls Rs), otherwise all channels count equally
+        state.channelWeight = 1.;
+
+        if (numChannels == 6)
+        {
+            if (c == 3)
+                state.channelWeight = 0.;
+            else if (c >= 4)
+                state.channelWeight = 1.41;
+        }
+    }
+
+    for (int i = 0; i < NumLoudnessBins; i++)
+    {
+        binEnergy[i] = 0.;
+        binCount[i] = 0;
+    }
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+void LevelAnalyser<T, MaxChannels, NumLoudnessBins>::processFrame (const T* frame)
+{
+    for (int c = 0; c < numChannels; c++)
+    {
+        ChannelState& state = channels[c];
+        T sample = frame[c];
+        T magnitude = sample < (T)0. ? -sample : sample;
+
+        if (magnitude > state.peak)
+            state.peak = magnitude;
+
+        if (magnitude >= clipThreshold)
+            state.clipCount++;
+
+        state.sum += sample;
+        state.sumOfSquares += (double)sample * (double)sample;
+
+        double weighted = state.highPass.process (state.shelf.process ((double)sample));
+        state.weightedEnergy[subBlockIndex] += weighted * weighted;
+    }
+
+    numFrames++;
+    framesInSubBlock++;
+
+    if (framesInSubBlock == subBlockLength)
+        finishSubBlock();
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+void LevelAnalyser<T, MaxChannels, NumLoudnessBins>::finishSubBlock()
+{
+    if (numSubBlocksSeen < numSubBlocks)
+        numSubBlocksSeen++;
+
+    // a gating block is the last four 100ms sub-blocks
+    if (numSubBlocksSeen == numSubBlocks)
+    {
+        double energy = 0.;
+
+        for (int c = 0; c < numChannels; c++)
+        {
+            double channelEnergy = 0.;
+
+            for (int i = 0; i < numSubBlocks; i++)
+                channelEnergy += channels[c].weightedEnergy[i];
+
+            energy += channels[c].channelWeight * channelEnergy;
+        }
+
+        energy /= (double)(subBlockLength * numSubBlocks);
+
+        int bin = loudnessToBin (energyToLoudness (energy));
+
+        if (bin >= 0)
+        {
+            binEnergy[bin] += energy;
+            binCount[bin]++;
+        }
+    }
+
+    subBlockIndex = (subBlockIndex + 1) % numSubBlocks;
+    framesInSubBlock = 0;
+
+    for (int c = 0; c < numChannels; c++)
+        channels[c].weightedEnergy[subBlockIndex] = 0.;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+double LevelAnalyser<T, MaxChannels, NumLoudnessBins>::energyToLoudness (double energy)
+{
+    if (energy <= 0.)
+        return -HUGE_VAL;
+
+    return -0.691 + 10. * log10 (energy);
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+int LevelAnalyser<T, MaxChannels, NumLoudnessBins>::loudnessToBin (double loudness)
+{
+    // blocks below the absolute gate of -70 LUFS are dropped
+    if (loudness < -70.)
+        return -1;
+
+    int bin = (int)((loudness + 70.) / 75. * NumLoudnessBins);
+
+    return bin < NumLoudnessBins ? bin : NumLoudnessBins - 1;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+double LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getBinTop (int bin)
+{
+    return -70. + (double)(bin + 1) * 75. / NumLoudnessBins;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+void LevelAnalyser<T, MaxChannels, NumLoudnessBins>::setClipThreshold (T threshold)
+{
+    clipThreshold = threshold;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+uint32_t LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getNumFrames() const
+{
+    return numFrames;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+T LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getPeak (int channel) const
+{
+    return channels[channel].peak;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+T LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getRMS (int channel) const
+{
+    if (numFrames == 0)
+        return (T)0.;
+
+    return (T)sqrt (channels[channel].sumOfSquares / (double)numFrames);
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+T LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getDCOffset (int channel) const
+{
+    if (numFrames == 0)
+        return (T)0.;
+
+    return (T)(channels[channel].sum / (double)numFrames);
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+uint32_t LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getClipCount (int channel) const
+{
+    return channels[channel].clipCount;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+double LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getIntegratedLoudness() const
+{
+    double energy = 0.;
+    uint32_t count = 0;
+
+    for (int i = 0; i < NumLoudnessBins; i++)
+    {
+        energy += binEnergy[i];
+        count += binCount[i];
+    }
+
+    if (count == 0)
+        return -HUGE_VAL;
+
+    // relative gate, then average again over the blocks above it
+    double relativeGate = energyToLoudness (energy / (double)count) - 10.;
+
+    energy = 0.;
+    count = 0;
+
+    for (int i = 0; i < NumLoudnessBins; i++)
+    {
+        if (getBinTop (i) > relativeGate)
+        {
+            energy += binEnergy[i];
+            count += binCount[i];
+        }
+    }
+
+    if (count == 0)
+        return -HUGE_VAL;
+
+    return energyToLoudness (energy / (double)count);
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+T LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getGainForLoudness (double targetLoudness) const
+{
+    double loudness = getIntegratedLoudness();
+
+    if (loudness == -HUGE_VAL)
+        return (T)1.;
+
+    return (T)pow (10., (targetLoudness - loudness) / 20.);
+}
+
+//=============================================================
+template <class T, int MaxChannels, int NumLoudnessBins>
+T LevelAnalyser<T, MaxChannels, NumLoudnessBins>::getGainForPeak (T targetPeak) const
+{
+    T peak = (T)0.;
+
+    for (int c = 0; c < numChannels; c++)
+    {
+        if (channels[c].peak > peak)
+            peak = channels[c].peak;
+    }
+
+    if (peak <= (T)0.)
+        return (T)1.;
+
+    return targetPeak / peak;
+}
+
+#endif /* LevelAnalysis_h */
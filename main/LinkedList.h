@@ -1,6 +1,8 @@
 #ifndef LinkedList_hpp
 #define LinkedList_hpp
 
+#include "Profiling.h"
+
 
 template <class T>
 class ListNode {
@@ -26,6 +28,7 @@ class LinkedList  {
   public:
     LinkedList();
     LinkedList(const LinkedList<T>&);
+    LinkedList(LinkedList<T>&&);
     ~LinkedList();
     T& getCurrent();
     T& First() const;
@@ -46,6 +49,7 @@ class LinkedList  {
     void PutFirstToLast();
     void Update(T elem);
     LinkedList& operator = (const LinkedList<T>&);
+    LinkedList& operator = (LinkedList<T>&&);
 };
 
 template <class T>
@@ -72,9 +76,26 @@ LinkedList<T>::LinkedList(const LinkedList<T> & list) {
     }
 }
 
+// takes over the nodes, leaving the other list empty
+template <class T>
+LinkedList<T>::LinkedList(LinkedList<T> && list) {
+    length = list.length;
+    head = list.head;
+    tail = list.tail;
+    curr = list.curr;
+
+    list.length = 0;
+    list.head = nullptr;
+    list.tail = nullptr;
+    list.curr = nullptr;
+}
+
 template <class T>
 LinkedList<T> & LinkedList<T>::operator=(const LinkedList<T> & list)
 {
+    if (this == &list)
+        return *this;
+
     clear();
 
     ListNode<T> * temp = list.head;
@@ -88,6 +109,27 @@ LinkedList<T> & LinkedList<T>::operator=(const LinkedList<T> & list)
     return *this;
 }
 
+template <class T>
+LinkedList<T> & LinkedList<T>::operator=(LinkedList<T> && list)
+{
+    if (this == &list)
+        return *this;
+
+    clear();
+
+    length = list.length;
+    head = list.head;
+    tail = list.tail;
+    curr = list.curr;
+
+    list.length = 0;
+    list.head = nullptr;
+    list.tail = nullptr;
+    list.curr = nullptr;
+
+    return *this;
+}
+
 template <class T>
 LinkedList<T>::~LinkedList() {
     clear();
@@ -120,6 +162,7 @@ int LinkedList<T>::size()
 template <class T>
 void LinkedList<T>::Append(T element)
 {
+    AUDIOFILE_PROFILE_ALLOCATION();
     ListNode<T> * node = new ListNode<T>(element, tail, nullptr);
 
     if(length == 0)
@@ -177,7 +220,7 @@ bool LinkedList<T>::prev()
     if(length == 0)
         return false;
 
-    if(curr->prev != nullptr)
+    if(curr->prev == nullptr)
         return false;
 
     curr = curr->prev;
@@ -265,37 +308,26 @@ void LinkedList<T>::clear()
     }
 
     head = curr = tail = nullptr;
-
+    length = 0;
 }
 
 template <class T>
 void LinkedList<T>::resize(int n)
 {
-    if(length == 0)
-        return false;
-    
-    else if(length > n) {
-        // If n is smaller than the current container size,
-        // the content is reduced to its first n elements,
-        // removing those beyond (and destroying them).
-        int counter = 0;
-        if(moveToStart())
-            do {
-                if(counter > n) {
-                    DeleteCurrent();
-                }
-                counter++;
-            } while (next());       
-    }
-    else {
-        // If n is greater than the current container size,
-        // the content is expanded by inserting at the end as many elements
-        // as needed to reach a size of n. 
-        T element = nullptr; // Not sure about here
-        Append(element);
-
-    }
-
+    if(n < 0)
+        n = 0;
+
+    // If n is smaller than the current container size,
+    // the content is reduced to its first n elements,
+    // removing those beyond (and destroying them).
+    while(length > n)
+        DeleteLast();
+
+    // If n is greater than the current container size,
+    // the content is expanded by inserting at the end as many
+    // value-initialised elements as needed to reach a size of n.
+    while(length < n)
+        Append(T());
 }
 
 template <class T>
@@ -304,7 +336,7 @@ void LinkedList<T>::fill(int startIndex, int endIndex, T value)
     int counter = 0;
     if(moveToStart()) {
         do {
-            if (counter >= startIn && counter <= endIndex) {
+            if (counter >= startIndex && counter <= endIndex) {
                 curr->element = value;
             }
             counter++;
@@ -0,0 +1,611 @@
+#ifndef Mixer_h
+#define Mixer_h
+
+#include <math.h>
+#include <stdint.h>
+#include "Allocation.h"
+#include "WavReader.h"
+
+#if ! defined (ARDUINO) && defined (__SSE__)
+ #include <xmmintrin.h>
+#endif
+
+/** Plays up to MaxVoices WAV files at once into one interleaved stereo stream.
+ *
+ * Each voice streams its file through its own WavReader, so a voice costs a
+ * few sectors of RAM whatever the length of the file. Every voice has a gain
+ * and a pan, and can loop. Everything, including the voices and the mix
+ * buffers, lives inside the Mixer, so nothing is allocated while mixing:
+ *
+ *      static Mixer<float, 4> mixer;
+ *
+ *      int music = mixer.play ("/music.wav", 0.5f, 0.f, true);
+ *      mixer.play ("/beep.wav", 1.f, -0.5f);
+ *
+ *      mixer.process (output, 256);    // 256 stereo frames
+ *
+ * With T = float (or double) samples are mixed in floating point, using SSE on
+ * hosts that have it. With T = int16_t the files are decoded straight to Q15 and
+ * mixed in 32 bit fixed point, for boards without an FPU.
+ *
+ * Sums above full scale are either clipped (MixMode::Saturate) or turned down by
+ * a limiter that ramps its gain over each block and recovers slowly
+ * (MixMode::Headroom), so a pile-up of voices ducks the mix instead of distorting.
+ */
+
+//=============================================================
+/** What the mixer does with sums that go past full scale */
+enum class MixMode
+{
+    Saturate,
+    Headroom
+};
+
+//=============================================================
+/** Sample, gain and accumulator types for floating point mixing */
+template <class T>
+struct MixerTraits
+{
+    typedef T Accumulator;
+    typedef T Gain;
+
+    static Gain toGain (float gain) { return (T) gain; }
+    static Gain getUnityGain() { return (T) 1.; }
+    static Accumulator getFullScale() { return (T) 1.; }
+    static Accumulator multiply (Accumulator sample, Gain gain) { return sample * gain; }
+    static Gain getGainForPeak (Accumulator peak) { return (T) 1. / peak; }
+    static T toSample (Accumulator sample) { return sample; }
+};
+
+//=============================================================
+/** Q15 samples mixed in 32 bits with Q15 gains of up to 2 */
+template <>
+struct MixerTraits<int16_t>
+{
+    typedef int32_t Accumulator;
+    typedef int32_t Gain;
+
+    static Gain toGain (float gain)
+    {
+        float scaled = gain * 32768.f + 0.5f;
+        return scaled < 0.f ? 0 : (scaled > 65535.f ? 65535 : (Gain) scaled);
+    }
+
+    static Gain getUnityGain() { return 32768; }
+    static Accumulator getFullScale() { return 32767; }
+    static Accumulator multiply (Accumulator sample, Gain gain) { return (Accumulator)(((int64_t) sample * gain) >> 15); }
+    static Gain getGainForPeak (Accumulator peak) { return (Gain)(((int64_t) 32767 << 15) / peak); }
+    static int16_t toSample (Accumulator sample) { return (int16_t) sample; }
+};
+
+//=============================================================
+namespace MixerHelpers
+{
+    /** Adds numFrames frames of a mono or stereo voice, scaled by a left and right gain,
+     * to an interleaved stereo mix
+     */
+    template <class T, class Accumulator, class Gain>
+    void accumulate (Accumulator* mix, const T* voice, int numFrames, int numChannels, Gain left, Gain right)
+    {
+        typedef MixerTraits<T> Traits;
+
+        if (numChannels == 1)
+        {
+            for (int i = 0; i < numFrames; i++)
+            {
+                mix[2 * i] += Traits::multiply (voice[i], left);
+                mix[2 * i + 1] += Traits::multiply (voice[i], right);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < numFrames; i++)
+            {
+                mix[2 * i] += Traits::multiply (voice[2 * i], left);
+                mix[2 * i + 1] += Traits::multiply (voice[2 * i + 1], right);
+            }
+        }
+    }
+
+    /** Clips numSamples samples of a mix to full scale and writes them out */
+    template <class T, class Accumulator>
+    void saturate (const Accumulator* mix, T* output, int numSamples)
+    {
+        typedef MixerTraits<T> Traits;
+        Accumulator fullScale = Traits::getFullScale();
+
+        for (int i = 0; i < numSamples; i++)
+        {
+            Accumulator sample = mix[i];
+
+            if (sample > fullScale)
+                sample = fullScale;
+            else if (sample < -fullScale - 1)
+                sample = -fullScale - 1;
+
+            output[i] = Traits::toSample (sample);
+        }
+    }
+
+    /** @Returns the largest absolute value in a mix */
+    template <class Accumulator>
+    Accumulator getPeak (const Accumulator* mix, int numSamples)
+    {
+        Accumulator peak = 0;
+
+        for (int i = 0; i < numSamples; i++)
+        {
+            Accumulator magnitude = mix[i] < 0 ? -mix[i] : mix[i];
+
+            if (magnitude > peak)
+                peak = magnitude;
+        }
+
+        return peak;
+    }
+
+#if ! defined (ARDUINO) && defined (__SSE__)
+    // four samples at a time; the gains are laid out as L R L R to match interleaved stereo
+    inline void accumulate (float* mix, const float* voice, int numFrames, int numChannels, float left, float right)
+    {
+        __m128 gains = _mm_setr_ps (left, right, left, right);
+        int i = 0;
+
+        if (numChannels == 1)
+        {
+            for (; i + 4 <= numFrames; i += 4)
+            {
+                __m128 samples = _mm_loadu_ps (voice + i);
+                __m128 low = _mm_mul_ps (_mm_unpacklo_ps (samples, samples), gains);
+                __m128 high = _mm_mul_ps (_mm_unpackhi_ps (samples, samples), gains);
+                _mm_storeu_ps (mix + 2 * i, _mm_add_ps (_mm_loadu_ps (mix + 2 * i), low));
+                _mm_storeu_ps (mix + 2 * i + 4, _mm_add_ps (_mm_loadu_ps (mix + 2 * i + 4), high));
+            }
+
+            for (; i < numFrames; i++)
+            {
+                mix[2 * i] += voice[i] * left;
+                mix[2 * i + 1] += voice[i] * right;
+            }
+        }
+        else
+        {
+            for (; i + 2 <= numFrames; i += 2)
+            {
+                __m128 samples = _mm_mul_ps (_mm_loadu_ps (voice + 2 * i), gains);
+                _mm_storeu_ps (mix + 2 * i, _mm_add_ps (_mm_loadu_ps (mix + 2 * i), samples));
+            }
+
+            for (; i < numFrames; i++)
+            {
+                mix[2 * i] += voice[2 * i] * left;
+                mix[2 * i + 1] += voice[2 * i + 1] * right;
+            }
+        }
+    }
+
+    inline void saturate (const float* mix, float* output, int numSamples)
+    {
+        __m128 high = _mm_set1_ps (1.f);
+        __m128 low = _mm_set1_ps (-1.f);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+            _mm_storeu_ps (output + i, _mm_max_ps (low, _mm_min_ps (high, _mm_loadu_ps (mix + i))));
+
+        for (; i < numSamples; i++)
+            output[i] = mix[i] > 1.f ? 1.f : (mix[i] < -1.f ? -1.f : mix[i]);
+    }
+#endif
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames = 128, class Source = PrefetchReader<>>
+class Mixer
+{
+public:
+
+    static_assert (MaxVoices > 0 && BlockFrames > 0, "a Mixer needs at least one voice and one frame per block");
+
+    typedef MixerTraits<T> Traits;
+    typedef typename Traits::Accumulator Accumulator;
+    typedef typename Traits::Gain Gain;
+
+    /** Constructor */
+    Mixer();
+
+    /** Sets the sample rate of the output. Files must match it to be played (default 44100) */
+    void setSampleRate (uint32_t sampleRate);
+
+    /** Sets what happens to sums past full scale (default MixMode::Headroom) */
+    void setMixMode (MixMode mode);
+
+    /** Sets a gain applied to the whole mix before the full scale check (default 1) */
+    void setMasterGain (float gain);
+
+    //=============================================================
+    /** Starts playing a mono or stereo WAV file on a free voice.
+     * @param pan -1 (left) to 1 (right). Mono files are panned at constant power;
+     *            stereo files are balanced, turning the opposite side down
+     * @Returns the voice number, or -1 if no voice is free or the file can't be played
+     */
+    int play (const String& filePath, float gain = 1.f, float pan = 0.f, bool loop = false);
+
+    /** Stops a voice and closes its file */
+    void stop (int voice);
+
+    /** Stops every voice */
+    void stopAll();
+
+    /** @Returns true if a voice is playing */
+    bool isPlaying (int voice) const;
+
+    /** @Returns the number of voices playing */
+    int getNumVoicesPlaying() const;
+
+    /** Changes the gain of a playing voice */
+    void setGain (int voice, float gain);
+
+    /** Changes the pan of a playing voice */
+    void setPan (int voice, float pan);
+
+    /** Turns looping on or off for a playing voice */
+    void setLooping (int voice, bool loop);
+
+    //=============================================================
+    /** Mixes numFrames frames of every playing voice into interleaved stereo output.
+     * Voices that reach the end of their file stop, or start again if they loop.
+     */
+    void process (T* interleavedStereoOutput, int numFrames);
+
+    /** Lets each voice read ahead. Worth calling from idle time on Arduino */
+    void prefetch();
+
+    /** @Returns the number of times a sum went past full scale and was clipped or limited */
+    uint32_t getNumOverloads() const;
+
+private:
+
+    //=============================================================
+    struct Voice
+    {
+        WavReader<T, 512, Source> reader;
+        float gain;
+        float pan;
+        Gain leftGain;
+        Gain rightGain;
+        bool playing;
+        bool looping;
+    };
+
+    void updateGains (Voice& voice);
+    void processBlock (T* output, int numFrames);
+    int readVoice (Voice& voice, int numFrames);
+    void limit (T* output, int numFrames);
+
+    //=============================================================
+    Voice voices[MaxVoices];
+    T voiceBlock[BlockFrames * 2];
+    Accumulator mixBlock[BlockFrames * 2];
+    uint32_t sampleRate;
+    MixMode mixMode;
+    Gain masterGain;
+    Gain limiterGain;
+    uint32_t numOverloads;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+Mixer<T, MaxVoices, BlockFrames, Source>::Mixer()
+{
+    // on boards with a known RAM size, a mixer that can't fit fails to compile
+    CheckRamBudget<sizeof (Mixer), AUDIOFILE_RAM_BUDGET> ramCheck;
+    (void) ramCheck;
+
+    for (int i = 0; i < MaxVoices; i++)
+    {
+        voices[i].playing = false;
+        voices[i].looping = false;
+        voices[i].gain = 1.f;
+        voices[i].pan = 0.f;
+        updateGains (voices[i]);
+    }
+
+    sampleRate = 44100;
+    mixMode = MixMode::Headroom;
+    masterGain = Traits::getUnityGain();
+    limiterGain = Traits::getUnityGain();
+    numOverloads = 0;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::setSampleRate (uint32_t newSampleRate)
+{
+    sampleRate = newSampleRate;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::setMixMode (MixMode mode)
+{
+    mixMode = mode;
+    limiterGain = Traits::getUnityGain();
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::setMasterGain (float gain)
+{
+    masterGain = Traits::toGain (gain);
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+int Mixer<T, MaxVoices, BlockFrames, Source>::play (const String& filePath, float gain, float pan, bool loop)
+{
+    int index = -1;
+
+    for (int i = 0; i < MaxVoices && index < 0; i++)
+        if (! voices[i].playing)
+            index = i;
+
+    if (index < 0)
+    {
+        Serial.println ("ERROR: all of the mixer's voices are playing");
+        return -1;
+    }
+
+    Voice& voice = voices[index];
+
+    if (! voice.reader.open (filePath))
+        return -1;
+
+    if (voice.reader.getNumChannels() > 2)
+    {
+        Serial.println ("ERROR: the mixer only plays mono and stereo files");
+        voice.reader.close();
+        return -1;
+    }
+
+    if (voice.reader.getSampleRate() != sampleRate)
+    {
+        Serial.println ("ERROR: this file's sample rate is different to the mixer's");
+        voice.reader.close();
+        return -1;
+    }
+
+    voice.gain = gain;
+    voice.pan = pan;
+    voice.looping = loop;
+    voice.playing = true;
+    updateGains (voice);
+    return index;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::stop (int voice)
+{
+    if (voice < 0 || voice >= MaxVoices)
+        return;
+
+    voices[voice].reader.close();
+    voices[voice].playing = false;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::stopAll()
+{
+    for (int i = 0; i < MaxVoices; i++)
+        stop (i);
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+bool Mixer<T, MaxVoices, BlockFrames, Source>::isPlaying (int voice) const
+{
+    return voice >= 0 && voice < MaxVoices && voices[voice].playing;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+int Mixer<T, MaxVoices, BlockFrames, Source>::getNumVoicesPlaying() const
+{
+    int numPlaying = 0;
+
+    for (int i = 0; i < MaxVoices; i++)
+        if (voices[i].playing)
+            numPlaying++;
+
+    return numPlaying;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::setGain (int voice, float gain)
+{
+    if (! isPlaying (voice))
+        return;
+
+    voices[voice].gain = gain;
+    updateGains (voices[voice]);
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::setPan (int voice, float pan)
+{
+    if (! isPlaying (voice))
+        return;
+
+    voices[voice].pan = pan;
+    updateGains (voices[voice]);
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::setLooping (int voice, bool loop)
+{
+    if (isPlaying (voice))
+        voices[voice].looping = loop;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::process (T* interleavedStereoOutput, int numFrames)
+{
+    while (numFrames > 0)
+    {
+        int framesThisTime = numFrames < BlockFrames ? numFrames : BlockFrames;
+        processBlock (interleavedStereoOutput, framesThisTime);
+        interleavedStereoOutput += framesThisTime * 2;
+        numFrames -= framesThisTime;
+    }
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::prefetch()
+{
+    for (int i = 0; i < MaxVoices; i++)
+        if (voices[i].playing)
+            voices[i].reader.prefetch();
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+uint32_t Mixer<T, MaxVoices, BlockFrames, Source>::getNumOverloads() const
+{
+    return numOverloads;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::updateGains (Voice& voice)
+{
+    float pan = voice.pan < -1.f ? -1.f : (voice.pan > 1.f ? 1.f : voice.pan);
+    float left, right;
+
+    if (voice.playing && voice.reader.getNumChannels() == 2)
+    {
+        left = pan > 0.f ? 1.f - pan : 1.f;
+        right = pan < 0.f ? 1.f + pan : 1.f;
+    }
+    else
+    {
+        // constant power, so a mono voice is equally loud wherever it is panned
+        float angle = (pan + 1.f) * 0.785398163f;
+        left = cosf (angle);
+        right = sinf (angle);
+    }
+
+    voice.leftGain = Traits::toGain (voice.gain * left);
+    voice.rightGain = Traits::toGain (voice.gain * right);
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::processBlock (T* output, int numFrames)
+{
+    for (int i = 0; i < numFrames * 2; i++)
+        mixBlock[i] = 0;
+
+    for (int i = 0; i < MaxVoices; i++)
+    {
+        Voice& voice = voices[i];
+
+        if (! voice.playing)
+            continue;
+
+        int numChannels = voice.reader.getNumChannels();
+        int numRead = readVoice (voice, numFrames);
+        MixerHelpers::accumulate (mixBlock, voiceBlock, numRead, numChannels, voice.leftGain, voice.rightGain);
+    }
+
+    if (masterGain != Traits::getUnityGain())
+        for (int i = 0; i < numFrames * 2; i++)
+            mixBlock[i] = Traits::multiply (mixBlock[i], masterGain);
+
+    if (mixMode == MixMode::Headroom)
+    {
+        limit (output, numFrames);
+        return;
+    }
+
+    if (MixerHelpers::getPeak (mixBlock, numFrames * 2) > Traits::getFullScale())
+        numOverloads++;
+
+    MixerHelpers::saturate (mixBlock, output, numFrames * 2);
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+int Mixer<T, MaxVoices, BlockFrames, Source>::readVoice (Voice& voice, int numFrames)
+{
+    int numChannels = voice.reader.getNumChannels();
+    int numRead = voice.reader.read (voiceBlock, numFrames);
+
+    // a looping voice carries on from the start of its file within the same block
+    while (numRead < numFrames && voice.looping && voice.reader.getNumFrames() > 0 && voice.reader.seekToFrame (0))
+    {
+        int n = voice.reader.read (voiceBlock + numRead * numChannels, numFrames - numRead);
+
+        if (n <= 0)
+            break;
+
+        numRead += n;
+    }
+
+    if (numRead < numFrames && ! voice.looping)
+    {
+        voice.reader.close();
+        voice.playing = false;
+    }
+
+    return numRead;
+}
+
+//=============================================================
+template <class T, int MaxVoices, int BlockFrames, class Source>
+void Mixer<T, MaxVoices, BlockFrames, Source>::limit (T* output, int numFrames)
+{
+    Gain unity = Traits::getUnityGain();
+    Gain startGain = limiterGain;
+    Gain targetGain = startGain;
+
+    // recover an eighth of the way back to unity each block
+    targetGain += (unity - targetGain) / 8;
+
+    Accumulator peak = MixerHelpers::getPeak (mixBlock, numFrames * 2);
+
+    if (Traits::multiply (peak, targetGain) > Traits::getFullScale())
+    {
+        targetGain = Traits::getGainForPeak (peak);
+        numOverloads++;
+    }
+
+    // the gain is ramped across the block so changes don't click; a block that has
+    // to come down sharply starts at the lower gain so its peak never clips
+    if (targetGain < startGain)
+        startGain = targetGain;
+
+    for (int i = 0; i < numFrames; i++)
+    {
+        Gain gain = startGain + (Gain)((targetGain - startGain) * (i + 1) / numFrames);
+        mixBlock[2 * i] = Traits::multiply (mixBlock[2 * i], gain);
+        mixBlock[2 * i + 1] = Traits::multiply (mixBlock[2 * i + 1], gain);
+    }
+
+    limiterGain = targetGain;
+
+    // rounding can leave a sample a hair over full scale
+    MixerHelpers::saturate (mixBlock, output, numFrames * 2);
+}
+
+#endif /* Mixer_h */
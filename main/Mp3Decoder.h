@@ -0,0 +1,2016 @@
+#ifndef Mp3Decoder_h
+#define Mp3Decoder_h
+
+#include <stdint.h>
+#include <string.h>
+#include <SD.h>
+#include "PrefetchReader.h"
+#include "Mp3Tables.h"
+
+/** Streaming decoder for MP3 (MPEG-1, MPEG-2 and MPEG-2.5 Layer III) files on SD
+ * (or any File), in fixed point so that it runs at full speed on boards without
+ * an FPU.
+ *
+ * Audio is decoded one granule at a time: 576 frames, which is half of an MPEG-1
+ * frame or all of an MPEG-2 one. Memory use is fixed whatever the file or bit rate:
+ * about 20 KB for stereo, plus the Source's read-ahead, for the bit reservoir (the
+ * bytes of earlier frames that a frame may borrow), the spectrum and overlap of
+ * each channel, the synthesis filter's history and the decoded granule. The constant tables (Huffman codes,
+ * windows) are kept in flash with PROGMEM, see Mp3Tables.h.
+ *
+ * The IMDCTs and the synthesis filterbank's DCT are computed through small
+ * complex FFTs, and subbands above the highest non-zero line of a granule skip
+ * them entirely. Files with a LAME header have the encoder's delay and padding
+ * removed, so tracks join without gaps. Granules that can't be decoded (corrupt
+ * data, or a bit reservoir that refers to frames before the start of the file)
+ * are returned as silence and counted by getNumCorruptBlocks().
+ *
+ *      Mp3Decoder<float> decoder;
+ *
+ *      if (decoder.open ("/song.mp3"))
+ *          int numRead = decoder.read (block, 256);
+ *
+ * As in FlacDecoder, a frame here is one sample of every channel; MP3's own frames
+ * are called blocks, and decodeBlock() decodes one granule.
+ */
+
+//=============================================================
+/** What the first frames of an MP3 file say about the stream */
+struct Mp3StreamInfo
+{
+    uint32_t sampleRate;
+    uint16_t numChannels;
+
+    /** The MPEG version times ten: 10, 20 or 25 */
+    uint16_t mpegVersion;
+
+    /** The bit rate of the first frame, in kbit/s */
+    uint16_t bitRate;
+
+    /** Frames in each MP3 frame: 1152 for MPEG-1, 576 otherwise */
+    uint16_t samplesPerBlock;
+
+    /** Frames in the file once the encoder's delay and padding are removed,
+     * or 0 if the file has no Xing, Info or VBRI header to say
+     */
+    uint32_t numFrames;
+
+    /** Frames the encoder added before and after the audio, from a LAME header */
+    uint16_t encoderDelay;
+    uint16_t encoderPadding;
+
+    /** Byte offsets of the first frame of audio and of the end of the last */
+    uint32_t firstBlockOffset;
+    uint32_t endOffset;
+
+    //=============================================================
+    /** @Returns the length of the file in seconds */
+    double getLengthInSeconds() const
+    {
+        return sampleRate > 0 ? (double)numFrames / (double)sampleRate : 0.;
+    }
+};
+
+//=============================================================
+/** Converts decoded MP3 samples (fixed point, with 1 << 24 as full scale) into samples
+ * in the range -1 to 1. Like other decoders it doesn't clip, so loud files can go
+ * slightly past full scale.
+ * @param destinationStride the number of samples from one output to the next, e.g.
+ *                          the number of channels to write interleaved frames
+ */
+template <class T>
+void decodeMp3Samples (const int32_t* source, T* destination, int numSamples, int destinationStride = 1)
+{
+    const T scale = static_cast<T> (1.) / static_cast<T> (1L << 24);
+
+    for (int i = 0; i < numSamples; i++, destination += destinationStride)
+        *destination = static_cast<T> (source[i]) * scale;
+}
+
+//=============================================================
+/** Fixed point version: rounds decoded MP3 samples to Q15, clipping at full scale */
+inline void decodeMp3Samples (const int32_t* source, int16_t* destination, int numSamples, int destinationStride = 1)
+{
+    for (int i = 0; i < numSamples; i++, destination += destinationStride)
+    {
+        int32_t sample = (source[i] + (1 << 8)) >> 9;
+        *destination = (int16_t)(sample > 32767 ? 32767 : (sample < -32768 ? -32768 : sample));
+    }
+}
+
+//=============================================================
+namespace Mp3Helpers
+{
+    /** The fields of one frame header */
+    struct FrameHeader
+    {
+        int version;            // 0 for MPEG-1, 1 for MPEG-2, 2 for MPEG-2.5
+        int sampleRateIndex;    // 0 to 8, for the scalefactor band tables
+        uint32_t sampleRate;
+        int bitRate;
+        int frameBytes;         // the whole frame, header included
+        int numChannels;
+        int channelMode;        // 0 stereo, 1 joint stereo, 2 dual channel, 3 mono
+        int modeExtension;      // joint stereo: 2 for mid/side, 1 for intensity
+        bool hasCrc;
+        int sideInfoBytes;
+        int samplesPerBlock;
+    };
+
+    /** Parses four bytes as a Layer III frame header.
+     * @Returns false if they aren't one, or use the free format bit rate
+     */
+    inline bool parseFrameHeader (const uint8_t* bytes, FrameHeader& header)
+    {
+        static const uint16_t bitRates[2][15] = {
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+            { 0,  8, 16, 24, 32, 40, 48, 56,  64,  80,  96, 112, 128, 144, 160 }
+        };
+        static const uint16_t sampleRates[3] = { 44100, 48000, 32000 };
+
+        if (bytes[0] != 0xFF || (bytes[1] & 0xE0) != 0xE0)
+            return false;
+
+        int versionBits = (bytes[1] >> 3) & 3;
+        int layerBits = (bytes[1] >> 1) & 3;
+        int bitRateIndex = bytes[2] >> 4;
+        int rateIndex = (bytes[2] >> 2) & 3;
+
+        if (versionBits == 1 || layerBits != 1 || bitRateIndex == 0 || bitRateIndex == 15 || rateIndex == 3)
+            return false;
+
+        header.version = versionBits == 3 ? 0 : (versionBits == 2 ? 1 : 2);
+        header.sampleRateIndex = header.version * 3 + rateIndex;
+        header.sampleRate = (uint32_t)(sampleRates[rateIndex] >> header.version);
+        header.bitRate = bitRates[header.version == 0 ? 0 : 1][bitRateIndex];
+        header.samplesPerBlock = header.version == 0 ? 1152 : 576;
+        header.frameBytes = (int)((uint32_t)(header.samplesPerBlock / 8) * 1000 * (uint32_t)header.bitRate / header.sampleRate) + ((bytes[2] >> 1) & 1);
+        header.channelMode = bytes[3] >> 6;
+        header.modeExtension = (bytes[3] >> 4) & 3;
+        header.numChannels = header.channelMode == 3 ? 1 : 2;
+        header.hasCrc = (bytes[1] & 1) == 0;
+
+        if (header.version == 0)
+            header.sideInfoBytes = header.numChannels == 1 ? 17 : 32;
+        else
+            header.sideInfoBytes = header.numChannels == 1 ? 9 : 17;
+
+        return true;
+    }
+
+    /** @Returns true if two frame headers can belong to the same stream */
+    inline bool isSameStream (const FrameHeader& a, const FrameHeader& b)
+    {
+        return a.version == b.version && a.sampleRate == b.sampleRate && a.numChannels == b.numChannels;
+    }
+
+    /** @Returns a big endian 32 bit value */
+    inline uint32_t readBigEndian32 (const uint8_t* bytes)
+    {
+        return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+    }
+
+    //=============================================================
+    /** Reads bits, most significant first, from bytes that have at least 4 more
+     * readable bytes past the last one read
+     */
+    class BitReader
+    {
+    public:
+
+        void start (const uint8_t* bytes, int bitPosition)
+        {
+            data = bytes;
+            position = bitPosition;
+        }
+
+        /** @Returns the next 32 bits, of which at least the top 25 are valid, without reading them */
+        uint32_t peek() const
+        {
+            return readBigEndian32 (data + (position >> 3)) << (position & 7);
+        }
+
+        /** Reads up to 25 bits */
+        uint32_t read (int numBits)
+        {
+            if (numBits == 0)
+                return 0;
+
+            uint32_t value = peek() >> (32 - numBits);
+            position += numBits;
+            return value;
+        }
+
+        void skip (int numBits) { position += numBits; }
+        int getPosition() const { return position; }
+
+    private:
+
+        const uint8_t* data;
+        int position;
+    };
+
+    //=============================================================
+    /** Samples are clamped to four times full scale between the stages of the filterbank,
+     * which leaves its transforms enough headroom that even corrupt data can't overflow them
+     */
+    static const int32_t maxSampleValue = (1 << 26) - 1;
+
+    inline int32_t clampSample (int64_t value)
+    {
+        return value > maxSampleValue ? maxSampleValue : (value < -maxSampleValue ? -maxSampleValue : (int32_t)value);
+    }
+
+    /** @Returns a * b for a Q31 b */
+    inline int32_t multiply (int32_t a, int32_t b)
+    {
+        return (int32_t)(((int64_t)a * b) >> 31);
+    }
+
+    /** @Returns a * c + b * s for Q31 c and s */
+    inline int32_t multiplyAdd (int32_t a, int32_t c, int32_t b, int32_t s)
+    {
+        return (int32_t)(((int64_t)a * c + (int64_t)b * s) >> 31);
+    }
+
+    inline int32_t readTable (const int32_t* table, int index)
+    {
+        return (int32_t)pgm_read_dword (table + index);
+    }
+
+    //=============================================================
+    /** In-place complex FFTs (with exp (-2 pi i n k / N)) of the sizes the DCT-IVs use */
+    template <int N>
+    struct Fft;
+
+    template <>
+    struct Fft<1>
+    {
+        static void transform (int32_t*, int32_t*) {}
+    };
+
+    template <>
+    struct Fft<2>
+    {
+        static void transform (int32_t* re, int32_t* im)
+        {
+            int32_t re1 = re[1], im1 = im[1];
+            re[1] = re[0] - re1;
+            im[1] = im[0] - im1;
+            re[0] += re1;
+            im[0] += im1;
+        }
+    };
+
+    template <>
+    struct Fft<3>
+    {
+        static void transform (int32_t* re, int32_t* im)
+        {
+            int32_t sumRe = re[1] + re[2], sumIm = im[1] + im[2];
+            int32_t differenceRe = multiply (re[1] - re[2], Mp3Tables::sinPiOverThree);
+            int32_t differenceIm = multiply (im[1] - im[2], Mp3Tables::sinPiOverThree);
+            int32_t middleRe = re[0] - (sumRe >> 1), middleIm = im[0] - (sumIm >> 1);
+
+            re[0] += sumRe;
+            im[0] += sumIm;
+            re[1] = middleRe + differenceIm;
+            im[1] = middleIm - differenceRe;
+            re[2] = middleRe - differenceIm;
+            im[2] = middleIm + differenceRe;
+        }
+    };
+
+    template <>
+    struct Fft<4>
+    {
+        static void transform (int32_t* re, int32_t* im)
+        {
+            int32_t aRe = re[0] + re[2], aIm = im[0] + im[2];
+            int32_t bRe = re[0] - re[2], bIm = im[0] - im[2];
+            int32_t cRe = re[1] + re[3], cIm = im[1] + im[3];
+            int32_t dRe = re[1] - re[3], dIm = im[1] - im[3];
+
+            re[0] = aRe + cRe;  im[0] = aIm + cIm;
+            re[2] = aRe - cRe;  im[2] = aIm - cIm;
+            re[1] = bRe + dIm;  im[1] = bIm - dRe;
+            re[3] = bRe - dIm;  im[3] = bIm + dRe;
+        }
+    };
+
+    template <>
+    struct Fft<8>
+    {
+        static void transform (int32_t* re, int32_t* im)
+        {
+            int32_t evenRe[4] = { re[0], re[2], re[4], re[6] }, evenIm[4] = { im[0], im[2], im[4], im[6] };
+            int32_t oddRe[4] = { re[1], re[3], re[5], re[7] }, oddIm[4] = { im[1], im[3], im[5], im[7] };
+            Fft<4>::transform (evenRe, evenIm);
+            Fft<4>::transform (oddRe, oddIm);
+
+            // the odd half times exp (-2 pi i k / 8)
+            int32_t twiddledRe[4], twiddledIm[4];
+            twiddledRe[0] = oddRe[0];
+            twiddledIm[0] = oddIm[0];
+            twiddledRe[1] = multiply (oddRe[1] + oddIm[1], Mp3Tables::cosPiOverFour);
+            twiddledIm[1] = multiply (oddIm[1] - oddRe[1], Mp3Tables::cosPiOverFour);
+            twiddledRe[2] = oddIm[2];
+            twiddledIm[2] = -oddRe[2];
+            twiddledRe[3] = multiply (oddIm[3] - oddRe[3], Mp3Tables::cosPiOverFour);
+            twiddledIm[3] = -multiply (oddRe[3] + oddIm[3], Mp3Tables::cosPiOverFour);
+
+            for (int k = 0; k < 4; k++)
+            {
+                re[k] = evenRe[k] + twiddledRe[k];
+                im[k] = evenIm[k] + twiddledIm[k];
+                re[k + 4] = evenRe[k] - twiddledRe[k];
+                im[k + 4] = evenIm[k] - twiddledIm[k];
+            }
+        }
+    };
+
+    template <>
+    struct Fft<9>
+    {
+        static void transform (int32_t* re, int32_t* im)
+        {
+            // three FFTs of 3 over every third input, twiddled, then three more across them
+            int32_t columnsRe[3][3], columnsIm[3][3];
+
+            for (int column = 0; column < 3; column++)
+            {
+                for (int row = 0; row < 3; row++)
+                {
+                    columnsRe[column][row] = re[3 * row + column];
+                    columnsIm[column][row] = im[3 * row + column];
+                }
+
+                Fft<3>::transform (columnsRe[column], columnsIm[column]);
+            }
+
+            // exp (-2 pi i column k / 9) for column k = 1, 2 and 4
+            const int twiddleIndex[3][3] = { { -1, -1, -1 }, { -1, 0, 1 }, { -1, 1, 2 } };
+
+            for (int column = 1; column < 3; column++)
+            {
+                for (int k = 1; k < 3; k++)
+                {
+                    int index = twiddleIndex[column][k];
+                    int32_t c = readTable (Mp3Tables::fft9Twiddles, 2 * index);
+                    int32_t s = readTable (Mp3Tables::fft9Twiddles, 2 * index + 1);
+                    int32_t a = columnsRe[column][k], b = columnsIm[column][k];
+                    columnsRe[column][k] = multiplyAdd (a, c, b, s);
+                    columnsIm[column][k] = multiplyAdd (b, c, a, -s);
+                }
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                int32_t rowRe[3] = { columnsRe[0][k], columnsRe[1][k], columnsRe[2][k] };
+                int32_t rowIm[3] = { columnsIm[0][k], columnsIm[1][k], columnsIm[2][k] };
+                Fft<3>::transform (rowRe, rowIm);
+
+                for (int j = 0; j < 3; j++)
+                {
+                    re[k + 3 * j] = rowRe[j];
+                    im[k + 3 * j] = rowIm[j];
+                }
+            }
+        }
+    };
+
+    //=============================================================
+    template <int N> inline const int32_t* getDct4Twiddles();
+    template <> inline const int32_t* getDct4Twiddles<2>() { return Mp3Tables::dct4Twiddles2; }
+    template <> inline const int32_t* getDct4Twiddles<4>() { return Mp3Tables::dct4Twiddles4; }
+    template <> inline const int32_t* getDct4Twiddles<8>() { return Mp3Tables::dct4Twiddles8; }
+    template <> inline const int32_t* getDct4Twiddles<16>() { return Mp3Tables::dct4Twiddles16; }
+    template <> inline const int32_t* getDct4Twiddles<6>() { return Mp3Tables::dct4Twiddles6; }
+    template <> inline const int32_t* getDct4Twiddles<18>() { return Mp3Tables::dct4Twiddles18; }
+
+    /** DCT-IV: output[n] = sum of input[k] cos (pi (2n + 1) (2k + 1) / 4N), through a
+     * complex FFT of N/2 points between two rotations
+     */
+    template <int N>
+    struct Dct4
+    {
+        static void transform (const int32_t* input, int32_t* output)
+        {
+            const int M = N / 2;
+            const int32_t* twiddles = getDct4Twiddles<N>();
+            int32_t re[M], im[M];
+
+            for (int k = 0; k < M; k++)
+            {
+                int32_t c = readTable (twiddles, 2 * k), s = readTable (twiddles, 2 * k + 1);
+                int32_t a = input[2 * k], b = input[N - 1 - 2 * k];
+                re[k] = multiplyAdd (a, c, b, s);
+                im[k] = multiplyAdd (b, c, a, -s);
+            }
+
+            Fft<M>::transform (re, im);
+
+            for (int k = 0; k < M; k++)
+            {
+                int32_t c = readTable (twiddles, 2 * M + 2 * k), s = readTable (twiddles, 2 * M + 2 * k + 1);
+                output[2 * k] = multiplyAdd (re[k], c, im[k], s);
+                output[N - 1 - 2 * k] = multiplyAdd (re[k], s, im[k], -c);
+            }
+        }
+    };
+
+    template <>
+    struct Dct4<1>
+    {
+        static void transform (const int32_t* input, int32_t* output)
+        {
+            output[0] = multiply (input[0], Mp3Tables::cosPiOverFour);
+        }
+    };
+
+    /** DCT-II: output[n] = sum of input[k] cos (pi n (2k + 1) / 2N), split recursively
+     * into a DCT-II of the even outputs and a DCT-IV of the odd ones
+     */
+    template <int N>
+    struct Dct2
+    {
+        static void transform (const int32_t* input, int32_t* output)
+        {
+            const int M = N / 2;
+            int32_t sums[M], differences[M], evens[M], odds[M];
+
+            for (int k = 0; k < M; k++)
+            {
+                sums[k] = input[k] + input[N - 1 - k];
+                differences[k] = input[k] - input[N - 1 - k];
+            }
+
+            Dct2<M>::transform (sums, evens);
+            Dct4<M>::transform (differences, odds);
+
+            for (int k = 0; k < M; k++)
+            {
+                output[2 * k] = evens[k];
+                output[2 * k + 1] = odds[k];
+            }
+        }
+    };
+
+    template <>
+    struct Dct2<1>
+    {
+        static void transform (const int32_t* input, int32_t* output)
+        {
+            output[0] = input[0];
+        }
+    };
+
+    //=============================================================
+    /** The IMDCT of N inputs, written as its 2N outputs from a DCT-IV of them:
+     * the DCT's second half, then all of it reversed and negated, then its first half negated
+     */
+    template <int N>
+    inline void imdct (const int32_t* input, int32_t* output)
+    {
+        int32_t y[N];
+        Dct4<N>::transform (input, y);
+
+        for (int i = 0; i < N / 2; i++)
+        {
+            output[i] = y[i + N / 2];
+            output[3 * N / 2 + i] = -y[i];
+        }
+
+        for (int i = N / 2; i < 3 * N / 2; i++)
+            output[i] = -y[3 * N / 2 - 1 - i];
+    }
+
+    /** @Returns i^(4/3) * 2^(exponent / 4) for an integer i, in Q24, clamped */
+    inline int32_t requantize (int32_t value, int exponent)
+    {
+        uint32_t magnitude = (uint32_t)(value < 0 ? -value : value);
+        uint32_t mantissa;
+        int shift = 0;
+        int third = 0;
+
+        if (magnitude < 128)
+        {
+            mantissa = pgm_read_dword (Mp3Tables::powerFourThirds + magnitude);
+        }
+        else
+        {
+            // interpolate between the top half of the table, then scale by 2^(4 shift / 3)
+            int numBits = 0;
+
+            while ((magnitude >> numBits) >= 128)
+                numBits++;
+
+            uint32_t index = magnitude >> numBits;
+            uint32_t fraction = magnitude & ((1u << numBits) - 1);
+            uint32_t low = pgm_read_dword (Mp3Tables::powerFourThirds + index);
+            uint32_t high = pgm_read_dword (Mp3Tables::powerFourThirds + index + 1);
+            mantissa = low + (uint32_t)(((uint64_t)(high - low) * fraction) >> numBits);
+            shift = numBits + numBits / 3;
+            third = numBits % 3;
+        }
+
+        int quarter = exponent & 3;
+        shift += (exponent - quarter) / 4;
+
+        // Q21 times Q30 is Q51, and the result is Q24
+        uint64_t product = (uint64_t)mantissa * pgm_read_dword (&Mp3Tables::fractionalPowersOfTwo[third][quarter]);
+        int rightShift = 27 - shift;
+        uint64_t result;
+
+        if (rightShift >= 64)
+            result = 0;
+        else if (rightShift >= 0)
+            result = product >> rightShift;
+        else
+            result = rightShift > -32 && (product >> (31 + rightShift)) == 0 ? product << -rightShift : (uint64_t)maxSampleValue;
+
+        int32_t clamped = result > (uint64_t)maxSampleValue ? maxSampleValue : (int32_t)result;
+        return value < 0 ? -clamped : clamped;
+    }
+}
+
+//=============================================================
+/** Finds the first frame of an MP3 file, skipping any ID3v2 tag, and reads the Xing,
+ * Info or VBRI header and LAME header an encoder may have put in it. The header
+ * frame holds no audio, so firstBlockOffset is the frame after it. A frame is only
+ * taken as the first if another frame of the same stream follows it.
+ * @param maxBytesToRead gives up if no frame can be found within this many bytes of reads
+ * @Returns true if the file has MPEG Layer III frames and its Xing, Info or VBRI
+ * header (if any) gives a length that fits in 32 bits
+ */
+inline bool readMp3StreamInfo (File& file, Mp3StreamInfo& info, uint32_t maxBytesToRead = 0xFFFFFFFF)
+{
+    using namespace Mp3Helpers;
+
+    uint8_t bytes[192];
+    uint32_t fileSize = file.size();
+    uint32_t numBytesRead = 0;
+    uint32_t position = 0;
+
+    memset (&info, 0, sizeof (info));
+
+    if (! file.seek (0) || file.read (bytes, 10) != 10)
+        return false;
+
+    numBytesRead = 10;
+
+    // an ID3v2 tag: "ID3", version, flags and a 28 bit size, plus a footer if flag 0x10 is set
+    if (memcmp (bytes, "ID3", 3) == 0)
+    {
+        uint32_t tagSize = ((uint32_t)(bytes[6] & 0x7F) << 21) | ((uint32_t)(bytes[7] & 0x7F) << 14) | ((uint32_t)(bytes[8] & 0x7F) << 7) | (uint32_t)(bytes[9] & 0x7F);
+        position = 10 + tagSize + ((bytes[5] & 0x10) != 0 ? 10 : 0);
+    }
+
+    // an ID3v1 tag takes the last 128 bytes
+    info.endOffset = fileSize;
+
+    if (fileSize >= 128 && file.seek (fileSize - 128) && file.read (bytes, 3) == 3 && memcmp (bytes, "TAG", 3) == 0)
+        info.endOffset = fileSize - 128;
+
+    FrameHeader header;
+    bool found = false;
+
+    while (! found)
+    {
+        if (position + 4 > info.endOffset || numBytesRead + 4 > maxBytesToRead)
+            return false;
+
+        if (! file.seek (position) || file.read (bytes, 4) != 4)
+            return false;
+
+        numBytesRead += 4;
+
+        if (parseFrameHeader (bytes, header))
+        {
+            FrameHeader nextHeader;
+            uint8_t nextBytes[4];
+            uint32_t nextPosition = position + (uint32_t)header.frameBytes;
+
+            // a lone frame at the very end of the file is accepted too
+            if (nextPosition + 4 > info.endOffset)
+                found = nextPosition <= info.endOffset;
+            else if (file.seek (nextPosition) && file.read (nextBytes, 4) == 4)
+                found = parseFrameHeader (nextBytes, nextHeader) && isSameStream (header, nextHeader);
+
+            numBytesRead += 4;
+        }
+
+        if (! found)
+            position++;
+    }
+
+    info.sampleRate = header.sampleRate;
+    info.numChannels = (uint16_t)header.numChannels;
+    info.mpegVersion = (uint16_t)(header.version == 0 ? 10 : (header.version == 1 ? 20 : 25));
+    info.bitRate = (uint16_t)header.bitRate;
+    info.samplesPerBlock = (uint16_t)header.samplesPerBlock;
+    info.firstBlockOffset = position;
+
+    // the Xing or Info header follows the side info, VBRI is always 32 bytes after the header
+    int numBytes = header.frameBytes < (int)sizeof (bytes) ? header.frameBytes : (int)sizeof (bytes);
+
+    if (numBytesRead + (uint32_t)numBytes > maxBytesToRead || ! file.seek (position) || file.read (bytes, numBytes) != numBytes)
+        return true;
+
+    int xingOffset = 4 + (header.hasCrc ? 2 : 0) + header.sideInfoBytes;
+    uint32_t numBlocks = 0;
+    bool hasInfoHeader = false;
+
+    if (xingOffset + 8 <= numBytes && (memcmp (bytes + xingOffset, "Xing", 4) == 0 || memcmp (bytes + xingOffset, "Info", 4) == 0))
+    {
+        uint32_t flags = readBigEndian32 (bytes + xingOffset + 4);
+        int offset = xingOffset + 8;
+        hasInfoHeader = true;
+
+        if ((flags & 1) != 0 && offset + 4 <= numBytes)
+            numBlocks = readBigEndian32 (bytes + offset);
+
+        offset += ((flags & 1) != 0 ? 4 : 0) + ((flags & 2) != 0 ? 4 : 0) + ((flags & 4) != 0 ? 100 : 0) + ((flags & 8) != 0 ? 4 : 0);
+
+        // the LAME header: 9 bytes of version, 12 of other fields, then 12 bits each of delay and padding
+        if (offset + 24 <= numBytes && memcmp (bytes + offset, "LAME", 4) == 0)
+        {
+            info.encoderDelay = (uint16_t)((bytes[offset + 21] << 4) | (bytes[offset + 22] >> 4));
+            info.encoderPadding = (uint16_t)(((bytes[offset + 22] & 0x0F) << 8) | bytes[offset + 23]);
+        }
+    }
+    else if (36 + 18 <= numBytes && memcmp (bytes + 36, "VBRI", 4) == 0)
+    {
+        hasInfoHeader = true;
+        numBlocks = readBigEndian32 (bytes + 36 + 14);
+    }
+
+    if (hasInfoHeader)
+    {
+        info.firstBlockOffset = position + (uint32_t)header.frameBytes;
+        uint64_t numSamples = (uint64_t)numBlocks * (uint64_t)header.samplesPerBlock;
+
+        // a count that doesn't fit the header's own field is corrupt, not a long file
+        if (numSamples > 0xFFFFFFFF)
+            return false;
+
+        uint32_t numTrimmed = (uint32_t)info.encoderDelay + info.encoderPadding;
+        info.numFrames = numSamples > numTrimmed ? (uint32_t)numSamples - numTrimmed : 0;
+    }
+
+    return true;
+}
+
+//=============================================================
+template <class T, class Source = PrefetchReader<>>
+class Mp3Decoder
+{
+public:
+
+    /** The most frames decodeBlock() returns: one granule */
+    static const int maxBlockSize = 576;
+
+    /** Constructor */
+    Mp3Decoder();
+
+    /** Destructor. Closes the file if it is still open */
+    ~Mp3Decoder();
+
+    /** Opens an MP3 file and finds its first frame.
+     * @Returns true if the file is an MPEG Layer III file
+     */
+    bool open (const String& filePath);
+
+    /** Decodes a file that is already open. The decoder closes it in close() */
+    bool open (File file);
+
+    /** Closes the file */
+    void close();
+
+    /** @Returns true if a file is open */
+    bool isOpen() const;
+
+    //=============================================================
+    /** @Returns what the first frames of the open file say about it */
+    const Mp3StreamInfo& getStreamInfo() const;
+
+    /** @Returns the sample rate */
+    uint32_t getSampleRate() const;
+
+    /** @Returns the number of audio channels */
+    int getNumChannels() const;
+
+    /** @Returns the number of frames (samples per channel) in the file, or 0 if the file doesn't say */
+    uint32_t getNumFrames() const;
+
+    /** @Returns the length of the file in seconds */
+    double getLengthInSeconds() const;
+
+    //=============================================================
+    /** Moves the read position to a frame index. Each granule depends on the ones before
+     * it, so this decodes forward, and moving back starts again from the first frame.
+     * @Returns false if the frame is past the end of the file
+     */
+    bool seekToFrame (uint32_t frame);
+
+    /** @Returns the index of the next frame read() will return */
+    uint32_t getPosition() const;
+
+    /** Reads up to numFrames interleaved frames from the current position and advances it.
+     * @Returns the number of frames read, which is less than numFrames at the end of the file
+     */
+    int read (T* interleavedFrames, int numFrames);
+
+    //=============================================================
+    /** Decodes the next granule, skipping anything read() hasn't returned from the current one.
+     * @Returns the number of frames decoded (up to maxBlockSize), or 0 at the end of the file
+     */
+    int decodeBlock();
+
+    /** @Returns the samples of one channel of the last granule decoded, in fixed point with
+     * 1 << 24 as full scale (see decodeMp3Samples())
+     */
+    const int32_t* getBlockChannel (int channel) const;
+
+    /** @Returns the number of frames in the last granule decoded */
+    int getBlockSize() const;
+
+    /** @Returns the number of granules that couldn't be decoded and were returned as silence */
+    uint32_t getNumCorruptBlocks() const;
+
+    //=============================================================
+    /** Lets the Source read ahead. Worth calling from idle time between reads on Arduino */
+    void prefetch();
+
+    /** @Returns the read-ahead hit, miss and stall counters */
+    PrefetchStats getPrefetchStats();
+
+private:
+
+    //=============================================================
+    // a frame may start its data up to 511 bytes back, in the frames before it
+    static const int maxReservoirBytes = 511;
+    static const int maxFrameBytes = 1441;
+    static const int mainDataBufferSize = maxReservoirBytes + maxFrameBytes + 8;
+
+    // frames decoders lag behind the encoder, which LAME's delay doesn't count
+    static const int decoderDelay = 529;
+
+    /** The side info of one channel of one granule */
+    struct GranuleChannel
+    {
+        int part23Length;
+        int bigValues;
+        int globalGain;
+        int scalefacCompress;
+        bool windowSwitching;
+        int blockType;
+        bool mixedBlock;
+        int tableSelect[3];
+        int subblockGain[3];
+        int region1Start;
+        int region2Start;
+        bool preflag;
+        bool scalefacScale;
+        int count1Table;
+    };
+
+    //=============================================================
+    void resetStream();
+    bool readFrame();
+    bool readSideInfo();
+    void readGranuleChannel (Mp3Helpers::BitReader& reader, GranuleChannel& channel);
+    bool decodeGranule();
+    void readScalefactors (Mp3Helpers::BitReader& reader, int channel);
+    void readLsfScalefactors (Mp3Helpers::BitReader& reader, int channel);
+    bool readHuffmanValues (Mp3Helpers::BitReader& reader, int channel, int endPosition);
+    void requantizeChannel (int channel);
+    void processStereo();
+    void applyIntensityStereo (int start, int end, int position);
+    void applyMidSide (int start, int end);
+    void reorderShortBlocks (int channel);
+    void reduceAliasing (int channel);
+    void hybridSynthesis (int channel);
+    void polyphaseSynthesis (int channel);
+
+    //=============================================================
+    File file;
+    Source source;
+    Mp3StreamInfo info;
+    bool fileIsOpen;
+    uint32_t streamPosition;
+
+    Mp3Helpers::FrameHeader header;
+    Mp3Helpers::FrameHeader firstHeader;
+    uint8_t sideInfo[32 + 4];
+    int mainDataBegin;
+    int scfsi[2];
+    GranuleChannel granules[2][2];
+    int granule;
+    int numGranules;
+
+    // the bit reservoir: the main data of the current frame, after up to 511 bytes of earlier ones
+    uint8_t mainData[mainDataBufferSize];
+    int mainDataLength;
+    int frameMainDataStart;
+    int granulePosition;
+    bool frameIsDecodable;
+
+    uint8_t longScalefactors[2][22];
+    uint8_t shortScalefactors[2][13][3];
+    uint8_t intensityLimitsLong[22];
+    uint8_t intensityLimitsShort[13];
+
+    // one granule of each channel: the spectrum, then the subband samples of the hybrid filterbank
+    int32_t spectrum[2][576];
+    int numNonZero[2];
+
+    // the second halves of the last IMDCTs, and the DCT outputs the synthesis window spans
+    int32_t overlap[2][32][18];
+    int32_t synthesisHistory[2][16][32];
+    int synthesisPosition;
+
+    int32_t blockSamples[2][576];
+    int blockStart;
+    int blockSize;
+    int blockPosition;
+    uint32_t blockStartFrame;
+    uint32_t numFramesToSkip;
+    uint32_t numFramesLeft;
+    uint32_t numCorruptBlocks;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, class Source>
+Mp3Decoder<T, Source>::Mp3Decoder()
+{
+    memset (&info, 0, sizeof (info));
+    fileIsOpen = false;
+    streamPosition = 0;
+    blockSize = 0;
+    blockPosition = 0;
+    blockStartFrame = 0;
+    numCorruptBlocks = 0;
+    resetStream();
+}
+
+//=============================================================
+template <class T, class Source>
+Mp3Decoder<T, Source>::~Mp3Decoder()
+{
+    close();
+}
+
+//=============================================================
+template <class T, class Source>
+bool Mp3Decoder<T, Source>::open (const String& filePath)
+{
+    File newFile = SD.open (filePath.c_str());
+
+    if (! newFile)
+    {
+        Serial.println ("ERROR: File doesn't exist or otherwise can't load file");
+        return false;
+    }
+
+    return open (newFile);
+}
+
+//=============================================================
+template <class T, class Source>
+bool Mp3Decoder<T, Source>::open (File newFile)
+{
+    close();
+    file = newFile;
+
+    if (! readMp3StreamInfo (file, info))
+    {
+        Serial.println ("ERROR: this doesn't seem to be a valid .MP3 file");
+        file.close();
+        return false;
+    }
+
+    source.attach (file, info.firstBlockOffset, info.endOffset);
+    fileIsOpen = true;
+    numCorruptBlocks = 0;
+    resetStream();
+    return true;
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::close()
+{
+    if (fileIsOpen)
+    {
+        source.detach();
+        file.close();
+    }
+
+    fileIsOpen = false;
+}
+
+//=============================================================
+template <class T, class Source>
+bool Mp3Decoder<T, Source>::isOpen() const
+{
+    return fileIsOpen;
+}
+
+//=============================================================
+template <class T, class Source>
+const Mp3StreamInfo& Mp3Decoder<T, Source>::getStreamInfo() const
+{
+    return info;
+}
+
+//=============================================================
+template <class T, class Source>
+uint32_t Mp3Decoder<T, Source>::getSampleRate() const
+{
+    return info.sampleRate;
+}
+
+//=============================================================
+template <class T, class Source>
+int Mp3Decoder<T, Source>::getNumChannels() const
+{
+    return (int)info.numChannels;
+}
+
+//=============================================================
+template <class T, class Source>
+uint32_t Mp3Decoder<T, Source>::getNumFrames() const
+{
+    return info.numFrames;
+}
+
+//=============================================================
+template <class T, class Source>
+double Mp3Decoder<T, Source>::getLengthInSeconds() const
+{
+    return info.getLengthInSeconds();
+}
+
+//=============================================================
+template <class T, class Source>
+bool Mp3Decoder<T, Source>::seekToFrame (uint32_t frame)
+{
+    if (! fileIsOpen || (info.numFrames > 0 && frame > info.numFrames))
+        return false;
+
+    if (frame < blockStartFrame)
+    {
+        if (! source.seek (info.firstBlockOffset))
+            return false;
+
+        resetStream();
+    }
+
+    while (frame >= blockStartFrame + (uint32_t)blockSize)
+    {
+        // the end of the file is a valid position, but nothing past it
+        if (decodeBlock() == 0)
+            return frame == blockStartFrame;
+    }
+
+    blockPosition = (int)(frame - blockStartFrame);
+    return true;
+}
+
+//=============================================================
+template <class T, class Source>
+uint32_t Mp3Decoder<T, Source>::getPosition() const
+{
+    return blockStartFrame + (uint32_t)blockPosition;
+}
+
+//=============================================================
+template <class T, class Source>
+int Mp3Decoder<T, Source>::read (T* interleavedFrames, int numFrames)
+{
+    if (! fileIsOpen)
+        return 0;
+
+    int numChannels = info.numChannels;
+    int numRead = 0;
+
+    while (numRead < numFrames)
+    {
+        if (blockPosition >= blockSize && decodeBlock() == 0)
+            break;
+
+        int framesThisTime = blockSize - blockPosition < numFrames - numRead ? blockSize - blockPosition : numFrames - numRead;
+
+        for (int channel = 0; channel < numChannels; channel++)
+            decodeMp3Samples (blockSamples[channel] + blockStart + blockPosition,
+                              interleavedFrames + numRead * numChannels + channel, framesThisTime, numChannels);
+
+        blockPosition += framesThisTime;
+        numRead += framesThisTime;
+    }
+
+    return numRead;
+}
+
+//=============================================================
+template <class T, class Source>
+int Mp3Decoder<T, Source>::decodeBlock()
+{
+    blockStartFrame += (uint32_t)blockSize;
+    blockSize = 0;
+    blockPosition = 0;
+    blockStart = 0;
+
+    if (! fileIsOpen)
+        return 0;
+
+    // the encoder's delay is decoded like any other granule, then dropped
+    while (blockSize == 0)
+    {
+        if (numFramesLeft == 0)
+            return 0;
+
+        if (granule >= numGranules && ! readFrame())
+            return 0;
+
+        if (! decodeGranule())
+        {
+            for (int channel = 0; channel < info.numChannels; channel++)
+                memset (blockSamples[channel], 0, sizeof (blockSamples[channel]));
+
+            numCorruptBlocks++;
+        }
+
+        granule++;
+        blockStart = numFramesToSkip < (uint32_t)maxBlockSize ? (int)numFramesToSkip : maxBlockSize;
+        numFramesToSkip -= (uint32_t)blockStart;
+        blockSize = maxBlockSize - blockStart;
+
+        if ((uint32_t)blockSize > numFramesLeft)
+            blockSize = (int)numFramesLeft;
+
+        numFramesLeft -= (uint32_t)blockSize;
+    }
+
+    return blockSize;
+}
+
+//=============================================================
+template <class T, class Source>
+const int32_t* Mp3Decoder<T, Source>::getBlockChannel (int channel) const
+{
+    return blockSamples[channel] + blockStart;
+}
+
+//=============================================================
+template <class T, class Source>
+int Mp3Decoder<T, Source>::getBlockSize() const
+{
+    return blockSize;
+}
+
+//=============================================================
+template <class T, class Source>
+uint32_t Mp3Decoder<T, Source>::getNumCorruptBlocks() const
+{
+    return numCorruptBlocks;
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::prefetch()
+{
+    if (fileIsOpen)
+        source.prefetch();
+}
+
+//=============================================================
+template <class T, class Source>
+PrefetchStats Mp3Decoder<T, Source>::getPrefetchStats()
+{
+    return source.getStats();
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::resetStream()
+{
+    streamPosition = info.firstBlockOffset;
+    granule = 0;
+    numGranules = 0;
+    mainDataLength = 0;
+    frameMainDataStart = 0;
+    frameIsDecodable = false;
+    synthesisPosition = 0;
+    memset (overlap, 0, sizeof (overlap));
+    memset (synthesisHistory, 0, sizeof (synthesisHistory));
+    memset (longScalefactors, 0, sizeof (longScalefactors));
+    memset (mainData, 0, sizeof (mainData));
+
+    blockStart = 0;
+    blockSize = 0;
+    blockPosition = 0;
+    blockStartFrame = 0;
+
+    // without a LAME header there is nothing to trim, and the length isn't known
+    bool hasGaplessInfo = info.encoderDelay > 0 || info.encoderPadding > 0;
+    numFramesToSkip = hasGaplessInfo ? (uint32_t)info.encoderDelay + decoderDelay : 0;
+    numFramesLeft = info.numFrames > 0 ? info.numFrames : 0xFFFFFFFF;
+}
+
+//=============================================================
+template <class T, class Source>
+bool Mp3Decoder<T, Source>::readFrame()
+{
+    using namespace Mp3Helpers;
+
+    uint8_t bytes[4];
+    bool isFirstFrame = numGranules == 0 && mainDataLength == 0;
+
+    // find the next header of the same stream, a byte at a time past anything else
+    for (;;)
+    {
+        if (streamPosition + 4 > info.endOffset || ! source.seek (streamPosition) || source.read (bytes, 4) != 4)
+            return false;
+
+        if (parseFrameHeader (bytes, header) && (isFirstFrame || isSameStream (header, firstHeader)))
+            break;
+
+        streamPosition++;
+    }
+
+    if (isFirstFrame)
+        firstHeader = header;
+
+    int numMainDataBytes = header.frameBytes - 4 - (header.hasCrc ? 2 : 0) - header.sideInfoBytes;
+
+    if (numMainDataBytes < 0 || streamPosition + (uint32_t)header.frameBytes > info.endOffset)
+        return false;
+
+    if (header.hasCrc && source.read (bytes, 2) != 2)
+        return false;
+
+    memset (sideInfo, 0, sizeof (sideInfo));
+
+    if (source.read (sideInfo, header.sideInfoBytes) != header.sideInfoBytes)
+        return false;
+
+    // keep the last 511 bytes of earlier frames for this frame's data to start in
+    if (mainDataLength > maxReservoirBytes)
+    {
+        memmove (mainData, mainData + mainDataLength - maxReservoirBytes, maxReservoirBytes);
+        mainDataLength = maxReservoirBytes;
+    }
+
+    frameMainDataStart = mainDataLength;
+
+    if (source.read (mainData + mainDataLength, numMainDataBytes) != numMainDataBytes)
+        return false;
+
+    mainDataLength += numMainDataBytes;
+    streamPosition += (uint32_t)header.frameBytes;
+
+    granule = 0;
+    numGranules = header.version == 0 ? 2 : 1;
+    frameIsDecodable = readSideInfo() && mainDataBegin <= frameMainDataStart;
+    granulePosition = (frameMainDataStart - mainDataBegin) * 8;
+    return true;
+}
+
+//=============================================================
+template <class T, class Source>
+bool Mp3Decoder<T, Source>::readSideInfo()
+{
+    Mp3Helpers::BitReader reader;
+    reader.start (sideInfo, 0);
+    int numChannels = header.numChannels;
+
+    if (header.version == 0)
+    {
+        mainDataBegin = (int)reader.read (9);
+        reader.skip (numChannels == 1 ? 5 : 3);
+
+        for (int channel = 0; channel < numChannels; channel++)
+            scfsi[channel] = (int)reader.read (4);
+    }
+    else
+    {
+        mainDataBegin = (int)reader.read (8);
+        reader.skip (numChannels == 1 ? 1 : 2);
+        scfsi[0] = scfsi[1] = 0;
+    }
+
+    bool ok = true;
+
+    for (int g = 0; g < (header.version == 0 ? 2 : 1); g++)
+    {
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            GranuleChannel& granuleChannel = granules[g][channel];
+            readGranuleChannel (reader, granuleChannel);
+
+            // big_values past the end of the spectrum, a reserved block type, or a mixed block
+            // at 8 kHz, whose long and short bands don't meet at 36 lines
+            if (granuleChannel.bigValues > 288 || (granuleChannel.windowSwitching && granuleChannel.blockType == 0)
+                || (granuleChannel.mixedBlock && header.sampleRateIndex == 8))
+                ok = false;
+        }
+    }
+
+    return ok;
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::readGranuleChannel (Mp3Helpers::BitReader& reader, GranuleChannel& channel)
+{
+    const uint8_t* longWidths = Mp3Tables::longBandWidths[header.sampleRateIndex];
+    const uint8_t* shortWidths = Mp3Tables::shortBandWidths[header.sampleRateIndex];
+
+    channel.part23Length = (int)reader.read (12);
+    channel.bigValues = (int)reader.read (9);
+    channel.globalGain = (int)reader.read (8);
+    channel.scalefacCompress = (int)reader.read (header.version == 0 ? 4 : 9);
+    channel.windowSwitching = reader.read (1) != 0;
+
+    if (channel.windowSwitching)
+    {
+        channel.blockType = (int)reader.read (2);
+        channel.mixedBlock = reader.read (1) != 0;
+        channel.tableSelect[0] = (int)reader.read (5);
+        channel.tableSelect[1] = (int)reader.read (5);
+        channel.tableSelect[2] = 0;
+
+        for (int window = 0; window < 3; window++)
+            channel.subblockGain[window] = (int)reader.read (3);
+
+        // region 0 is the first 9 short bands (3 of each window), or the first 8 long
+        // ones, where a mixed block in MPEG-2 counts short band 3 twice
+        int region1Start = 0;
+
+        if (channel.blockType == 2 && ! channel.mixedBlock)
+        {
+            for (int band = 0; band < 3; band++)
+                region1Start += 3 * pgm_read_byte (shortWidths + band);
+        }
+        else if (channel.blockType == 2 && header.version != 0)
+        {
+            for (int band = 0; band < 6; band++)
+                region1Start += pgm_read_byte (longWidths + band);
+
+            region1Start += 2 * pgm_read_byte (shortWidths + 3);
+        }
+        else
+        {
+            for (int band = 0; band < 8; band++)
+                region1Start += pgm_read_byte (longWidths + band);
+        }
+
+        channel.region1Start = region1Start;
+        channel.region2Start = 576;
+    }
+    else
+    {
+        channel.blockType = 0;
+        channel.mixedBlock = false;
+
+        for (int region = 0; region < 3; region++)
+            channel.tableSelect[region] = (int)reader.read (5);
+
+        channel.subblockGain[0] = channel.subblockGain[1] = channel.subblockGain[2] = 0;
+
+        int region0Count = (int)reader.read (4);
+        int region1Count = (int)reader.read (3);
+        int start = 0;
+
+        for (int band = 0; band < 22; band++)
+        {
+            if (band == region0Count + 1)
+                channel.region1Start = start;
+
+            if (band == region0Count + region1Count + 2)
+                break;
+
+            start += pgm_read_byte (longWidths + band);
+        }
+
+        if (region0Count + 1 >= 22)
+            channel.region1Start = start;
+
+        channel.region2Start = start;
+    }
+
+    channel.preflag = header.version == 0 ? reader.read (1) != 0 : false;
+    channel.scalefacScale = reader.read (1) != 0;
+    channel.count1Table = (int)reader.read (1);
+}
+
+//=============================================================
+template <class T, class Source>
+bool Mp3Decoder<T, Source>::decodeGranule()
+{
+    int numChannels = header.numChannels;
+    bool ok = frameIsDecodable;
+
+    if (ok)
+    {
+        Mp3Helpers::BitReader reader;
+
+        for (int channel = 0; channel < numChannels && ok; channel++)
+        {
+            GranuleChannel& granuleChannel = granules[granule][channel];
+            int endPosition = granulePosition + granuleChannel.part23Length;
+
+            if (endPosition > mainDataLength * 8)
+            {
+                ok = false;
+                break;
+            }
+
+            reader.start (mainData, granulePosition);
+
+            if (header.version == 0)
+                readScalefactors (reader, channel);
+            else
+                readLsfScalefactors (reader, channel);
+
+            ok = reader.getPosition() <= endPosition && readHuffmanValues (reader, channel, endPosition);
+            granulePosition = endPosition;
+        }
+
+        for (int channel = 0; channel < numChannels && ok; channel++)
+            requantizeChannel (channel);
+
+        if (ok && header.channelMode == 1)
+            processStereo();
+    }
+
+    // a granule that can't be decoded is silent, and its overlap still fades out
+    if (! ok)
+    {
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            memset (spectrum[channel], 0, sizeof (spectrum[channel]));
+            numNonZero[channel] = 0;
+        }
+
+        // the next granule of this frame starts at an unknown position
+        frameIsDecodable = false;
+    }
+
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        if (ok)
+        {
+            reorderShortBlocks (channel);
+            reduceAliasing (channel);
+        }
+
+        hybridSynthesis (channel);
+        polyphaseSynthesis (channel);
+    }
+
+    synthesisPosition = (synthesisPosition - 18) & 15;
+    return ok;
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::readScalefactors (Mp3Helpers::BitReader& reader, int channel)
+{
+    const GranuleChannel& granuleChannel = granules[granule][channel];
+    int slen1 = pgm_read_byte (&Mp3Tables::scalefactorBits[granuleChannel.scalefacCompress][0]);
+    int slen2 = pgm_read_byte (&Mp3Tables::scalefactorBits[granuleChannel.scalefacCompress][1]);
+
+    if (granuleChannel.windowSwitching && granuleChannel.blockType == 2)
+    {
+        int firstShortBand = 0;
+
+        if (granuleChannel.mixedBlock)
+        {
+            for (int band = 0; band < 8; band++)
+                longScalefactors[channel][band] = (uint8_t)reader.read (slen1);
+
+            firstShortBand = 3;
+        }
+
+        for (int band = firstShortBand; band < 12; band++)
+            for (int window = 0; window < 3; window++)
+                shortScalefactors[channel][band][window] = (uint8_t)reader.read (band < 6 ? slen1 : slen2);
+
+        for (int window = 0; window < 3; window++)
+            shortScalefactors[channel][12][window] = 0;
+    }
+    else
+    {
+        // granule 1 reuses the groups of bands that scfsi marks from granule 0
+        static const uint8_t groupEnds[4] = { 6, 11, 16, 21 };
+        int band = 0;
+
+        for (int group = 0; group < 4; group++)
+        {
+            bool reuse = granule == 1 && (scfsi[channel] & (8 >> group)) != 0;
+
+            for (; band < groupEnds[group]; band++)
+                if (! reuse)
+                    longScalefactors[channel][band] = (uint8_t)reader.read (group < 2 ? slen1 : slen2);
+        }
+
+        longScalefactors[channel][21] = 0;
+    }
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::readLsfScalefactors (Mp3Helpers::BitReader& reader, int channel)
+{
+    GranuleChannel& granuleChannel = granules[granule][channel];
+    int compress = granuleChannel.scalefacCompress;
+    bool isIntensityChannel = header.channelMode == 1 && (header.modeExtension & 1) != 0 && channel == 1;
+    int slen[4] = { 0, 0, 0, 0 };
+    int partition;
+
+    granuleChannel.preflag = false;
+
+    if (! isIntensityChannel)
+    {
+        if (compress < 400)
+        {
+            slen[0] = (compress >> 4) / 5;
+            slen[1] = (compress >> 4) % 5;
+            slen[2] = (compress & 15) >> 2;
+            slen[3] = compress & 3;
+            partition = 0;
+        }
+        else if (compress < 500)
+        {
+            compress -= 400;
+            slen[0] = (compress >> 2) / 5;
+            slen[1] = (compress >> 2) % 5;
+            slen[2] = compress & 3;
+            partition = 1;
+        }
+        else
+        {
+            compress -= 500;
+            slen[0] = compress / 3;
+            slen[1] = compress % 3;
+            granuleChannel.preflag = true;
+            partition = 2;
+        }
+    }
+    else
+    {
+        compress >>= 1;
+
+        if (compress < 180)
+        {
+            slen[0] = compress / 36;
+            slen[1] = (compress % 36) / 6;
+            slen[2] = compress % 6;
+            partition = 3;
+        }
+        else if (compress < 244)
+        {
+            compress -= 180;
+            slen[0] = (compress & 63) >> 4;
+            slen[1] = (compress & 15) >> 2;
+            slen[2] = compress & 3;
+            partition = 4;
+        }
+        else
+        {
+            compress -= 244;
+            slen[0] = compress / 3;
+            slen[1] = compress % 3;
+            partition = 5;
+        }
+    }
+
+    bool isShort = granuleChannel.windowSwitching && granuleChannel.blockType == 2;
+    int blockIndex = isShort ? (granuleChannel.mixedBlock ? 2 : 1) : 0;
+    uint8_t values[39];
+    uint8_t limits[39];
+    int numValues = 0;
+
+    for (int part = 0; part < 4; part++)
+    {
+        int count = pgm_read_byte (&Mp3Tables::lsfScalefactorCounts[partition][blockIndex][part]);
+
+        for (int i = 0; i < count; i++, numValues++)
+        {
+            values[numValues] = (uint8_t)reader.read (slen[part]);
+            limits[numValues] = (uint8_t)((1 << slen[part]) - 1);
+        }
+    }
+
+    // the values run through the long bands, then the short bands a window at a time
+    int numLongBands = ! isShort ? 21 : (granuleChannel.mixedBlock ? 6 : 0);
+    int firstShortBand = granuleChannel.mixedBlock ? 3 : 0;
+
+    for (int band = 0; band < numLongBands; band++)
+    {
+        longScalefactors[channel][band] = values[band];
+        intensityLimitsLong[band] = limits[band];
+    }
+
+    for (int i = numLongBands; i < numValues && isShort; i++)
+    {
+        int band = firstShortBand + (i - numLongBands) / 3;
+        shortScalefactors[channel][band][(i - numLongBands) % 3] = values[i];
+        intensityLimitsShort[band] = limits[i];
+    }
+
+    longScalefactors[channel][21] = 0;
+    intensityLimitsLong[21] = intensityLimitsLong[20];
+    intensityLimitsShort[12] = intensityLimitsShort[11];
+
+    for (int window = 0; window < 3; window++)
+        shortScalefactors[channel][12][window] = 0;
+}
+
+//=============================================================
+template <class T, class Source>
+bool Mp3Decoder<T, Source>::readHuffmanValues (Mp3Helpers::BitReader& reader, int channel, int endPosition)
+{
+    const GranuleChannel& granuleChannel = granules[granule][channel];
+    int32_t* values = spectrum[channel];
+    int bigValuesEnd = granuleChannel.bigValues * 2;
+    int regionEnds[3] = { granuleChannel.region1Start < bigValuesEnd ? granuleChannel.region1Start : bigValuesEnd,
+                          granuleChannel.region2Start < bigValuesEnd ? granuleChannel.region2Start : bigValuesEnd,
+                          bigValuesEnd };
+    int i = 0;
+
+    for (int region = 0; region < 3; region++)
+    {
+        const Mp3Tables::HuffmanTable* table = Mp3Tables::huffmanTables + granuleChannel.tableSelect[region];
+        int offset = pgm_read_word (&table->offset);
+        int rootBits = pgm_read_byte (&table->rootBits);
+        int linBits = pgm_read_byte (&table->linBits);
+
+        if (rootBits == 0)
+        {
+            // table 0 codes nothing: all of its values are zero, and tables 4 and 14 don't exist
+            if (granuleChannel.tableSelect[region] != 0)
+                return false;
+
+            for (; i < regionEnds[region]; i++)
+                values[i] = 0;
+
+            continue;
+        }
+
+        const int16_t* entries = Mp3Tables::huffmanEntries + offset;
+
+        for (; i < regionEnds[region]; i += 2)
+        {
+            // follow the lookup tables until one gives the pair
+            uint32_t bits = reader.peek();
+            int numBitsUsed = 0;
+            int lookupBits = rootBits;
+            int entry = (int16_t)pgm_read_word (entries + (bits >> (32 - rootBits)));
+
+            while (entry < 0)
+            {
+                numBitsUsed += lookupBits;
+                lookupBits = (-entry) & 15;
+                entry = (int16_t)pgm_read_word (entries + ((-entry) >> 4) + ((bits << numBitsUsed) >> (32 - lookupBits)));
+            }
+
+            reader.skip (numBitsUsed + (entry >> 8));
+            int x = (entry >> 4) & 15;
+            int y = entry & 15;
+
+            if (x == 15 && linBits > 0)
+                x += (int)reader.read (linBits);
+
+            if (x != 0 && reader.read (1) != 0)
+                x = -x;
+
+            if (y == 15 && linBits > 0)
+                y += (int)reader.read (linBits);
+
+            if (y != 0 && reader.read (1) != 0)
+                y = -y;
+
+            values[i] = x;
+            values[i + 1] = y;
+
+            // corrupt data could otherwise read far past the bit reservoir
+            if (reader.getPosition() > endPosition)
+                return false;
+        }
+    }
+
+    // count1: quadruples of -1, 0 or 1 until the bits run out, dropping one that overruns them
+    while (i <= 572 && reader.getPosition() < endPosition)
+    {
+        int quad;
+
+        if (granuleChannel.count1Table == 0)
+        {
+            int entry = pgm_read_byte (Mp3Tables::count1TableA + (reader.peek() >> 26));
+            reader.skip (entry >> 4);
+            quad = entry & 15;
+        }
+        else
+        {
+            quad = 15 - (int)reader.read (4);
+        }
+
+        for (int bit = 3; bit >= 0; bit--, i++)
+        {
+            values[i] = (quad >> bit) & 1;
+
+            if (values[i] != 0 && reader.read (1) != 0)
+                values[i] = -1;
+        }
+
+        if (reader.getPosition() > endPosition)
+        {
+            i -= 4;
+            break;
+        }
+    }
+
+    numNonZero[channel] = i;
+
+    for (; i < 576; i++)
+        values[i] = 0;
+
+    return true;
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::requantizeChannel (int channel)
+{
+    const GranuleChannel& granuleChannel = granules[granule][channel];
+    const uint8_t* longWidths = Mp3Tables::longBandWidths[header.sampleRateIndex];
+    const uint8_t* shortWidths = Mp3Tables::shortBandWidths[header.sampleRateIndex];
+    int32_t* values = spectrum[channel];
+    int end = numNonZero[channel];
+
+    // exponents are in quarter powers of two
+    int globalExponent = granuleChannel.globalGain - 210;
+    int scalefactorStep = granuleChannel.scalefacScale ? 4 : 2;
+    bool isShort = granuleChannel.windowSwitching && granuleChannel.blockType == 2;
+    int numLongBands = ! isShort ? 22 : (granuleChannel.mixedBlock ? (header.version == 0 ? 8 : 6) : 0);
+    int firstShortBand = granuleChannel.mixedBlock ? 3 : 0;
+    int i = 0;
+
+    for (int band = 0; band < numLongBands && i < end; band++)
+    {
+        int scalefactor = longScalefactors[channel][band] + (granuleChannel.preflag ? pgm_read_byte (Mp3Tables::pretab + band) : 0);
+        int exponent = globalExponent - scalefactorStep * scalefactor;
+        int bandEnd = i + pgm_read_byte (longWidths + band);
+
+        for (; i < bandEnd && i < end; i++)
+            if (values[i] != 0)
+                values[i] = Mp3Helpers::requantize (values[i], exponent);
+    }
+
+    for (int band = firstShortBand; isShort && band < 13 && i < end; band++)
+    {
+        int width = pgm_read_byte (shortWidths + band);
+
+        for (int window = 0; window < 3; window++)
+        {
+            int exponent = globalExponent - 8 * granuleChannel.subblockGain[window] - scalefactorStep * shortScalefactors[channel][band][window];
+            int bandEnd = i + width;
+
+            for (; i < bandEnd && i < end; i++)
+                if (values[i] != 0)
+                    values[i] = Mp3Helpers::requantize (values[i], exponent);
+        }
+    }
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::processStereo()
+{
+    bool useMidSide = (header.modeExtension & 2) != 0;
+    bool useIntensity = (header.modeExtension & 1) != 0;
+    int end = numNonZero[0] > numNonZero[1] ? numNonZero[0] : numNonZero[1];
+
+    if (! useIntensity)
+    {
+        if (useMidSide)
+            applyMidSide (0, end);
+
+        numNonZero[0] = numNonZero[1] = end;
+        return;
+    }
+
+    // intensity stereo codes the bands above the last non-zero one of the right channel
+    // as the left channel scaled by a position taken from the right channel's scalefactors
+    const GranuleChannel& right = granules[granule][1];
+    const uint8_t* longWidths = Mp3Tables::longBandWidths[header.sampleRateIndex];
+    const uint8_t* shortWidths = Mp3Tables::shortBandWidths[header.sampleRateIndex];
+    const int32_t* rightValues = spectrum[1];
+    bool isShort = right.windowSwitching && right.blockType == 2;
+    int numLongBands = ! isShort ? 22 : (right.mixedBlock ? (header.version == 0 ? 8 : 6) : 0);
+    int firstShortBand = right.mixedBlock ? 3 : 0;
+    int illegalPosition = 7;
+    int lastNonZero = numNonZero[1] - 1;
+
+    while (lastNonZero >= 0 && rightValues[lastNonZero] == 0)
+        lastNonZero--;
+
+    int start = 0;
+    int previousPosition = -1;
+
+    // a mixed block's long bands only count if none of its short bands have anything
+    for (int band = 0; band < numLongBands; band++)
+    {
+        int width = pgm_read_byte (longWidths + band);
+        bool isIntensityBand = start > lastNonZero && ! (isShort && lastNonZero >= 36);
+        int position = band < 21 ? longScalefactors[1][band] : previousPosition;
+
+        if (header.version != 0)
+            illegalPosition = intensityLimitsLong[band];
+
+        if (isIntensityBand && position >= 0 && position != illegalPosition)
+            applyIntensityStereo (start, start + width, position);
+        else if (useMidSide)
+            applyMidSide (start, start + width);
+
+        previousPosition = isIntensityBand ? position : -1;
+        start += width;
+    }
+
+    if (isShort)
+    {
+        // each window has its own last non-zero band
+        int lastNonZeroBand[3] = { -1, -1, -1 };
+        int bandStart = start;
+
+        for (int band = firstShortBand; band < 13; band++)
+        {
+            int width = pgm_read_byte (shortWidths + band);
+
+            for (int window = 0; window < 3; window++)
+            {
+                for (int i = bandStart + window * width; i < bandStart + (window + 1) * width; i++)
+                    if (rightValues[i] != 0)
+                        lastNonZeroBand[window] = band;
+            }
+
+            bandStart += 3 * width;
+        }
+
+        for (int band = firstShortBand; band < 13; band++)
+        {
+            int width = pgm_read_byte (shortWidths + band);
+
+            for (int window = 0; window < 3; window++)
+            {
+                int bandIndex = band < 12 ? band : 11;
+                int position = shortScalefactors[1][bandIndex][window];
+
+                if (header.version != 0)
+                    illegalPosition = intensityLimitsShort[bandIndex];
+
+                if (band > lastNonZeroBand[window] && (band < 12 || lastNonZeroBand[window] < 11) && position != illegalPosition)
+                    applyIntensityStereo (start, start + width, position);
+                else if (useMidSide)
+                    applyMidSide (start, start + width);
+
+                start += width;
+            }
+        }
+    }
+
+    numNonZero[0] = numNonZero[1] = 576;
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::applyIntensityStereo (int start, int end, int position)
+{
+    int32_t leftGain, rightGain;
+
+    if (header.version == 0)
+    {
+        leftGain = Mp3Helpers::readTable (Mp3Tables::intensityRatios[position], 0);
+        rightGain = Mp3Helpers::readTable (Mp3Tables::intensityRatios[position], 1);
+    }
+    else
+    {
+        // odd positions turn the left channel down, even ones the right
+        const int32_t* gains = Mp3Tables::lsfIntensityGains[granules[granule][1].scalefacCompress & 1];
+        leftGain = (position & 1) != 0 ? Mp3Helpers::readTable (gains, (position + 1) / 2) : 0x7FFFFFFF;
+        rightGain = (position & 1) != 0 ? 0x7FFFFFFF : Mp3Helpers::readTable (gains, position / 2);
+    }
+
+    int32_t* left = spectrum[0];
+    int32_t* right = spectrum[1];
+
+    for (int i = start; i < end; i++)
+    {
+        int32_t value = left[i];
+        left[i] = Mp3Helpers::multiply (value, leftGain);
+        right[i] = Mp3Helpers::multiply (value, rightGain);
+    }
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::applyMidSide (int start, int end)
+{
+    int32_t* left = spectrum[0];
+    int32_t* right = spectrum[1];
+
+    for (int i = start; i < end; i++)
+    {
+        int64_t middle = left[i];
+        int64_t side = right[i];
+        left[i] = (int32_t)(((middle + side) * Mp3Tables::cosPiOverFour) >> 31);
+        right[i] = (int32_t)(((middle - side) * Mp3Tables::cosPiOverFour) >> 31);
+    }
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::reorderShortBlocks (int channel)
+{
+    const GranuleChannel& granuleChannel = granules[granule][channel];
+
+    if (! (granuleChannel.windowSwitching && granuleChannel.blockType == 2))
+        return;
+
+    // short bands arrive a window at a time; the IMDCTs want each line's three windows together
+    const uint8_t* shortWidths = Mp3Tables::shortBandWidths[header.sampleRateIndex];
+    int32_t* values = spectrum[channel];
+    int32_t band[3 * 66];   // the widest short band, at 48 kHz
+    int start = granuleChannel.mixedBlock ? 36 : 0;
+
+    for (int b = granuleChannel.mixedBlock ? 3 : 0; b < 13 && start < numNonZero[channel]; b++)
+    {
+        int width = pgm_read_byte (shortWidths + b);
+        memcpy (band, values + start, sizeof (int32_t) * 3 * (size_t)width);
+
+        for (int window = 0; window < 3; window++)
+            for (int i = 0; i < width; i++)
+                values[start + 3 * i + window] = band[window * width + i];
+
+        start += 3 * width;
+    }
+
+    // the reordered lines reach into every subband they touch
+    numNonZero[channel] = start < numNonZero[channel] ? numNonZero[channel] : start;
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::reduceAliasing (int channel)
+{
+    const GranuleChannel& granuleChannel = granules[granule][channel];
+    bool isShort = granuleChannel.windowSwitching && granuleChannel.blockType == 2;
+
+    if (isShort && ! granuleChannel.mixedBlock)
+        return;
+
+    // a mixed block only has the boundary between its two long subbands
+    int numSubbands = (numNonZero[channel] + 17) / 18;
+    int lastBoundary = isShort ? 1 : (numSubbands < 32 ? numSubbands : 31);
+    int32_t* values = spectrum[channel];
+
+    for (int boundary = 1; boundary <= lastBoundary; boundary++)
+    {
+        int32_t* lower = values + 18 * boundary - 1;
+        int32_t* upper = values + 18 * boundary;
+
+        for (int i = 0; i < 8; i++)
+        {
+            int32_t cs = Mp3Helpers::readTable (Mp3Tables::aliasCs, i);
+            int32_t ca = Mp3Helpers::readTable (Mp3Tables::aliasCa, i);
+            int32_t a = lower[-i];
+            int32_t b = upper[i];
+            lower[-i] = Mp3Helpers::multiplyAdd (a, cs, b, -ca);
+            upper[i] = Mp3Helpers::multiplyAdd (b, cs, a, ca);
+        }
+    }
+
+    int reach = 18 * lastBoundary + 8;
+
+    if (numNonZero[channel] < reach)
+        numNonZero[channel] = reach < 576 ? reach : 576;
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::hybridSynthesis (int channel)
+{
+    const GranuleChannel& granuleChannel = granules[granule][channel];
+    bool isShort = granuleChannel.windowSwitching && granuleChannel.blockType == 2;
+    int32_t* values = spectrum[channel];
+
+    for (int subband = 0; subband < 32; subband++)
+    {
+        int32_t* x = values + 18 * subband;
+        int32_t* previous = overlap[channel][subband];
+
+        // a subband with nothing in it only has the tail of the last granule to add
+        if (18 * subband >= numNonZero[channel])
+        {
+            for (int i = 0; i < 18; i++)
+            {
+                x[i] = previous[i];
+                previous[i] = 0;
+            }
+        }
+        else if (isShort && ! (granuleChannel.mixedBlock && subband < 2))
+        {
+            // three overlapping 12 point IMDCTs, the first starting 6 samples in
+            int32_t output[36];
+            memset (output, 0, sizeof (output));
+
+            for (int window = 0; window < 3; window++)
+            {
+                int32_t input[6], transformed[12];
+
+                for (int i = 0; i < 6; i++)
+                    input[i] = x[3 * i + window];
+
+                Mp3Helpers::imdct<6> (input, transformed);
+
+                for (int i = 0; i < 12; i++)
+                    output[6 + 6 * window + i] += Mp3Helpers::multiply (transformed[i], Mp3Helpers::readTable (Mp3Tables::shortWindow, i));
+            }
+
+            for (int i = 0; i < 18; i++)
+            {
+                x[i] = Mp3Helpers::clampSample ((int64_t)previous[i] + output[i]);
+                previous[i] = output[18 + i];
+            }
+        }
+        else
+        {
+            // the long subbands of a mixed block use the normal window
+            int blockType = isShort ? 0 : granuleChannel.blockType;
+            const int32_t* window = Mp3Tables::longWindows[blockType == 0 ? 0 : (blockType == 1 ? 1 : 2)];
+            int32_t output[36];
+            Mp3Helpers::imdct<18> (x, output);
+
+            for (int i = 0; i < 18; i++)
+            {
+                x[i] = Mp3Helpers::clampSample ((int64_t)previous[i] + Mp3Helpers::multiply (output[i], Mp3Helpers::readTable (window, i)));
+                previous[i] = Mp3Helpers::multiply (output[18 + i], Mp3Helpers::readTable (window, 18 + i));
+            }
+        }
+
+        // odd subbands come out of the filterbank frequency inverted
+        if ((subband & 1) != 0)
+            for (int i = 1; i < 18; i += 2)
+                x[i] = -x[i];
+    }
+}
+
+//=============================================================
+template <class T, class Source>
+void Mp3Decoder<T, Source>::polyphaseSynthesis (int channel)
+{
+    const int32_t* values = spectrum[channel];
+    int32_t* output = blockSamples[channel];
+
+    for (int slot = 0; slot < 18; slot++)
+    {
+        // the 64 values the synthesis matrix makes from 32 subband samples are one DCT-II
+        // of them, read with symmetries, so only the DCT's 32 outputs are kept
+        int position = (synthesisPosition - slot - 1) & 15;
+        int32_t subbandSamples[32];
+
+        for (int subband = 0; subband < 32; subband++)
+            subbandSamples[subband] = values[18 * subband + slot];
+
+        int32_t* transformed = synthesisHistory[channel][position];
+        Mp3Helpers::Dct2<32>::transform (subbandSamples, transformed);
+
+        for (int j = 0; j < 32; j++)
+        {
+            const int32_t* window = Mp3Tables::synthesisWindow[j];
+            int evenIndex = j < 16 ? 16 + j : (j == 16 ? 0 : 48 - j);
+            int oddIndex = j < 16 ? 16 - j : j - 16;
+            int64_t sum = 0;
+
+            for (int m = 0; m < 16; m += 2)
+            {
+                sum += (int64_t)synthesisHistory[channel][(position + m) & 15][evenIndex] * Mp3Helpers::readTable (window, m);
+                sum += (int64_t)synthesisHistory[channel][(position + m + 1) & 15][oddIndex] * Mp3Helpers::readTable (window, m + 1);
+            }
+
+            // the window is scaled by 65536
+            sum >>= 16;
+            output[32 * slot + j] = Mp3Helpers::clampSample (sum);
+        }
+    }
+}
+
+#endif /* Mp3Decoder_h */
@@ -0,0 +1,655 @@
+#ifndef Mp3Tables_h
+#define Mp3Tables_h
+
+#include <stdint.h>
+#include <Arduino.h>
+
+/** Constant tables for Mp3Decoder, kept in flash (PROGMEM) on boards that
+ * separate it from RAM and read with the pgm_read macros.
+ *
+ * The Huffman codes, scalefactor bands, pretab and synthesis window are those
+ * of ISO/IEC 11172-3 and 13818-3; the rest are sines, cosines and powers
+ * rounded to the fixed point formats the decoder uses (Q31 unless noted).
+ */
+namespace Mp3Tables
+{
+    //=============================================================
+    /** The big value Huffman tables as lookup tables. Each table starts with 2^rootBits
+     * entries indexed by the next rootBits bits of the stream. An entry that is positive
+     * is a pair of values: (code length << 8) | (x << 4) | y, where the length counts the
+     * bits used at that level. A negative entry continues in a smaller table:
+     * -((offset << 4) | bits), where offset is from the start of the whole table.
+     */
+    static const int16_t huffmanEntries[] PROGMEM = {
+           785,    769,    528,    528,    256,    256,    256,    256,   1570,   1538,   1298,   1298,
+          1313,   1313,   1312,   1312,    785,    785,    785,    785,    785,    785,    785,    785,
+           769,    769,    769,    769,    769,    769,    769,    769,    784,    784,    784,    784,
+           784,    784,    784,    784,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+          1570,   1538,   1298,   1298,   1313,   1313,   1312,   1312,    784,    784,    784,    784,
+           784,    784,    784,    784,    529,    529,    529,    529,    529,    529,    529,    529,
+           529,    529,    529,    529,    529,    529,    529,    529,    513,    513,    513,    513,
+           513,    513,    513,    513,    513,    513,    513,    513,    513,    513,    513,    513,
+           512,    512,    512,    512,    512,    512,    512,    512,    512,    512,    512,    512,
+           512,    512,    512,    512,  -1026,   1585,  -1089,  -1121,   1554,   1569,   1538,   1568,
+           785,    785,    785,    785,    785,    785,    785,    785,    769,    769,    769,    769,
+           769,    769,    769,    769,    784,    784,    784,    784,    784,    784,    784,    784,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    563,    547,    306,    306,
+           275,    259,    304,    290,  -1025,   1571,   1586,   1584,   1299,   1299,   1329,   1329,
+          1314,   1314,   1282,   1282,   1042,   1042,   1042,   1042,   1057,   1057,   1057,   1057,
+          1056,   1056,   1056,   1056,    769,    769,    769,    769,    769,    769,    769,    769,
+           529,    529,    529,    529,    529,    529,    529,    529,    529,    529,    529,    529,
+           529,    529,    529,    529,    784,    784,    784,    784,    784,    784,    784,    784,
+           768,    768,    768,    768,    768,    768,    768,    768,    307,    259,  -1028,  -1283,
+         -1410,  -1473,  -1506,  -1569,  -1601,   1554,   1313,   1313,   1538,   1568,   1041,   1041,
+          1041,   1041,    769,    769,    769,    769,    769,    769,    769,    769,    784,    784,
+           784,    784,    784,    784,    784,    784,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,   1109,   1093,   1108,   1107,    821,    821,    836,    836,    805,    805,
+           850,    850,    533,    533,    533,    533,    593,    593,    773,    820,    592,    592,
+           835,    819,    548,    578,    276,    276,    321,    320,    516,    547,    562,    515,
+           275,    305,    304,    290,  -1028,  -1315,  -1442,  -1506,  -1570,   1570,   1538,   1568,
+          1042,   1042,   1042,   1042,   1057,   1057,   1057,   1057,    529,    529,    529,    529,
+           529,    529,    529,    529,    529,    529,    529,    529,    529,    529,    529,    529,
+           769,    769,    769,    769,    769,    769,    769,    769,    784,    784,    784,    784,
+           784,    784,    784,    784,    512,    512,    512,    512,    512,    512,    512,    512,
+           512,    512,    512,    512,    512,    512,    512,    512,  -1281,   1093,    851,    851,
+          1077,   1092,    805,    805,    850,    850,    773,    773,    533,    533,    533,    533,
+           341,    340,    593,    593,    820,    835,    848,    819,    548,    548,    578,    532,
+           321,    321,    516,    576,    547,    562,    531,    561,    515,    560,  -1027,  -1154,
+         -1217,  -1250,  -1313,  -1345,   1556,   1601,   1571,   1586,   1299,   1299,   1329,   1329,
+          1539,   1584,   1314,   1314,   1282,   1282,   1042,   1042,   1042,   1042,   1057,   1057,
+          1057,   1057,   1056,   1056,   1056,   1056,    785,    785,    785,    785,    785,    785,
+           785,    785,    769,    769,    769,    769,    769,    769,    769,    769,    784,    784,
+           784,    784,    784,    784,    784,    784,    768,    768,    768,    768,    768,    768,
+           768,    768,    853,    837,    565,    565,    595,    595,    852,    773,    580,    549,
+           594,    533,    337,    308,    323,    323,    592,    516,    292,    322,    307,    320,
+         -1028,  -1412,  -1668,  -1923,  -2051,  -2178,  -2241,  -2273,   1554,   1569,   1538,   1568,
+          1041,   1041,   1041,   1041,    769,    769,    769,    769,    769,    769,    769,    769,
+           784,    784,    784,    784,    784,    784,    784,    784,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,  -1281,  -1313,  -1345,   1095,   1140,   1110,   1125,   1079,
+          1139,   1094,  -1377,   1123,    807,    807,    882,    882,    375,    359,    374,    343,
+           373,    358,    341,    340,   1124,   1031,    880,    880,    866,    866,   1093,   1077,
+           774,    774,   1107,   1092,    535,    535,    535,    535,    625,    625,    625,    625,
+           822,    822,    806,    806,   1061,   1106,    789,    789,    849,    849,   1076,   1091,
+           534,    534,    609,    609,    608,    608,    773,    848,    804,    834,    819,    772,
+           532,    532,    577,    577,    576,    547,    562,    515,    275,    305,    304,    290,
+         -1028,  -1316,  -1570,  -1635,  -1763,  -1890,  -1954,  -2019,  -2146,  -2209,   1555,   1585,
+         -2241,   1570,   1313,   1313,   1042,   1042,   1042,   1042,   1282,   1282,   1312,   1312,
+           785,    785,    785,    785,    785,    785,    785,    785,    769,    769,    769,    769,
+           769,    769,    769,    769,    784,    784,    784,    784,    784,    784,    784,    784,
+           512,    512,    512,    512,    512,    512,    512,    512,    512,    512,    512,    512,
+           512,    512,    512,    512,   1143,   1127,   1142,   1141,   1126,   1095,   1140,  -1281,
+          1110,   1125,    823,    823,    883,    883,    838,    838,    343,    341,   1093,   1108,
+          1077,   1107,    551,    551,    551,    551,    626,    626,    626,    626,    868,    868,
+           775,    775,    369,    369,    535,    624,    566,    566,    611,    611,    608,    608,
+           836,    805,    850,    773,    533,    533,    354,    354,    354,    354,    550,    518,
+           278,    278,    353,    353,    593,    564,    592,    592,    835,    819,    548,    548,
+           578,    578,    532,    577,    516,    576,    291,    306,    259,    304,  -1028,  -1283,
+         -1410,  -1475,  -1603,  -1729,  -1762,  -1826,  -1889,  -1921,  -1954,  -2017,   1587,   1601,
+          1571,   1586,  -2049,   1584,   1299,   1299,   1329,   1329,   1314,   1314,   1042,   1042,
+          1042,   1042,   1057,   1057,   1057,   1057,   1282,   1282,   1312,   1312,   1024,   1024,
+          1024,   1024,    785,    785,    785,    785,    785,    785,    785,    785,    769,    769,
+           769,    769,    769,    769,    769,    769,    784,    784,    784,    784,    784,    784,
+           784,    784,   1143,   1127,    886,    886,    855,    855,    885,    885,    870,    870,
+           839,    839,    884,    884,    869,    869,    598,    598,    567,    567,    883,    853,
+           551,    551,    626,    582,    612,    535,    625,    625,    775,    880,    566,    566,
+           611,    611,    581,    581,    596,    596,    580,    580,    774,    773,    294,    354,
+           353,    353,    534,    608,    565,    595,    549,    594,    277,    337,    308,    323,
+           592,    516,    292,    292,    322,    276,    320,    259,  -1028,  -4388,  -5220,  -5732,
+         -6020,  -6275,  -6404,  -6659,  -6786,  -6850,  -6913,  -6945,   1554,   1569,   1538,   1568,
+          1041,   1041,   1041,   1041,   1025,   1025,   1025,   1025,    784,    784,    784,    784,
+           784,    784,    784,    784,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+         -1284,  -2436,  -2724,  -2980,  -3235,  -3363,  -3491,  -3619,  -3747,  -3875,  -4003,  -4130,
+         -4194,  -4257,  -4289,  -4322,  -1540,  -1826,  -1891,  -2017,  -2050,  -2113,  -2145,  -2177,
+         -2209,  -2242,  -2306,   1271,   1242,  -2369,  -2401,   1135,  -1793,   1277,   1005,   1005,
+           767,    767,    767,    767,    751,    751,    751,    751,    735,    735,    735,    735,
+           510,    508,    750,    719,    734,    703,    763,    763,    718,    718,    732,    732,
+           943,   1001,    492,    477,    762,    717,    446,    446,    491,    415,    505,    490,
+           445,    475,    399,    504,    460,    460,    686,    670,    398,    398,    639,    638,
+           429,    444,    459,    502,   1256,   1119,   1181,   1241,   1269,   1255,   1196,   1211,
+          1103,   1268,  -2689,   1267,    831,    831,   1165,   1240,    458,    486,    815,    815,
+          1010,   1010,   1134,   1180,    783,    783,   1225,   1118,    939,    939,   1149,   1239,
+           846,    846,   1224,   1238,    830,    830,    953,    953,   1179,   1194,    543,    543,
+           543,    543,    753,    753,    753,    753,    752,    752,    954,    997,    996,    908,
+           877,    995,    738,    738,    814,    782,    542,    542,    737,    737,    992,    861,
+           981,    892,    967,    845,    907,    952,    980,    922,    937,    876,    710,    710,
+           573,    573,    979,    891,    557,    557,    722,    722,    541,    541,    695,    695,
+           860,    965,    921,    890,    707,    707,    935,    919,    587,    587,    465,    465,
+           465,    465,    525,    720,    650,    680,    588,    708,    619,    694,    316,    300,
+           450,    347,    693,    649,    284,    284,  -4642,  -4706,  -4770,  -4834,  -4898,  -4962,
+         -5026,   1202,   1051,   1201,  -5089,  -5121,  -5153,  -5185,   1066,   1186,    449,    449,
+           664,    524,    448,    448,    692,    618,    678,    633,    315,    315,    435,    435,
+           648,    602,    299,    299,    677,    617,    420,    420,    632,    647,    404,    404,
+           631,    630,    267,    432,    406,    330,    314,    419,    345,    405,   1050,   1185,
+         -5473,   1184,  -5505,   1171,  -5537,  -5569,   1065,   1170,  -5601,   1080,   1155,  -5633,
+         -5665,  -5697,    266,    360,    390,    329,    313,    344,    389,    359,    343,    373,
+           358,    327,    372,    342,    357,    371,    793,    793,    913,    913,   1033,   1168,
+          1096,   1156,   1138,  -5985,    808,    808,    898,    898,    792,    792,    326,    356,
+          1079,   1063,    791,    791,    881,    881,   1109,   1031,   1136,   1078,   1123,   1093,
+          1108,   1062,   1122,   1077,    641,    641,    776,    896,    790,    865,    774,    864,
+          1107,   1092,    805,    805,    850,    850,    773,    773,    533,    533,    533,    533,
+           593,    593,    593,    593,    820,    835,    848,    804,    834,    819,    532,    532,
+           321,    321,    516,    576,    547,    562,    275,    275,    305,    259,    304,    290,
+         -1028,  -2308,  -3140,  -3620,  -3940,  -4196,  -4452,  -4708,  -4963,  -5091,  -5218,  -5283,
+         -5410,  -5475,  -5602,  -5667,  -5794,  -5857,  -5889,  -5922,  -5985,  -6017,   1601,  -6049,
+          1571,   1586,  -6081,   1555,   1585,   1584,   1314,   1314,   1298,   1298,   1313,   1313,
+          1282,   1282,   1312,   1312,    785,    785,    785,    785,    785,    785,    785,    785,
+          1025,   1025,   1025,   1025,   1040,   1040,   1040,   1040,    768,    768,    768,    768,
+           768,    768,    768,    768,  -1283,  -1411,  -1538,  -1602,  -1666,  -1730,  -1794,  -1859,
+         -1985,  -2018,  -2081,  -2113,  -2145,  -2178,  -2241,  -2273,   1023,   1007,   1022,    991,
+           750,    750,   1021,    975,   1020,    990,   1005,    959,    763,    763,    974,   1004,
+           733,    687,    762,    702,    747,    717,    732,    671,    761,    746,    701,    731,
+           655,    760,    716,    670,    745,    639,    759,    685,    730,    730,    700,    700,
+           623,    623,    942,    783,    459,    502,    654,    744,    607,    669,    501,    382,
+           487,    428,    458,    443,    729,    653,    335,    335,    500,    319,    499,    472,
+         -2561,  -2594,  -2657,  -2689,  -2721,  -2753,  -2785,  -2817,  -2849,  -2881,  -2913,  -2945,
+         -2977,  -3009,  -3042,  -3105,    486,    303,    498,    498,    622,    752,    287,    497,
+           412,    457,    350,    427,    442,    485,    381,    471,    334,    484,    396,    456,
+           318,    365,    470,    483,    411,    441,    302,    426,    482,    286,    481,    481,
+           526,    736,    349,    469,  -3393,  -3425,   1236,  -3457,  -3489,  -3521,   1235,   1234,
+         -3553,   1053,   1147,   1207,   1233,  -3585,   1221,   1162,    380,    455,    333,    395,
+           440,    410,    425,    364,    454,    317,    301,    269,    348,    464,   1192,   1100,
+          1220,   1131,   1206,  -3873,   1084,   1219,   1146,   1191,   1190,  -3905,    962,    962,
+          1068,   1115,    409,    268,    448,    267,   1205,   1052,   1161,   1176,   1217,   1099,
+          1204,   1130,   1083,   1145,    947,    947,   1175,   1160,   1067,   1114,    946,    946,
+          1189,   1051,    945,    945,   1200,   1129,   1174,   1098,   1188,   1144,   1159,   1082,
+           931,    931,    857,    857,    917,    917,    810,    810,    930,    930,    794,    794,
+           929,    929,   1034,   1184,    872,    872,    902,    902,    841,    841,    916,    916,
+           825,    825,    915,    915,   1143,   1033,    856,    856,    901,    901,    809,    871,
+           886,    914,    657,    657,    793,    912,    840,    900,    855,    885,    824,    899,
+           870,    839,    552,    642,    536,    641,    884,    776,    896,    854,    869,    823,
+           883,    838,    551,    626,    612,    535,    597,    597,    625,    625,    775,    880,
+           566,    566,    611,    581,    596,    550,    610,    610,    534,    534,    774,    864,
+           565,    565,    353,    353,    595,    580,    293,    338,    277,    337,    517,    592,
+           308,    308,    323,    292,    322,    307,    276,    260,    320,    259,  -1028,  -1476,
+         -2340,  -3492,  -4996,  -5668,  -6084,  -6340,  -6595,  -6723,  -6849,  -6882,   1554,   1569,
+          1538,   1568,   1041,   1041,   1041,   1041,   1025,   1025,   1025,   1025,    784,    784,
+           784,    784,    784,    784,    784,    784,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,    256,
+           256,    256,  -1281,  -1313,  -1345,  -1377,   1199,  -1409,  -1441,   1167,   1151,   1271,
+          1135,   1270,    767,    767,    767,    767,    495,    510,    479,    509,    463,    508,
+           447,    507,    506,    415,    505,    504,   1119,   1269,    847,    847,   1012,   1012,
+          1011,   1011,   1008,   1008,   1087,  -1732,    754,    754,    754,    754,  -1987,  -2114,
+          1262,  -2177,   1214,   1229,  -2209,   1198,   1228,  -2241,  -2273,   1226,  -2305,   1118,
+           957,    957,    718,    718,   1004,    989,    478,    478,    478,    478,    489,    489,
+           746,    729,    493,    491,    476,    475,    429,    474,    382,    428,    457,    381,
+           815,    815,    783,    783,    543,    543,    543,    543,    753,    753,    753,    753,
+         -2596,  -2852,  -3108,  -3363,    926,    926,   1212,   1227,   1166,   1256,   1181,   1255,
+          1211,   1165,   1240,   1134,    998,    998,    924,    924,   1195,   1210,   1253,   1239,
+           846,    846,   1252,   1164,    968,    968,    830,    830,    877,    877,   1238,   1179,
+          1209,   1194,    993,    993,    980,    980,   1208,   1193,    891,    891,   1207,   1232,
+           739,    739,    739,    739,    782,    992,    861,    981,    892,    967,    845,    907,
+         -3747,  -3875,  -4003,  -4130,  -4194,  -4259,  -4386,  -4450,  -4514,  -4578,  -4642,  -4705,
+         -4738,  -4802,  -4866,  -4930,    922,    876,    966,    829,    860,    965,    525,    525,
+           906,    936,    921,    844,    950,    890,    572,    572,    859,    905,    540,    540,
+           704,    704,    920,    889,    482,    482,    558,    542,    723,    557,    722,    721,
+           571,    571,    919,    904,    285,    285,    285,    285,    708,    619,    707,    679,
+           300,    300,    706,    693,    705,    524,    587,    692,    618,    678,    435,    435,
+           602,    677,    299,    299,    434,    283,    433,    433,    523,    688,    617,    662,
+           586,    676,    632,    647,    419,    419,    570,    601,    298,    298,  -5250,  -5314,
+         -5378,   1186,   1050,  -5441,  -5473,  -5505,   1065,   1170,  -5537,   1049,   1169,  -5569,
+         -5601,  -5633,    661,    616,    417,    417,    646,    631,    404,    404,    585,    599,
+           359,    359,    266,    416,    313,    403,    344,    389,    374,    265,    400,    328,
+           388,    373,    312,    387,  -5921,   1154,  -5953,   1048,   1153,   1152,  -5985,   1079,
+          1139,  -6017,   1063,   1138,  -6049,   1031,    791,    791,    358,    296,    327,    372,
+           264,    342,    357,    326,    356,    341,    881,    881,   1136,   1078,   1123,   1093,
+          1108,   1062,    866,    866,    790,    790,    865,    865,   1030,   1120,    851,    851,
+          1077,   1092,    805,    805,    850,    850,    593,    593,    593,    593,    789,    789,
+           773,    773,    820,    835,    848,    804,    834,    819,    532,    532,    577,    577,
+           772,    832,    547,    547,    562,    562,    275,    305,    515,    560,    290,    290,
+         -1026,  -1090,  -1154,  -1217,  -1250,  -1313,  -1345,  -1377,  -1409,  -1441,  -1474,  -1540,
+          1279,   1279,   1279,   1279,  -2244,  -2724,  -2980,  -3236,  -3524,  -3876,  -4132,  -4387,
+         -4515,  -4643,  -4772,  -5028,  -5282,  -5346,  -5410,  -5475,  -5603,  -5730,  -5793,  -5825,
+         -5858,  -5921,   1555,   1585,  -5953,   1570,   1298,   1298,   1313,   1313,   1538,   1568,
+          1041,   1041,   1041,   1041,   1025,   1025,   1025,   1025,   1040,   1040,   1040,   1040,
+          1024,   1024,   1024,   1024,    751,    766,    735,    765,    719,    764,    703,    763,
+           506,    506,    687,    671,    505,    504,    655,    639,    503,    503,    367,    502,
+           351,    501,    335,    500,    319,    499,    303,    498,    497,    497,    543,    752,
+           783,    783,  -1793,  -1825,  -1857,  -1889,  -1921,  -1953,  -1985,  -2017,  -2049,  -2081,
+         -2113,  -2145,  -2177,  -2209,    494,    478,    493,    462,    492,    477,    446,    491,
+           461,    476,    430,    490,    445,    475,    460,    414,    489,    429,    474,    444,
+           459,    398,    488,    413,    473,    382,    487,    428,  -2497,  -2529,  -2562,   1254,
+         -2625,   1225,   1118,   1210,   1253,  -2657,   1239,   1252,   1164,   1224,  -2689,   1086,
+           458,    443,    397,    472,    526,    736,    269,    269,    366,    412,    427,    381,
+           334,    302,   1133,   1238,   1251,   1179,   1209,   1194,   1250,   1054,   1249,   1117,
+          1237,   1148,   1223,   1101,   1163,   1208,   1236,   1178,   1193,   1132,   1222,   1085,
+          1235,   1069,   1234,   1053,   1147,   1207,   1233,   1116,   1221,   1162,   1192,   1177,
+          1100,   1220,   1131,   1206,  -3489,   1084,   1219,   1146,   1191,   1068,   1218,   1115,
+          1205,   1052,    464,    268,   1161,   1176,   1217,   1099,  -3777,   1083,  -3809,   1050,
+           948,    948,   1130,   1190,   1145,   1175,  -3841,   1168,    448,    267,    432,    266,
+           416,    265,    947,    947,    904,    904,   1067,   1114,    946,    946,   1189,   1051,
+          1201,   1129,    918,    918,    932,    932,   1098,   1144,    903,    903,    826,    826,
+           931,    931,    857,    857,    917,    917,    810,    810,    930,    930,    929,    872,
+           902,    887,    841,    916,    825,    915,    856,    901,    809,    871,    886,    914,
+           793,    913,    840,    900,    855,    885,    824,    899,    870,    808,    898,    898,
+           792,    792,    839,    839,    884,    884,    897,    897,   1032,   1152,    854,    854,
+           869,    869,    791,    791,   1031,   1136,    627,    627,    627,    627,    823,    823,
+           807,    807,    626,    626,    626,    626,    582,    612,    597,    625,    566,    611,
+           581,    596,    550,    610,    534,    609,    774,    864,    565,    565,    595,    595,
+           580,    580,    549,    549,    594,    594,    533,    533,    773,    848,    337,    337,
+           564,    579,    292,    322,    307,    276,    321,    321,    516,    576,    291,    306,
+           259,    304
+    };
+
+    /** Where each of the 32 table_select values starts in huffmanEntries, with its root
+     * and linbits. Tables 0, 4 and 14 have no codes: 0 means all values are zero and
+     * the others aren't used by valid streams (rootBits is 0 for all three).
+     */
+    struct HuffmanTable
+    {
+        uint16_t offset;
+        uint8_t rootBits;
+        uint8_t linBits;
+    };
+
+    static const HuffmanTable huffmanTables[32] PROGMEM = {
+        {    0, 0,  0 },
+        {    0, 3,  0 },
+        {    8, 6,  0 },
+        {   72, 6,  0 },
+        {    0, 0,  0 },
+        {  136, 6,  0 },
+        {  208, 6,  0 },
+        {  274, 6,  0 },
+        {  376, 6,  0 },
+        {  478, 6,  0 },
+        {  564, 6,  0 },
+        {  708, 6,  0 },
+        {  850, 6,  0 },
+        {  980, 6,  0 },
+        {    0, 0,  0 },
+        { 1416, 6,  0 },
+        { 1798, 6,  1 },
+        { 1798, 6,  2 },
+        { 1798, 6,  3 },
+        { 1798, 6,  4 },
+        { 1798, 6,  6 },
+        { 1798, 6,  8 },
+        { 1798, 6, 10 },
+        { 1798, 6, 13 },
+        { 2232, 6,  4 },
+        { 2232, 6,  5 },
+        { 2232, 6,  6 },
+        { 2232, 6,  7 },
+        { 2232, 6,  8 },
+        { 2232, 6,  9 },
+        { 2232, 6, 11 },
+        { 2232, 6, 13 }
+    };
+
+    /** count1 table A indexed by the next 6 bits: (code length << 4) | vwxy. Table B is
+     * the 4 bits of vwxy inverted, so it needs no table
+     */
+    static const uint8_t count1TableA[64] PROGMEM = {
+        107, 111, 109, 110, 103, 101,  89,  89,  86,  86,  83,  83,  90,  90,  92,  92,
+         66,  66,  66,  66,  65,  65,  65,  65,  68,  68,  68,  68,  72,  72,  72,  72,
+         16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,
+         16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16,  16
+    };
+
+    //=============================================================
+    /** Widths in lines of the 22 long block scalefactor bands at each sample rate:
+     * 44.1, 48 and 32 kHz (MPEG-1), 22.05, 24 and 16 kHz (MPEG-2), then 11.025, 12
+     * and 8 kHz (MPEG-2.5)
+     */
+    static const uint8_t longBandWidths[9][22] PROGMEM = {
+        {   4,   4,   4,   4,   4,   4,   6,   6,   8,   8,  10,  12,  16,  20,  24,  28,  34,  42,  50,  54,  76, 158 },
+        {   4,   4,   4,   4,   4,   4,   6,   6,   6,   8,  10,  12,  16,  18,  22,  28,  34,  40,  46,  54,  54, 192 },
+        {   4,   4,   4,   4,   4,   4,   6,   6,   8,  10,  12,  16,  20,  24,  30,  38,  46,  56,  68,  84, 102,  26 },
+        {   6,   6,   6,   6,   6,   6,   8,  10,  12,  14,  16,  20,  24,  28,  32,  38,  46,  52,  60,  68,  58,  54 },
+        {   6,   6,   6,   6,   6,   6,   8,  10,  12,  14,  16,  18,  22,  26,  32,  38,  46,  54,  62,  70,  76,  36 },
+        {   6,   6,   6,   6,   6,   6,   8,  10,  12,  14,  16,  20,  24,  28,  32,  38,  46,  52,  60,  68,  58,  54 },
+        {   6,   6,   6,   6,   6,   6,   8,  10,  12,  14,  16,  20,  24,  28,  32,  38,  46,  52,  60,  68,  58,  54 },
+        {   6,   6,   6,   6,   6,   6,   8,  10,  12,  14,  16,  20,  24,  28,  32,  38,  46,  52,  60,  68,  58,  54 },
+        {  12,  12,  12,  12,  12,  12,  16,  20,  24,  28,  32,  40,  48,  56,  64,  76,  90,   2,   2,   2,   2,   2 }
+    };
+
+    /** Widths of the 13 short block scalefactor bands, in lines of one window */
+    static const uint8_t shortBandWidths[9][13] PROGMEM = {
+        {  4,  4,  4,  4,  6,  8, 10, 12, 14, 18, 22, 30, 56 },
+        {  4,  4,  4,  4,  6,  6, 10, 12, 14, 16, 20, 26, 66 },
+        {  4,  4,  4,  4,  6,  8, 12, 16, 20, 26, 34, 42, 12 },
+        {  4,  4,  4,  6,  6,  8, 10, 14, 18, 26, 32, 42, 18 },
+        {  4,  4,  4,  6,  8, 10, 12, 14, 18, 24, 32, 44, 12 },
+        {  4,  4,  4,  6,  8, 10, 12, 14, 18, 24, 30, 40, 18 },
+        {  4,  4,  4,  6,  8, 10, 12, 14, 18, 24, 30, 40, 18 },
+        {  4,  4,  4,  6,  8, 10, 12, 14, 18, 24, 30, 40, 18 },
+        {  8,  8,  8, 12, 16, 20, 24, 28, 36,  2,  2,  2, 26 }
+    };
+
+    /** Added to the long block scalefactors when preflag is set */
+    static const uint8_t pretab[22] PROGMEM = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 3, 2, 0
+    };
+
+    /** Bits in each scalefactor of the first (slen1) and second (slen2) groups of
+     * bands, indexed by MPEG-1's scalefac_compress
+     */
+    static const uint8_t scalefactorBits[16][2] PROGMEM = {
+        { 0, 0 }, { 0, 1 }, { 0, 2 }, { 0, 3 }, { 3, 0 }, { 1, 1 }, { 1, 2 }, { 1, 3 },
+        { 2, 1 }, { 2, 2 }, { 2, 3 }, { 3, 1 }, { 3, 2 }, { 3, 3 }, { 4, 2 }, { 4, 3 }
+    };
+
+    /** MPEG-2's number of scalefactors in each of four groups, by the partition
+     * scalefac_compress selects and by long, short or mixed blocks
+     */
+    static const uint8_t lsfScalefactorCounts[6][3][4] PROGMEM = {
+        { {  6,  5,  5, 5 }, {  9,  9,  9, 9 }, {  6,  9,  9, 9 } },
+        { {  6,  5,  7, 3 }, {  9,  9, 12, 6 }, {  6,  9, 12, 6 } },
+        { { 11, 10,  0, 0 }, { 18, 18,  0, 0 }, { 15, 18,  0, 0 } },
+        { {  7,  7,  7, 0 }, { 12, 12, 12, 0 }, {  6, 15, 12, 0 } },
+        { {  6,  6,  6, 3 }, { 12,  9,  9, 6 }, {  6, 12,  9, 6 } },
+        { {  8,  8,  5, 0 }, { 15, 12,  9, 0 }, {  6, 18,  9, 0 } }
+    };
+
+    //=============================================================
+    /** i^(4/3) for i up to 128, as unsigned Q21. Larger values are interpolated from
+     * the top half of the table
+     */
+    static const uint32_t powerFourThirds[129] PROGMEM = {
+                 0,    2097152,    5284492,    9073850,   13316085,   17930397,   22864669,   28081952,
+          33554432,   39260268,   45181770,   51304267,   57615354,   64104381,   70762085,   77580324,
+          84551870,   91670262,   98929675,  106324833,  113850927,  121503550,  129278652,  137172490,
+         145181595,  153302741,  161532918,  169869312,  178309282,  186850346,  195490166,  204226534,
+         213057363,  221980672,  230994585,  240097314,  249287160,  258562502,  267921791,  277363549,
+         286886358,  296488863,  306169762,  315927805,  325761791,  335670566,  345653016,  355708071,
+         365834696,  376031894,  386298701,  396634186,  407037448,  417507616,  428043844,  438645315,
+         449311235,  460040835,  470833368,  481688108,  492604350,  503581409,  514618619,  525715330,
+         536870912,  548084749,  559356243,  570684809,  582069879,  593510896,  605007320,  616558620,
+         628164281,  639823797,  651536677,  663302438,  675120609,  686990728,  698912347,  710885022,
+         722908323,  734981827,  747105119,  759277794,  771499455,  783769712,  796088183,  808454493,
+         820868276,  833329170,  845836823,  858390888,  870991023,  883636894,  896328173,  909064537,
+         921845669,  934671258,  947540998,  960454587,  973411731,  986412137,  999455521, 1012541600,
+        1025670099, 1038840743, 1052053267, 1065307405, 1078602898, 1091939491, 1105316931, 1118734971,
+        1132193366, 1145691876, 1159230264, 1172808296, 1186425743, 1200082376, 1213777973, 1227512314,
+        1241285180, 1255096358, 1268945636, 1282832806, 1296757661, 1310720000, 1324719622, 1338756329,
+        1352829926
+    };
+
+    /** 2^(i/3 + j/4), the fractional powers of two left over from the exponents
+     * of requantisation, as unsigned Q30
+     */
+    static const uint32_t fractionalPowersOfTwo[3][4] PROGMEM = {
+        { 1073741824, 1276901417, 1518500250, 1805811301 },
+        { 1352829926, 1608794974, 1913190429, 2275179671 },
+        { 1704458901, 2026954652, 2410468894, 2866546760 }
+    };
+
+    //=============================================================
+    /** The butterflies that reduce aliasing between long block subbands */
+    static const int32_t aliasCs[8] PROGMEM = {
+         1841452036,  1893526521,  2039311996,  2111652008,  2137858231,  2145680960,  2147267171,  2147468949
+    };
+
+    static const int32_t aliasCa[8] PROGMEM = {
+        -1104871222, -1013036689,  -672972959,  -390655622,  -203096532,   -87972919,   -30491194,    -7945635
+    };
+
+    /** The 36 point windows of normal, start and stop long blocks (block types 0, 1 and 3) */
+    static const int32_t longWindows[3][36] PROGMEM = {
+        {
+               93671921,   280302863,   464800532,   645760787,   821806413,   991597596,
+             1153842123,  1307305214,  1450818924,  1583291025,  1703713325,  1811169339,
+             1904841260,  1984016189,  2048091557,  2096579711,  2129111628,  2145439719,
+             2145439719,  2129111628,  2096579711,  2048091557,  1984016189,  1904841260,
+             1811169339,  1703713325,  1583291025,  1450818924,  1307305214,  1153842123,
+              991597596,   821806413,   645760787,   464800532,   280302863,    93671921
+        },
+        {
+               93671921,   280302863,   464800532,   645760787,   821806413,   991597596,
+             1153842123,  1307305214,  1450818924,  1583291025,  1703713325,  1811169339,
+             1904841260,  1984016189,  2048091557,  2096579711,  2129111628,  2145439719,
+             2147483647,  2147483647,  2147483647,  2147483647,  2147483647,  2147483647,
+             2129111628,  1984016189,  1703713325,  1307305214,   821806413,   280302863,
+                          0,               0,               0,               0,               0,               0
+        },
+        {
+                          0,               0,               0,               0,               0,               0,
+              280302863,   821806413,  1307305214,  1703713325,  1984016189,  2129111628,
+             2147483647,  2147483647,  2147483647,  2147483647,  2147483647,  2147483647,
+             2145439719,  2129111628,  2096579711,  2048091557,  1984016189,  1904841260,
+             1811169339,  1703713325,  1583291025,  1450818924,  1307305214,  1153842123,
+              991597596,   821806413,   645760787,   464800532,   280302863,    93671921
+        }
+    };
+
+    /** The 12 point window of each short block */
+    static const int32_t shortWindow[12] PROGMEM = {
+          280302863,   821806413,  1307305214,  1703713325,  1984016189,  2129111628,
+         2129111628,  1984016189,  1703713325,  1307305214,   821806413,   280302863
+    };
+
+    //=============================================================
+    /** Twiddles of the DCT-IV of N points, computed through a complex FFT of N/2 points:
+     * cos and sin of pi (4k + 1) / 4N before the FFT and of pi k / N after it
+     */
+    static const int32_t dct4Twiddles2[4] PROGMEM = {
+         1984016189,   821806413,  2147483647,           0
+    };
+
+    static const int32_t dct4Twiddles4[8] PROGMEM = {
+         2106220352,   418953276,  1193077991,  1785567396,
+         2147483647,           0,  1518500250,  1518500250
+    };
+
+    static const int32_t dct4Twiddles8[16] PROGMEM = {
+         2137142927,   210490206,  1893911494,  1012316784,
+         1362349204,  1660027308,   623381598,  2055013723,
+         2147483647,           0,  1984016189,   821806413,
+         1518500250,  1518500250,   821806413,  1984016189
+    };
+
+    static const int32_t dct4Twiddles16[32] PROGMEM = {
+         2144896910,   105372028,  2083126254,   521795963,
+         1941302225,   918167572,  1724875040,  1279254516,
+         1442161874,  1591180426,  1104027237,  1841958164,
+          723465451,  2021950484,   315101295,  2124240380,
+         2147483647,           0,  2106220352,   418953276,
+         1984016189,   821806413,  1785567396,  1193077991,
+         1518500250,  1518500250,  1193077991,  1785567396,
+          821806413,  1984016189,   418953276,  2106220352
+    };
+
+    static const int32_t dct4Twiddles6[12] PROGMEM = {
+         2129111628,   280302863,  1703713325,  1307305214,
+          821806413,  1984016189,  2147483647,           0,
+         1859775393,  1073741824,  1073741824,  1859775393
+    };
+
+    static const int32_t dct4Twiddles18[36] PROGMEM = {
+         2145439719,    93671921,  2096579711,   464800532,
+         1984016189,   821806413,  1811169339,  1153842123,
+         1583291025,  1450818924,  1307305214,  1703713325,
+          991597596,  1904841260,   645760787,  2048091557,
+          280302863,  2129111628,  2147483647,           0,
+         2114858546,   372906622,  2017974537,   734482665,
+         1859775393,  1073741824,  1645067915,  1380375881,
+         1380375881,  1645067915,  1073741824,  1859775393,
+          734482665,  2017974537,   372906622,  2114858546
+    };
+
+    /** The constants of the 3 and 9 point FFTs of the 6 and 18 point DCT-IVs: sin (pi / 3)
+     * and cos and sin of 2 pi k / 9 for k = 1, 2 and 4
+     */
+    static const int32_t sinPiOverThree = 1859775393;
+    static const int32_t fft9Twiddles[6] PROGMEM = {
+         1645067915,  1380375881,   372906622,  2114858546, -2017974537,   734482665
+    };
+
+    /** cos (pi / 4), also the gain of mid/side stereo */
+    static const int32_t cosPiOverFour = 1518500250;
+
+    //=============================================================
+    /** The synthesis window, ISO's D[i] times 65536 (which makes them integers), rearranged
+     * for the polyphase filter: for output sample j, the coefficients of the 16 DCT outputs
+     * it sums, newest first, with the signs of the DCT's symmetries folded in
+     */
+    static const int32_t synthesisWindow[32][16] PROGMEM = {
+        {
+                  0,      29,     213,     459,    2037,    5153,    6574,   37489,
+              75038,  -37489,    6574,   -5153,    2037,    -459,     213,     -29
+        },
+        {
+                 -1,      31,     218,     519,    2000,    5517,    5959,   39336,
+              74992,  -35640,    7134,   -4788,    2063,    -401,     208,     -26
+        },
+        {
+                 -1,      35,     222,     581,    1952,    5879,    5288,   41176,
+              74856,  -33791,    7640,   -4425,    2080,    -347,     202,     -24
+        },
+        {
+                 -1,      38,     225,     645,    1893,    6237,    4561,   43006,
+              74630,  -31947,    8092,   -4063,    2087,    -294,     196,     -21
+        },
+        {
+                 -1,      41,     227,     711,    1822,    6589,    3776,   44821,
+              74313,  -30112,    8492,   -3705,    2085,    -244,     190,     -19
+        },
+        {
+                 -1,      45,     228,     779,    1739,    6935,    2935,   46617,
+              73908,  -28289,    8840,   -3351,    2075,    -197,     183,     -17
+        },
+        {
+                 -1,      49,     228,     848,    1644,    7271,    2037,   48390,
+              73415,  -26482,    9139,   -3004,    2057,    -153,     176,     -16
+        },
+        {
+                 -2,      53,     227,     919,    1535,    7597,    1082,   50137,
+              72835,  -24694,    9389,   -2663,    2032,    -111,     169,     -14
+        },
+        {
+                 -2,      58,     224,     991,    1414,    7910,      70,   51853,
+              72169,  -22929,    9592,   -2330,    2001,     -72,     161,     -13
+        },
+        {
+                 -2,      63,     221,    1064,    1280,    8209,    -998,   53534,
+              71420,  -21189,    9750,   -2006,    1962,     -36,     154,     -11
+        },
+        {
+                 -2,      68,     215,    1137,    1131,    8491,   -2122,   55178,
+              70590,  -19478,    9863,   -1692,    1919,      -2,     147,     -10
+        },
+        {
+                 -3,      73,     208,    1210,     970,    8755,   -3300,   56778,
+              69679,  -17799,    9935,   -1388,    1870,      29,     139,      -9
+        },
+        {
+                 -3,      79,     200,    1283,     794,    8998,   -4533,   58333,
+              68692,  -16155,    9966,   -1095,    1817,      57,     132,      -8
+        },
+        {
+                 -4,      85,     189,    1356,     605,    9219,   -5818,   59838,
+              67629,  -14548,    9959,    -814,    1759,      83,     125,      -7
+        },
+        {
+                 -4,      91,     177,    1428,     402,    9416,   -7154,   61289,
+              66494,  -12980,    9916,    -545,    1698,     106,     117,      -7
+        },
+        {
+                 -5,      97,     163,    1498,     185,    9585,   -8540,   62684,
+              65290,  -11455,    9838,    -288,    1634,     127,     111,      -6
+        },
+        {
+                  0,     104,       0,    1567,       0,    9727,       0,   64019,
+                  0,   -9975,       0,     -45,       0,     146,       0,      -5
+        },
+        {
+                  6,     111,    -127,    1634,     288,    9838,   11455,   65290,
+             -62684,   -8540,   -9585,     185,   -1498,     163,     -97,      -5
+        },
+        {
+                  7,     117,    -106,    1698,     545,    9916,   12980,   66494,
+             -61289,   -7154,   -9416,     402,   -1428,     177,     -91,      -4
+        },
+        {
+                  7,     125,     -83,    1759,     814,    9959,   14548,   67629,
+             -59838,   -5818,   -9219,     605,   -1356,     189,     -85,      -4
+        },
+        {
+                  8,     132,     -57,    1817,    1095,    9966,   16155,   68692,
+             -58333,   -4533,   -8998,     794,   -1283,     200,     -79,      -3
+        },
+        {
+                  9,     139,     -29,    1870,    1388,    9935,   17799,   69679,
+             -56778,   -3300,   -8755,     970,   -1210,     208,     -73,      -3
+        },
+        {
+                 10,     147,       2,    1919,    1692,    9863,   19478,   70590,
+             -55178,   -2122,   -8491,    1131,   -1137,     215,     -68,      -2
+        },
+        {
+                 11,     154,      36,    1962,    2006,    9750,   21189,   71420,
+             -53534,    -998,   -8209,    1280,   -1064,     221,     -63,      -2
+        },
+        {
+                 13,     161,      72,    2001,    2330,    9592,   22929,   72169,
+             -51853,      70,   -7910,    1414,    -991,     224,     -58,      -2
+        },
+        {
+                 14,     169,     111,    2032,    2663,    9389,   24694,   72835,
+             -50137,    1082,   -7597,    1535,    -919,     227,     -53,      -2
+        },
+        {
+                 16,     176,     153,    2057,    3004,    9139,   26482,   73415,
+             -48390,    2037,   -7271,    1644,    -848,     228,     -49,      -1
+        },
+        {
+                 17,     183,     197,    2075,    3351,    8840,   28289,   73908,
+             -46617,    2935,   -6935,    1739,    -779,     228,     -45,      -1
+        },
+        {
+                 19,     190,     244,    2085,    3705,    8492,   30112,   74313,
+             -44821,    3776,   -6589,    1822,    -711,     227,     -41,      -1
+        },
+        {
+                 21,     196,     294,    2087,    4063,    8092,   31947,   74630,
+             -43006,    4561,   -6237,    1893,    -645,     225,     -38,      -1
+        },
+        {
+                 24,     202,     347,    2080,    4425,    7640,   33791,   74856,
+             -41176,    5288,   -5879,    1952,    -581,     222,     -35,      -1
+        },
+        {
+                 26,     208,     401,    2063,    4788,    7134,   35640,   74992,
+             -39336,    5959,   -5517,    2000,    -519,     218,     -31,      -1
+        }
+    };
+
+    //=============================================================
+    /** MPEG-1 intensity stereo: the left and right gains of each is_pos from 0 to 6 */
+    static const int32_t intensityRatios[7][2] PROGMEM = {
+        {           0,  2147483647 },
+        {   453816693,  1693666955 },
+        {   786033569,  1361450079 },
+        {  1073741824,  1073741824 },
+        {  1361450079,   786033569 },
+        {  1693666955,   453816693 },
+        {  2147483647,           0 }
+    };
+
+    /** MPEG-2 intensity stereo: 2^(-n/4) and 2^(-n/2), by intensity_scale, for n up to 16 */
+    static const int32_t lsfIntensityGains[2][17] PROGMEM = {
+        {
+             2147483647,  1805811301,  1518500250,  1276901417,  1073741824,   902905651,
+              759250125,   638450708,   536870912,   451452825,   379625062,   319225354,
+              268435456,   225726413,   189812531,   159612677,   134217728
+        },
+        {
+             2147483647,  1518500250,  1073741824,   759250125,   536870912,   379625062,
+              268435456,   189812531,   134217728,    94906266,    67108864,    47453133,
+               33554432,    23726566,    16777216,    11863283,     8388608
+        }
+    };
+}
+
+#endif /* Mp3Tables_h */
@@ -0,0 +1,705 @@
+#ifndef PeakPyramid_h
+#define PeakPyramid_h
+
+#include <Arduino.h>
+#include <SD.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "BufferedWriter.h"
+#include "DynamicArray.h"
+#include "LevelAnalysis.h"
+
+/** A multi-resolution min/max/RMS index of a file, for drawing its waveform.
+ *
+ * Attached to an AudioFile as its analysis sink, it is built while the file is
+ * decoded: every BaseBucketFrames frames become one bucket of the first level,
+ * and each level above summarises four buckets of the one below. Drawing a
+ * stretch of the file then reads only the coarsest level whose buckets are no
+ * wider than a pixel, so an overview costs a few buckets per pixel however long
+ * the file is:
+ *
+ *      PeakPyramid<float> peaks;
+ *
+ *      if (! peaks.load ("/long.wav"))
+ *      {
+ *          audioFile.setAnalysisSink (&peaks);
+ *          audioFile.load ("/long.wav");
+ *          peaks.save ("/long.wav");
+ *      }
+ *
+ *      peaks.render (0, 0, peaks.getNumFrames(), pixels, 800);
+ *
+ * save() writes the pyramid to a sidecar file next to the audio file (the same
+ * path with ".peaks" added) along with the audio file's size and modification
+ * time; load() reads the sidecar back only if they still match, and never reads
+ * the audio itself. Minimum, maximum and RMS are stored as 16 bit values, 6 bytes
+ * per bucket and channel, so the sidecar of a 16 bit file is about 1/60th of its size.
+ *
+ * Pixels narrower than a first level bucket are drawn from whole buckets, so when
+ * zoomed in that far, read the samples instead. Only AudioFiles that decode on
+ * load feed a sink; a LazyAllocation one doesn't.
+ */
+
+//=============================================================
+/** The smallest, largest and RMS sample value of a stretch of one channel */
+template <class T>
+struct PeakSummary
+{
+    T minimum;
+    T maximum;
+    T rms;
+};
+
+namespace PeakPyramidHelpers
+{
+    /** Buckets hold 16 bit values: Q15 for floating point samples, as is for int16_t ones */
+    struct Bucket
+    {
+        int16_t minimum;
+        int16_t maximum;
+        int16_t rms;
+    };
+
+    template <class T>
+    inline int16_t toBucketValue (T sample)
+    {
+        double scaled = (double) sample * 32768.;
+        return (int16_t)(scaled >= 32767. ? 32767 : (scaled <= -32768. ? -32768 : lround (scaled)));
+    }
+
+    template <>
+    inline int16_t toBucketValue<int16_t> (int16_t sample)
+    {
+        return sample;
+    }
+
+    template <class T>
+    inline T fromBucketValue (int16_t value)
+    {
+        return (T)((double) value / 32768.);
+    }
+
+    template <>
+    inline int16_t fromBucketValue<int16_t> (int16_t value)
+    {
+        return value;
+    }
+
+    inline uint32_t readLittleEndian (const uint8_t* source, int numBytes)
+    {
+        uint32_t value = 0;
+
+        for (int i = 0; i < numBytes; i++)
+            value |= (uint32_t) source[i] << (8 * i);
+
+        return value;
+    }
+}
+
+//=============================================================
+template <class T, int MaxChannels = 2, int BaseBucketFrames = 256>
+class PeakPyramid : public AudioAnalysisSink<T>
+{
+public:
+
+    static_assert (BaseBucketFrames > 0, "a PeakPyramid's buckets need at least one frame");
+
+    /** The number of buckets of one level that make up a bucket of the level above */
+    static const int levelFactor = 4;
+
+    /** The most levels a pyramid has, enough for 2^32 frames */
+    static const int maxLevels = 16;
+
+    /** Constructor */
+    PeakPyramid();
+
+    /** Discards the pyramid and starts building a new one */
+    void begin (uint32_t sampleRate, int numChannels) override;
+
+    /** Adds one frame (one sample per channel) to the first level */
+    void processFrame (const T* frame) override;
+
+    /** Finishes the last bucket and builds the levels above the first */
+    void end() override;
+
+    /** Discards the pyramid and frees its memory */
+    void clear();
+
+    //=============================================================
+    /** Writes the pyramid to the sidecar file of an audio file, recording the audio file's size and modification time.
+     * @Returns true if the sidecar was written
+     */
+    bool save (const String& audioFilePath) const;
+
+    /** Reads the pyramid from the sidecar file of an audio file.
+     * @Returns false, leaving the pyramid empty, if there is no sidecar or the audio file has changed since it was written
+     */
+    bool load (const String& audioFilePath);
+
+    /** @Returns the path of the sidecar file that save() and load() use for an audio file */
+    static String getSidecarPath (const String& audioFilePath);
+
+    //=============================================================
+    /** @Returns true once a pyramid has been built or loaded */
+    bool isComplete() const;
+
+    /** @Returns the sample rate of the file the pyramid describes */
+    uint32_t getSampleRate() const;
+
+    /** @Returns the number of channels in the pyramid */
+    int getNumChannels() const;
+
+    /** @Returns the number of frames the pyramid covers */
+    uint32_t getNumFrames() const;
+
+    /** @Returns the number of levels, each a quarter of the size of the one below */
+    int getNumLevels() const;
+
+    /** @Returns the number of frames summarised by each bucket of a level */
+    uint32_t getBucketFrames (int level) const;
+
+    /** @Returns the number of buckets (per channel) in a level */
+    int getNumBuckets (int level) const;
+
+    /** @Returns the minimum, maximum and RMS of the frames from startFrame up to (but not including)
+     * endFrame on a channel, read from the coarsest level that resolves the range
+     */
+    PeakSummary<T> getSummary (int channel, uint32_t startFrame, uint32_t endFrame) const;
+
+    /** Divides the frames from startFrame to endFrame into numPixels equal stretches and summarises
+     * each of them into pixels, for drawing one channel numPixels wide
+     */
+    void render (int channel, uint32_t startFrame, uint32_t endFrame, PeakSummary<T>* pixels, int numPixels) const;
+
+private:
+
+    //=============================================================
+    typedef PeakPyramidHelpers::Bucket Bucket;
+
+    static const int headerSize = 36;
+    static const int bucketSize = 6;
+    static const uint32_t formatVersion = 1;
+
+    struct Accumulator
+    {
+        T minimum;
+        T maximum;
+        double sumOfSquares;
+    };
+
+    //=============================================================
+    void finishBucket();
+    bool buildLevel (int level);
+    uint32_t getFramesInBucket (int level, int bucket) const;
+    static bool readAudioFileKey (const String& audioFilePath, uint32_t& fileSize, uint32_t& modificationTime);
+
+    //=============================================================
+    DynamicArray<Bucket> levels[maxLevels];
+    Accumulator accumulators[MaxChannels];
+    uint32_t sampleRate;
+    uint32_t numFrames;
+    int numChannels;
+    int numLevels;
+    int framesInBucket;
+    bool complete;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+PeakPyramid<T, MaxChannels, BaseBucketFrames>::PeakPyramid()
+{
+    clear();
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+void PeakPyramid<T, MaxChannels, BaseBucketFrames>::begin (uint32_t sampleRate_, int numChannels_)
+{
+    clear();
+
+    sampleRate = sampleRate_;
+    numChannels = numChannels_ < 1 ? 1 : (numChannels_ > MaxChannels ? MaxChannels : numChannels_);
+    numLevels = 1;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+void PeakPyramid<T, MaxChannels, BaseBucketFrames>::processFrame (const T* frame)
+{
+    for (int c = 0; c < numChannels; c++)
+    {
+        Accumulator& accumulator = accumulators[c];
+        T sample = frame[c];
+
+        if (framesInBucket == 0 || sample < accumulator.minimum)
+            accumulator.minimum = sample;
+
+        if (framesInBucket == 0 || sample > accumulator.maximum)
+            accumulator.maximum = sample;
+
+        accumulator.sumOfSquares += (double) sample * (double) sample;
+    }
+
+    numFrames++;
+    framesInBucket++;
+
+    if (framesInBucket == BaseBucketFrames)
+        finishBucket();
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+void PeakPyramid<T, MaxChannels, BaseBucketFrames>::finishBucket()
+{
+    using namespace PeakPyramidHelpers;
+
+    int numBuckets = levels[0].size();
+
+    for (int c = 0; c < numChannels; c++)
+    {
+        Accumulator& accumulator = accumulators[c];
+
+        Bucket bucket;
+        bucket.minimum = toBucketValue<T> (accumulator.minimum);
+        bucket.maximum = toBucketValue<T> (accumulator.maximum);
+        bucket.rms = toBucketValue<T> ((T) sqrt (accumulator.sumOfSquares / (double) framesInBucket));
+        levels[0].Append (bucket);
+
+        accumulator.sumOfSquares = 0.;
+    }
+
+    framesInBucket = 0;
+
+    // without every bucket the levels above would read past the first one, so the pyramid is dropped
+    if (levels[0].size() != numBuckets + numChannels)
+    {
+        Serial.println ("ERROR: there isn't enough memory for the peaks of this file");
+        clear();
+    }
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+void PeakPyramid<T, MaxChannels, BaseBucketFrames>::end()
+{
+    if (numLevels == 0)
+        return;
+
+    // the last bucket of the first level covers whatever frames are left over
+    if (framesInBucket > 0)
+        finishBucket();
+
+    // a level that doesn't fit in memory is left out, along with the ones above it
+    while (numLevels < maxLevels && getNumBuckets (numLevels - 1) > 1 && buildLevel (numLevels))
+        numLevels++;
+
+    complete = true;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+bool PeakPyramid<T, MaxChannels, BaseBucketFrames>::buildLevel (int level)
+{
+    const DynamicArray<Bucket>& below = levels[level - 1];
+    DynamicArray<Bucket>& above = levels[level];
+
+    int numBucketsBelow = getNumBuckets (level - 1);
+    int numBucketsAbove = (numBucketsBelow + levelFactor - 1) / levelFactor;
+
+    above.resize (numBucketsAbove * numChannels);
+
+    if (above.size() != numBucketsAbove * numChannels)
+    {
+        above.clear();
+        return false;
+    }
+
+    for (int i = 0; i < numBucketsAbove; i++)
+    {
+        int first = i * levelFactor;
+        int last = first + levelFactor < numBucketsBelow ? first + levelFactor : numBucketsBelow;
+
+        for (int c = 0; c < numChannels; c++)
+        {
+            Bucket bucket = below[first * numChannels + c];
+            double sumOfSquares = 0.;
+
+            // RMS values combine as the mean of their squares, weighted by the frames they cover
+            for (int j = first; j < last; j++)
+            {
+                const Bucket& source = below[j * numChannels + c];
+
+                if (source.minimum < bucket.minimum)
+                    bucket.minimum = source.minimum;
+
+                if (source.maximum > bucket.maximum)
+                    bucket.maximum = source.maximum;
+
+                sumOfSquares += (double) source.rms * (double) source.rms * (double) getFramesInBucket (level - 1, j);
+            }
+
+            bucket.rms = (int16_t) lround (sqrt (sumOfSquares / (double) getFramesInBucket (level, i)));
+            above[i * numChannels + c] = bucket;
+        }
+    }
+
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+void PeakPyramid<T, MaxChannels, BaseBucketFrames>::clear()
+{
+    for (int i = 0; i < maxLevels; i++)
+        levels[i].clear();
+
+    for (int c = 0; c < MaxChannels; c++)
+        accumulators[c].sumOfSquares = 0.;
+
+    sampleRate = 0;
+    numFrames = 0;
+    numChannels = 0;
+    numLevels = 0;
+    framesInBucket = 0;
+    complete = false;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+String PeakPyramid<T, MaxChannels, BaseBucketFrames>::getSidecarPath (const String& audioFilePath)
+{
+    return audioFilePath + ".peaks";
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+bool PeakPyramid<T, MaxChannels, BaseBucketFrames>::readAudioFileKey (const String& audioFilePath, uint32_t& fileSize, uint32_t& modificationTime)
+{
+    File file = SD.open (audioFilePath.c_str());
+
+    if (! file)
+        return false;
+
+    fileSize = file.size();
+    modificationTime = BufferedWriterHelpers::getModificationTime (file, 0);
+    file.close();
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+bool PeakPyramid<T, MaxChannels, BaseBucketFrames>::save (const String& audioFilePath) const
+{
+    using BufferedWriterHelpers::writeLittleEndian;
+
+    if (! complete)
+    {
+        Serial.println ("ERROR: the peak pyramid hasn't been built");
+        return false;
+    }
+
+    uint32_t fileSize = 0, modificationTime = 0;
+
+    if (! readAudioFileKey (audioFilePath, fileSize, modificationTime))
+    {
+        Serial.println ("ERROR: File doesn't exist or otherwise can't load file");
+        return false;
+    }
+
+    uint32_t numBytes = headerSize;
+
+    for (int level = 0; level < numLevels; level++)
+        numBytes += (uint32_t) levels[level].size() * bucketSize;
+
+    BufferedWriter<> writer;
+
+    if (! writer.open (getSidecarPath (audioFilePath), numBytes))
+    {
+        Serial.println ("ERROR: couldn't create the peak file");
+        return false;
+    }
+
+    uint8_t header[headerSize];
+    memcpy (header, "PEAK", 4);
+    writeLittleEndian (header + 4, formatVersion, 4);
+    writeLittleEndian (header + 8, sampleRate, 4);
+    writeLittleEndian (header + 12, (uint32_t) numChannels, 4);
+    writeLittleEndian (header + 16, numFrames, 4);
+    writeLittleEndian (header + 20, BaseBucketFrames, 4);
+    writeLittleEndian (header + 24, (uint32_t) numLevels, 4);
+    writeLittleEndian (header + 28, fileSize, 4);
+    writeLittleEndian (header + 32, modificationTime, 4);
+    writer.write (header, headerSize);
+
+    // buckets go through a small block so that each write() is a useful size
+    const int bucketsPerBlock = 32;
+    uint8_t block[bucketsPerBlock * bucketSize];
+
+    for (int level = 0; level < numLevels; level++)
+    {
+        const DynamicArray<Bucket>& buckets = levels[level];
+
+        for (int start = 0; start < buckets.size(); start += bucketsPerBlock)
+        {
+            int count = buckets.size() - start < bucketsPerBlock ? buckets.size() - start : bucketsPerBlock;
+
+            for (int i = 0; i < count; i++)
+            {
+                const Bucket& bucket = buckets[start + i];
+                writeLittleEndian (block + i * bucketSize, (uint16_t) bucket.minimum, 2);
+                writeLittleEndian (block + i * bucketSize + 2, (uint16_t) bucket.maximum, 2);
+                writeLittleEndian (block + i * bucketSize + 4, (uint16_t) bucket.rms, 2);
+            }
+
+            writer.write (block, (uint32_t)(count * bucketSize));
+        }
+    }
+
+    if (! writer.close())
+    {
+        Serial.println ("ERROR: couldn't write the peak file");
+        return false;
+    }
+
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+bool PeakPyramid<T, MaxChannels, BaseBucketFrames>::load (const String& audioFilePath)
+{
+    using namespace PeakPyramidHelpers;
+
+    clear();
+
+    uint32_t fileSize = 0, modificationTime = 0;
+
+    if (! readAudioFileKey (audioFilePath, fileSize, modificationTime))
+        return false;
+
+    File file = SD.open (getSidecarPath (audioFilePath).c_str());
+
+    if (! file)
+        return false;
+
+    uint8_t header[headerSize];
+
+    if (file.read (header, headerSize) != headerSize || memcmp (header, "PEAK", 4) != 0
+        || readLittleEndian (header + 4, 4) != formatVersion)
+    {
+        Serial.println ("ERROR: this doesn't seem to be a valid peak file");
+        file.close();
+        return false;
+    }
+
+    uint32_t storedChannels = readLittleEndian (header + 12, 4);
+    uint32_t storedLevels = readLittleEndian (header + 24, 4);
+
+    // a sidecar written with other settings, or for an older version of the audio, is rebuilt
+    if (storedChannels < 1 || storedChannels > (uint32_t) MaxChannels || storedLevels < 1 || storedLevels > (uint32_t) maxLevels
+        || readLittleEndian (header + 20, 4) != (uint32_t) BaseBucketFrames
+        || readLittleEndian (header + 28, 4) != fileSize || readLittleEndian (header + 32, 4) != modificationTime)
+    {
+        file.close();
+        return false;
+    }
+
+    sampleRate = readLittleEndian (header + 8, 4);
+    numChannels = (int) storedChannels;
+    numFrames = readLittleEndian (header + 16, 4);
+    numLevels = (int) storedLevels;
+
+    uint64_t numBytes = headerSize;
+
+    for (int level = 0; level < numLevels; level++)
+        numBytes += (uint64_t) getNumBuckets (level) * (uint64_t) numChannels * bucketSize;
+
+    // checked before anything is allocated, so a damaged header can't ask for more memory than the file holds
+    if (numBytes != (uint64_t) file.size())
+    {
+        Serial.println ("ERROR: the peak file is truncated");
+        file.close();
+        clear();
+        return false;
+    }
+
+    const int bucketsPerBlock = 32;
+    uint8_t block[bucketsPerBlock * bucketSize];
+
+    for (int level = 0; level < numLevels; level++)
+    {
+        DynamicArray<Bucket>& buckets = levels[level];
+        buckets.resize (getNumBuckets (level) * numChannels);
+
+        if (buckets.size() != getNumBuckets (level) * numChannels)
+        {
+            Serial.println ("ERROR: there isn't enough memory to load this peak file");
+            file.close();
+            clear();
+            return false;
+        }
+
+        for (int start = 0; start < buckets.size(); start += bucketsPerBlock)
+        {
+            int count = buckets.size() - start < bucketsPerBlock ? buckets.size() - start : bucketsPerBlock;
+
+            if (file.read (block, count * bucketSize) != count * bucketSize)
+            {
+                Serial.println ("ERROR: the peak file is truncated");
+                file.close();
+                clear();
+                return false;
+            }
+
+            for (int i = 0; i < count; i++)
+            {
+                Bucket& bucket = buckets[start + i];
+                bucket.minimum = (int16_t) readLittleEndian (block + i * bucketSize, 2);
+                bucket.maximum = (int16_t) readLittleEndian (block + i * bucketSize + 2, 2);
+                bucket.rms = (int16_t) readLittleEndian (block + i * bucketSize + 4, 2);
+            }
+        }
+    }
+
+    file.close();
+    complete = true;
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+bool PeakPyramid<T, MaxChannels, BaseBucketFrames>::isComplete() const
+{
+    return complete;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+uint32_t PeakPyramid<T, MaxChannels, BaseBucketFrames>::getSampleRate() const
+{
+    return sampleRate;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+int PeakPyramid<T, MaxChannels, BaseBucketFrames>::getNumChannels() const
+{
+    return numChannels;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+uint32_t PeakPyramid<T, MaxChannels, BaseBucketFrames>::getNumFrames() const
+{
+    return numFrames;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+int PeakPyramid<T, MaxChannels, BaseBucketFrames>::getNumLevels() const
+{
+    return numLevels;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+uint32_t PeakPyramid<T, MaxChannels, BaseBucketFrames>::getBucketFrames (int level) const
+{
+    // the top level's single bucket can be wider than the longest file
+    uint64_t bucketFrames = (uint64_t) BaseBucketFrames << (2 * level);
+    return bucketFrames < 0xFFFFFFFFULL ? (uint32_t) bucketFrames : 0xFFFFFFFFUL;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+int PeakPyramid<T, MaxChannels, BaseBucketFrames>::getNumBuckets (int level) const
+{
+    uint64_t bucketFrames = (uint64_t) BaseBucketFrames << (2 * level);
+    return (int)(((uint64_t) numFrames + bucketFrames - 1) / bucketFrames);
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+uint32_t PeakPyramid<T, MaxChannels, BaseBucketFrames>::getFramesInBucket (int level, int bucket) const
+{
+    uint64_t bucketFrames = (uint64_t) BaseBucketFrames << (2 * level);
+    uint64_t start = bucketFrames * (uint64_t) bucket;
+    return (uint32_t)(numFrames - start < bucketFrames ? numFrames - start : bucketFrames);
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+PeakSummary<T> PeakPyramid<T, MaxChannels, BaseBucketFrames>::getSummary (int channel, uint32_t startFrame, uint32_t endFrame) const
+{
+    using namespace PeakPyramidHelpers;
+
+    PeakSummary<T> summary;
+    summary.minimum = summary.maximum = summary.rms = (T) 0;
+
+    if (endFrame > numFrames)
+        endFrame = numFrames;
+
+    if (! complete || channel < 0 || channel >= numChannels || startFrame >= endFrame)
+        return summary;
+
+    // the coarsest level whose buckets fit in the range, so the range spans at most a few of them
+    int level = 0;
+
+    while (level + 1 < numLevels && getBucketFrames (level + 1) <= endFrame - startFrame)
+        level++;
+
+    const DynamicArray<Bucket>& buckets = levels[level];
+    uint32_t bucketFrames = getBucketFrames (level);
+    int first = (int)(startFrame / bucketFrames);
+    int last = (int)((endFrame - 1) / bucketFrames);
+
+    Bucket combined = buckets[first * numChannels + channel];
+    double sumOfSquares = 0.;
+    double framesCovered = 0.;
+
+    for (int i = first; i <= last; i++)
+    {
+        const Bucket& bucket = buckets[i * numChannels + channel];
+
+        if (bucket.minimum < combined.minimum)
+            combined.minimum = bucket.minimum;
+
+        if (bucket.maximum > combined.maximum)
+            combined.maximum = bucket.maximum;
+
+        double frames = (double) getFramesInBucket (level, i);
+        sumOfSquares += (double) bucket.rms * (double) bucket.rms * frames;
+        framesCovered += frames;
+    }
+
+    summary.minimum = fromBucketValue<T> (combined.minimum);
+    summary.maximum = fromBucketValue<T> (combined.maximum);
+    summary.rms = fromBucketValue<T> ((int16_t) lround (sqrt (sumOfSquares / framesCovered)));
+    return summary;
+}
+
+//=============================================================
+template <class T, int MaxChannels, int BaseBucketFrames>
+void PeakPyramid<T, MaxChannels, BaseBucketFrames>::render (int channel, uint32_t startFrame, uint32_t endFrame, PeakSummary<T>* pixels, int numPixels) const
+{
+    uint64_t numRangeFrames = endFrame > startFrame ? endFrame - startFrame : 0;
+
+    for (int i = 0; i < numPixels; i++)
+    {
+        uint32_t pixelStart = startFrame + (uint32_t)(numRangeFrames * (uint64_t) i / (uint64_t) numPixels);
+        uint32_t pixelEnd = startFrame + (uint32_t)(numRangeFrames * (uint64_t)(i + 1) / (uint64_t) numPixels);
+
+        // zoomed in past one frame per pixel, each pixel still shows the frame under it
+        if (pixelEnd == pixelStart && numRangeFrames > 0)
+            pixelEnd = pixelStart + 1;
+
+        pixels[i] = getSummary (channel, pixelStart, pixelEnd);
+    }
+}
+
+#endif /* PeakPyramid_h */
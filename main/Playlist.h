@@ -0,0 +1,644 @@
+#ifndef Playlist_h
+#define Playlist_h
+
+#include <math.h>
+#include <stdint.h>
+#include "Mixer.h"
+#include "WavReader.h"
+
+/** Gapless playback of a list of WAV files into one interleaved stereo stream.
+ *
+ * While a track plays, the next one is opened and its first PreloadFrames
+ * frames are decoded into memory, one block per call to process(), so the
+ * work of starting a file is spread over the blocks before the boundary
+ * rather than landing on it. At the boundary the next track carries on in the
+ * same output block on the very next frame, or the two overlap by a set
+ * number of frames with a fade curve:
+ *
+ *      Playlist<float> playlist;
+ *      playlist.addTrack ("/intro.wav");
+ *      playlist.addTrack ("/song.wav");
+ *      playlist.setCrossfade (22050, CrossfadeCurve::EqualPower);
+ *      playlist.start();
+ *
+ *      playlist.process (output, 256);     // 256 stereo frames
+ *
+ * Mono tracks play on both channels. Tracks must have the playlist's sample
+ * rate; ones that don't, or that can't be opened, are skipped. A crossfade is
+ * shortened to at most half of either track, so a track's fade in and fade out
+ * never overlap.
+ */
+
+//=============================================================
+/** The shape of a crossfade. The fade out is always the fade in reversed */
+enum class CrossfadeCurve
+{
+    Linear,         // gains sum to 1: no bump for identical material, a dip for unrelated material
+    EqualPower,     // powers sum to 1: steady loudness for unrelated material
+    SCurve          // raised cosine: gentle at both ends, gains sum to 1
+};
+
+//=============================================================
+template <class T, int MaxTracks = 16, int BlockFrames = 128, int PreloadFrames = 512, class Source = PrefetchReader<>>
+class Playlist
+{
+public:
+
+    static_assert (MaxTracks > 0 && BlockFrames > 0 && PreloadFrames >= 0, "invalid Playlist sizes");
+
+    typedef MixerTraits<T> Traits;
+    typedef typename Traits::Accumulator Accumulator;
+    typedef typename Traits::Gain Gain;
+
+    /** Constructor */
+    Playlist();
+
+    /** Adds a WAV file to the end of the list. @Returns false if the list is full */
+    bool addTrack (const String& filePath);
+
+    /** Stops playback and empties the list */
+    void clear();
+
+    /** @Returns the number of tracks in the list */
+    int getNumTracks() const;
+
+    /** Sets the sample rate of the output. Tracks must match it to be played (default 44100) */
+    void setSampleRate (uint32_t sampleRate);
+
+    /** Sets how many frames neighbouring tracks overlap, and the fade shape. 0 (the default)
+     * joins them end to start with no gap
+     */
+    void setCrossfade (uint32_t numFrames, CrossfadeCurve curve = CrossfadeCurve::EqualPower);
+
+    /** Starts again from the first track after the last one */
+    void setRepeat (bool shouldRepeat);
+
+    //=============================================================
+    /** Starts playing from a track. @Returns false if no track from there on can be played */
+    bool start (int track = 0);
+
+    /** Stops playback and closes the files */
+    void stop();
+
+    /** @Returns true until the last track has finished */
+    bool isPlaying() const;
+
+    /** @Returns the index of the track playing, or -1 */
+    int getCurrentTrack() const;
+
+    /** @Returns the number of frames of the current track played so far */
+    uint32_t getPositionInTrack() const;
+
+    /** @Returns the number of track boundaries reached before the next track had been
+     * fully preloaded, so its first frames were read from the file in the boundary's block
+     */
+    uint32_t getNumLateStarts() const;
+
+    //=============================================================
+    /** Fills numFrames frames of interleaved stereo output, with silence after the end of
+     * the list. @Returns the number of frames that came from tracks
+     */
+    int process (T* interleavedStereoOutput, int numFrames);
+
+    /** Lets the playing files read ahead. Worth calling from idle time on Arduino */
+    void prefetch();
+
+private:
+
+    //=============================================================
+    static const int FadeTableSize = 256;
+
+    struct Deck
+    {
+        WavReader<T, 512, Source> reader;
+        T preload[PreloadFrames > 0 ? PreloadFrames * 2 : 1];
+        int numPreloaded;
+        int preloadPosition;
+        uint32_t position;          // frames played
+        uint32_t length;
+        int track;
+        bool open;
+    };
+
+    Deck& getCurrent() { return decks[currentDeck]; }
+    Deck& getNext() { return decks[1 - currentDeck]; }
+
+    bool openDeck (Deck& deck, int firstTrack);
+    void closeDeck (Deck& deck);
+    void prepareNext (bool mustOpen);
+    int readDeck (Deck& deck, T* stereo, int numFrames);
+    int readFromFile (Deck& deck, T* stereo, int numFrames);
+    int getNextTrackIndex (int track) const;
+    uint32_t getFadeLength();
+    Gain getFadeGain (uint32_t framesIntoFade, uint32_t fadeLength) const;
+    int processBlock (T* output, int numFrames);
+    void advance();
+
+    //=============================================================
+    String tracks[MaxTracks];
+    int numTracks;
+    Deck decks[2];
+    int currentDeck;
+    bool nextTried;
+    bool playing;
+    bool repeat;
+    uint32_t sampleRate;
+    uint32_t crossfadeFrames;
+    uint32_t numLateStarts;
+    Gain fadeTable[FadeTableSize + 1];
+    T fileBlock[BlockFrames * 2];
+    T fadeBlock[BlockFrames * 2];
+    Accumulator mixBlock[BlockFrames * 2];
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::Playlist()
+{
+    numTracks = 0;
+    currentDeck = 0;
+    nextTried = false;
+    playing = false;
+    repeat = false;
+    sampleRate = 44100;
+    numLateStarts = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        decks[i].open = false;
+        decks[i].track = -1;
+        closeDeck (decks[i]);
+    }
+
+    setCrossfade (0);
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+bool Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::addTrack (const String& filePath)
+{
+    if (numTracks == MaxTracks)
+    {
+        Serial.println ("ERROR: the playlist is full");
+        return false;
+    }
+
+    tracks[numTracks++] = filePath;
+
+    // the old last track may have been waiting for nothing to follow it
+    if (playing && ! getNext().open)
+        nextTried = false;
+
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::clear()
+{
+    stop();
+
+    for (int i = 0; i < numTracks; i++)
+        tracks[i] = String();
+
+    numTracks = 0;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+int Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::getNumTracks() const
+{
+    return numTracks;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::setSampleRate (uint32_t newSampleRate)
+{
+    sampleRate = newSampleRate;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::setCrossfade (uint32_t numFrames, CrossfadeCurve curve)
+{
+    crossfadeFrames = numFrames;
+
+    // the curve is sampled once here so that fading costs a table lookup per frame
+    for (int i = 0; i <= FadeTableSize; i++)
+    {
+        float x = (float) i / (float) FadeTableSize;
+        float gain = x;
+
+        if (curve == CrossfadeCurve::EqualPower)
+            gain = sinf (x * 1.57079633f);
+        else if (curve == CrossfadeCurve::SCurve)
+            gain = 0.5f - 0.5f * cosf (x * 3.14159265f);
+
+        fadeTable[i] = Traits::toGain (gain);
+    }
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::setRepeat (bool shouldRepeat)
+{
+    repeat = shouldRepeat;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+bool Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::start (int track)
+{
+    stop();
+
+    if (track < 0 || track >= numTracks)
+        return false;
+
+    currentDeck = 0;
+
+    if (! openDeck (getCurrent(), track))
+        return false;
+
+    playing = true;
+    return true;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::stop()
+{
+    closeDeck (decks[0]);
+    closeDeck (decks[1]);
+    nextTried = false;
+    playing = false;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+bool Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::isPlaying() const
+{
+    return playing;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+int Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::getCurrentTrack() const
+{
+    return playing ? decks[currentDeck].track : -1;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+uint32_t Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::getPositionInTrack() const
+{
+    return playing ? decks[currentDeck].position : 0;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+uint32_t Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::getNumLateStarts() const
+{
+    return numLateStarts;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+int Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::process (T* interleavedStereoOutput, int numFrames)
+{
+    int numPlayed = 0;
+
+    while (numFrames > 0)
+    {
+        int framesThisTime = numFrames < BlockFrames ? numFrames : BlockFrames;
+        int n = playing ? processBlock (interleavedStereoOutput, framesThisTime) : 0;
+
+        for (int i = n * 2; i < framesThisTime * 2; i++)
+            interleavedStereoOutput[i] = 0;
+
+        numPlayed += n;
+        interleavedStereoOutput += framesThisTime * 2;
+        numFrames -= framesThisTime;
+    }
+
+    return numPlayed;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::prefetch()
+{
+    for (int i = 0; i < 2; i++)
+        if (decks[i].open)
+            decks[i].reader.prefetch();
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+bool Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::openDeck (Deck& deck, int firstTrack)
+{
+    closeDeck (deck);
+
+    // skip over tracks that can't be played, trying each at most once
+    for (int i = 0, track = firstTrack; i < numTracks && track >= 0; i++, track = getNextTrackIndex (track))
+    {
+        if (! deck.reader.open (tracks[track]))
+            continue;
+
+        if (deck.reader.getSampleRate() != sampleRate)
+        {
+            Serial.println ("ERROR: this track's sample rate is different to the playlist's");
+            deck.reader.close();
+            continue;
+        }
+
+        // an empty track has nothing to play, and with repeat on a list of them would never end
+        if (deck.reader.getNumFrames() == 0)
+        {
+            deck.reader.close();
+            continue;
+        }
+
+        deck.track = track;
+        deck.length = deck.reader.getNumFrames();
+        deck.open = true;
+        return true;
+    }
+
+    return false;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::closeDeck (Deck& deck)
+{
+    if (deck.open)
+        deck.reader.close();
+
+    deck.numPreloaded = 0;
+    deck.preloadPosition = 0;
+    deck.position = 0;
+    deck.length = 0;
+    deck.track = -1;
+    deck.open = false;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::prepareNext (bool mustOpen)
+{
+    Deck& next = getNext();
+
+    if (! next.open)
+    {
+        if (nextTried)
+            return;
+
+        nextTried = true;
+        int track = getNextTrackIndex (getCurrent().track);
+
+        if (track >= 0)
+            openDeck (next, track);
+
+        // opening is this block's share of the work, unless the boundary can't wait
+        if (! mustOpen)
+            return;
+    }
+
+    if (next.open && next.position == 0 && next.numPreloaded < PreloadFrames)
+    {
+        int numFrames = PreloadFrames - next.numPreloaded;
+
+        if (numFrames > BlockFrames)
+            numFrames = BlockFrames;
+
+        next.numPreloaded += readFromFile (next, next.preload + next.numPreloaded * 2, numFrames);
+    }
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+int Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::readDeck (Deck& deck, T* stereo, int numFrames)
+{
+    int numRead = 0;
+
+    if (deck.preloadPosition < deck.numPreloaded)
+    {
+        numRead = deck.numPreloaded - deck.preloadPosition;
+
+        if (numRead > numFrames)
+            numRead = numFrames;
+
+        memcpy (stereo, deck.preload + deck.preloadPosition * 2, numRead * 2 * sizeof (T));
+        deck.preloadPosition += numRead;
+    }
+
+    if (numRead < numFrames)
+        numRead += readFromFile (deck, stereo + numRead * 2, numFrames - numRead);
+
+    deck.position += numRead;
+    return numRead;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+int Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::readFromFile (Deck& deck, T* stereo, int numFrames)
+{
+    int numChannels = deck.reader.getNumChannels();
+    int numRead = 0;
+
+    while (numRead < numFrames)
+    {
+        int framesThisTime = numFrames - numRead;
+
+        if (framesThisTime > BlockFrames)
+            framesThisTime = BlockFrames;
+
+        int n = deck.reader.read (fileBlock, framesThisTime);
+
+        if (n <= 0)
+            break;
+
+        T* destination = stereo + numRead * 2;
+
+        if (numChannels == 1)
+        {
+            for (int i = 0; i < n; i++)
+                destination[2 * i] = destination[2 * i + 1] = fileBlock[i];
+        }
+        else if (numChannels == 2)
+        {
+            memcpy (destination, fileBlock, n * 2 * sizeof (T));
+        }
+        else
+        {
+            // keep the first two channels of anything wider
+            for (int i = 0; i < n; i++)
+            {
+                destination[2 * i] = fileBlock[i * numChannels];
+                destination[2 * i + 1] = fileBlock[i * numChannels + 1];
+            }
+        }
+
+        numRead += n;
+    }
+
+    return numRead;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+int Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::getNextTrackIndex (int track) const
+{
+    if (track + 1 < numTracks)
+        return track + 1;
+
+    return repeat && numTracks > 0 ? 0 : -1;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+uint32_t Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::getFadeLength()
+{
+    Deck& current = getCurrent();
+    Deck& next = getNext();
+
+    if (crossfadeFrames == 0 || ! next.open)
+        return 0;
+
+    uint32_t fadeLength = crossfadeFrames;
+
+    // each track's fade in and fade out have half of it each at most
+    if (fadeLength > current.length / 2)
+        fadeLength = current.length / 2;
+
+    if (fadeLength > next.length / 2)
+        fadeLength = next.length / 2;
+
+    return fadeLength;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+typename Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::Gain
+Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::getFadeGain (uint32_t framesIntoFade, uint32_t fadeLength) const
+{
+    // 8 bits of fraction between table entries
+    uint32_t scaled = (uint32_t)(((uint64_t) framesIntoFade * FadeTableSize * 256) / fadeLength);
+    int index = (int)(scaled >> 8);
+    int fraction = (int)(scaled & 255);
+
+    if (index >= FadeTableSize)
+        return fadeTable[FadeTableSize];
+
+    return fadeTable[index] + (Gain)((fadeTable[index + 1] - fadeTable[index]) * fraction / 256);
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+int Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::processBlock (T* output, int numFrames)
+{
+    int numDone = 0;
+    int numEmptyTracks = 0;
+
+    while (numDone < numFrames && playing)
+    {
+        Deck& current = getCurrent();
+        uint32_t framesLeft = current.length - current.position;
+        bool nearEnd = framesLeft <= crossfadeFrames + (uint32_t) numFrames;
+
+        prepareNext (nearEnd);
+
+        Deck& next = getNext();
+        uint32_t fadeLength = getFadeLength();
+        uint32_t fadeStart = current.length - fadeLength;
+        T* destination = output + numDone * 2;
+
+        if (current.position < fadeStart || fadeLength == 0)
+        {
+            // plain playback up to the start of the fade (or the end of the track)
+            uint32_t limit = fadeLength > 0 ? fadeStart - current.position : framesLeft;
+            int framesThisTime = (uint32_t)(numFrames - numDone) < limit ? numFrames - numDone : (int) limit;
+            int n = framesThisTime > 0 ? readDeck (current, destination, framesThisTime) : 0;
+            numDone += n;
+
+            if (n < framesThisTime)
+                current.length = current.position;      // the file was shorter than its header said
+
+            if (current.position >= current.length)
+            {
+                // stop if a whole cycle through the list (e.g. files that can't be read) played nothing
+                numEmptyTracks = n > 0 ? 0 : numEmptyTracks + 1;
+
+                if (numEmptyTracks > numTracks)
+                {
+                    stop();
+                    break;
+                }
+
+                advance();
+            }
+
+            continue;
+        }
+
+        // overlap: the current track fades out while the next fades in
+        uint32_t framesOfFade = current.length - current.position;
+        int framesThisTime = (uint32_t)(numFrames - numDone) < framesOfFade ? numFrames - numDone : (int) framesOfFade;
+
+        if (next.position == 0 && next.numPreloaded < PreloadFrames && next.numPreloaded < (int) next.length)
+            numLateStarts++;
+
+        int numOut = readDeck (current, destination, framesThisTime);
+        int numIn = readDeck (next, fadeBlock, framesThisTime);
+
+        for (int i = numOut; i < framesThisTime; i++)
+            destination[2 * i] = destination[2 * i + 1] = 0;
+
+        for (int i = numIn; i < framesThisTime; i++)
+            fadeBlock[2 * i] = fadeBlock[2 * i + 1] = 0;
+
+        uint32_t framesIntoFade = current.position - numOut - fadeStart;
+
+        for (int i = 0; i < framesThisTime; i++)
+        {
+            Gain fadeIn = getFadeGain (framesIntoFade + i, fadeLength);
+            Gain fadeOut = getFadeGain (fadeLength - framesIntoFade - i, fadeLength);
+            mixBlock[2 * i] = Traits::multiply (destination[2 * i], fadeOut) + Traits::multiply (fadeBlock[2 * i], fadeIn);
+            mixBlock[2 * i + 1] = Traits::multiply (destination[2 * i + 1], fadeOut) + Traits::multiply (fadeBlock[2 * i + 1], fadeIn);
+        }
+
+        MixerHelpers::saturate (mixBlock, destination, framesThisTime * 2);
+        numDone += framesThisTime;
+
+        if (numOut < framesThisTime || current.position >= current.length)
+            advance();
+    }
+
+    return numDone;
+}
+
+//=============================================================
+template <class T, int MaxTracks, int BlockFrames, int PreloadFrames, class Source>
+void Playlist<T, MaxTracks, BlockFrames, PreloadFrames, Source>::advance()
+{
+    Deck& next = getNext();
+
+    // the boundary came before the next track had been fully preloaded
+    if (crossfadeFrames == 0 && next.open && next.position == 0
+        && next.numPreloaded < PreloadFrames && next.numPreloaded < (int) next.length)
+        numLateStarts++;
+
+    closeDeck (getCurrent());
+    currentDeck = 1 - currentDeck;
+    nextTried = false;
+
+    if (! getCurrent().open)
+        playing = false;
+}
+
+#endif /* Playlist_h */
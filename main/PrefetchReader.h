@@ -0,0 +1,636 @@
+#ifndef PrefetchReader_h
+#define PrefetchReader_h
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+#include <SD.h>
+
+/** Read-ahead buffering between a File and a decoder.
+ *
+ * A region of the file (e.g. a WAV data chunk) is read through a ring of
+ * NumBlocks blocks of BlockSize bytes. Blocks start at multiples of BlockSize
+ * in the file, so with sector-sized blocks every card read is sector aligned,
+ * and neighbouring free blocks are filled with a single multi-sector read.
+ *
+ * Access patterns are watched: while reads follow on from each other the whole
+ * ring is used for read-ahead, and after a seek only the blocks a read needs are
+ * fetched, so random access doesn't pay for data it will never use.
+ *
+ * PrefetchReader reads on the caller's thread. It fills the ring whenever a
+ * read() finds it empty, and prefetch() can be called from idle time (e.g. the
+ * sketch's loop()) to top it up so the next read() doesn't wait for the card.
+ * On hosts, AsyncPrefetchReader keeps the next blocks in flight on a background
+ * thread while the current ones are being decoded.
+ *
+ * Both count hits (reads served from the ring), misses (reads that had to wait
+ * for the file) and the time spent waiting.
+ */
+
+//=============================================================
+/** The block size and read-ahead depth WavReader uses by default: one sector and two
+ * blocks on Arduino, and larger multi-sector blocks on hosts
+ */
+#ifndef AUDIOFILE_READ_BLOCK_SIZE
+ #ifdef ARDUINO
+  #define AUDIOFILE_READ_BLOCK_SIZE 512
+ #else
+  #define AUDIOFILE_READ_BLOCK_SIZE 16384
+ #endif
+#endif
+
+#ifndef AUDIOFILE_READ_AHEAD_BLOCKS
+ #ifdef ARDUINO
+  #define AUDIOFILE_READ_AHEAD_BLOCKS 2
+ #else
+  #define AUDIOFILE_READ_AHEAD_BLOCKS 8
+ #endif
+#endif
+
+//=============================================================
+struct PrefetchStats
+{
+    uint32_t numHits;           // read() calls served entirely from the ring
+    uint32_t numMisses;         // read() calls that had to wait for the file
+    uint32_t stallMicros;       // time read() spent waiting for the file
+    uint32_t numFileReads;      // reads made from the file
+    uint32_t numBytesFromFile;  // bytes read from the file
+};
+
+//=============================================================
+/** The ring of blocks and the bookkeeping shared by both readers. Not thread safe */
+template <int BlockSize, int NumBlocks>
+class PrefetchRing
+{
+public:
+
+    static_assert (BlockSize > 0 && NumBlocks > 0, "a prefetch ring needs at least one block");
+
+    /** @Returns the file offset the next read() starts from */
+    uint32_t getPosition() const { return position; }
+
+    /** @Returns the end of the region being read */
+    uint32_t getEndOffset() const { return endOffset; }
+
+    /** @Returns the hit, miss and stall counters */
+    PrefetchStats getStats() const { return stats; }
+
+    /** Clears the counters */
+    void resetStats() { memset (&stats, 0, sizeof (stats)); }
+
+protected:
+
+    //=============================================================
+    PrefetchRing()
+    {
+        endOffset = 0;
+        firstOffset = 0;
+        numBufferedBytes = 0;
+        headBlock = 0;
+        numBlocksFilled = 0;
+        position = 0;
+        lastReadEnd = 0;
+        numSequentialReads = 0;
+        generation = 0;
+        resetStats();
+    }
+
+    void startRegion (uint32_t startOffset, uint32_t endOffset_)
+    {
+        endOffset = endOffset_;
+        position = startOffset;
+        lastReadEnd = startOffset;
+        numSequentialReads = 1;     // reading usually starts at the beginning and carries on
+        emptyRing (startOffset);
+    }
+
+    /** Forgets the buffered blocks and lines the ring up with the block holding an offset */
+    void emptyRing (uint32_t offset)
+    {
+        uint32_t alignedOffset = offset - offset % BlockSize;
+
+        // an empty ring that is already in place is left alone, so a block on its way in still lands
+        if (numBlocksFilled == 0 && alignedOffset == firstOffset)
+            return;
+
+        generation++;
+        firstOffset = alignedOffset;
+        numBufferedBytes = 0;
+        headBlock = 0;
+        numBlocksFilled = 0;
+    }
+
+    /** Frees the blocks that end before an offset. A backwards jump empties the ring */
+    void dropBlocksBefore (uint32_t offset)
+    {
+        if (offset < firstOffset)
+        {
+            emptyRing (offset);
+            return;
+        }
+
+        while (numBlocksFilled > 0 && numBufferedBytes >= (uint32_t) BlockSize && offset >= firstOffset + BlockSize)
+        {
+            headBlock = (headBlock + 1) % NumBlocks;
+            numBlocksFilled--;
+            firstOffset += BlockSize;
+            numBufferedBytes -= BlockSize;
+        }
+
+        if (numBlocksFilled == 0)
+            emptyRing (offset);
+    }
+
+    bool isBuffered (uint32_t offset) const
+    {
+        return offset >= firstOffset && offset < firstOffset + numBufferedBytes;
+    }
+
+    /** Copies buffered bytes from an offset, up to the end of its block. @Returns the number copied */
+    int copyFromRing (uint32_t offset, uint8_t* destination, int maxBytes) const
+    {
+        uint32_t blockIndex = (offset - firstOffset) / BlockSize;
+        uint32_t offsetInBlock = (offset - firstOffset) % BlockSize;
+        int slot = (int)((headBlock + blockIndex) % NumBlocks);
+
+        uint32_t numAvailable = BlockSize - offsetInBlock;
+
+        if (numAvailable > firstOffset + numBufferedBytes - offset)
+            numAvailable = firstOffset + numBufferedBytes - offset;
+
+        int numBytes = (uint32_t) maxBytes < numAvailable ? maxBytes : (int) numAvailable;
+        memcpy (destination, buffer + slot * BlockSize + offsetInBlock, numBytes);
+        return numBytes;
+    }
+
+    /** Works out the next read-ahead: up to maxBlocks free blocks that follow the buffered
+     * ones, in the file and in memory.
+     * @Returns the number of bytes to read, or 0 if the ring is full or the region has been read
+     */
+    uint32_t getNextFill (int maxBlocks, uint32_t& offset, uint8_t*& destination)
+    {
+        // a short block only ever comes at the end of the region
+        if (numBlocksFilled >= NumBlocks || maxBlocks <= 0 || numBufferedBytes != (uint32_t) numBlocksFilled * BlockSize)
+            return 0;
+
+        offset = firstOffset + numBufferedBytes;
+
+        if (offset >= endOffset)
+            return 0;
+
+        int tail = (headBlock + numBlocksFilled) % NumBlocks;
+        int numBlocks = maxBlocks;
+
+        if (numBlocks > NumBlocks - numBlocksFilled)
+            numBlocks = NumBlocks - numBlocksFilled;
+
+        if (numBlocks > NumBlocks - tail)
+            numBlocks = NumBlocks - tail;
+
+        uint32_t numBytes = (uint32_t) numBlocks * BlockSize;
+
+        if (numBytes > endOffset - offset)
+            numBytes = endOffset - offset;
+
+        destination = buffer + tail * BlockSize;
+        return numBytes;
+    }
+
+    /** Adds the result of a read set up by getNextFill() to the ring */
+    void commitFill (uint32_t numBytesRequested, int numBytesRead)
+    {
+        stats.numFileReads++;
+
+        if (numBytesRead <= 0)
+        {
+            // the file is shorter than the region said
+            endOffset = firstOffset + numBufferedBytes;
+            return;
+        }
+
+        stats.numBytesFromFile += numBytesRead;
+        numBufferedBytes += numBytesRead;
+        numBlocksFilled += (numBytesRead + BlockSize - 1) / BlockSize;
+
+        if ((uint32_t) numBytesRead < numBytesRequested)
+            endOffset = firstOffset + numBufferedBytes;
+    }
+
+    /** Updates the access pattern at the start of a read() */
+    void noteReadStart()
+    {
+        numSequentialReads = position == lastReadEnd ? numSequentialReads + 1 : 0;
+    }
+
+    bool isSequential() const
+    {
+        return numSequentialReads > 0;
+    }
+
+    /** @Returns the number of blocks covering numBytes from the read position */
+    int getNumBlocksNeeded (int numBytes) const
+    {
+        int numBlocks = (int)((position % BlockSize + numBytes + BlockSize - 1) / BlockSize);
+        return numBlocks < NumBlocks ? numBlocks : NumBlocks;
+    }
+
+    void noteReadEnd (bool waited, uint32_t stallMicros)
+    {
+        lastReadEnd = position;
+
+        if (waited)
+        {
+            stats.numMisses++;
+            stats.stallMicros += stallMicros;
+        }
+        else
+        {
+            stats.numHits++;
+        }
+    }
+
+    //=============================================================
+    uint8_t buffer[BlockSize * NumBlocks];
+    uint32_t endOffset;
+    uint32_t firstOffset;           // file offset of the head block
+    uint32_t numBufferedBytes;      // bytes buffered from firstOffset on
+    int headBlock;
+    int numBlocksFilled;
+    uint32_t position;
+    uint32_t lastReadEnd;
+    int numSequentialReads;
+    uint32_t generation;            // changes whenever the ring is emptied
+    PrefetchStats stats;
+};
+
+//=============================================================
+/** Read-ahead on the caller's thread */
+template <int BlockSize = AUDIOFILE_READ_BLOCK_SIZE, int NumBlocks = AUDIOFILE_READ_AHEAD_BLOCKS>
+class PrefetchReader : public PrefetchRing<BlockSize, NumBlocks>
+{
+public:
+
+    /** Starts reading the bytes from startOffset up to endOffset of a file */
+    void attach (File file, uint32_t startOffset, uint32_t endOffset);
+
+    /** Stops using the file (it is not closed) */
+    void detach();
+
+    /** Moves the read position. Nothing is read until the next read() */
+    bool seek (uint32_t offset);
+
+    /** Reads up to numBytes from the read position and advances it.
+     * @Returns the number of bytes read, which is less than numBytes at the end of the region
+     */
+    int read (uint8_t* destination, int numBytes);
+
+    /** Tops up the read-ahead while reads are sequential. Call it when there is time to spare */
+    void prefetch();
+
+private:
+
+    //=============================================================
+    typedef PrefetchRing<BlockSize, NumBlocks> Ring;
+
+    void fill (int maxBlocks);
+
+    //=============================================================
+    File file;
+    uint32_t filePosition;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+void PrefetchReader<BlockSize, NumBlocks>::attach (File file_, uint32_t startOffset, uint32_t endOffset)
+{
+    file = file_;
+    filePosition = 0xFFFFFFFF;
+    Ring::startRegion (startOffset, endOffset);
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+void PrefetchReader<BlockSize, NumBlocks>::detach()
+{
+    file = File();
+    Ring::startRegion (0, 0);
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+bool PrefetchReader<BlockSize, NumBlocks>::seek (uint32_t offset)
+{
+    if (offset > Ring::endOffset)
+        return false;
+
+    Ring::position = offset;
+    return true;
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+int PrefetchReader<BlockSize, NumBlocks>::read (uint8_t* destination, int numBytes)
+{
+    Ring::noteReadStart();
+
+    bool waited = false;
+    uint32_t stallMicros = 0;
+    int numRead = 0;
+
+    while (numRead < numBytes && Ring::position < Ring::endOffset)
+    {
+        Ring::dropBlocksBefore (Ring::position);
+
+        if (! Ring::isBuffered (Ring::position))
+        {
+            // sequential reads refill the whole ring in one go, random ones just what they need
+            unsigned long start = micros();
+            fill (Ring::isSequential() ? NumBlocks : Ring::getNumBlocksNeeded (numBytes - numRead));
+            stallMicros += (uint32_t)(micros() - start);
+            waited = true;
+
+            if (! Ring::isBuffered (Ring::position))
+                break;
+        }
+
+        int n = Ring::copyFromRing (Ring::position, destination + numRead, numBytes - numRead);
+        numRead += n;
+        Ring::position += n;
+    }
+
+    Ring::noteReadEnd (waited, stallMicros);
+    return numRead;
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+void PrefetchReader<BlockSize, NumBlocks>::prefetch()
+{
+    if (! Ring::isSequential())
+        return;
+
+    Ring::dropBlocksBefore (Ring::position);
+    fill (NumBlocks);
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+void PrefetchReader<BlockSize, NumBlocks>::fill (int maxBlocks)
+{
+    uint32_t offset;
+    uint8_t* destination;
+    uint32_t numBytes;
+
+    while ((numBytes = Ring::getNextFill (maxBlocks, offset, destination)) > 0)
+    {
+        if (filePosition != offset && ! file.seek (offset))
+        {
+            Ring::commitFill (numBytes, 0);
+            return;
+        }
+
+        int numBytesRead = file.read (destination, numBytes);
+        filePosition = offset + (numBytesRead > 0 ? numBytesRead : 0);
+        Ring::commitFill (numBytes, numBytesRead);
+
+        if (numBytesRead < (int) numBytes)
+            return;
+
+        maxBlocks -= (int)(numBytes / BlockSize);
+    }
+}
+
+#ifndef ARDUINO
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//=============================================================
+/** Host only: read-ahead on a background thread. While reads are sequential the
+ * thread keeps the ring full, so read() only waits if decoding outruns the disk.
+ */
+template <int BlockSize = AUDIOFILE_READ_BLOCK_SIZE, int NumBlocks = AUDIOFILE_READ_AHEAD_BLOCKS>
+class AsyncPrefetchReader : public PrefetchRing<BlockSize, NumBlocks>
+{
+public:
+
+    AsyncPrefetchReader();
+
+    /** Destructor. Stops the background thread */
+    ~AsyncPrefetchReader();
+
+    /** Starts reading the bytes from startOffset up to endOffset of a file */
+    void attach (File file, uint32_t startOffset, uint32_t endOffset);
+
+    /** Stops the background thread and stops using the file (it is not closed) */
+    void detach();
+
+    /** Moves the read position. Nothing is read until the next read() */
+    bool seek (uint32_t offset);
+
+    /** Reads up to numBytes from the read position and advances it.
+     * @Returns the number of bytes read, which is less than numBytes at the end of the region
+     */
+    int read (uint8_t* destination, int numBytes);
+
+    /** Does nothing: the background thread prefetches. Here so the readers can be swapped */
+    void prefetch() {}
+
+    /** @Returns the hit, miss and stall counters */
+    PrefetchStats getStats();
+
+    /** Clears the counters */
+    void resetStats();
+
+private:
+
+    //=============================================================
+    typedef PrefetchRing<BlockSize, NumBlocks> Ring;
+
+    void run();
+
+    //=============================================================
+    File file;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wakeWorker;
+    std::condition_variable dataArrived;
+    int numBlocksWanted;        // blocks a waiting read() needs, or 0
+    bool shouldStop;
+};
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+AsyncPrefetchReader<BlockSize, NumBlocks>::AsyncPrefetchReader()
+{
+    numBlocksWanted = 0;
+    shouldStop = false;
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+AsyncPrefetchReader<BlockSize, NumBlocks>::~AsyncPrefetchReader()
+{
+    detach();
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+void AsyncPrefetchReader<BlockSize, NumBlocks>::attach (File file_, uint32_t startOffset, uint32_t endOffset)
+{
+    detach();
+
+    file = file_;
+    Ring::startRegion (startOffset, endOffset);
+    numBlocksWanted = 0;
+    shouldStop = false;
+    thread = std::thread (&AsyncPrefetchReader::run, this);
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+void AsyncPrefetchReader<BlockSize, NumBlocks>::detach()
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard (lock);
+            shouldStop = true;
+        }
+
+        wakeWorker.notify_all();
+        thread.join();
+    }
+
+    file = File();
+    Ring::startRegion (0, 0);
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+bool AsyncPrefetchReader<BlockSize, NumBlocks>::seek (uint32_t offset)
+{
+    std::lock_guard<std::mutex> guard (lock);
+
+    if (offset > Ring::endOffset)
+        return false;
+
+    Ring::position = offset;
+    return true;
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+int AsyncPrefetchReader<BlockSize, NumBlocks>::read (uint8_t* destination, int numBytes)
+{
+    std::unique_lock<std::mutex> guard (lock);
+    Ring::noteReadStart();
+
+    bool waited = false;
+    uint32_t stallMicros = 0;
+    int numRead = 0;
+
+    while (numRead < numBytes && Ring::position < Ring::endOffset)
+    {
+        Ring::dropBlocksBefore (Ring::position);
+
+        if (! Ring::isBuffered (Ring::position))
+        {
+            unsigned long start = micros();
+            numBlocksWanted = Ring::getNumBlocksNeeded (numBytes - numRead);
+            wakeWorker.notify_one();
+
+            dataArrived.wait (guard, [this]
+            {
+                return Ring::isBuffered (Ring::position) || Ring::position >= Ring::endOffset || shouldStop;
+            });
+
+            numBlocksWanted = 0;
+            stallMicros += (uint32_t)(micros() - start);
+            waited = true;
+
+            if (! Ring::isBuffered (Ring::position))
+                break;
+        }
+
+        int n = Ring::copyFromRing (Ring::position, destination + numRead, numBytes - numRead);
+        numRead += n;
+        Ring::position += n;
+    }
+
+    Ring::noteReadEnd (waited, stallMicros);
+
+    // consumed blocks make room for more read-ahead
+    Ring::dropBlocksBefore (Ring::position);
+    guard.unlock();
+    wakeWorker.notify_one();
+
+    return numRead;
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+PrefetchStats AsyncPrefetchReader<BlockSize, NumBlocks>::getStats()
+{
+    std::lock_guard<std::mutex> guard (lock);
+    return Ring::getStats();
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+void AsyncPrefetchReader<BlockSize, NumBlocks>::resetStats()
+{
+    std::lock_guard<std::mutex> guard (lock);
+    Ring::resetStats();
+}
+
+//=============================================================
+template <int BlockSize, int NumBlocks>
+void AsyncPrefetchReader<BlockSize, NumBlocks>::run()
+{
+    uint32_t filePosition = 0xFFFFFFFF;
+    std::unique_lock<std::mutex> guard (lock);
+
+    while (! shouldStop)
+    {
+        // read ahead while access is sequential, otherwise only fetch what a waiting read needs
+        int maxBlocks = Ring::isSequential() ? NumBlocks : numBlocksWanted;
+
+        // unless a read is waiting, let half the ring drain so each file read covers several blocks
+        if (numBlocksWanted == 0 && Ring::numBlocksFilled > NumBlocks / 2)
+            maxBlocks = 0;
+
+        uint32_t offset;
+        uint8_t* destination;
+        uint32_t numBytes = Ring::getNextFill (maxBlocks, offset, destination);
+
+        if (numBytes == 0)
+        {
+            dataArrived.notify_all();
+            wakeWorker.wait (guard);
+            continue;
+        }
+
+        uint32_t generation = Ring::generation;
+
+        // the blocks being filled are outside the buffered range, so the reader leaves them alone
+        guard.unlock();
+        int numBytesRead = filePosition == offset || file.seek (offset) ? file.read (destination, numBytes) : 0;
+        filePosition = numBytesRead > 0 ? offset + numBytesRead : 0xFFFFFFFF;
+        guard.lock();
+
+        if (generation == Ring::generation)
+            Ring::commitFill (numBytes, numBytesRead);
+
+        dataArrived.notify_all();
+    }
+}
+
+#endif /* ARDUINO */
+
+#endif /* PrefetchReader_h */
@@ -0,0 +1,107 @@
+#ifndef ProbeBatch_h
+#define ProbeBatch_h
+
+/** Host-only batch probing: describes every WAV, FLAC and MP3 file in a directory,
+ * spreading the files over several threads. Each probe reads only a file's headers
+ * (a FLAC file's STREAMINFO, or an MP3 file's first frames), so this is bound by
+ * file open latency rather than by the size of the files. FLAC and MP3 files come
+ * back invalid if AUDIOFILE_WITH_FLAC or AUDIOFILE_WITH_MP3 has left them out.
+ * On Arduino builds this header is empty.
+ */
+#ifndef ARDUINO
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <strings.h>
+#include "AudioFile.h"
+
+//=============================================================
+/** One file found by probeDirectory() */
+struct ProbedAudioFile
+{
+    String filePath;
+    AudioFileInfo info;
+};
+
+//=============================================================
+/** Probes a list of files in parallel.
+ * @param numThreads the number of worker threads, or 0 to use one per hardware thread
+ * @Returns one entry per file, in the same order as filePaths
+ */
+inline std::vector<ProbedAudioFile> probeFiles (const std::vector<String>& filePaths, int numThreads = 0)
+{
+    std::vector<ProbedAudioFile> results (filePaths.size());
+
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+
+    if (numThreads <= 0)
+        numThreads = 1;
+
+    if ((size_t)numThreads > filePaths.size())
+        numThreads = (int)filePaths.size();
+
+    // workers take the next unprobed file until there are none left
+    std::atomic<size_t> nextIndex (0);
+
+    auto worker = [&]()
+    {
+        for (size_t i = nextIndex++; i < filePaths.size(); i = nextIndex++)
+        {
+            results[i].filePath = filePaths[i];
+            results[i].info = probeAudioFile (filePaths[i]);
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (int t = 1; t < numThreads; t++)
+        threads.push_back (std::thread (worker));
+
+    worker();
+
+    for (auto& thread : threads)
+        thread.join();
+
+    return results;
+}
+
+//=============================================================
+/** Probes every .wav, .flac and .mp3 file (not recursing into sub-directories) in a directory in parallel.
+ * @Returns one entry per file, sorted by file name
+ */
+inline std::vector<ProbedAudioFile> probeDirectory (const String& directoryPath, int numThreads = 0)
+{
+    std::vector<std::string> fileNames;
+
+    if (DIR* directory = opendir (directoryPath.c_str()))
+    {
+        while (dirent* entry = readdir (directory))
+        {
+            const char* extension = strrchr (entry->d_name, '.');
+
+            if (extension != nullptr && extension != entry->d_name
+                && (strcasecmp (extension, ".wav") == 0 || strcasecmp (extension, ".flac") == 0 || strcasecmp (extension, ".mp3") == 0))
+                fileNames.push_back (entry->d_name);
+        }
+
+        closedir (directory);
+    }
+
+    std::sort (fileNames.begin(), fileNames.end());
+
+    std::vector<String> filePaths;
+
+    for (const auto& fileName : fileNames)
+        filePaths.push_back (directoryPath + "/" + fileName.c_str());
+
+    return probeFiles (filePaths, numThreads);
+}
+
+#endif /* ARDUINO */
+
+#endif /* ProbeBatch_h */
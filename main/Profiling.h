@@ -0,0 +1,361 @@
+#ifndef Profiling_h
+#define Profiling_h
+
+/** Optional per-stage profiling of the codec.
+ *
+ * Define AUDIOFILE_PROFILING before including AudioFile.h (or pass
+ * -DAUDIOFILE_PROFILING) to have each stage of loading, saving and streaming
+ * record how long it took, how many bytes it handled and how many heap
+ * allocations it made. The results are read at runtime from a ProfileStats,
+ * e.g. audioFile.getProfileStats().print().
+ *
+ * Time is measured in ticks of the fastest counter the platform has:
+ *
+ *      Cortex-M3/M4/M7     DWT cycle counter (CPU cycles)
+ *      other Arduinos      micros()
+ *      x86 hosts           rdtsc
+ *      other hosts         std::chrono::steady_clock (nanoseconds)
+ *
+ * Without AUDIOFILE_PROFILING the macros below expand to nothing, the
+ * arguments are never evaluated and no stats are stored, so the hooks can
+ * be left in production firmware.
+ */
+
+#ifdef AUDIOFILE_PROFILING
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#ifndef ARDUINO
+ #include <atomic>
+ #include <chrono>
+ #if defined (__x86_64__) || defined (__i386__)
+  #include <x86intrin.h>
+ #endif
+#endif
+
+//=============================================================
+/** The stages of the codec that are timed */
+enum class ProfileStage
+{
+    FileRead,
+    HeaderParse,
+    Decode,
+    Encode,
+    FileWrite,
+    NumStages
+};
+
+//=============================================================
+namespace Profiling
+{
+#if defined (ARDUINO) && (defined (__ARM_ARCH_7M__) || defined (__ARM_ARCH_7EM__) || defined (__ARM_ARCH_8M_MAIN__))
+    #define AUDIOFILE_PROFILING_DWT 1
+    typedef uint32_t Ticks;
+#elif defined (ARDUINO)
+    typedef unsigned long Ticks;
+#else
+    typedef uint64_t Ticks;
+#endif
+
+#ifdef AUDIOFILE_PROFILING_DWT
+    // Cortex-M debug registers
+    static volatile uint32_t& DEMCR = *(volatile uint32_t*)0xE000EDFC;
+    static volatile uint32_t& DWT_CTRL = *(volatile uint32_t*)0xE0001000;
+    static volatile uint32_t& DWT_CYCCNT = *(volatile uint32_t*)0xE0001004;
+
+    #ifndef F_CPU
+    extern "C" uint32_t SystemCoreClock;
+    #endif
+#endif
+
+    /** Starts the cycle counter if the platform needs it started. Safe to call more than once */
+    inline void enableCounter()
+    {
+#ifdef AUDIOFILE_PROFILING_DWT
+        DEMCR |= (1UL << 24);       // TRCENA
+        DWT_CTRL |= 1UL;            // CYCCNTENA
+#endif
+    }
+
+    /** @Returns the current value of the tick counter */
+    inline Ticks getTicks()
+    {
+#if defined (AUDIOFILE_PROFILING_DWT)
+        return DWT_CYCCNT;
+#elif defined (ARDUINO)
+        return micros();
+#elif defined (__x86_64__) || defined (__i386__)
+        return (Ticks)__rdtsc();
+#else
+        return (Ticks)std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /** @Returns the number of ticks per second */
+    inline double getTicksPerSecond()
+    {
+#if defined (AUDIOFILE_PROFILING_DWT)
+  #ifdef F_CPU
+        return (double)F_CPU;
+  #else
+        return (double)SystemCoreClock;
+  #endif
+#elif defined (ARDUINO)
+        return 1.e6;
+#elif defined (__x86_64__) || defined (__i386__)
+        // the TSC rate isn't exposed portably, so measure it once against the steady clock
+        static double ticksPerSecond = []
+        {
+            auto start = std::chrono::steady_clock::now();
+            Ticks startTicks = getTicks();
+
+            while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds (20)) {}
+
+            double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+            return (double)(getTicks() - startTicks) / seconds;
+        }();
+
+        return ticksPerSecond;
+#else
+        return 1.e9;
+#endif
+    }
+
+#ifdef ARDUINO
+    typedef volatile uint32_t AllocationCounter;
+#else
+    typedef std::atomic<uint32_t> AllocationCounter;
+#endif
+
+    /** @Returns the process-wide count of allocations made by the library's containers */
+    inline AllocationCounter& getAllocationCounter()
+    {
+        static AllocationCounter counter (0);
+        return counter;
+    }
+
+    inline uint32_t getNumAllocations()
+    {
+        return getAllocationCounter();
+    }
+
+    inline void countAllocation()
+    {
+        getAllocationCounter()++;
+    }
+}
+
+//=============================================================
+/** The totals for one stage */
+struct StageStats
+{
+    uint32_t numCalls;
+    uint64_t ticks;
+    uint64_t numBytes;
+    uint32_t numAllocations;
+};
+
+//=============================================================
+/** Totals for every stage, accumulated until reset() is called */
+class ProfileStats
+{
+public:
+
+    /** Constructor */
+    ProfileStats();
+
+    /** Clears all the totals */
+    void reset();
+
+    /** @Returns the totals for a stage */
+    const StageStats& get (ProfileStage stage) const;
+
+    /** @Returns the time spent in a stage, in seconds */
+    double getSeconds (ProfileStage stage) const;
+
+    /** @Returns the throughput of a stage in bytes per second, or 0 if it hasn't run */
+    double getBytesPerSecond (ProfileStage stage) const;
+
+    /** Adds one run of a stage to its totals */
+    void add (ProfileStage stage, Profiling::Ticks ticks, uint32_t numBytes, uint32_t numAllocations);
+
+    /** Prints a line per stage that has run to the console */
+    void print() const;
+
+    /** @Returns the name of a stage */
+    static const char* getStageName (ProfileStage stage);
+
+private:
+
+    //=============================================================
+    StageStats stages[(int)ProfileStage::NumStages];
+};
+
+//=============================================================
+/** Times one run of a stage, from start() to stop() */
+class ProfileTimer
+{
+public:
+
+    void start()
+    {
+        startAllocations = Profiling::getNumAllocations();
+        startTicks = Profiling::getTicks();
+    }
+
+    void stop (ProfileStats& stats, ProfileStage stage, uint32_t numBytes)
+    {
+        Profiling::Ticks elapsed = Profiling::getTicks() - startTicks;
+        stats.add (stage, elapsed, numBytes, Profiling::getNumAllocations() - startAllocations);
+    }
+
+private:
+
+    //=============================================================
+    uint32_t startAllocations;
+    Profiling::Ticks startTicks;
+};
+
+//=============================================================
+/** Times the enclosing scope as one run of a stage */
+class ProfileScope
+{
+public:
+
+    ProfileScope (ProfileStats& stats_, ProfileStage stage_, uint32_t numBytes_)
+        : stats (stats_), stage (stage_), numBytes (numBytes_)
+    {
+        timer.start();
+    }
+
+    ~ProfileScope()
+    {
+        timer.stop (stats, stage, numBytes);
+    }
+
+private:
+
+    //=============================================================
+    ProfileStats& stats;
+    ProfileStage stage;
+    uint32_t numBytes;
+    ProfileTimer timer;
+};
+
+#define AUDIOFILE_PROFILE_JOIN2(a, b) a##b
+#define AUDIOFILE_PROFILE_JOIN(a, b) AUDIOFILE_PROFILE_JOIN2 (a, b)
+
+/** Times the rest of the enclosing scope as a run of a stage that handles numBytes */
+#define AUDIOFILE_PROFILE_STAGE(stats, stage, numBytes) \
+    ProfileScope AUDIOFILE_PROFILE_JOIN (profileScope, __LINE__) (stats, stage, (uint32_t)(numBytes))
+
+/** Starts a named timer, for stages that don't match a scope */
+#define AUDIOFILE_PROFILE_START(timer) \
+    ProfileTimer timer; \
+    timer.start()
+
+/** Stops a timer started with AUDIOFILE_PROFILE_START and adds the run to a stage */
+#define AUDIOFILE_PROFILE_STOP(timer, stats, stage, numBytes) \
+    timer.stop (stats, stage, (uint32_t)(numBytes))
+
+/** Counts a heap allocation made by one of the library's containers */
+#define AUDIOFILE_PROFILE_ALLOCATION() Profiling::countAllocation()
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+inline ProfileStats::ProfileStats()
+{
+    Profiling::enableCounter();
+    reset();
+}
+
+//=============================================================
+inline void ProfileStats::reset()
+{
+    for (int i = 0; i < (int)ProfileStage::NumStages; i++)
+        stages[i] = StageStats { 0, 0, 0, 0 };
+}
+
+//=============================================================
+inline const StageStats& ProfileStats::get (ProfileStage stage) const
+{
+    return stages[(int)stage];
+}
+
+//=============================================================
+inline double ProfileStats::getSeconds (ProfileStage stage) const
+{
+    return (double)stages[(int)stage].ticks / Profiling::getTicksPerSecond();
+}
+
+//=============================================================
+inline double ProfileStats::getBytesPerSecond (ProfileStage stage) const
+{
+    double seconds = getSeconds (stage);
+    return seconds > 0. ? (double)stages[(int)stage].numBytes / seconds : 0.;
+}
+
+//=============================================================
+inline void ProfileStats::add (ProfileStage stage, Profiling::Ticks ticks, uint32_t numBytes, uint32_t numAllocations)
+{
+    StageStats& s = stages[(int)stage];
+    s.numCalls++;
+    s.ticks += ticks;
+    s.numBytes += numBytes;
+    s.numAllocations += numAllocations;
+}
+
+//=============================================================
+inline void ProfileStats::print() const
+{
+    for (int i = 0; i < (int)ProfileStage::NumStages; i++)
+    {
+        ProfileStage stage = (ProfileStage)i;
+        const StageStats& s = stages[i];
+
+        if (s.numCalls == 0)
+            continue;
+
+        Serial.print (getStageName (stage));
+        Serial.print (": ");
+        Serial.print ((unsigned long)s.numCalls);
+        Serial.print (" calls, ");
+        Serial.print (getSeconds (stage) * 1000., 3);
+        Serial.print (" ms, ");
+        Serial.print ((unsigned long)s.numBytes);
+        Serial.print (" bytes, ");
+        Serial.print (getBytesPerSecond (stage) / 1.e6, 2);
+        Serial.print (" MB/s, ");
+        Serial.print ((unsigned long)s.numAllocations);
+        Serial.println (" allocations");
+    }
+}
+
+//=============================================================
+inline const char* ProfileStats::getStageName (ProfileStage stage)
+{
+    switch (stage)
+    {
+        case ProfileStage::FileRead:    return "File read";
+        case ProfileStage::HeaderParse: return "Header parse";
+        case ProfileStage::Decode:      return "Decode";
+        case ProfileStage::Encode:      return "Encode";
+        case ProfileStage::FileWrite:   return "File write";
+        default:                        return "Unknown";
+    }
+}
+
+#else
+
+#define AUDIOFILE_PROFILE_STAGE(stats, stage, numBytes)
+#define AUDIOFILE_PROFILE_START(timer)
+#define AUDIOFILE_PROFILE_STOP(timer, stats, stage, numBytes)
+#define AUDIOFILE_PROFILE_ALLOCATION()
+
+#endif /* AUDIOFILE_PROFILING */
+
+#endif /* Profiling_h */
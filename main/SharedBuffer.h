@@ -0,0 +1,235 @@
+#ifndef SharedBuffer_h
+#define SharedBuffer_h
+
+#include "DynamicArray.h"
+
+#ifndef ARDUINO
+ #include <atomic>
+#endif
+
+/** A copy-on-write sample buffer with the same methods as DynamicArray<DynamicArray<T>>.
+ *
+ * Copies share one reference counted set of channels, so copying an AudioFile or
+ * its samples costs a counter increment however long the audio is. The first
+ * change made through any copy (a non-const operator[], resize() or clear())
+ * gives that copy its own channels, and the others keep the original:
+ *
+ *      AudioFile<float, SharedAllocation> original;
+ *      original.load ("/drums.wav");
+ *
+ *      AudioFile<float, SharedAllocation> edit = original;  // nothing copied yet
+ *      edit.samples[0][0] = 0.f;                             // now the channels are copied
+ *
+ * Read through a const reference to keep sharing: the non-const operator[] has to
+ * assume the caller is about to write. The count is atomic on hosts, so copies
+ * can be read and released on different threads; making one unique while another
+ * thread copies the same object still needs a lock.
+ *
+ * AudioFile uses it as its sample buffer with SharedAllocation (see Allocation.h).
+ */
+template <class T>
+class SharedBuffer
+{
+public:
+
+    typedef DynamicArray<DynamicArray<T>> Channels;
+
+    SharedBuffer();
+    SharedBuffer (const SharedBuffer<T>&);
+    SharedBuffer (SharedBuffer<T>&&);
+    ~SharedBuffer();
+    SharedBuffer& operator = (const SharedBuffer<T>&);
+    SharedBuffer& operator = (SharedBuffer<T>&&);
+
+    /** @Returns one channel to be changed, copying the channels first if they are shared */
+    DynamicArray<T>& operator [] (int channel);
+
+    /** @Returns one channel to be read, without copying anything */
+    const DynamicArray<T>& operator [] (int channel) const;
+
+    /** @Returns the number of channels */
+    int size() const;
+
+    /** Changes the number of channels. New channels are empty */
+    void resize (int numChannels);
+
+    /** Removes all channels. Other copies keep theirs */
+    void clear();
+
+    /** @Returns true if another buffer shares these channels */
+    bool isShared() const;
+
+    /** @Returns the number of buffers sharing these channels (0 for an empty buffer) */
+    int getNumReferences() const;
+
+private:
+
+    //=============================================================
+    struct Block
+    {
+        Block() : numReferences (1) {}
+
+    #ifdef ARDUINO
+        int numReferences;
+    #else
+        std::atomic<int> numReferences;
+    #endif
+        Channels channels;
+    };
+
+    //=============================================================
+    void makeUnique();
+    void release();
+
+    //=============================================================
+    // nullptr until there is a channel to hold, so an empty buffer never allocates
+    Block* block;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T>
+SharedBuffer<T>::SharedBuffer()
+{
+    block = nullptr;
+}
+
+//=============================================================
+template <class T>
+SharedBuffer<T>::SharedBuffer (const SharedBuffer<T>& other)
+{
+    block = other.block;
+
+    if (block != nullptr)
+        block->numReferences++;
+}
+
+//=============================================================
+template <class T>
+SharedBuffer<T>::SharedBuffer (SharedBuffer<T>&& other)
+{
+    block = other.block;
+    other.block = nullptr;
+}
+
+//=============================================================
+template <class T>
+SharedBuffer<T>::~SharedBuffer()
+{
+    release();
+}
+
+//=============================================================
+template <class T>
+SharedBuffer<T>& SharedBuffer<T>::operator = (const SharedBuffer<T>& other)
+{
+    // take the new reference first, so assigning a buffer to itself doesn't free it
+    Block* newBlock = other.block;
+
+    if (newBlock != nullptr)
+        newBlock->numReferences++;
+
+    release();
+    block = newBlock;
+    return *this;
+}
+
+//=============================================================
+template <class T>
+SharedBuffer<T>& SharedBuffer<T>::operator = (SharedBuffer<T>&& other)
+{
+    if (this != &other)
+    {
+        release();
+        block = other.block;
+        other.block = nullptr;
+    }
+
+    return *this;
+}
+
+//=============================================================
+template <class T>
+DynamicArray<T>& SharedBuffer<T>::operator [] (int channel)
+{
+    makeUnique();
+    return block->channels[channel];
+}
+
+//=============================================================
+template <class T>
+const DynamicArray<T>& SharedBuffer<T>::operator [] (int channel) const
+{
+    return block->channels[channel];
+}
+
+//=============================================================
+template <class T>
+int SharedBuffer<T>::size() const
+{
+    return block != nullptr ? block->channels.size() : 0;
+}
+
+//=============================================================
+template <class T>
+void SharedBuffer<T>::resize (int numChannels)
+{
+    if (numChannels == size() && ! isShared())
+        return;
+
+    makeUnique();
+    block->channels.resize (numChannels);
+}
+
+//=============================================================
+template <class T>
+void SharedBuffer<T>::clear()
+{
+    release();
+}
+
+//=============================================================
+template <class T>
+bool SharedBuffer<T>::isShared() const
+{
+    return block != nullptr && block->numReferences > 1;
+}
+
+//=============================================================
+template <class T>
+int SharedBuffer<T>::getNumReferences() const
+{
+    return block != nullptr ? (int) block->numReferences : 0;
+}
+
+//=============================================================
+template <class T>
+void SharedBuffer<T>::makeUnique()
+{
+    if (block == nullptr)
+    {
+        block = new Block();
+    }
+    else if (block->numReferences > 1)
+    {
+        Block* copy = new Block();
+        copy->channels = block->channels;
+        release();
+        block = copy;
+    }
+}
+
+//=============================================================
+template <class T>
+void SharedBuffer<T>::release()
+{
+    if (block != nullptr && --block->numReferences == 0)
+        delete block;
+
+    block = nullptr;
+}
+
+#endif /* SharedBuffer_h */
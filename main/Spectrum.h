@@ -0,0 +1,703 @@
+#ifndef Spectrum_h
+#define Spectrum_h
+
+#include <math.h>
+#include <stdint.h>
+#include "DynamicArray.h"
+
+/** Spectral analysis for audio loaded into an AudioFile, or for blocks of
+ * samples coming out of a decoder.
+ *
+ * All transforms have a compile time size so that twiddle and window tables
+ * are plain arrays inside the object and nothing is allocated at run time.
+ *
+ * Spectra are returned in packed form inside the caller's buffer of N values:
+ *
+ *      buffer[0]           DC (real)
+ *      buffer[1]           Nyquist (real)
+ *      buffer[2k], [2k+1]  real and imaginary part of bin k, for 0 < k < N/2
+ */
+
+//=============================================================
+/** Window shapes that can be applied before a transform */
+enum class WindowType
+{
+    Rectangular,
+    Hann,
+    Hamming,
+    Blackman
+};
+
+//=============================================================
+/** Floating point real-input FFT of size N (a power of two, at least 4).
+ * The N/2 point complex transform inside runs in radix-4 passes with a
+ * single radix-2 pass when log2 (N/2) is odd.
+ */
+template <class T, int N>
+class RealFFT
+{
+public:
+
+    static_assert (N >= 4 && (N & (N - 1)) == 0, "FFT size must be a power of two and at least 4");
+
+    /** Constructor. Computes the twiddle and bit reversal tables */
+    RealFFT();
+
+    /** Transforms N real samples in place into the packed spectrum described above */
+    void forward (T* buffer);
+
+    /** @Returns the size of the transform */
+    static int getSize() { return N; }
+
+    /** @Returns the number of magnitude bins, including DC and Nyquist */
+    static int getNumBins() { return N / 2 + 1; }
+
+private:
+
+    //=============================================================
+    static const int M = N / 2;
+
+    void complexTransform (T* data);
+
+    //=============================================================
+    T cosTable[M];
+    T sinTable[M];
+    uint16_t bitReverseTable[M];
+};
+
+//=============================================================
+/** Fixed point (Q15) real-input FFT of size N for devices without an FPU.
+ * The input is halved once and every butterfly stage is scaled down by one bit
+ * so the transform can never overflow; the packed output is therefore the true
+ * spectrum divided by N.
+ */
+template <int N>
+class RealFFTQ15
+{
+public:
+
+    static_assert (N >= 4 && (N & (N - 1)) == 0, "FFT size must be a power of two and at least 4");
+
+    /** Constructor. Computes the Q15 twiddle and bit reversal tables */
+    RealFFTQ15();
+
+    /** Transforms N Q15 samples in place into the packed spectrum (scaled by 1/N) */
+    void forward (int16_t* buffer);
+
+    /** @Returns the size of the transform */
+    static int getSize() { return N; }
+
+    /** @Returns the number of magnitude bins, including DC and Nyquist */
+    static int getNumBins() { return N / 2 + 1; }
+
+private:
+
+    //=============================================================
+    static const int M = N / 2;
+
+    void complexTransform (int16_t* data);
+    static int16_t multiply (int16_t a, int16_t b);
+
+    //=============================================================
+    int16_t cosTable[M];
+    int16_t sinTable[M];
+    uint16_t bitReverseTable[M];
+};
+
+//=============================================================
+/** Short-time Fourier transform over a stream of sample blocks.
+ *
+ * Blocks of interleaved frames (as produced by the WAV decoder) are pushed in
+ * one after the other. Whenever hopSize new frames have arrived after the
+ * first full window, a windowed spectrum becomes ready:
+ *
+ *      int offset = 0;
+ *
+ *      while (offset < numFrames)
+ *      {
+ *          offset += stft.push (block + offset * numChannels, numFrames - offset, numChannels);
+ *
+ *          if (stft.isFrameReady())
+ *              useMagnitudes (stft.getMagnitudes());
+ *      }
+ */
+template <class T, int N>
+class ShortTimeFourierTransform
+{
+public:
+
+    /** Constructor
+     * @param hopSize the number of frames between the starts of consecutive windows (1 to N)
+     * @param channel the channel to analyse, or -1 to analyse the average of all channels
+     */
+    ShortTimeFourierTransform (int hopSize = N / 2, WindowType windowType = WindowType::Hann, int channel = -1);
+
+    /** Pushes interleaved frames into the analysis window. Stops early if a spectrum becomes ready.
+     * @Returns the number of frames consumed
+     */
+    int push (const T* interleavedFrames, int numFrames, int numChannels);
+
+    /** @Returns true if a new spectrum was computed by the last call to push() */
+    bool isFrameReady() const;
+
+    /** @Returns the N/2 + 1 magnitudes of the last spectrum, normalised so a full scale sine reads 1 */
+    const T* getMagnitudes() const;
+
+    /** @Returns the packed complex spectrum of the last frame */
+    const T* getSpectrum() const;
+
+    /** @Returns the index of the first input frame of the last analysed window */
+    uint32_t getFramePosition() const;
+
+    /** Discards any buffered input */
+    void reset();
+
+private:
+
+    //=============================================================
+    RealFFT<T, N> fft;
+    T window[N];
+    T input[N];
+    T spectrum[N];
+    T magnitudes[N / 2 + 1];
+    T windowGain;
+    int hopSize;
+    int channel;
+    int writeIndex;
+    int framesUntilNextHop;
+    uint32_t framesPushed;
+    bool frameReady;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+namespace SpectrumHelpers
+{
+    const double pi = 3.14159265358979323846;
+
+    inline uint16_t reverseBits (uint16_t value, int numBits)
+    {
+        uint16_t result = 0;
+
+        for (int i = 0; i < numBits; i++)
+        {
+            result = (result << 1) | (value & 1);
+            value >>= 1;
+        }
+
+        return result;
+    }
+
+    inline int log2OfPowerOfTwo (int value)
+    {
+        int bits = 0;
+
+        while ((1 << bits) < value)
+            bits++;
+
+        return bits;
+    }
+}
+
+//=============================================================
+/** Fills a table with N window coefficients
+ * @Returns the coherent gain (the mean of the coefficients)
+ */
+template <class T>
+T fillWindow (T* window, int N, WindowType windowType)
+{
+    double sum = 0.;
+
+    for (int i = 0; i < N; i++)
+    {
+        double phase = 2. * SpectrumHelpers::pi * (double)i / (double)N;
+        double value = 1.;
+
+        if (windowType == WindowType::Hann)
+            value = 0.5 - 0.5 * cos (phase);
+        else if (windowType == WindowType::Hamming)
+            value = 0.54 - 0.46 * cos (phase);
+        else if (windowType == WindowType::Blackman)
+            value = 0.42 - 0.5 * cos (phase) + 0.08 * cos (2. * phase);
+
+        window[i] = (T)value;
+        sum += value;
+    }
+
+    return (T)(sum / (double)N);
+}
+
+//=============================================================
+/** Converts a packed spectrum of size N into N/2 + 1 magnitudes, scaled by the given factor */
+template <class T>
+void packedSpectrumToMagnitudes (const T* spectrum, int N, T* magnitudes, T scale = (T)1.)
+{
+    magnitudes[0] = (T)fabs (spectrum[0]) * scale;
+    magnitudes[N / 2] = (T)fabs (spectrum[1]) * scale;
+
+    for (int k = 1; k < N / 2; k++)
+    {
+        T re = spectrum[2 * k];
+        T im = spectrum[2 * k + 1];
+        magnitudes[k] = (T)sqrt (re * re + im * im) * scale;
+    }
+}
+
+//=============================================================
+/** Copies N samples of one AudioFile channel, starting at startIndex, into a transform
+ * buffer and applies a window. Samples beyond the end of the channel are zero.
+ * @Returns the number of samples that were copied from the channel
+ */
+template <class T>
+int copyChannelToFFTBuffer (const DynamicArray<T>& channelSamples, int startIndex, T* buffer, int N, const T* window = nullptr)
+{
+    int numCopied = channelSamples.size() - startIndex;
+
+    if (numCopied > N)
+        numCopied = N;
+
+    if (numCopied < 0)
+        numCopied = 0;
+
+    for (int i = 0; i < numCopied; i++)
+        buffer[i] = window != nullptr ? channelSamples[startIndex + i] * window[i] : channelSamples[startIndex + i];
+
+    for (int i = numCopied; i < N; i++)
+        buffer[i] = (T)0.;
+
+    return numCopied;
+}
+
+//=============================================================
+template <class T, int N>
+RealFFT<T, N>::RealFFT()
+{
+    int numBits = SpectrumHelpers::log2OfPowerOfTwo (M);
+
+    for (int k = 0; k < M; k++)
+    {
+        double phase = 2. * SpectrumHelpers::pi * (double)k / (double)N;
+        cosTable[k] = (T)cos (phase);
+        sinTable[k] = (T)sin (phase);
+        bitReverseTable[k] = SpectrumHelpers::reverseBits ((uint16_t)k, numBits);
+    }
+}
+
+//=============================================================
+template <class T, int N>
+void RealFFT<T, N>::forward (T* buffer)
+{
+    // the N real samples are treated as N/2 complex values (even samples real,
+    // odd samples imaginary), transformed, and then split into the real spectrum
+    complexTransform (buffer);
+
+    T re0 = buffer[0];
+    T im0 = buffer[1];
+    buffer[0] = re0 + im0;
+    buffer[1] = re0 - im0;
+
+    for (int k = 1; k <= M / 2; k++)
+    {
+        int j = M - k;
+
+        T zkRe = buffer[2 * k];
+        T zkIm = buffer[2 * k + 1];
+        T zjRe = buffer[2 * j];
+        T zjIm = buffer[2 * j + 1];
+
+        // even and odd parts of bin k
+        T evenRe = (T)0.5 * (zkRe + zjRe);
+        T evenIm = (T)0.5 * (zkIm - zjIm);
+        T oddRe = (T)0.5 * (zkIm + zjIm);
+        T oddIm = (T)0.5 * (zjRe - zkRe);
+
+        // W = exp (-2 pi i k / N)
+        T wRe = cosTable[k];
+        T wIm = -sinTable[k];
+
+        T tRe = wRe * oddRe - wIm * oddIm;
+        T tIm = wRe * oddIm + wIm * oddRe;
+
+        buffer[2 * k] = evenRe + tRe;
+        buffer[2 * k + 1] = evenIm + tIm;
+
+        // bin N/2 - k is the mirror image, conj (even) - conj (W) * conj (odd) rotated
+        if (j != k)
+        {
+            buffer[2 * j] = evenRe - tRe;
+            buffer[2 * j + 1] = tIm - evenIm;
+        }
+    }
+}
+
+//=============================================================
+template <class T, int N>
+void RealFFT<T, N>::complexTransform (T* data)
+{
+    for (int i = 0; i < M; i++)
+    {
+        int j = bitReverseTable[i];
+
+        if (j > i)
+        {
+            T re = data[2 * i];
+            T im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    int numStages = SpectrumHelpers::log2OfPowerOfTwo (M);
+    int halfSize = 1;
+
+    // a single radix-2 pass first if there is an odd number of stages
+    if (numStages % 2 == 1)
+    {
+        for (int i = 0; i < M; i += 2)
+        {
+            T aRe = data[2 * i];
+            T aIm = data[2 * i + 1];
+            T bRe = data[2 * i + 2];
+            T bIm = data[2 * i + 3];
+            data[2 * i] = aRe + bRe;
+            data[2 * i + 1] = aIm + bIm;
+            data[2 * i + 2] = aRe - bRe;
+            data[2 * i + 3] = aIm - bIm;
+        }
+
+        halfSize = 2;
+    }
+
+    // radix-4 passes, each one doing the work of two radix-2 stages
+    while (halfSize < M)
+    {
+        int groupSize = halfSize * 4;
+        int stride1 = N / (2 * halfSize);
+        int stride2 = N / groupSize;
+
+        for (int group = 0; group < M; group += groupSize)
+        {
+            for (int j = 0; j < halfSize; j++)
+            {
+                int i0 = 2 * (group + j);
+                int i1 = i0 + 2 * halfSize;
+                int i2 = i1 + 2 * halfSize;
+                int i3 = i2 + 2 * halfSize;
+
+                T w1Re = cosTable[j * stride1];
+                T w1Im = -sinTable[j * stride1];
+                T w2Re = cosTable[j * stride2];
+                T w2Im = -sinTable[j * stride2];
+
+                // first stage: (a0, a1) and (a2, a3)
+                T tRe = w1Re * data[i1] - w1Im * data[i1 + 1];
+                T tIm = w1Re * data[i1 + 1] + w1Im * data[i1];
+                T b0Re = data[i0] + tRe;
+                T b0Im = data[i0 + 1] + tIm;
+                T b1Re = data[i0] - tRe;
+                T b1Im = data[i0 + 1] - tIm;
+
+                tRe = w1Re * data[i3] - w1Im * data[i3 + 1];
+                tIm = w1Re * data[i3 + 1] + w1Im * data[i3];
+                T b2Re = data[i2] + tRe;
+                T b2Im = data[i2 + 1] + tIm;
+                T b3Re = data[i2] - tRe;
+                T b3Im = data[i2 + 1] - tIm;
+
+                // second stage: (b0, b2) with W and (b1, b3) with W * -i
+                T cRe = w2Re * b2Re - w2Im * b2Im;
+                T cIm = w2Re * b2Im + w2Im * b2Re;
+                T dRe = w2Re * b3Im + w2Im * b3Re;
+                T dIm = w2Im * b3Im - w2Re * b3Re;
+
+                data[i0] = b0Re + cRe;
+                data[i0 + 1] = b0Im + cIm;
+                data[i2] = b0Re - cRe;
+                data[i2 + 1] = b0Im - cIm;
+                data[i1] = b1Re + dRe;
+                data[i1 + 1] = b1Im + dIm;
+                data[i3] = b1Re - dRe;
+                data[i3 + 1] = b1Im - dIm;
+            }
+        }
+
+        halfSize = groupSize;
+    }
+}
+
+//=============================================================
+template <int N>
+RealFFTQ15<N>::RealFFTQ15()
+{
+    int numBits = SpectrumHelpers::log2OfPowerOfTwo (M);
+
+    for (int k = 0; k < M; k++)
+    {
+        double phase = 2. * SpectrumHelpers::pi * (double)k / (double)N;
+        double c = cos (phase) * 32767.;
+        double s = sin (phase) * 32767.;
+        cosTable[k] = (int16_t)(c < 0 ? c - 0.5 : c + 0.5);
+        sinTable[k] = (int16_t)(s < 0 ? s - 0.5 : s + 0.5);
+        bitReverseTable[k] = SpectrumHelpers::reverseBits ((uint16_t)k, numBits);
+    }
+}
+
+//=============================================================
+template <int N>
+int16_t RealFFTQ15<N>::multiply (int16_t a, int16_t b)
+{
+    return (int16_t)(((int32_t)a * (int32_t)b + (1 << 14)) >> 15);
+}
+
+//=============================================================
+template <int N>
+void RealFFTQ15<N>::forward (int16_t* buffer)
+{
+    // pairs of full scale real samples make complex values with a magnitude
+    // above full scale, so give up one bit of headroom before transforming
+    for (int i = 0; i < N; i++)
+        buffer[i] = (int16_t)(buffer[i] >> 1);
+
+    complexTransform (buffer);
+
+    int32_t re0 = buffer[0];
+    int32_t im0 = buffer[1];
+    buffer[0] = (int16_t)(re0 + im0);
+    buffer[1] = (int16_t)(re0 - im0);
+
+    for (int k = 1; k <= M / 2; k++)
+    {
+        int j = M - k;
+
+        int32_t zkRe = buffer[2 * k];
+        int32_t zkIm = buffer[2 * k + 1];
+        int32_t zjRe = buffer[2 * j];
+        int32_t zjIm = buffer[2 * j + 1];
+
+        int16_t evenRe = (int16_t)((zkRe + zjRe) >> 1);
+        int16_t evenIm = (int16_t)((zkIm - zjIm) >> 1);
+        int16_t oddRe = (int16_t)((zkIm + zjIm) >> 1);
+        int16_t oddIm = (int16_t)((zjRe - zkRe) >> 1);
+
+        int16_t wRe = cosTable[k];
+        int16_t wIm = (int16_t)-sinTable[k];
+
+        int32_t tRe = (int32_t)multiply (wRe, oddRe) - multiply (wIm, oddIm);
+        int32_t tIm = (int32_t)multiply (wRe, oddIm) + multiply (wIm, oddRe);
+
+        buffer[2 * k] = (int16_t)(evenRe + tRe);
+        buffer[2 * k + 1] = (int16_t)(evenIm + tIm);
+
+        if (j != k)
+        {
+            buffer[2 * j] = (int16_t)(evenRe - tRe);
+            buffer[2 * j + 1] = (int16_t)(tIm - evenIm);
+        }
+    }
+}
+
+//=============================================================
+template <int N>
+void RealFFTQ15<N>::complexTransform (int16_t* data)
+{
+    for (int i = 0; i < M; i++)
+    {
+        int j = bitReverseTable[i];
+
+        if (j > i)
+        {
+            int16_t re = data[2 * i];
+            int16_t im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    int numStages = SpectrumHelpers::log2OfPowerOfTwo (M);
+    int halfSize = 1;
+
+    if (numStages % 2 == 1)
+    {
+        for (int i = 0; i < M; i += 2)
+        {
+            int32_t aRe = data[2 * i];
+            int32_t aIm = data[2 * i + 1];
+            int32_t bRe = data[2 * i + 2];
+            int32_t bIm = data[2 * i + 3];
+            data[2 * i] = (int16_t)((aRe + bRe) >> 1);
+            data[2 * i + 1] = (int16_t)((aIm + bIm) >> 1);
+            data[2 * i + 2] = (int16_t)((aRe - bRe) >> 1);
+            data[2 * i + 3] = (int16_t)((aIm - bIm) >> 1);
+        }
+
+        halfSize = 2;
+    }
+
+    while (halfSize < M)
+    {
+        int groupSize = halfSize * 4;
+        int stride1 = N / (2 * halfSize);
+        int stride2 = N / groupSize;
+
+        for (int group = 0; group < M; group += groupSize)
+        {
+            for (int j = 0; j < halfSize; j++)
+            {
+                int i0 = 2 * (group + j);
+                int i1 = i0 + 2 * halfSize;
+                int i2 = i1 + 2 * halfSize;
+                int i3 = i2 + 2 * halfSize;
+
+                int16_t w1Re = cosTable[j * stride1];
+                int16_t w1Im = (int16_t)-sinTable[j * stride1];
+                int16_t w2Re = cosTable[j * stride2];
+                int16_t w2Im = (int16_t)-sinTable[j * stride2];
+
+                // each of the two stages is scaled by 1/2
+                int32_t tRe = (int32_t)multiply (w1Re, data[i1]) - multiply (w1Im, data[i1 + 1]);
+                int32_t tIm = (int32_t)multiply (w1Re, data[i1 + 1]) + multiply (w1Im, data[i1]);
+                int16_t b0Re = (int16_t)((data[i0] + tRe) >> 1);
+                int16_t b0Im = (int16_t)((data[i0 + 1] + tIm) >> 1);
+                int16_t b1Re = (int16_t)((data[i0] - tRe) >> 1);
+                int16_t b1Im = (int16_t)((data[i0 + 1] - tIm) >> 1);
+
+                tRe = (int32_t)multiply (w1Re, data[i3]) - multiply (w1Im, data[i3 + 1]);
+                tIm = (int32_t)multiply (w1Re, data[i3 + 1]) + multiply (w1Im, data[i3]);
+                int16_t b2Re = (int16_t)((data[i2] + tRe) >> 1);
+                int16_t b2Im = (int16_t)((data[i2 + 1] + tIm) >> 1);
+                int16_t b3Re = (int16_t)((data[i2] - tRe) >> 1);
+                int16_t b3Im = (int16_t)((data[i2 + 1] - tIm) >> 1);
+
+                int32_t cRe = (int32_t)multiply (w2Re, b2Re) - multiply (w2Im, b2Im);
+                int32_t cIm = (int32_t)multiply (w2Re, b2Im) + multiply (w2Im, b2Re);
+                int32_t dRe = (int32_t)multiply (w2Re, b3Im) + multiply (w2Im, b3Re);
+                int32_t dIm = (int32_t)multiply (w2Im, b3Im) - multiply (w2Re, b3Re);
+
+                data[i0] = (int16_t)((b0Re + cRe) >> 1);
+                data[i0 + 1] = (int16_t)((b0Im + cIm) >> 1);
+                data[i2] = (int16_t)((b0Re - cRe) >> 1);
+                data[i2 + 1] = (int16_t)((b0Im - cIm) >> 1);
+                data[i1] = (int16_t)((b1Re + dRe) >> 1);
+                data[i1 + 1] = (int16_t)((b1Im + dIm) >> 1);
+                data[i3] = (int16_t)((b1Re - dRe) >> 1);
+                data[i3 + 1] = (int16_t)((b1Im - dIm) >> 1);
+            }
+        }
+
+        halfSize = groupSize;
+    }
+}
+
+//=============================================================
+template <class T, int N>
+ShortTimeFourierTransform<T, N>::ShortTimeFourierTransform (int hopSize_, WindowType windowType, int channel_)
+{
+    windowGain = fillWindow (window, N, windowType);
+    hopSize = hopSize_ < 1 ? 1 : (hopSize_ > N ? N : hopSize_);
+    channel = channel_;
+    reset();
+}
+
+//=============================================================
+template <class T, int N>
+void ShortTimeFourierTransform<T, N>::reset()
+{
+    for (int i = 0; i < N; i++)
+        input[i] = (T)0.;
+
+    for (int i = 0; i <= N / 2; i++)
+        magnitudes[i] = (T)0.;
+
+    writeIndex = 0;
+    framesUntilNextHop = N;
+    framesPushed = 0;
+    frameReady = false;
+}
+
+//=============================================================
+template <class T, int N>
+int ShortTimeFourierTransform<T, N>::push (const T* interleavedFrames, int numFrames, int numChannels)
+{
+    frameReady = false;
+
+    int numConsumed = 0;
+
+    while (numConsumed < numFrames)
+    {
+        const T* frame = interleavedFrames + numConsumed * numChannels;
+        T sample;
+
+        if (channel >= 0 && channel < numChannels)
+        {
+            sample = frame[channel];
+        }
+        else
+        {
+            sample = (T)0.;
+
+            for (int c = 0; c < numChannels; c++)
+                sample += frame[c];
+
+            sample /= (T)numChannels;
+        }
+
+        input[writeIndex] = sample;
+        writeIndex = (writeIndex + 1) % N;
+        numConsumed++;
+        framesPushed++;
+        framesUntilNextHop--;
+
+        if (framesUntilNextHop == 0)
+        {
+            // input is a ring buffer whose oldest sample is at writeIndex
+            for (int i = 0; i < N; i++)
+                spectrum[i] = input[(writeIndex + i) % N] * window[i];
+
+            fft.forward (spectrum);
+            packedSpectrumToMagnitudes (spectrum, N, magnitudes, (T)2. / ((T)N * windowGain));
+
+            framesUntilNextHop = hopSize;
+            frameReady = true;
+            break;
+        }
+    }
+
+    return numConsumed;
+}
+
+//=============================================================
+template <class T, int N>
+bool ShortTimeFourierTransform<T, N>::isFrameReady() const
+{
+    return frameReady;
+}
+
+//=============================================================
+template <class T, int N>
+const T* ShortTimeFourierTransform<T, N>::getMagnitudes() const
+{
+    return magnitudes;
+}
+
+//=============================================================
+template <class T, int N>
+const T* ShortTimeFourierTransform<T, N>::getSpectrum() const
+{
+    return spectrum;
+}
+
+//=============================================================
+template <class T, int N>
+uint32_t ShortTimeFourierTransform<T, N>::getFramePosition() const
+{
+    return framesPushed - N;
+}
+
+#endif /* Spectrum_h */
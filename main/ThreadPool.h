@@ -0,0 +1,272 @@
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+/** Host-only work-stealing thread pool.
+ *
+ * Each worker owns a deque of jobs. A worker takes jobs from the back of its
+ * own deque and, when that is empty, steals from the front of the others, so
+ * long and short jobs balance out across cores without a single shared queue.
+ * Jobs are told which worker runs them, so callers can keep per-worker state
+ * (buffers, decoders) without any locking.
+ *
+ * On Arduino builds this header is empty.
+ */
+#ifndef ARDUINO
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+
+    typedef std::function<void (int workerIndex)> Job;
+
+    /** Constructor
+     * @param numThreads the number of workers, or 0 to use one per hardware thread
+     */
+    explicit ThreadPool (int numThreads = 0);
+
+    /** Destructor. Waits for queued jobs to finish, then stops the workers */
+    ~ThreadPool();
+
+    /** @Returns the number of worker threads */
+    int getNumThreads() const;
+
+    /** Queues a job. Jobs are spread over the workers' deques round robin */
+    void addJob (Job job);
+
+    /** Blocks until every queued job has finished */
+    void waitForAll();
+
+    /** Splits the range [begin, end) into chunks of at most grainSize and runs
+     * function (chunkBegin, chunkEnd, workerIndex) for each on the pool, returning
+     * once all of those chunks have finished. Several threads may call this at once,
+     * but not a job running on this same pool.
+     */
+    void parallelFor (size_t begin, size_t end, size_t grainSize, std::function<void (size_t, size_t, int)> function);
+
+private:
+
+    //=============================================================
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<Job> jobs;
+    };
+
+    void run (int workerIndex);
+    bool takeJob (int workerIndex, Job& job);
+
+    //=============================================================
+    std::vector<Worker*> workers;
+    std::vector<std::thread> threads;
+    std::mutex stateLock;
+    std::condition_variable jobAdded;
+    std::condition_variable allDone;
+    std::atomic<int> nextWorker;
+    int numQueuedJobs;
+    int numUnfinishedJobs;
+    bool shouldStop;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+inline ThreadPool::ThreadPool (int numThreads)
+    : nextWorker (0), numQueuedJobs (0), numUnfinishedJobs (0), shouldStop (false)
+{
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+
+    if (numThreads <= 0)
+        numThreads = 1;
+
+    for (int i = 0; i < numThreads; i++)
+        workers.push_back (new Worker());
+
+    for (int i = 0; i < numThreads; i++)
+        threads.push_back (std::thread (&ThreadPool::run, this, i));
+}
+
+//=============================================================
+inline ThreadPool::~ThreadPool()
+{
+    waitForAll();
+
+    {
+        std::lock_guard<std::mutex> guard (stateLock);
+        shouldStop = true;
+    }
+
+    jobAdded.notify_all();
+
+    for (auto& thread : threads)
+        thread.join();
+
+    for (auto* worker : workers)
+        delete worker;
+}
+
+//=============================================================
+inline int ThreadPool::getNumThreads() const
+{
+    return (int)workers.size();
+}
+
+//=============================================================
+inline void ThreadPool::addJob (Job job)
+{
+    int index = nextWorker++ % (int)workers.size();
+
+    {
+        std::lock_guard<std::mutex> guard (stateLock);
+        numQueuedJobs++;
+        numUnfinishedJobs++;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard (workers[index]->lock);
+        workers[index]->jobs.push_back (std::move (job));
+    }
+
+    jobAdded.notify_one();
+}
+
+//=============================================================
+inline void ThreadPool::waitForAll()
+{
+    std::unique_lock<std::mutex> guard (stateLock);
+    allDone.wait (guard, [this] { return numUnfinishedJobs == 0; });
+}
+
+//=============================================================
+inline void ThreadPool::parallelFor (size_t begin, size_t end, size_t grainSize, std::function<void (size_t, size_t, int)> function)
+{
+    if (grainSize == 0)
+        grainSize = 1;
+
+    // count down this call's chunks only, so other users of the pool don't hold it up
+    struct Countdown
+    {
+        std::mutex lock;
+        std::condition_variable finished;
+        size_t numRemaining;
+    };
+
+    auto countdown = std::make_shared<Countdown>();
+    countdown->numRemaining = (end - begin + grainSize - 1) / grainSize;
+
+    for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize)
+    {
+        size_t chunkEnd = chunkBegin + grainSize < end ? chunkBegin + grainSize : end;
+
+        addJob ([=] (int workerIndex)
+        {
+            function (chunkBegin, chunkEnd, workerIndex);
+
+            std::lock_guard<std::mutex> guard (countdown->lock);
+
+            if (--countdown->numRemaining == 0)
+                countdown->finished.notify_all();
+        });
+    }
+
+    std::unique_lock<std::mutex> guard (countdown->lock);
+    countdown->finished.wait (guard, [&] { return countdown->numRemaining == 0; });
+}
+
+//=============================================================
+/** @Returns a pool with one worker per hardware thread, shared by everything in
+ * the process that wants to split work up (e.g. AudioFile's decoder and encoder).
+ * It is created the first time it is asked for.
+ */
+inline ThreadPool& getSharedThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+//=============================================================
+inline bool ThreadPool::takeJob (int workerIndex, Job& job)
+{
+    int numWorkers = (int)workers.size();
+
+    // own deque first (newest job, still warm in cache), then steal the oldest job from the others
+    for (int i = 0; i < numWorkers; i++)
+    {
+        Worker* worker = workers[(workerIndex + i) % numWorkers];
+        std::lock_guard<std::mutex> guard (worker->lock);
+
+        if (! worker->jobs.empty())
+        {
+            if (i == 0)
+            {
+                job = std::move (worker->jobs.back());
+                worker->jobs.pop_back();
+            }
+            else
+            {
+                job = std::move (worker->jobs.front());
+                worker->jobs.pop_front();
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//=============================================================
+inline void ThreadPool::run (int workerIndex)
+{
+    for (;;)
+    {
+        Job job;
+
+        if (takeJob (workerIndex, job))
+        {
+            {
+                std::lock_guard<std::mutex> guard (stateLock);
+                numQueuedJobs--;
+            }
+
+            job (workerIndex);
+
+            std::lock_guard<std::mutex> guard (stateLock);
+
+            if (--numUnfinishedJobs == 0)
+                allDone.notify_all();
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard (stateLock);
+
+        if (shouldStop)
+            return;
+
+        // a job is counted just before it is pushed, so a non-zero count with
+        // nothing to take means a push is in progress and is worth retrying
+        if (numQueuedJobs <= 0)
+            jobAdded.wait (guard);
+        else
+        {
+            guard.unlock();
+            std::this_thread::yield();
+        }
+    }
+}
+
+#endif /* ARDUINO */
+
+#endif /* ThreadPool_h */
@@ -1,7 +0,0 @@
-String splitString (String inputString, int startIndex, int endIndex) {
-    String answer = "";
-    for (int i = startIndex, i < endIndex; i++) {
-        answer += inputString[i];
-    }
-    return answer;
-}
\ No newline at end of file
@@ -0,0 +1,353 @@
+#ifndef WavReader_h
+#define WavReader_h
+
+#include "WaveFormat.h"
+#include "PrefetchReader.h"
+#include "Profiling.h"
+
+/** Random access reader for PCM WAV files on SD (or any File).
+ *
+ * Unlike AudioFile::load(), only the header is read when a file is opened.
+ * Frames are then read from any position by computing their byte offset from
+ * the fmt chunk, so seeking costs the same whatever the length of the file,
+ * and memory use is bounded by the caller's buffer, BufferSize bytes and the
+ * read-ahead ring of the Source (see PrefetchReader.h).
+ *
+ * Reads go through the Source's read-ahead: on hosts, AsyncPrefetchReader keeps
+ * the file reads on a background thread while read() converts samples.
+ *
+ *      WavReader<float> reader;
+ *
+ *      if (reader.open ("/jingle.wav") && reader.seek (1.5))
+ *          int numRead = reader.read (block, 256);
+ */
+template <class T, int BufferSize = 512, class Source = PrefetchReader<>>
+class WavReader
+{
+public:
+
+    /** Constructor */
+    WavReader();
+
+    /** Destructor. Closes the file if it is still open */
+    ~WavReader();
+
+    /** Opens a WAV file and reads its header.
+     * @Returns true if the file is a WAV file that can be decoded
+     */
+    bool open (const String& filePath);
+
+    /** Closes the file */
+    void close();
+
+    /** @Returns true if a file is open */
+    bool isOpen() const;
+
+    //=============================================================
+    /** @Returns the format of the open file */
+    const WaveFormat& getFormat() const;
+
+    /** @Returns the sample rate */
+    uint32_t getSampleRate() const;
+
+    /** @Returns the number of audio channels */
+    int getNumChannels() const;
+
+    /** @Returns the bit depth of each sample */
+    int getBitDepth() const;
+
+    /** @Returns the number of frames (samples per channel) in the file */
+    uint32_t getNumFrames() const;
+
+    /** @Returns the length of the file in seconds */
+    double getLengthInSeconds() const;
+
+    //=============================================================
+    /** Moves the read position to a time in seconds, rounded down to a whole frame.
+     * @Returns false if the time is outside the file
+     */
+    bool seek (double seconds);
+
+    /** Moves the read position to a frame index.
+     * @Returns false if the frame is outside the file
+     */
+    bool seekToFrame (uint32_t frame);
+
+    /** @Returns the index of the next frame read() will return */
+    uint32_t getPosition() const;
+
+    /** Reads up to numFrames interleaved frames from the current position and advances it.
+     * @Returns the number of frames read, which is less than numFrames at the end of the file
+     */
+    int read (T* interleavedFrames, int numFrames);
+
+    /** Reads up to numFrames interleaved frames starting at startFrame, leaving the
+     * read position just after the last frame read.
+     * @Returns the number of frames read
+     */
+    int readFrames (uint32_t startFrame, int numFrames, T* interleavedFrames);
+
+    /** Lets the Source read ahead. Worth calling from idle time between reads on Arduino */
+    void prefetch();
+
+    /** @Returns the read-ahead hit, miss and stall counters */
+    PrefetchStats getPrefetchStats();
+
+#ifdef AUDIOFILE_PROFILING
+    /** Only with AUDIOFILE_PROFILING defined: @Returns the time, bytes and allocations of
+     * the file reads and conversions made by read() so far
+     */
+    ProfileStats& getProfileStats();
+#endif
+
+private:
+
+    //=============================================================
+    File file;
+    Source source;
+    WaveFormat format;
+    uint8_t buffer[BufferSize];
+    uint32_t position;
+    bool fileIsOpen;
+    
+#ifdef AUDIOFILE_PROFILING
+    ProfileStats profileStats;
+#endif
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+WavReader<T, BufferSize, Source>::WavReader()
+{
+    memset (&format, 0, sizeof (format));
+    position = 0;
+    fileIsOpen = false;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+WavReader<T, BufferSize, Source>::~WavReader()
+{
+    close();
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+bool WavReader<T, BufferSize, Source>::open (const String& filePath)
+{
+    close();
+
+    file = SD.open (filePath.c_str());
+
+    if (! file)
+    {
+        Serial.println ("ERROR: File doesn't exist or otherwise can't load file");
+        return false;
+    }
+
+    if (! readWaveFormat (file, format))
+    {
+        Serial.println ("ERROR: this doesn't seem to be a valid .WAV file");
+        file.close();
+        return false;
+    }
+
+    // the internal buffer must hold at least one frame
+    if (format.numBytesPerBlock > BufferSize)
+    {
+        Serial.println ("ERROR: this WAV file has more channels than the reader buffer can hold");
+        file.close();
+        return false;
+    }
+
+    source.attach (file, format.dataOffset, format.dataOffset + format.dataSize);
+    position = 0;
+    fileIsOpen = true;
+    return true;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+void WavReader<T, BufferSize, Source>::close()
+{
+    if (fileIsOpen)
+    {
+        source.detach();
+        file.close();
+    }
+
+    fileIsOpen = false;
+    position = 0;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+bool WavReader<T, BufferSize, Source>::isOpen() const
+{
+    return fileIsOpen;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+const WaveFormat& WavReader<T, BufferSize, Source>::getFormat() const
+{
+    return format;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+uint32_t WavReader<T, BufferSize, Source>::getSampleRate() const
+{
+    return format.sampleRate;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+int WavReader<T, BufferSize, Source>::getNumChannels() const
+{
+    return (int)format.numChannels;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+int WavReader<T, BufferSize, Source>::getBitDepth() const
+{
+    return (int)format.bitDepth;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+uint32_t WavReader<T, BufferSize, Source>::getNumFrames() const
+{
+    return format.getNumFrames();
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+double WavReader<T, BufferSize, Source>::getLengthInSeconds() const
+{
+    return format.getLengthInSeconds();
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+bool WavReader<T, BufferSize, Source>::seek (double seconds)
+{
+    if (seconds < 0.)
+        return false;
+
+    return seekToFrame ((uint32_t)(seconds * (double)format.sampleRate));
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+bool WavReader<T, BufferSize, Source>::seekToFrame (uint32_t frame)
+{
+    if (! fileIsOpen || frame > getNumFrames())
+        return false;
+
+    if (! source.seek (format.getFrameOffset (frame)))
+        return false;
+
+    position = frame;
+    return true;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+uint32_t WavReader<T, BufferSize, Source>::getPosition() const
+{
+    return position;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+int WavReader<T, BufferSize, Source>::read (T* interleavedFrames, int numFrames)
+{
+    if (! fileIsOpen || numFrames <= 0)
+        return 0;
+
+    uint32_t framesLeft = getNumFrames() - position;
+
+    if ((uint32_t)numFrames > framesLeft)
+        numFrames = (int)framesLeft;
+
+    int numChannels = format.numChannels;
+    int framesPerRead = BufferSize / format.numBytesPerBlock;
+    int numRead = 0;
+
+    while (numRead < numFrames)
+    {
+        int framesThisTime = numFrames - numRead;
+
+        if (framesThisTime > framesPerRead)
+            framesThisTime = framesPerRead;
+
+        int bytesThisTime = framesThisTime * format.numBytesPerBlock;
+        AUDIOFILE_PROFILE_START (readTimer);
+        int bytesRead = source.read (buffer, bytesThisTime);
+        AUDIOFILE_PROFILE_STOP (readTimer, profileStats, ProfileStage::FileRead, bytesRead > 0 ? bytesRead : 0);
+
+        if (bytesRead <= 0)
+            break;
+
+        // only whole frames are converted; a short read ends the block
+        framesThisTime = bytesRead / format.numBytesPerBlock;
+        
+        AUDIOFILE_PROFILE_START (decodeTimer);
+        decodePcmSamples (buffer, format.bitDepth, interleavedFrames + numRead * numChannels, framesThisTime * numChannels);
+        AUDIOFILE_PROFILE_STOP (decodeTimer, profileStats, ProfileStage::Decode, framesThisTime * format.numBytesPerBlock);
+
+        numRead += framesThisTime;
+        position += framesThisTime;
+
+        if (bytesRead < bytesThisTime)
+        {
+            // keep the source in step with position if a partial frame was read
+            source.seek (format.getFrameOffset (position));
+            break;
+        }
+    }
+
+    return numRead;
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+int WavReader<T, BufferSize, Source>::readFrames (uint32_t startFrame, int numFrames, T* interleavedFrames)
+{
+    if (position != startFrame && ! seekToFrame (startFrame))
+        return 0;
+
+    return read (interleavedFrames, numFrames);
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+void WavReader<T, BufferSize, Source>::prefetch()
+{
+    if (fileIsOpen)
+        source.prefetch();
+}
+
+//=============================================================
+template <class T, int BufferSize, class Source>
+PrefetchStats WavReader<T, BufferSize, Source>::getPrefetchStats()
+{
+    return source.getStats();
+}
+
+#ifdef AUDIOFILE_PROFILING
+//=============================================================
+template <class T, int BufferSize, class Source>
+ProfileStats& WavReader<T, BufferSize, Source>::getProfileStats()
+{
+    return profileStats;
+}
+#endif
+
+#endif /* WavReader_h */
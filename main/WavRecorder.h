@@ -0,0 +1,563 @@
+#ifndef WavRecorder_h
+#define WavRecorder_h
+
+#include <stdint.h>
+#include <string.h>
+#include <SD.h>
+#include "BufferedWriter.h"
+
+#ifndef ARDUINO
+ #include <atomic>
+#endif
+
+/** Records audio from an interrupt (an ADC timer, or an I2S DMA callback) straight
+ * to a WAV file on SD.
+ *
+ * The interrupt deposits samples into a ring of NumBuffers preallocated buffers
+ * (two, ping-pong, by default) and never touches the card. When a buffer fills it
+ * is handed to the main loop, whose process() writes it to the file. The WAV
+ * header is padded to 512 bytes, so the samples start on a sector boundary and
+ * every buffer is written as whole sectors, straight from the buffer it was
+ * recorded into.
+ *
+ * If the card falls behind far enough for every buffer to be waiting, the
+ * interrupt drops whole frames until one is free again; getNumOverruns() and
+ * getNumDroppedFrames() count how often and how much. getLongestWriteMicros()
+ * against getBufferMicros() shows how close the card came to that.
+ *
+ *      WavRecorder<int16_t> recorder;
+ *
+ *      void onSample() { recorder.depositSample (analogRead (A0) * 64 - 32768); }
+ *
+ *      recorder.start ("/take.wav", 16000, 1);
+ *      // attach onSample to a 16 kHz timer interrupt
+ *      while (recording)
+ *          recorder.process();
+ *      // detach the interrupt
+ *      recorder.stop();
+ *
+ * The interrupt's functions are the only ones it may call. The sizes in the
+ * header are filled in by stop(), which seeks back to the start of the file to
+ * rewrite it. Until then they are the largest a WAV file allows, and every reader
+ * in this library stops at the end of the file, so a recording cut off by a reset
+ * still loads up to the last time flush() was called.
+ */
+
+//=============================================================
+/** The mode the recording is opened with. The Arduino SD library's FILE_WRITE
+ * includes O_APPEND, which sends every write (and so stop()'s header) to the
+ * end of the file, so where its flags exist the file is opened without it.
+ */
+#ifndef AUDIOFILE_RECORDER_OPEN_MODE
+ #if defined (O_READ) && defined (O_WRITE) && defined (O_CREAT)
+  #define AUDIOFILE_RECORDER_OPEN_MODE (O_READ | O_WRITE | O_CREAT)
+ #else
+  #define AUDIOFILE_RECORDER_OPEN_MODE FILE_WRITE
+ #endif
+#endif
+
+//=============================================================
+/** The size of each capture buffer. Must be a multiple of 512 */
+#ifndef AUDIOFILE_CAPTURE_BUFFER_SIZE
+ #ifdef ARDUINO
+  #define AUDIOFILE_CAPTURE_BUFFER_SIZE 512
+ #else
+  #define AUDIOFILE_CAPTURE_BUFFER_SIZE 8192
+ #endif
+#endif
+
+namespace WavRecorderHelpers
+{
+    /** The WAV bit depth of each sample type the recorder can store: WAV's 8 bit samples are unsigned */
+    template <class SampleType> struct BitDepth;
+    template <> struct BitDepth<uint8_t> { static const int value = 8; };
+    template <> struct BitDepth<int16_t> { static const int value = 16; };
+
+#ifdef ARDUINO
+    typedef volatile bool Flag;
+    typedef volatile uint32_t Counter;
+
+    /** Keeps the compiler (and CPUs that reorder stores) from moving the samples
+     * past the flag that hands their buffer over
+     */
+    inline void memoryBarrier() { __sync_synchronize(); }
+#else
+    typedef std::atomic<bool> Flag;
+    typedef std::atomic<uint32_t> Counter;
+
+    inline void memoryBarrier() {}
+#endif
+}
+
+//=============================================================
+template <class SampleType = int16_t, int BufferBytes = AUDIOFILE_CAPTURE_BUFFER_SIZE, int NumBuffers = 2>
+class WavRecorder
+{
+public:
+
+    static_assert (BufferBytes > 0 && BufferBytes % 512 == 0, "WavRecorder's buffers must be a whole number of 512 byte sectors");
+    static_assert (NumBuffers >= 2, "WavRecorder needs at least two buffers, one to fill while another is written");
+
+    /** The bytes before the first sample: the RIFF, fmt and data headers, padded to a sector with a JUNK chunk */
+    static const int headerBytes = 512;
+
+    /** Constructor */
+    WavRecorder();
+
+    /** Destructor. Stops recording, finishing the file */
+    ~WavRecorder();
+
+    /** Creates a WAV file, replacing any file already at the path, and starts accepting samples.
+     * @param numChannels must divide the buffers into whole frames (1, 2, 4 or 8 channels)
+     * @param maxFrames the expected length, to reserve the file's clusters up front, or 0
+     * @Returns true if the file was created
+     */
+    bool start (const String& filePath, uint32_t sampleRate, int numChannels, uint32_t maxFrames = 0);
+
+    /** Stops accepting samples, writes what has been recorded and completes the header.
+     * Detach the interrupt first.
+     * @Returns true if every write succeeded, including the header's
+     */
+    bool stop();
+
+    /** @Returns true between start() and stop() */
+    bool isRecording() const;
+
+    //=============================================================
+    /** Interrupt side: adds one sample. Channels are interleaved */
+    void depositSample (SampleType sample);
+
+    /** Interrupt side: adds interleaved samples, e.g. a DMA buffer */
+    void depositSamples (const SampleType* samples, int numSamples);
+
+    //=============================================================
+    /** Main loop side: writes every buffer the interrupt has filled.
+     * @Returns false if a write failed
+     */
+    bool process();
+
+    /** Main loop side: has the file system save the file's length, so that what has been
+     * written so far survives a reset or power cut before stop(). This costs a directory
+     * update, so call it every few seconds rather than after every process().
+     * @Returns false if a write failed
+     */
+    bool flush();
+
+    //=============================================================
+    /** @Returns the number of frames written to the file so far */
+    uint32_t getNumFramesWritten() const;
+
+    /** @Returns the number of times the interrupt found every buffer full */
+    uint32_t getNumOverruns() const;
+
+    /** @Returns the number of frames dropped because every buffer was full */
+    uint32_t getNumDroppedFrames() const;
+
+    /** @Returns the longest time one buffer took to write, in microseconds */
+    uint32_t getLongestWriteMicros() const;
+
+    /** @Returns the most buffers that were waiting to be written at once */
+    int getMostBuffersWaiting() const;
+
+    /** @Returns the time it takes the interrupt to fill one buffer, in microseconds.
+     * A write that takes longer than (NumBuffers - 1) times this loses samples.
+     */
+    uint32_t getBufferMicros() const;
+
+private:
+
+    //=============================================================
+    static const int samplesPerBuffer = BufferBytes / (int) sizeof (SampleType);
+
+    // the data size in the header until stop() fills in the real one: the most a RIFF size allows
+    static const uint32_t placeholderDataSize = 0xFFFFFFFF - (headerBytes - 1);
+
+    //=============================================================
+    void finishBuffer();
+    bool writeBuffer (const SampleType* samples, uint32_t numBytes);
+    bool writeHeader (uint32_t dataSize);
+
+    //=============================================================
+    File file;
+    SampleType buffers[NumBuffers][samplesPerBuffer];
+
+    // set by the interrupt when a buffer is full, cleared by process() once it is written
+    WavRecorderHelpers::Flag isFull[NumBuffers];
+    WavRecorderHelpers::Flag recording;
+
+    // only the interrupt uses these while recording
+    int fillBuffer;
+    int fillPosition;
+    bool dropping;
+    int dropPosition;
+    WavRecorderHelpers::Counter numOverruns;
+    WavRecorderHelpers::Counter numDroppedSamples;
+
+    // and only the main loop these
+    int drainBuffer;
+    uint32_t sampleRate;
+    int numChannels;
+    uint32_t numBytesWritten;
+    uint32_t longestWriteMicros;
+    int mostBuffersWaiting;
+    bool fileIsOpen;
+    bool ok;
+};
+
+//=============================================================
+/* IMPLEMENTATION */
+//=============================================================
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+WavRecorder<SampleType, BufferBytes, NumBuffers>::WavRecorder()
+{
+    for (int i = 0; i < NumBuffers; i++)
+        isFull[i] = false;
+
+    recording = false;
+    fillBuffer = 0;
+    fillPosition = 0;
+    dropping = false;
+    dropPosition = 0;
+    numOverruns = 0;
+    numDroppedSamples = 0;
+    drainBuffer = 0;
+    sampleRate = 0;
+    numChannels = 1;
+    numBytesWritten = 0;
+    longestWriteMicros = 0;
+    mostBuffersWaiting = 0;
+    fileIsOpen = false;
+    ok = false;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+WavRecorder<SampleType, BufferBytes, NumBuffers>::~WavRecorder()
+{
+    stop();
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+bool WavRecorder<SampleType, BufferBytes, NumBuffers>::start (const String& filePath, uint32_t sampleRate_, int numChannels_, uint32_t maxFrames)
+{
+    stop();
+
+    if (numChannels_ < 1 || samplesPerBuffer % numChannels_ != 0)
+    {
+        Serial.println ("ERROR: the number of channels must divide the recording buffers into whole frames");
+        return false;
+    }
+
+    // opening keeps the contents of an existing file, so replace it instead
+    if (SD.exists (filePath.c_str()))
+        SD.remove (filePath.c_str());
+
+    file = SD.open (filePath.c_str(), AUDIOFILE_RECORDER_OPEN_MODE);
+
+    if (! file)
+    {
+        Serial.println ("ERROR: couldn't create " + filePath);
+        return false;
+    }
+
+    sampleRate = sampleRate_;
+    numChannels = numChannels_;
+
+    // reserving the clusters keeps the card from searching for free ones mid-recording
+    if (maxFrames > 0)
+        BufferedWriterHelpers::preAllocate (file, headerBytes + maxFrames * (uint32_t) (numChannels * sizeof (SampleType)), 0);
+
+    numBytesWritten = 0;
+    longestWriteMicros = 0;
+    mostBuffersWaiting = 0;
+    fileIsOpen = true;
+    ok = writeHeader (placeholderDataSize);
+
+    if (! ok)
+    {
+        Serial.println ("ERROR: couldn't write to " + filePath);
+        file.close();
+        fileIsOpen = false;
+        return false;
+    }
+
+    for (int i = 0; i < NumBuffers; i++)
+        isFull[i] = false;
+
+    fillBuffer = 0;
+    fillPosition = 0;
+    dropping = false;
+    dropPosition = 0;
+    numOverruns = 0;
+    numDroppedSamples = 0;
+    drainBuffer = 0;
+
+    WavRecorderHelpers::memoryBarrier();
+    recording = true;
+    return true;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+bool WavRecorder<SampleType, BufferBytes, NumBuffers>::stop()
+{
+    if (! fileIsOpen)
+        return ok;
+
+    recording = false;
+    WavRecorderHelpers::memoryBarrier();
+
+    // the full buffers, then the one the interrupt was filling
+    process();
+
+    if (fillPosition > 0)
+        writeBuffer (buffers[fillBuffer], (uint32_t) fillPosition * sizeof (SampleType));
+
+    fillPosition = 0;
+
+    // WAV chunks are padded to an even size, which only an odd number of 8 bit samples needs
+    uint32_t dataSize = numBytesWritten;
+
+    if ((dataSize & 1) != 0)
+    {
+        uint8_t padding = 0;
+
+        if (file.write (&padding, 1) != 1)
+            ok = false;
+    }
+
+    if (! writeHeader (dataSize))
+    {
+        Serial.println ("ERROR: couldn't rewrite the recording's header (was the file opened for appending?)");
+        ok = false;
+    }
+
+    file.close();
+    fileIsOpen = false;
+
+    if (! ok)
+        Serial.println ("ERROR: the recording couldn't be written in full");
+
+    return ok;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+bool WavRecorder<SampleType, BufferBytes, NumBuffers>::isRecording() const
+{
+    return recording;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+void WavRecorder<SampleType, BufferBytes, NumBuffers>::depositSample (SampleType sample)
+{
+    if (! recording)
+        return;
+
+    // after an overrun, drop whole frames until the main loop frees a buffer
+    if (dropping)
+    {
+        if (dropPosition == 0 && ! isFull[fillBuffer])
+        {
+            dropping = false;
+        }
+        else
+        {
+            numDroppedSamples++;
+            dropPosition = dropPosition + 1 < numChannels ? dropPosition + 1 : 0;
+            return;
+        }
+    }
+
+    buffers[fillBuffer][fillPosition++] = sample;
+
+    if (fillPosition == samplesPerBuffer)
+        finishBuffer();
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+void WavRecorder<SampleType, BufferBytes, NumBuffers>::depositSamples (const SampleType* samples, int numSamples)
+{
+    if (! recording)
+        return;
+
+    while (numSamples > 0)
+    {
+        // only while dropping does this go a sample at a time
+        if (dropping)
+        {
+            depositSample (*samples++);
+            numSamples--;
+            continue;
+        }
+
+        int numToCopy = samplesPerBuffer - fillPosition < numSamples ? samplesPerBuffer - fillPosition : numSamples;
+        memcpy (buffers[fillBuffer] + fillPosition, samples, sizeof (SampleType) * (size_t) numToCopy);
+        fillPosition += numToCopy;
+        samples += numToCopy;
+        numSamples -= numToCopy;
+
+        if (fillPosition == samplesPerBuffer)
+            finishBuffer();
+    }
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+bool WavRecorder<SampleType, BufferBytes, NumBuffers>::process()
+{
+    if (! fileIsOpen)
+        return ok;
+
+    int numWaiting = 0;
+
+    for (int i = 0; i < NumBuffers; i++)
+        numWaiting += isFull[i] ? 1 : 0;
+
+    if (numWaiting > mostBuffersWaiting)
+        mostBuffersWaiting = numWaiting;
+
+    while (isFull[drainBuffer])
+    {
+        WavRecorderHelpers::memoryBarrier();
+
+        unsigned long startMicros = micros();
+        writeBuffer (buffers[drainBuffer], BufferBytes);
+        uint32_t writeMicros = (uint32_t) (micros() - startMicros);
+
+        if (writeMicros > longestWriteMicros)
+            longestWriteMicros = writeMicros;
+
+        // hand the buffer back only once its samples have left it
+        WavRecorderHelpers::memoryBarrier();
+        isFull[drainBuffer] = false;
+        drainBuffer = drainBuffer + 1 < NumBuffers ? drainBuffer + 1 : 0;
+    }
+
+    return ok;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+bool WavRecorder<SampleType, BufferBytes, NumBuffers>::flush()
+{
+    if (fileIsOpen)
+        file.flush();
+
+    return ok;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+uint32_t WavRecorder<SampleType, BufferBytes, NumBuffers>::getNumFramesWritten() const
+{
+    return numBytesWritten / (uint32_t) (numChannels * sizeof (SampleType));
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+uint32_t WavRecorder<SampleType, BufferBytes, NumBuffers>::getNumOverruns() const
+{
+    return numOverruns;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+uint32_t WavRecorder<SampleType, BufferBytes, NumBuffers>::getNumDroppedFrames() const
+{
+    return numDroppedSamples / (uint32_t) numChannels;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+uint32_t WavRecorder<SampleType, BufferBytes, NumBuffers>::getLongestWriteMicros() const
+{
+    return longestWriteMicros;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+int WavRecorder<SampleType, BufferBytes, NumBuffers>::getMostBuffersWaiting() const
+{
+    return mostBuffersWaiting;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+uint32_t WavRecorder<SampleType, BufferBytes, NumBuffers>::getBufferMicros() const
+{
+    return sampleRate > 0 ? (uint32_t) ((uint64_t) (samplesPerBuffer / numChannels) * 1000000 / sampleRate) : 0;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+void WavRecorder<SampleType, BufferBytes, NumBuffers>::finishBuffer()
+{
+    WavRecorderHelpers::memoryBarrier();
+    isFull[fillBuffer] = true;
+    fillBuffer = fillBuffer + 1 < NumBuffers ? fillBuffer + 1 : 0;
+    fillPosition = 0;
+
+    // the next buffer hasn't been written yet: nowhere to put what comes next
+    if (isFull[fillBuffer])
+    {
+        dropping = true;
+        dropPosition = 0;
+        numOverruns++;
+    }
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+bool WavRecorder<SampleType, BufferBytes, NumBuffers>::writeBuffer (const SampleType* samples, uint32_t numBytes)
+{
+    if (file.write ((const uint8_t*) samples, numBytes) != numBytes)
+        ok = false;
+    else
+        numBytesWritten += numBytes;
+
+    return ok;
+}
+
+//=============================================================
+template <class SampleType, int BufferBytes, int NumBuffers>
+bool WavRecorder<SampleType, BufferBytes, NumBuffers>::writeHeader (uint32_t dataSize)
+{
+    using BufferedWriterHelpers::writeLittleEndian;
+
+    // the interrupt isn't running yet, or any more, so its first buffer is free to build the header in
+    uint8_t* header = (uint8_t*) buffers[0];
+    int bytesPerSample = (int) sizeof (SampleType);
+    uint32_t paddedDataSize = dataSize + (dataSize & 1);
+
+    memset (header, 0, headerBytes);
+    memcpy (header, "RIFF", 4);
+    writeLittleEndian (header + 4, headerBytes - 8 + paddedDataSize, 4);
+    memcpy (header + 8, "WAVE", 4);
+
+    memcpy (header + 12, "fmt ", 4);
+    writeLittleEndian (header + 16, 16, 4);
+    writeLittleEndian (header + 20, 1, 2);
+    writeLittleEndian (header + 22, (uint32_t) numChannels, 2);
+    writeLittleEndian (header + 24, sampleRate, 4);
+    writeLittleEndian (header + 28, sampleRate * (uint32_t) (numChannels * bytesPerSample), 4);
+    writeLittleEndian (header + 32, (uint32_t) (numChannels * bytesPerSample), 2);
+    writeLittleEndian (header + 34, WavRecorderHelpers::BitDepth<SampleType>::value, 2);
+
+    // readers skip chunks they don't know, so this one just moves the data to the next sector
+    memcpy (header + 36, "JUNK", 4);
+    writeLittleEndian (header + 40, headerBytes - 52, 4);
+
+    memcpy (header + headerBytes - 8, "data", 4);
+    writeLittleEndian (header + headerBytes - 4, dataSize, 4);
+
+    // a file system that appends every write would have put it at the end instead
+    return file.seek (0) && file.write (header, headerBytes) == (size_t) headerBytes && file.position() == (uint32_t) headerBytes;
+}
+
+#endif /* WavRecorder_h */
@@ -0,0 +1,248 @@
+#ifndef WaveFormat_h
+#define WaveFormat_h
+
+#include <stdint.h>
+#include <string.h>
+#include <SD.h>
+
+/** The fields of a PCM WAV file's fmt chunk, plus where its data chunk lives.
+ * This is everything needed to turn a frame index into a byte offset, so a
+ * file can be read from any position without touching the rest of it.
+ */
+struct WaveFormat
+{
+    uint16_t audioFormat;
+    uint16_t numChannels;
+    uint32_t sampleRate;
+    uint32_t numBytesPerSecond;
+    uint16_t numBytesPerBlock;
+    uint16_t bitDepth;
+
+    /** Byte offset of the first sample in the file */
+    uint32_t dataOffset;
+
+    /** Size of the data chunk in bytes */
+    uint32_t dataSize;
+
+    //=============================================================
+    /** @Returns the number of frames (samples per channel) in the data chunk */
+    uint32_t getNumFrames() const
+    {
+        return numBytesPerBlock > 0 ? dataSize / numBytesPerBlock : 0;
+    }
+
+    /** @Returns the byte offset in the file of a given frame */
+    uint32_t getFrameOffset (uint32_t frame) const
+    {
+        return dataOffset + frame * numBytesPerBlock;
+    }
+
+    /** @Returns the length of the data chunk in seconds */
+    double getLengthInSeconds() const
+    {
+        return sampleRate > 0 ? (double)getNumFrames() / (double)sampleRate : 0.;
+    }
+};
+
+//=============================================================
+/** Reads the RIFF header of an open file and walks its chunks until both the
+ * fmt and data chunks have been found. Only the chunk headers and the 16 bytes
+ * of PCM format information are read; everything else is skipped with seek().
+ * On return the file is positioned at the first sample.
+ * @param maxBytesToRead gives up if the chunks can't be found within this many bytes of reads
+ * @Returns true if the file is a PCM WAV file this library can decode
+ */
+inline bool readWaveFormat (File& file, WaveFormat& format, uint32_t maxBytesToRead = 0xFFFFFFFF)
+{
+    uint8_t header[16];
+
+    if (! file.seek (0) || file.read (header, 12) != 12)
+        return false;
+
+    uint32_t numBytesRead = 12;
+
+    if (memcmp (header, "RIFF", 4) != 0 || memcmp (header + 8, "WAVE", 4) != 0)
+        return false;
+
+    uint32_t fileSize = file.size();
+    uint32_t position = 12;
+    bool foundFormat = false;
+    bool foundData = false;
+
+    while (! (foundFormat && foundData) && position + 8 <= fileSize)
+    {
+        if (numBytesRead + 8 > maxBytesToRead)
+            return false;
+
+        if (! file.seek (position) || file.read (header, 8) != 8)
+            return false;
+
+        numBytesRead += 8;
+
+        uint32_t chunkSize = (uint32_t)header[4] | ((uint32_t)header[5] << 8) | ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 24);
+
+        if (memcmp (header, "fmt ", 4) == 0)
+        {
+            if (chunkSize < 16 || numBytesRead + 16 > maxBytesToRead || file.read (header, 16) != 16)
+                return false;
+
+            numBytesRead += 16;
+
+            format.audioFormat = (uint16_t)(header[0] | (header[1] << 8));
+            format.numChannels = (uint16_t)(header[2] | (header[3] << 8));
+            format.sampleRate = (uint32_t)header[4] | ((uint32_t)header[5] << 8) | ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 24);
+            format.numBytesPerSecond = (uint32_t)header[8] | ((uint32_t)header[9] << 8) | ((uint32_t)header[10] << 16) | ((uint32_t)header[11] << 24);
+            format.numBytesPerBlock = (uint16_t)(header[12] | (header[13] << 8));
+            format.bitDepth = (uint16_t)(header[14] | (header[15] << 8));
+            foundFormat = true;
+        }
+        else if (memcmp (header, "data", 4) == 0)
+        {
+            format.dataOffset = position + 8;
+
+            // a truncated file (e.g. a recording that was cut off) still has its samples up to the end
+            format.dataSize = chunkSize;
+
+            if (format.dataSize > fileSize - format.dataOffset)
+                format.dataSize = fileSize - format.dataOffset;
+
+            foundData = true;
+        }
+
+        // a chunk that runs past the end of the file must be the last one (and a corrupt
+        // size would otherwise wrap position around)
+        if (chunkSize > fileSize - position - 8)
+            break;
+
+        // chunks are padded to an even number of bytes
+        position += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    if (! foundFormat || ! foundData)
+        return false;
+
+    // same restrictions as AudioFile::decodeWaveFile()
+    if (format.audioFormat != 1 || format.numChannels < 1)
+        return false;
+
+    if (format.bitDepth != 8 && format.bitDepth != 16 && format.bitDepth != 24)
+        return false;
+
+    if (format.numBytesPerBlock != format.numChannels * (format.bitDepth / 8))
+        return false;
+
+    return file.seek (format.dataOffset);
+}
+
+//=============================================================
+/** Converts numSamples little endian PCM samples of the given bit depth into
+ * samples in the range -1 to 1, using the same scaling as AudioFile.
+ * @param sourceStride the number of bytes from one sample to the next, e.g. the
+ *                     block align to pull one channel out of interleaved data
+ *                     (0 means the samples are packed)
+ */
+template <class T>
+void decodePcmSamples (const uint8_t* source, int bitDepth, T* destination, int numSamples, int sourceStride = 0)
+{
+    if (sourceStride == 0)
+        sourceStride = bitDepth / 8;
+
+    if (bitDepth == 8)
+    {
+        for (int i = 0; i < numSamples; i++, source += sourceStride)
+            destination[i] = static_cast<T> ((int)source[0] - 128) / static_cast<T> (128.);
+    }
+    else if (bitDepth == 16)
+    {
+        for (int i = 0; i < numSamples; i++, source += sourceStride)
+        {
+            int16_t sampleAsInt = (int16_t)(source[0] | (source[1] << 8));
+            destination[i] = static_cast<T> (sampleAsInt) / static_cast<T> (32768.);
+        }
+    }
+    else if (bitDepth == 24)
+    {
+        for (int i = 0; i < numSamples; i++, source += sourceStride)
+        {
+            int32_t sampleAsInt = ((int32_t)source[2] << 16) | ((int32_t)source[1] << 8) | (int32_t)source[0];
+
+            if (sampleAsInt & 0x800000) //  if the 24th bit is set, this is a negative number in 24-bit world
+                sampleAsInt = sampleAsInt | ~0xFFFFFF; // so make sure sign is extended to the 32 bit float
+
+            destination[i] = (T)sampleAsInt / (T)8388608.;
+        }
+    }
+}
+
+//=============================================================
+/** Fixed point version for devices without an FPU: converts PCM into Q15 samples
+ * (-32768 to 32767) with shifts only. 24 bit samples are truncated to 16 bits.
+ */
+inline void decodePcmSamples (const uint8_t* source, int bitDepth, int16_t* destination, int numSamples, int sourceStride = 0)
+{
+    if (sourceStride == 0)
+        sourceStride = bitDepth / 8;
+
+    if (bitDepth == 8)
+    {
+        for (int i = 0; i < numSamples; i++, source += sourceStride)
+            destination[i] = (int16_t)(((int)source[0] - 128) * 256);
+    }
+    else if (bitDepth == 16)
+    {
+        for (int i = 0; i < numSamples; i++, source += sourceStride)
+            destination[i] = (int16_t)(source[0] | (source[1] << 8));
+    }
+    else if (bitDepth == 24)
+    {
+        for (int i = 0; i < numSamples; i++, source += sourceStride)
+            destination[i] = (int16_t)(source[1] | (source[2] << 8));
+    }
+}
+
+//=============================================================
+/** Converts numSamples samples in the range -1 to 1 into little endian PCM of the
+ * given bit depth, clamping anything out of range, using the same scaling as AudioFile.
+ * @param destinationStride the number of bytes from one sample to the next (0 means packed)
+ */
+template <class T>
+void encodePcmSamples (const T* source, int numSamples, int bitDepth, uint8_t* destination, int destinationStride = 0)
+{
+    if (destinationStride == 0)
+        destinationStride = bitDepth / 8;
+
+    for (int i = 0; i < numSamples; i++, destination += destinationStride)
+    {
+        T sample = source[i];
+
+        if (sample < (T)-1.)
+            sample = (T)-1.;
+        else if (sample > (T)1.)
+            sample = (T)1.;
+
+        if (bitDepth == 8)
+        {
+            destination[0] = static_cast<uint8_t> ((sample + (T)1.) / (T)2. * (T)255.);
+        }
+        else if (bitDepth == 16)
+        {
+            int16_t sampleAsInt = static_cast<int16_t> (sample * (T)32767.);
+            destination[0] = (uint8_t)(sampleAsInt & 0xFF);
+            destination[1] = (uint8_t)((sampleAsInt >> 8) & 0xFF);
+        }
+        else if (bitDepth == 24)
+        {
+            int32_t sampleAsInt = (int32_t)(sample * (T)8388608.);
+
+            // +1.0 would wrap around to the most negative 24 bit value
+            if (sampleAsInt > 8388607)
+                sampleAsInt = 8388607;
+
+            destination[0] = (uint8_t)(sampleAsInt & 0xFF);
+            destination[1] = (uint8_t)((sampleAsInt >> 8) & 0xFF);
+            destination[2] = (uint8_t)((sampleAsInt >> 16) & 0xFF);
+        }
+    }
+}
+
+#endif /* WaveFormat_h */